@@ -31,5 +31,10 @@
 #cmakedefine ENABLE_DEFAULT_LOG_HANDLER 1
 
 #cmakedefine HAVE_LIBRT 1
+#cmakedefine HAVE_FALLOCATE 1
+#cmakedefine HAVE_POSIX_FADVISE 1
+#cmakedefine HAVE_FDATASYNC 1
+#cmakedefine HAVE_COPY_FILE_RANGE 1
+#cmakedefine HAVE_SENDFILE 1
 
 #cmakedefine HAVE_EXECINFO 
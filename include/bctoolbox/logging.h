@@ -42,6 +42,19 @@
 #define BCTBX_LOG_DOMAIN "bctbx"
 #endif
 
+/**
+ * The BCTBX_LOG_DOMAIN_MIN_LEVEL preprocessor directive gives the lowest level whose log statements are compiled, one
+ *of the BctbxLogLevel values. It is meant to be defined along with BCTBX_LOG_DOMAIN, for the release builds of
+ *components where logging must cost nothing: the statements below that level, made with bctbx_message() and the other
+ *C functions, the BCTBX_LOG_HANDLE macros or BCTBX_SLOG, are compiled down to nothing, and their arguments are not
+ *evaluated. Fatal messages are always compiled. By default all levels are compiled.
+ **/
+#ifndef BCTBX_LOG_DOMAIN_MIN_LEVEL
+#define BCTBX_LOG_DOMAIN_MIN_LEVEL BCTBX_LOG_DEBUG
+#endif
+
+#define BCTBX_LOG_LEVEL_COMPILED(level) ((level) >= BCTBX_LOG_DOMAIN_MIN_LEVEL || (level) == BCTBX_LOG_FATAL)
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -58,9 +71,39 @@ typedef enum {
 
 typedef struct _bctbx_log_handler_t bctbx_log_handler_t;
 
+typedef enum {
+	BCTBX_LOG_FIELD_STRING,
+	BCTBX_LOG_FIELD_INT,
+	BCTBX_LOG_FIELD_UINT,
+	BCTBX_LOG_FIELD_DOUBLE,
+	BCTBX_LOG_FIELD_BOOL
+} BctbxLogFieldType;
+
+/*
+ * A typed key-value field of a structured message, see bctbx_log_fields().
+ * The key and the string values are referenced, not copied.
+ */
+typedef struct _bctbx_log_field_t {
+	const char *key;
+	BctbxLogFieldType type;
+	union {
+		const char *string_value;
+		int64_t int_value;
+		uint64_t uint_value;
+		double double_value;
+		bool_t bool_value;
+	} value;
+} bctbx_log_field_t;
+
 typedef void (*BctbxLogFunc)(const char *domain, BctbxLogLevel lev, const char *fmt, va_list args);
 typedef void (*BctbxLogHandlerFunc)(void *info, const char *domain, BctbxLogLevel lev, const char *fmt, va_list args);
 typedef void (*BctbxLogHandlerDestroyFunc)(bctbx_log_handler_t *handler);
+typedef void (*BctbxLogHandlerFieldsFunc)(void *info,
+                                          const char *domain,
+                                          BctbxLogLevel lev,
+                                          const char *msg,
+                                          const bctbx_log_field_t *fields,
+                                          size_t count);
 
 /*
  initialise logging functions, add default log handler for stdout output.
@@ -86,6 +129,7 @@ bctbx_create_log_handler(BctbxLogHandlerFunc func, BctbxLogHandlerDestroyFunc de
 
 /*
  Function to create a file log handler
+ The files are rotated and reopened by a thread of the handler, the messages logged meanwhile are buffered.
  @param[in] uint64_t max_size : the maximum size of the log file before rotating to a new one (if 0 then no rotation)
  @param[in] const char* path : the path where to put the log files
  @param[in] const char* name : the name of the log files
@@ -101,12 +145,87 @@ BCTBX_PUBLIC bctbx_log_handler_t *bctbx_create_file_log_handler(uint64_t max_siz
  */
 BCTBX_PUBLIC void bctbx_file_log_handler_reopen(bctbx_log_handler_t *file_log_handler);
 
+typedef enum {
+	BCTBX_LOG_FLUSH_EVERY_MESSAGE, /* each message is written and flushed right away (default) */
+	BCTBX_LOG_FLUSH_INTERVAL,      /* messages are buffered and written every given number of milliseconds */
+	BCTBX_LOG_FLUSH_SIZE,          /* messages are buffered and written once they reach the given number of bytes */
+	BCTBX_LOG_FLUSH_WARNING        /* messages are buffered and written with the next warning, error or fatal one */
+} BctbxLogFlushPolicy;
+
+/**
+ * @brief Choose when a file log handler writes its messages.
+ * Buffering the messages spares a system call per message on busy processes, at the risk of losing the last ones
+ * if the process crashes. Fatal messages are always written right away, and the buffer is written anyway when it
+ * reaches one megabyte or when the process exits.
+ * @param[in] file_log_handler The file log handler.
+ * @param[in] policy The flush policy.
+ * @param[in] value The interval in milliseconds for BCTBX_LOG_FLUSH_INTERVAL, an interval of 0 meaning
+ * BCTBX_LOG_FLUSH_EVERY_MESSAGE, the size in bytes for BCTBX_LOG_FLUSH_SIZE, ignored otherwise.
+ */
+BCTBX_PUBLIC void bctbx_file_log_handler_set_flush_policy(bctbx_log_handler_t *file_log_handler,
+                                                          BctbxLogFlushPolicy policy,
+                                                          uint64_t value);
+
+/**
+ * @brief Write the messages buffered by a file log handler to its file.
+ * @param[in] file_log_handler The file log handler.
+ */
+BCTBX_PUBLIC void bctbx_file_log_handler_flush(bctbx_log_handler_t *file_log_handler);
+
+/*
+ Function to create a binary log handler. Messages are not formatted: the handler records the format string once, then
+ for each message its arguments, timestamp, thread and tags into a compact binary stream, which is buffered and written
+ when it gets large, for each error and when flushed or destroyed.
+ Such logs are read back with bctbx_decode_binary_log(), or the bctbx-log-decoder tool.
+ @param[in] const char* path : the path where to put the log file
+ @param[in] const char* name : the name of the log file, appended to if it exists
+ @return a new bctbx_log_handler_t, NULL if the file cannot be opened
+*/
+BCTBX_PUBLIC bctbx_log_handler_t *bctbx_create_binary_log_handler(const char *path, const char *name);
+
+/*
+ Write the messages buffered by a binary log handler to its file.
+ */
+BCTBX_PUBLIC void bctbx_binary_log_handler_flush(bctbx_log_handler_t *binary_log_handler);
+
+/* Prefix each decoded message with the thread that logged it */
+#define BCTBX_BINARY_LOG_DECODE_THREADS 1
+
+/*
+ Format the messages of a binary log file, in the same text format as the file log handler.
+ @param[in] FILE* in : the binary log
+ @param[in] FILE* out : where to write the formatted messages
+ @param[in] int flags : a combination of BCTBX_BINARY_LOG_DECODE_* flags
+ @return the number of messages decoded, -1 if the input is not a binary log. Decoding stops at the first truncated or
+ invalid record.
+*/
+BCTBX_PUBLIC int bctbx_decode_binary_log(FILE *in, FILE *out, int flags);
+
+/*
+ Function to create a JSON log handler, writing each message as a line of JSON (NDJSON) such as
+ {"time":"2025-01-31T12:00:00.000Z","domain":"my-component","level":"message","tags":{"call":"1234"},
+ "message":"Call ended","fields":{"call-id":"1234","duration":1.5}}
+ The time is in UTC, the tags are the ones pushed by the logging thread, keyed by their identifier, and the fields are
+ the typed fields of the structured messages logged with bctbx_log_fields(), written without being formatted to text.
+ @param[in] const char* path : the path where to put the log file
+ @param[in] const char* name : the name of the log file, appended to if it exists
+ @return a new bctbx_log_handler_t, NULL if the file cannot be opened
+*/
+BCTBX_PUBLIC bctbx_log_handler_t *bctbx_create_json_log_handler(const char *path, const char *name);
+
+/*
+ * Set the function receiving the structured messages logged with bctbx_log_fields(), with their typed fields.
+ * The handlers without one receive these messages as text, the fields being appended to the message as key=value.
+ */
+BCTBX_PUBLIC void bctbx_log_handler_set_fields_func(bctbx_log_handler_t *log_handler, BctbxLogHandlerFieldsFunc func);
+
 /* set domain the handler is limited to. NULL for ALL*/
 BCTBX_PUBLIC void bctbx_log_handler_set_domain(bctbx_log_handler_t *log_handler, const char *domain);
 BCTBX_PUBLIC void bctbx_log_handler_set_user_data(bctbx_log_handler_t *, void *user_data);
 BCTBX_PUBLIC void *bctbx_log_handler_get_user_data(const bctbx_log_handler_t *log_handler);
 
 BCTBX_PUBLIC void bctbx_add_log_handler(bctbx_log_handler_t *handler);
+/* the handler is destroyed once no thread is giving it a message anymore, possibly after this function returned */
 BCTBX_PUBLIC void bctbx_remove_log_handler(bctbx_log_handler_t *handler);
 
 /*
@@ -123,6 +242,27 @@ BCTBX_PUBLIC void bctbx_set_log_handler_for_domain(BctbxLogFunc func, const char
 BCTBX_PUBLIC void bctbx_set_log_file(FILE *f);
 BCTBX_PUBLIC bctbx_list_t *bctbx_get_log_handlers(void);
 
+typedef enum {
+	BCTBX_LOG_TIMESTAMP_WALL_CLOCK, /* local date and time, with milliseconds (default) */
+	BCTBX_LOG_TIMESTAMP_MONOTONIC   /* seconds elapsed since the process started, with microseconds */
+} BctbxLogTimestampSource;
+
+/*
+ * Choose the timestamp written at the beginning of the log lines by the default and file log handlers.
+ * The monotonic clock is cheaper to read, precise to the microsecond and not affected by clock changes, which suits
+ * high rate debug logging.
+ */
+BCTBX_PUBLIC void bctbx_set_log_timestamp_source(BctbxLogTimestampSource source);
+
+/*
+ * Limit the rate of the messages of a domain, NULL for the default domain which applies to the domains without a limit
+ * of their own. Each call site, identified by its format string, may log up to 'burst' messages in a row, then 'rate'
+ * messages per second. The messages beyond are dropped before being formatted, and the next message let through is
+ * preceded by a "last message repeated N times" one. Fatal messages are never dropped.
+ * A rate of 0 removes the limit.
+ */
+BCTBX_PUBLIC void bctbx_set_log_rate_limit(const char *domain, unsigned int rate, unsigned int burst);
+
 BCTBX_PUBLIC void bctbx_logv_out(const char *domain, BctbxLogLevel level, const char *fmt, va_list args);
 BCTBX_PUBLIC void
 bctbx_logv_file(void *user_info, const char *domain, BctbxLogLevel level, const char *fmt, va_list args);
@@ -135,6 +275,59 @@ BCTBX_PUBLIC int bctbx_log_level_enabled(const char *domain, BctbxLogLevel level
 
 BCTBX_PUBLIC void bctbx_logv(const char *domain, BctbxLogLevel level, const char *fmt, va_list args);
 
+/*
+ * Log a structured message: a message and typed key-value fields, built with the bctbx_log_field_*() functions.
+ * The handlers having a fields function receive the fields as they are, the others receive them as text, appended to
+ * the message as key=value. For example:
+ *	bctbx_log_field_t fields[] = {bctbx_log_field_string("call-id", callId), bctbx_log_field_double("duration", 1.5)};
+ *	bctbx_log_fields(BCTBX_LOG_DOMAIN, BCTBX_LOG_MESSAGE, "Call ended", fields, 2);
+ */
+BCTBX_PUBLIC void bctbx_log_fields(
+    const char *domain, BctbxLogLevel level, const char *msg, const bctbx_log_field_t *fields, size_t count);
+
+/*
+ * A log domain interned once for all, to log without looking the domain up by its name for each message.
+ * Handles remain valid until the process exits.
+ */
+typedef const struct _bctbx_log_domain *bctbx_log_domain_handle_t;
+
+/*
+ * Returns the handle of a log domain, creating the domain if needed.
+ * Until a level is set for it, the domain follows the level of the default domain, as any unknown domain does.
+ * NULL gives the handle of the default domain.
+ */
+BCTBX_PUBLIC bctbx_log_domain_handle_t bctbx_get_log_domain_handle(const char *domain);
+
+/*
+ * Returns the name of the domain of a handle, NULL for the default domain.
+ */
+BCTBX_PUBLIC const char *bctbx_log_domain_handle_get_name(bctbx_log_domain_handle_t handle);
+
+/*
+ * Same as bctbx_log_level_enabled() for a domain handle: a single atomic load, unless the calling thread has set a
+ * thread log level.
+ */
+BCTBX_PUBLIC int bctbx_log_handle_level_enabled(bctbx_log_domain_handle_t handle, BctbxLogLevel level);
+
+BCTBX_PUBLIC void
+bctbx_logv_handle(bctbx_log_domain_handle_t handle, BctbxLogLevel level, const char *fmt, va_list args);
+
+/*
+ * Log an already formatted message, whose level was checked to be enabled. It is given to the handlers with a "%s"
+ * format. Used by the C++ log streams.
+ */
+BCTBX_PUBLIC void bctbx_log_message(const char *domain, BctbxLogLevel level, const char *msg);
+BCTBX_PUBLIC void bctbx_log_handle_message(bctbx_log_domain_handle_t handle, BctbxLogLevel level, const char *msg);
+
+/*
+ * Same as bctbx_log_fields() for a domain handle.
+ */
+BCTBX_PUBLIC void bctbx_log_handle_fields(bctbx_log_domain_handle_t handle,
+                                          BctbxLogLevel level,
+                                          const char *msg,
+                                          const bctbx_log_field_t *fields,
+                                          size_t count);
+
 /**
  * Flushes the log output queue.
  * WARNING: Must be called from the thread that has been defined with bctbx_set_log_thread_id().
@@ -184,6 +377,18 @@ BCTBX_PUBLIC void bctbx_pop_log_tag(const char *tag_identifier);
  */
 BCTBX_PUBLIC const bctbx_list_t *bctbx_get_log_tags(void);
 
+/**
+ * Retrieve the current tags rendered as "[value1][value2]", or an empty string if there are none.
+ * The string is cached and only rebuilt when tags are pushed or popped, it remains valid until then.
+ */
+BCTBX_PUBLIC const char *bctbx_get_log_tags_string(void);
+
+/**
+ * Retrieve the current tags as string fields keyed by their identifier, in the order of bctbx_get_log_tags().
+ * The fields remain valid until tags are pushed or popped.
+ */
+BCTBX_PUBLIC const bctbx_log_field_t *bctbx_get_log_tag_fields(size_t *count);
+
 /*
  * An opaque type to represent a copy of current tags.
  */
@@ -193,6 +398,8 @@ typedef struct _bctbx_log_tags bctbx_log_tags_t;
  * Create a copy of the current tags for the calling thread.
  * This copy can then be paste to a newly created thread, so that its log messages
  * can bear the same tags that as the thread that created it at the moment it was created.
+ * Copies are shared: as long as the tags of the thread do not change, the same copy is returned again.
+ * Each of them must be released with bctbx_log_tags_destroy().
  */
 BCTBX_PUBLIC bctbx_log_tags_t *bctbx_create_log_tags_copy(void);
 
@@ -215,6 +422,43 @@ BCTBX_PUBLIC void bctbx_log_tags_destroy(bctbx_log_tags_t *log_tags);
  */
 BCTBX_PUBLIC void bctbx_set_log_thread_id(unsigned long thread_id);
 
+/**
+ * What to do with a message logged while the asynchronous logging queue is full.
+ */
+typedef enum {
+	BCTBX_LOG_OVERFLOW_DROP,     /* drop the new message */
+	BCTBX_LOG_OVERFLOW_BLOCK,    /* wait for the writer thread to make room in the queue */
+	BCTBX_LOG_OVERFLOW_OVERWRITE /* drop the oldest queued message to make room for the new one */
+} BctbxLogOverflowPolicy;
+
+/**
+ * Enable the asynchronous logging: messages are formatted on the logging thread and queued in a bounded lock-free
+ * queue, the handlers are called by a dedicated writer thread. Logging then never waits for the handlers I/O, except
+ * with the BCTBX_LOG_OVERFLOW_BLOCK policy when the queue is full.
+ * The queue is flushed before aborting on a fatal message and at exit.
+ * When enabled, it takes precedence over the thread set by bctbx_set_log_thread_id().
+ * @param[in] capacity The number of messages the queue can hold, rounded up to a power of 2. 0 for a default value.
+ * @param[in] policy What to do when the queue is full.
+ * @return 0 on success, -1 if the writer thread cannot be started.
+ */
+BCTBX_PUBLIC int bctbx_enable_async_logging(size_t capacity, BctbxLogOverflowPolicy policy);
+
+/**
+ * Disable the asynchronous logging: the queued messages are given to the handlers and the writer thread stops.
+ */
+BCTBX_PUBLIC void bctbx_disable_async_logging(void);
+
+/**
+ * Wait until the messages queued so far for the asynchronous logging are given to the handlers.
+ * Does nothing if the asynchronous logging is not enabled.
+ */
+BCTBX_PUBLIC void bctbx_flush_async_logging(void);
+
+/**
+ * @return the number of messages dropped by the asynchronous logging because its queue was full.
+ */
+BCTBX_PUBLIC uint64_t bctbx_get_async_logging_dropped_count(void);
+
 #ifdef __GNUC__
 #define CHECK_FORMAT_ARGS(m, n) __attribute__((format(printf, m, n)))
 #else
@@ -224,6 +468,48 @@ BCTBX_PUBLIC void bctbx_set_log_thread_id(unsigned long thread_id);
 /*in case of compile with -g static inline can produce this type of warning*/
 #pragma GCC diagnostic ignored "-Wunused-function"
 #endif
+
+/* Build the fields of the structured messages logged with bctbx_log_fields() */
+static BCTBX_INLINE bctbx_log_field_t bctbx_log_field_string(const char *key, const char *value) {
+	bctbx_log_field_t field;
+	field.key = key;
+	field.type = BCTBX_LOG_FIELD_STRING;
+	field.value.string_value = value;
+	return field;
+}
+
+static BCTBX_INLINE bctbx_log_field_t bctbx_log_field_int(const char *key, int64_t value) {
+	bctbx_log_field_t field;
+	field.key = key;
+	field.type = BCTBX_LOG_FIELD_INT;
+	field.value.int_value = value;
+	return field;
+}
+
+static BCTBX_INLINE bctbx_log_field_t bctbx_log_field_uint(const char *key, uint64_t value) {
+	bctbx_log_field_t field;
+	field.key = key;
+	field.type = BCTBX_LOG_FIELD_UINT;
+	field.value.uint_value = value;
+	return field;
+}
+
+static BCTBX_INLINE bctbx_log_field_t bctbx_log_field_double(const char *key, double value) {
+	bctbx_log_field_t field;
+	field.key = key;
+	field.type = BCTBX_LOG_FIELD_DOUBLE;
+	field.value.double_value = value;
+	return field;
+}
+
+static BCTBX_INLINE bctbx_log_field_t bctbx_log_field_bool(const char *key, bool_t value) {
+	bctbx_log_field_t field;
+	field.key = key;
+	field.type = BCTBX_LOG_FIELD_BOOL;
+	field.value.bool_value = value;
+	return field;
+}
+
 #ifdef BCTBX_DEBUG_MODE
 static BCTBX_INLINE void CHECK_FORMAT_ARGS(1, 2) bctbx_debug(const char *fmt, ...) {
 	va_list args;
@@ -282,6 +568,53 @@ static BCTBX_INLINE void CHECK_FORMAT_ARGS(1, 2) bctbx_fatal(const char *fmt, ..
 	va_end(args);
 }
 
+static BCTBX_INLINE void CHECK_FORMAT_ARGS(3, 4)
+    bctbx_log_handle(bctbx_log_domain_handle_t handle, BctbxLogLevel lev, const char *fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+	bctbx_logv_handle(handle, lev, fmt, args);
+	va_end(args);
+}
+
+/*
+ * The C functions above, as expressions that are not evaluated when their level is below BCTBX_LOG_DOMAIN_MIN_LEVEL.
+ * The parentheses around the function names call the functions themselves.
+ */
+#ifdef BCTBX_DEBUG_MODE
+#define bctbx_debug(...) (BCTBX_LOG_LEVEL_COMPILED(BCTBX_LOG_DEBUG) ? (bctbx_debug)(__VA_ARGS__) : (void)0)
+#endif
+#ifndef BCTBX_NOMESSAGE_MODE
+#define bctbx_log(domain, lev, ...) (BCTBX_LOG_LEVEL_COMPILED(lev) ? (bctbx_log)((domain), (lev), __VA_ARGS__) : (void)0)
+#define bctbx_message(...) (BCTBX_LOG_LEVEL_COMPILED(BCTBX_LOG_MESSAGE) ? (bctbx_message)(__VA_ARGS__) : (void)0)
+#define bctbx_warning(...) (BCTBX_LOG_LEVEL_COMPILED(BCTBX_LOG_WARNING) ? (bctbx_warning)(__VA_ARGS__) : (void)0)
+#endif
+#define bctbx_error(...) (BCTBX_LOG_LEVEL_COMPILED(BCTBX_LOG_ERROR) ? (bctbx_error)(__VA_ARGS__) : (void)0)
+
+/*
+ * Log through a domain handle. The arguments are not evaluated when the level is disabled for the domain.
+ */
+#define BCTBX_LOG_HANDLE(handle, lev, ...)                                                                              \
+	do {                                                                                                               \
+		if (BCTBX_LOG_LEVEL_COMPILED(lev) && bctbx_log_handle_level_enabled((handle), (lev)))                          \
+			bctbx_log_handle((handle), (lev), __VA_ARGS__);                                                            \
+	} while (0)
+
+#ifdef BCTBX_DEBUG_MODE
+#define BCTBX_LOG_HANDLE_DEBUG(handle, ...) BCTBX_LOG_HANDLE(handle, BCTBX_LOG_DEBUG, __VA_ARGS__)
+#else
+#define BCTBX_LOG_HANDLE_DEBUG(handle, ...)
+#endif
+
+#ifdef BCTBX_NOMESSAGE_MODE
+#define BCTBX_LOG_HANDLE_MESSAGE(handle, ...)
+#define BCTBX_LOG_HANDLE_WARNING(handle, ...)
+#else
+#define BCTBX_LOG_HANDLE_MESSAGE(handle, ...) BCTBX_LOG_HANDLE(handle, BCTBX_LOG_MESSAGE, __VA_ARGS__)
+#define BCTBX_LOG_HANDLE_WARNING(handle, ...) BCTBX_LOG_HANDLE(handle, BCTBX_LOG_WARNING, __VA_ARGS__)
+#endif
+
+#define BCTBX_LOG_HANDLE_ERROR(handle, ...) BCTBX_LOG_HANDLE(handle, BCTBX_LOG_ERROR, __VA_ARGS__)
+
 #ifdef __QNX__
 void bctbx_qnx_log_handler(const char *domain, BctbxLogLevel lev, const char *fmt, va_list args);
 #endif
@@ -334,7 +667,135 @@ inline std::basic_istream<CharT, TraitsT> &operator>>(std::basic_istream<CharT,
 } // namespace log
 } // namespace bctoolbox
 
+#include <cstring>
+#include <deque>
+#include <memory>
 #include <ostream>
+#include <streambuf>
+#include <type_traits>
+#include <vector>
+#if __cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+#include <string_view>
+#define BCTBX_LOG_STRING_VIEW 1
+#endif
+
+namespace bctoolbox {
+
+/* The characters of a log stream, in a buffer reused from one message to the other. */
+class LogStreamBuffer : public std::streambuf {
+public:
+	LogStreamBuffer() : mStorage(kInitialSize) {
+		reset();
+	}
+
+	void reset() {
+		if (mStorage.size() > kMaxKeptSize) {
+			std::vector<char>(kInitialSize).swap(mStorage);
+		}
+		setp(mStorage.data(), mStorage.data() + mStorage.size() - 1); // room is kept for the terminating NUL
+	}
+
+	void append(const char *data, size_t size) {
+		reserve(size);
+		memcpy(pptr(), data, size);
+		pbump((int)size);
+	}
+
+	const char *c_str() {
+		*pptr() = '\0';
+		return pbase();
+	}
+
+protected:
+	int_type overflow(int_type c) override {
+		if (traits_type::eq_int_type(c, traits_type::eof())) return traits_type::not_eof(c);
+		char ch = traits_type::to_char_type(c);
+		append(&ch, 1);
+		return c;
+	}
+
+	std::streamsize xsputn(const char *data, std::streamsize size) override {
+		append(data, (size_t)size);
+		return size;
+	}
+
+private:
+	static constexpr size_t kInitialSize = 256;
+	static constexpr size_t kMaxKeptSize = 64 * 1024;
+
+	void reserve(size_t size) {
+		size_t used = (size_t)(pptr() - pbase());
+		if (used + size + 1 <= mStorage.size()) return;
+		size_t newSize = 2 * mStorage.size();
+		if (newSize < used + size + 1) newSize = used + size + 1;
+		mStorage.resize(newSize);
+		setp(mStorage.data(), mStorage.data() + mStorage.size() - 1);
+		pbump((int)used);
+	}
+
+	std::vector<char> mStorage;
+};
+
+/*
+ * A log stream of the calling thread. The stream and its locale are created once, then reset for each message. Log
+ * statements nested in the evaluation of another one, like a log in an operator<<(), get their own stream.
+ */
+class LogStream {
+public:
+	static LogStream &acquire() {
+		Pool &pool = getPool();
+		if (pool.mUsed == pool.mStreams.size()) pool.mStreams.emplace_back(new LogStream());
+		LogStream &logStream = *pool.mStreams[pool.mUsed++];
+		logStream.reset();
+		return logStream;
+	}
+
+	static void release() {
+		getPool().mUsed--;
+	}
+
+	std::ostream &getStream() {
+		return mStream;
+	}
+
+	LogStreamBuffer &getBuffer() {
+		return mBuffer;
+	}
+
+	/* Whether text and decimal integers can be appended as is, without formatting */
+	bool isPlain() const {
+		return mStream.width() == 0 &&
+		       (mStream.flags() & (std::ios_base::basefield | std::ios_base::showpos)) == std::ios_base::dec;
+	}
+
+private:
+	struct Pool {
+		std::vector<std::unique_ptr<LogStream>> mStreams;
+		size_t mUsed = 0;
+	};
+
+	static Pool &getPool() {
+		thread_local Pool sPool;
+		return sPool;
+	}
+
+	LogStream() : mStream(&mBuffer) {
+	}
+
+	void reset() {
+		mBuffer.reset();
+		mStream.clear();
+		mStream.flags(std::ios_base::skipws | std::ios_base::dec);
+		mStream.precision(6);
+		mStream.width(0);
+		mStream.fill(' ');
+	}
+
+	LogStreamBuffer mBuffer;
+	std::ostream mStream;
+};
+
+} // namespace bctoolbox
 
 class pumpstream {
 public:
@@ -344,75 +805,158 @@ public:
 #ifndef BCTBX_DEBUG_MODE
 		/* If debug mode is not enabled, the pumpstream shall do nothing if level requested is BCTBX_LOG_DEBUG.
 		 * bctbx_log_level_enabled() does not even need to be called. */
-		if (level == BCTBX_LOG_DEBUG) {
-			mIslogLevelEnabled = false;
-			return;
-		}
+		if (level == BCTBX_LOG_DEBUG) return;
+#endif
+		if (bctbx_log_level_enabled(domain, mLevel)) mLogStream = &bctoolbox::LogStream::acquire();
+	}
+
+	/* Log through an interned domain: BCTBX_SLOG(handle, level) checks the level with a single atomic load. */
+	pumpstream(bctbx_log_domain_handle_t handle, BctbxLogLevel level) : mHandle(handle), mLevel(level) {
+#ifndef BCTBX_DEBUG_MODE
+		if (level == BCTBX_LOG_DEBUG) return;
 #endif
-		mIslogLevelEnabled = bctbx_log_level_enabled(domain, mLevel);
+		if (bctbx_log_handle_level_enabled(handle, mLevel)) mLogStream = &bctoolbox::LogStream::acquire();
 	}
 
+	pumpstream(const pumpstream &) = delete;
+
 	~pumpstream() {
-		if (mIslogLevelEnabled) bctbx_log(mDomain, mLevel, "%s", mOstringstream.str().c_str());
+		if (!mLogStream) return;
+		const char *msg = mLogStream->getBuffer().c_str();
+		if (mHandle) bctbx_log_handle_message(mHandle, mLevel, msg);
+		else bctbx_log_message(mDomain, mLevel, msg);
+		bctoolbox::LogStream::release();
 	}
 
-	template <typename _Tp>
-	friend pumpstream &operator<<(pumpstream &__os, _Tp &&__x);
-	template <typename _Tp>
-	friend pumpstream &operator<<(pumpstream &&__os, _Tp &&__x);
 	template <typename T>
-	friend pumpstream &operator<<(pumpstream &&pumpStream, const T &x);
+	friend pumpstream &operator<<(pumpstream &pumpStream, T &&x);
 	template <typename T>
-	friend pumpstream &operator<<(pumpstream &pumpStream, const T &x);
-	friend pumpstream &operator<<(pumpstream &__os, std::ostream &(*pf)(std::ostream &));
+	friend pumpstream &operator<<(pumpstream &&pumpStream, T &&x);
+	friend pumpstream &operator<<(pumpstream &pumpStream, std::ostream &(*pf)(std::ostream &));
+	friend pumpstream &operator<<(pumpstream &&pumpStream, std::ostream &(*pf)(std::ostream &));
 
 private:
-	std::ostringstream mOstringstream{};
-	bool mIslogLevelEnabled = false;
-	const char *mDomain;
+	/* Text and integers are appended directly to the buffer unless a manipulator asks for some formatting. */
+	void append(const char *str) {
+		if (str && mLogStream->isPlain()) mLogStream->getBuffer().append(str, strlen(str));
+		else mLogStream->getStream() << str;
+	}
+	void append(char *str) {
+		append(static_cast<const char *>(str));
+	}
+	void append(const std::string &str) {
+		if (mLogStream->isPlain()) mLogStream->getBuffer().append(str.data(), str.size());
+		else mLogStream->getStream() << str;
+	}
+#ifdef BCTBX_LOG_STRING_VIEW
+	void append(std::string_view str) {
+		if (mLogStream->isPlain()) mLogStream->getBuffer().append(str.data(), str.size());
+		else mLogStream->getStream() << str;
+	}
+#endif
+	void append(char c) {
+		if (mLogStream->isPlain()) mLogStream->getBuffer().append(&c, 1);
+		else mLogStream->getStream() << c;
+	}
+	void append(int value) {
+		appendInteger(value);
+	}
+	void append(unsigned int value) {
+		appendInteger(value);
+	}
+	void append(long value) {
+		appendInteger(value);
+	}
+	void append(unsigned long value) {
+		appendInteger(value);
+	}
+	void append(long long value) {
+		appendInteger(value);
+	}
+	void append(unsigned long long value) {
+		appendInteger(value);
+	}
+	template <typename T>
+	void append(const T &x) {
+		mLogStream->getStream() << x;
+	}
+
+	template <typename T>
+	static bool isNegative(T value, std::true_type) {
+		return value < 0;
+	}
+	template <typename T>
+	static bool isNegative(T, std::false_type) {
+		return false;
+	}
+
+	template <typename T>
+	void appendInteger(T value) {
+		if (!mLogStream->isPlain()) {
+			mLogStream->getStream() << value;
+			return;
+		}
+		char digits[24];
+		char *end = digits + sizeof(digits);
+		char *p = end;
+		bool negative = isNegative(value, std::is_signed<T>());
+		unsigned long long magnitude = negative ? 0ULL - (unsigned long long)value : (unsigned long long)value;
+		do {
+			*--p = (char)('0' + magnitude % 10);
+			magnitude /= 10;
+		} while (magnitude != 0);
+		if (negative) *--p = '-';
+		mLogStream->getBuffer().append(p, (size_t)(end - p));
+	}
+
+	bctoolbox::LogStream *mLogStream = nullptr; // NULL if the level is disabled
+	const char *mDomain = nullptr;
+	bctbx_log_domain_handle_t mHandle = nullptr;
 	const BctbxLogLevel mLevel;
 };
 
 inline pumpstream &operator<<(pumpstream &pumpStream, std::ostream &(*pf)(std::ostream &)) {
-	if (pumpStream.mIslogLevelEnabled) {
-		pumpStream.mOstringstream << pf;
+	if (pumpStream.mLogStream) {
+		pumpStream.mLogStream->getStream() << pf;
 	}
 	return pumpStream;
 }
 
-template <typename T>
-inline pumpstream &operator<<(pumpstream &pumpStream, T &&x) {
-	if (pumpStream.mIslogLevelEnabled) {
-		pumpStream.mOstringstream << std::forward<T>(x);
-	}
-	return pumpStream;
+inline pumpstream &operator<<(pumpstream &&pumpStream, std::ostream &(*pf)(std::ostream &)) {
+	return pumpStream << pf;
 }
 
 template <typename T>
-inline pumpstream &operator<<(pumpstream &pumpStream, const T &x) {
-	if (pumpStream.mIslogLevelEnabled) {
-		pumpStream.mOstringstream << x;
+inline pumpstream &operator<<(pumpstream &pumpStream, T &&x) {
+	if (pumpStream.mLogStream) {
+		pumpStream.append(std::forward<T>(x));
 	}
 	return pumpStream;
 }
 
 template <typename T>
 inline pumpstream &operator<<(pumpstream &&pumpStream, T &&x) {
-	if (pumpStream.mIslogLevelEnabled) {
-		pumpStream.mOstringstream << std::forward<T>(x);
+	if (pumpStream.mLogStream) {
+		pumpStream.append(std::forward<T>(x));
 	}
 	return pumpStream;
 }
 
-template <typename T>
-inline pumpstream &operator<<(pumpstream &&pumpStream, const T &x) {
-	if (pumpStream.mIslogLevelEnabled) {
-		pumpStream.mOstringstream << x;
+namespace bctoolbox {
+
+/* Turns a log stream statement into a void expression, see BCTBX_SLOG */
+struct LogStreamVoidify {
+	void operator&(pumpstream &) {
 	}
-	return pumpStream;
-}
+	void operator&(pumpstream &&) {
+	}
+};
+
+} // namespace bctoolbox
 
-#define BCTBX_SLOG(domain, thelevel) pumpstream(domain, thelevel)
+/* The operands of the statement are not evaluated when the level is below BCTBX_LOG_DOMAIN_MIN_LEVEL. */
+#define BCTBX_SLOG(domain, thelevel)                                                                                   \
+	!BCTBX_LOG_LEVEL_COMPILED(thelevel) ? (void)0 : bctoolbox::LogStreamVoidify() & pumpstream(domain, thelevel)
 
 #define BCTBX_SLOGD BCTBX_SLOG(BCTBX_LOG_DOMAIN, BCTBX_LOG_DEBUG)
 // deprecated: prefer BCTBX_SLOGM for consistency.
@@ -423,5 +967,74 @@ inline pumpstream &operator<<(pumpstream &&pumpStream, const T &x) {
 #define BCTBX_SLOGE BCTBX_SLOG(BCTBX_LOG_DOMAIN, BCTBX_LOG_ERROR)
 #define BCTBX_SLOGF BCTBX_SLOG(BCTBX_LOG_DOMAIN, BCTBX_LOG_FATAL)
 
+namespace bctoolbox {
+
+/*
+ * Builds a structured message, logged with bctbx_log_fields() by log():
+ *	bctoolbox::LogFields(BCTBX_LOG_DOMAIN, BCTBX_LOG_MESSAGE).add("call-id", callId).add("duration", 1.5).log("Call ended");
+ * Nothing is stored when the level is disabled. The keys and the values given as const char * are referenced and must
+ * remain valid until log() is called, the std::string values are copied.
+ */
+class LogFields {
+public:
+	LogFields(const char *domain, BctbxLogLevel level)
+	    : mDomain(domain), mLevel(level), mEnabled(bctbx_log_level_enabled(domain, level) != 0) {
+	}
+	LogFields(bctbx_log_domain_handle_t handle, BctbxLogLevel level)
+	    : mHandle(handle), mUseHandle(true), mLevel(level),
+	      mEnabled(bctbx_log_handle_level_enabled(handle, level) != 0) {
+	}
+	LogFields(const LogFields &) = delete;
+
+	LogFields &add(const char *key, const char *value) {
+		if (mEnabled) mFields.push_back(bctbx_log_field_string(key, value));
+		return *this;
+	}
+	LogFields &add(const char *key, const std::string &value) {
+		if (mEnabled) {
+			mStrings.push_back(value); // a deque does not move its elements when growing
+			mFields.push_back(bctbx_log_field_string(key, mStrings.back().c_str()));
+		}
+		return *this;
+	}
+	LogFields &add(const char *key, bool value) {
+		if (mEnabled) mFields.push_back(bctbx_log_field_bool(key, value ? TRUE : FALSE));
+		return *this;
+	}
+	LogFields &add(const char *key, double value) {
+		if (mEnabled) mFields.push_back(bctbx_log_field_double(key, value));
+		return *this;
+	}
+	template <typename T,
+	          typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value, int>::type = 0>
+	LogFields &add(const char *key, T value) {
+		if (mEnabled) {
+			mFields.push_back(std::is_signed<T>::value ? bctbx_log_field_int(key, (int64_t)value)
+			                                           : bctbx_log_field_uint(key, (uint64_t)value));
+		}
+		return *this;
+	}
+
+	void log(const char *msg) {
+		if (!mEnabled && mLevel != BCTBX_LOG_FATAL) return;
+		if (mUseHandle) bctbx_log_handle_fields(mHandle, mLevel, msg, mFields.data(), mFields.size());
+		else bctbx_log_fields(mDomain, mLevel, msg, mFields.data(), mFields.size());
+	}
+	void log(const std::string &msg) {
+		log(msg.c_str());
+	}
+
+private:
+	const char *mDomain = nullptr;
+	bctbx_log_domain_handle_t mHandle = nullptr;
+	bool mUseHandle = false;
+	BctbxLogLevel mLevel;
+	bool mEnabled;
+	std::vector<bctbx_log_field_t> mFields;
+	std::deque<std::string> mStrings;
+};
+
+} // namespace bctoolbox
+
 #endif
 #endif
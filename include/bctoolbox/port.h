@@ -539,6 +539,134 @@ struct _bctbx_list;
  **/
 BCTBX_PUBLIC struct _bctbx_list *bctbx_parse_directory(const char *path, const char *file_type);
 
+/**
+ * Type of a directory entry
+ */
+typedef enum bctbx_dir_entry_type_t {
+	BCTBX_DIR_ENTRY_UNKNOWN = 0, /* the type could not be determined */
+	BCTBX_DIR_ENTRY_FILE,
+	BCTBX_DIR_ENTRY_DIRECTORY,
+	BCTBX_DIR_ENTRY_SYMLINK,
+	BCTBX_DIR_ENTRY_OTHER /* fifo, socket, device... */
+} bctbx_dir_entry_type_t;
+
+/**
+ * A directory entry, as given by bctbx_dir_scan() and bctbx_dir_list()
+ */
+typedef struct bctbx_dir_entry_t {
+	const char *name;            /* name of the entry, without the directory path */
+	size_t name_length;          /* length of name */
+	bctbx_dir_entry_type_t type; /* type of the entry, a symbolic link is not followed */
+} bctbx_dir_entry_t;
+
+/**
+ * Callback called by bctbx_dir_scan() for each entry.
+ * @param[in] user_data	The user data given to bctbx_dir_scan()
+ * @param[in] entry	The entry, valid during the call only
+ * @return 0 to continue the scan, any other value to stop it
+ */
+typedef int (*bctbx_dir_scan_cb_t)(void *user_data, const bctbx_dir_entry_t *entry);
+
+/**
+ * Scan a directory and give each of its entries to a callback. The entries are read from the system by large batches
+ * and the type of the entries is given without any additional system call when the file system provides it.
+ *
+ * @param[in]	path		The directory to scan
+ * @param[in]	suffix		Select only the entries whose name ends with it, can be NULL to select all the entries
+ * @param[in]	cb		Called for each selected entry
+ * @param[in]	user_data	Given to the callback
+ *
+ * @note	. and .. are never given to the callback
+ *
+ * @return	0 once all the entries are scanned, the value returned by the callback if it stopped the scan,
+ * 		a negative errno value if the directory cannot be read
+ **/
+BCTBX_PUBLIC int bctbx_dir_scan(const char *path, const char *suffix, bctbx_dir_scan_cb_t cb, void *user_data);
+
+/**
+ * Entries of a directory, in a contiguous array
+ */
+typedef struct bctbx_dir_list_t {
+	bctbx_dir_entry_t *entries; /* the entries, in the order given by the system */
+	size_t count;               /* number of entries */
+	char *names;                /* storage of the entries names, for internal use */
+} bctbx_dir_list_t;
+
+/**
+ * List the entries of a directory
+ *
+ * @param[in]	path		The directory to list
+ * @param[in]	suffix		Select only the entries whose name ends with it, can be NULL to select all the entries
+ *
+ * @note	. and .. are never listed
+ *
+ * @return	the entries of the directory, to be freed with bctbx_dir_list_free(). NULL if the directory cannot be read
+ **/
+BCTBX_PUBLIC bctbx_dir_list_t *bctbx_dir_list(const char *path, const char *suffix);
+
+/**
+ * Free a list of directory entries returned by bctbx_dir_list()
+ *
+ * @param[in]	list	The list to free
+ **/
+BCTBX_PUBLIC void bctbx_dir_list_free(bctbx_dir_list_t *list);
+
+/**
+ * Events reported by bctbx_tree_walk()
+ */
+typedef enum bctbx_tree_walk_event_t {
+	BCTBX_TREE_WALK_ENTRY = 0,        /* an entry which is not a directory */
+	BCTBX_TREE_WALK_DIRECTORY_PRE,    /* a directory, before its content */
+	BCTBX_TREE_WALK_DIRECTORY_POST    /* a directory, after its content */
+} bctbx_tree_walk_event_t;
+
+/**
+ * An entry visited by bctbx_tree_walk()
+ */
+typedef struct bctbx_tree_walk_entry_t {
+	const char *path;             /* path of the entry: the walked path followed by the names of the entries */
+	const char *name;             /* name of the entry in its parent directory, points inside path */
+	bctbx_dir_entry_type_t type;  /* type of the entry, symbolic links are never followed */
+	int depth;                    /* 0 for the walked path, 1 for its entries, ... */
+	int dir_fd;                   /* descriptor of the parent directory to use with the *at() functions
+	                                 (openat, unlinkat, fstatat...) with name, -1 on Windows */
+	bctbx_tree_walk_event_t event;
+	int error;                    /* on BCTBX_TREE_WALK_DIRECTORY_POST, a negative errno value if the content of the
+	                                 directory could not be read entirely, 0 otherwise */
+} bctbx_tree_walk_entry_t;
+
+/* Return value of a bctbx_tree_walk_cb_t on BCTBX_TREE_WALK_DIRECTORY_PRE to not walk the directory content */
+#define BCTBX_TREE_WALK_SKIP_SUBTREE 1
+
+/**
+ * Callback called by bctbx_tree_walk() for each entry.
+ * @param[in] user_data	The user data given to bctbx_tree_walk()
+ * @param[in] entry	The entry, valid during the call only
+ * @return 0 to continue the walk, BCTBX_TREE_WALK_SKIP_SUBTREE to skip the content of a directory,
+ * 	   any other value to stop the walk
+ */
+typedef int (*bctbx_tree_walk_cb_t)(void *user_data, const bctbx_tree_walk_entry_t *entry);
+
+/**
+ * Walk a file tree depth first, as nftw() does without following symbolic links. Each directory is reported before
+ * (BCTBX_TREE_WALK_DIRECTORY_PRE) and after (BCTBX_TREE_WALK_DIRECTORY_POST) its content, other entries are reported
+ * once (BCTBX_TREE_WALK_ENTRY).
+ * Directories are opened relatively to their parent directory descriptor, so the cost of an operation on an entry does
+ * not grow with its depth when it is performed with the *at() functions and the dir_fd given to the callback.
+ * Only the first 16 levels of directories stay open during the walk: deeper directories are read entirely before
+ * their content is walked and opened again by path after each of their subdirectories, so that the walk holds a
+ * bounded number of descriptors and buffers whatever the depth.
+ * A directory which cannot be read does not stop the walk, the error is given with its BCTBX_TREE_WALK_DIRECTORY_POST.
+ *
+ * @param[in]	path		The root of the tree, it is given to the callback too
+ * @param[in]	cb		Called for each entry
+ * @param[in]	user_data	Given to the callback
+ *
+ * @return	0 once the whole tree is walked, the value returned by the callback if it stopped the walk,
+ * 		a negative errno value if the root does not exist
+ **/
+BCTBX_PUBLIC int bctbx_tree_walk(const char *path, bctbx_tree_walk_cb_t cb, void *user_data);
+
 /**
  * Create a directory
  * Note: parent directory must exists, this function cannot create a complete path
@@ -560,6 +688,22 @@ BCTBX_PUBLIC int bctbx_mkdir(const char *path);
  **/
 BCTBX_PUBLIC int bctbx_rmdir(const char *path, bool_t recursive);
 
+/**
+ * Delete a directory and all its content using a pool of worker threads: each worker empties one directory at a
+ * time, the subdirectories it finds are queued for the other workers. Directories are deleted once all their
+ * subdirectories are.
+ * The deletion goes on when an entry cannot be deleted, the directories holding it are kept.
+ * The calling thread is one of the workers and the function returns once the whole tree is processed, like
+ * bctbx_rmdir(), so that its result is known: call it from a thread which may block to delete a tree in background.
+ *
+ * @param[in]	path		the directory to delete
+ * @param[in]	max_workers	the maximum number of threads deleting the tree, including the calling one.
+ * 				1 or less deletes the tree on the calling thread only.
+ *
+ * @return 0 on success
+ **/
+BCTBX_PUBLIC int bctbx_rmdir_parallel(const char *path, int max_workers);
+
 /**
  * @brief return a timeSpec structure(sec and nsec) containing current time(WARNING: there is no guarantees it is UTC ).
  *        The time returned may refers to UTC or last boot.
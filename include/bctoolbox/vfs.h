@@ -52,13 +52,27 @@
 
 #define BCTBX_VFS_ERROR -255 /* Some kind of disk I/O error occurred */
 
-#define BCTBX_VFS_PRINTF_PAGE_SIZE 4096   /* Size of the page hold in memory by fprintf */
+#define BCTBX_VFS_PRINTF_PAGE_SIZE 4096   /* Default size of the page hold in memory by fprintf */
 #define BCTBX_VFS_GETLINE_PAGE_SIZE 17385 /* Size of the page hold in memory by getnextline */
+#define BCTBX_VFS_LINE_ITERATOR_READ_SIZE 65536 /* Default size of the reads performed by the line iterator */
+#define BCTBX_VFS_COPY_BUFFER_SIZE (1024 * 1024)  /* Size of the buffers used by bctbx_file_copy when streaming */
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/**
+ * Expected access pattern on a file range, given to bctbx_file_advise().
+ */
+typedef enum bctbx_vfs_advice_t {
+	BCTBX_VFS_ADVICE_NORMAL = 0, /* No particular access pattern */
+	BCTBX_VFS_ADVICE_SEQUENTIAL, /* Data will be accessed sequentially, from lower offsets to higher ones */
+	BCTBX_VFS_ADVICE_RANDOM,     /* Data will be accessed in random order */
+	BCTBX_VFS_ADVICE_WILLNEED,   /* Data will be accessed in the near future */
+	BCTBX_VFS_ADVICE_DONTNEED,   /* Data will not be accessed in the near future */
+	BCTBX_VFS_ADVICE_NOREUSE     /* Data will be accessed only once */
+} bctbx_vfs_advice_t;
+
 /**
  * Methods associated with the bctbx_vfs_t.
  */
@@ -79,6 +93,8 @@ struct bctbx_vfs_file_t {
 	char fPage[BCTBX_VFS_PRINTF_PAGE_SIZE]; /* Buffer storing the current page cached by fprintf */
 	off_t fPageOffset;                      /* The original offset of the cached page */
 	size_t fSize;                           /* number of bytes in cache */
+	char *fPageBuffer; /* Buffer used instead of fPage when the page size was set by bctbx_file_set_printf_page_size */
+	size_t fPageSize;  /* Size of fPageBuffer, 0 when using fPage */
 	/* get_nxtline cache */
 	char gPage[BCTBX_VFS_GETLINE_PAGE_SIZE +
 	           1];     /* Buffer storing the current page cachec by get_nxtline +1 to hold the \0 */
@@ -97,6 +113,8 @@ struct bctbx_io_methods_t {
 	int (*pFuncSync)(bctbx_vfs_file_t *pFile);
 	int (*pFuncGetLineFromFd)(bctbx_vfs_file_t *pFile, char *s, int count);
 	bool_t (*pFuncIsEncrypted)(bctbx_vfs_file_t *pFile);
+	int (*pFuncAllocate)(bctbx_vfs_file_t *pFile, int64_t offset, int64_t len);
+	int (*pFuncAdvise)(bctbx_vfs_file_t *pFile, int64_t offset, int64_t len, bctbx_vfs_advice_t advice);
 };
 
 /**
@@ -173,6 +191,28 @@ BCTBX_PUBLIC ssize_t bctbx_file_size(bctbx_vfs_file_t *pFile);
  */
 BCTBX_PUBLIC int bctbx_file_truncate(bctbx_vfs_file_t *pFile, int64_t size);
 
+/**
+ * Reserve storage for a range of the file, so later writes in this range do not have to allocate blocks.
+ * The file size is not modified. This is an optimization only: if the platform or the file system does not support
+ * preallocation, nothing is done and the call succeeds.
+ * @param  pFile  bctbx_vfs_file_t File handle pointer.
+ * @param  offset Beginning of the range, in bytes.
+ * @param  len    Length of the range, in bytes.
+ * @return        BCTBX_VFS_ERROR if an error occured (ie: not enough space on the device), BCTBX_VFS_OK otherwise.
+ */
+BCTBX_PUBLIC int bctbx_file_allocate(bctbx_vfs_file_t *pFile, int64_t offset, int64_t len);
+
+/**
+ * Announce the access pattern expected on a range of the file. This is only a hint: if the platform does not
+ * support it, nothing is done and the call succeeds.
+ * @param  pFile  bctbx_vfs_file_t File handle pointer.
+ * @param  offset Beginning of the range, in bytes.
+ * @param  len    Length of the range, in bytes, 0 extends the range until the end of the file.
+ * @param  advice The expected access pattern.
+ * @return        BCTBX_VFS_ERROR if an error occured, BCTBX_VFS_OK otherwise.
+ */
+BCTBX_PUBLIC int bctbx_file_advise(bctbx_vfs_file_t *pFile, int64_t offset, int64_t len, bctbx_vfs_advice_t advice);
+
 /**
  * Write count bytes contained in buf to a file associated with pFile at the position
  * offset. Calls pFuncWrite (set to bc_Write by default).
@@ -195,6 +235,22 @@ BCTBX_PUBLIC ssize_t bctbx_file_write(bctbx_vfs_file_t *pFile, const void *buf,
  */
 BCTBX_PUBLIC ssize_t bctbx_file_write2(bctbx_vfs_file_t *pFile, const void *buf, size_t count);
 
+/**
+ * Copy a range of a file into another one.
+ * When both files are opened with the standard vfs, the copy is performed by the kernel (copy_file_range, which may
+ * clone the blocks, or sendfile). Otherwise data is streamed through large buffers; when one of the files is
+ * encrypted, reading (and decrypting) the next buffer runs in a separate thread while the current one is written.
+ * @param  src       Source file handle pointer.
+ * @param  dst       Destination file handle pointer.
+ * @param  srcOffset Where to start reading in the source file.
+ * @param  dstOffset Where to start writing in the destination file.
+ * @param  length    Number of bytes to copy, a negative value copies until the end of the source file.
+ * @return           Number of bytes copied (less than length if the end of the source file is reached),
+ *                   BCTBX_VFS_ERROR if an error occurred.
+ */
+BCTBX_PUBLIC int64_t bctbx_file_copy(
+    bctbx_vfs_file_t *src, bctbx_vfs_file_t *dst, int64_t srcOffset, int64_t dstOffset, int64_t length);
+
 /**
  * Writes to file.
  * @param  pFile  File handle pointer.
@@ -204,6 +260,16 @@ BCTBX_PUBLIC ssize_t bctbx_file_write2(bctbx_vfs_file_t *pFile, const void *buf,
  */
 BCTBX_PUBLIC ssize_t bctbx_file_fprintf(bctbx_vfs_file_t *pFile, off_t offset, const char *fmt, ...);
 
+/**
+ * Set the size of the page used by bctbx_file_fprintf to cache small writes.
+ * Outputs that do not fit in the remaining space of the page are written directly along with the cached data.
+ * The current page is flushed before changing its size.
+ * @param  pFile  File handle pointer.
+ * @param  size   New page size in bytes, 0 restores the default BCTBX_VFS_PRINTF_PAGE_SIZE.
+ * @return        BCTBX_VFS_OK on success, BCTBX_VFS_ERROR otherwise.
+ */
+BCTBX_PUBLIC int bctbx_file_set_printf_page_size(bctbx_vfs_file_t *pFile, size_t size);
+
 /**
  * Wrapper to pFuncGetNxtLine. Returns a line with at most maxlen characters
  * from the file associated to pFile and  writes it into s.
@@ -214,6 +280,36 @@ BCTBX_PUBLIC ssize_t bctbx_file_fprintf(bctbx_vfs_file_t *pFile, off_t offset, c
  */
 BCTBX_PUBLIC int bctbx_file_get_nxtline(bctbx_vfs_file_t *pFile, char *s, int maxlen);
 
+/**
+ * Line iterator on a file, see bctbx_file_line_iterator_new().
+ */
+typedef struct bctbx_vfs_line_iterator_t bctbx_vfs_line_iterator_t;
+
+/**
+ * Create an iterator on the lines of a file, starting at the file offset (see bctbx_file_seek).
+ * Lines end with \n, \r or \r\n and have no length limit: the internal buffer grows as needed.
+ * The file offset is moved past each line returned, so bctbx_file_get_nxtline can be used after the iterator.
+ * @param  pFile    File handle pointer.
+ * @param  readSize Size of the reads performed on the file, 0 for BCTBX_VFS_LINE_ITERATOR_READ_SIZE.
+ * @return          the iterator, to be destroyed with bctbx_file_line_iterator_destroy(), NULL on error.
+ */
+BCTBX_PUBLIC bctbx_vfs_line_iterator_t *bctbx_file_line_iterator_new(bctbx_vfs_file_t *pFile, size_t readSize);
+
+/**
+ * Get the next line of the file.
+ * @param[in]  it     The line iterator.
+ * @param[out] line   Points to the line, without its terminator but followed by a \0. It is valid until the next call.
+ * @param[out] length Length of the line, may be NULL.
+ * @return 1 if a line was found, 0 at end of file, BCTBX_VFS_ERROR if an error occurred.
+ */
+BCTBX_PUBLIC int bctbx_file_line_iterator_next(bctbx_vfs_line_iterator_t *it, const char **line, size_t *length);
+
+/**
+ * Destroy a line iterator. The file it iterates on is not closed.
+ * @param it The line iterator.
+ */
+BCTBX_PUBLIC void bctbx_file_line_iterator_destroy(bctbx_vfs_line_iterator_t *it);
+
 /**
  * Simply sync the file contents given through the file handle
  * to the persistent media.
@@ -222,6 +318,17 @@ BCTBX_PUBLIC int bctbx_file_get_nxtline(bctbx_vfs_file_t *pFile, char *s, int ma
  */
 BCTBX_PUBLIC int bctbx_file_sync(bctbx_vfs_file_t *pFile);
 
+/**
+ * Sync several files to the persistent media at once.
+ * Each file first writes back its buffered data, then the files are synced concurrently, with fdatasync where
+ * available so that the write back errors of each file are reported. Syncs of the same file requested concurrently by
+ * other threads are shared.
+ * @param  files  Array of file handle pointers.
+ * @param  count  Number of files in the array.
+ * @return   BCTBX_VFS_OK when all the files were synced, BCTBX_VFS_ERROR otherwise
+ */
+BCTBX_PUBLIC int bctbx_file_sync_batch(bctbx_vfs_file_t **files, size_t count);
+
 /**
  * Set the position to offset in the file, this position is used only by the function
  * bctbx_file_get_nxtline. Read and write give their own offset as param and won't modify this one
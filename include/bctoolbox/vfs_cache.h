@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2025 Belledonne Communications SARL.
+ *
+ * This file is part of bctoolbox.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BCTBX_VFS_CACHE_H
+#define BCTBX_VFS_CACHE_H
+
+#include "bctoolbox/port.h"
+#include "bctoolbox/vfs.h"
+
+#define BCTBX_VFS_CACHE_PAGE_SIZE 4096                          /* Size of a page held by the block cache */
+#define BCTBX_VFS_CACHE_DEFAULT_MEMORY_BUDGET (4 * 1024 * 1024) /* Default memory budget of the block cache */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Block cache statistics, shared by all the caching VFS instances.
+ */
+typedef struct bctbx_vfs_cache_stats_t {
+	uint64_t hits;        /* number of page accesses served from the cache */
+	uint64_t misses;      /* number of pages loaded from the underlying VFS */
+	uint64_t evictions;   /* number of pages evicted to stay within the memory budget */
+	uint64_t writebacks;  /* number of dirty pages written back to the underlying VFS */
+	size_t memory_used;   /* memory currently used by cached pages, in bytes */
+	size_t memory_budget; /* configured memory budget, in bytes */
+} bctbx_vfs_cache_stats_t;
+
+/**
+ * Create a caching VFS on top of another one (standard or encrypted).
+ * All files opened through any caching VFS share a single LRU page cache bounded by one memory budget,
+ * see bctbx_vfs_cache_set_memory_budget(). Writes are kept in the cache and written back to the underlying
+ * VFS on bctbx_file_sync(), bctbx_file_close() or when a dirty page is evicted.
+ * @param  underlying The VFS used to actually access the files.
+ * @return a VFS to be used with bctbx_file_open/bctbx_file_open2, destroy it with bctbx_vfs_cache_destroy()
+ *         once all files opened with it are closed. NULL if underlying is NULL.
+ */
+BCTBX_PUBLIC bctbx_vfs_t *bctbx_vfs_cache_create(bctbx_vfs_t *underlying);
+
+/**
+ * Destroy a caching VFS created by bctbx_vfs_cache_create().
+ * Files opened through this VFS must be closed before.
+ * @param cacheVfs The caching VFS to destroy.
+ */
+BCTBX_PUBLIC void bctbx_vfs_cache_destroy(bctbx_vfs_t *cacheVfs);
+
+/**
+ * Set the memory budget shared by all the files opened through a caching VFS.
+ * If the cache currently uses more memory, least recently used pages are evicted (dirty ones are written back).
+ * @param budget Maximum amount of memory, in bytes, used by cached pages. 0 effectively disables the cache.
+ */
+BCTBX_PUBLIC void bctbx_vfs_cache_set_memory_budget(size_t budget);
+
+/**
+ * @return the memory budget shared by all the files opened through a caching VFS
+ */
+BCTBX_PUBLIC size_t bctbx_vfs_cache_get_memory_budget(void);
+
+/**
+ * Get the block cache statistics.
+ * @param[out] stats Filled with the current statistics.
+ */
+BCTBX_PUBLIC void bctbx_vfs_cache_get_stats(bctbx_vfs_cache_stats_t *stats);
+
+/**
+ * @return the ratio of page accesses served from the cache, in range [0, 1]. 0 if no access was made.
+ */
+BCTBX_PUBLIC float bctbx_vfs_cache_get_hit_ratio(void);
+
+/**
+ * Reset the hits, misses, evictions and writebacks counters.
+ */
+BCTBX_PUBLIC void bctbx_vfs_cache_reset_stats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BCTBX_VFS_CACHE_H */
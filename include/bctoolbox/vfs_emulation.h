@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2025 Belledonne Communications SARL.
+ *
+ * This file is part of bctoolbox.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BCTBX_VFS_EMULATION_H
+#define BCTBX_VFS_EMULATION_H
+
+#include "bctoolbox/port.h"
+#include "bctoolbox/vfs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Storage behaviour emulated by an emulation VFS. A zeroed structure emulates nothing.
+ * Latencies are in microseconds, bandwidths in bytes per second, probabilities in percent (0 to 100).
+ */
+typedef struct bctbx_vfs_emulation_config_t {
+	uint32_t open_latency_us;     /* added to each open */
+	uint32_t read_latency_us;     /* added to each read */
+	uint32_t write_latency_us;    /* added to each write */
+	uint32_t sync_latency_us;     /* added to each sync */
+	uint32_t sync_stall_us;       /* additional stall of one sync out of sync_stall_interval */
+	uint32_t sync_stall_interval; /* period of the sync stalls, 0 to disable them */
+	uint64_t read_bandwidth;      /* read throughput of the emulated device, 0 for unlimited */
+	uint64_t write_bandwidth;     /* write throughput of the emulated device, 0 for unlimited */
+	uint32_t short_read_percent;  /* probability for a read to return less bytes than requested */
+	uint32_t short_write_percent; /* probability for a write to write less bytes than requested */
+	uint32_t seed;                /* seed of the pseudo random generator used for short reads and writes */
+} bctbx_vfs_emulation_config_t;
+
+/**
+ * Create a VFS emulating a slow or faulty storage on top of another one: latencies and bandwidth limits delay the
+ * calling thread, short reads and writes only transfer a part of the requested bytes.
+ * The bandwidth is shared by all the files opened through the VFS, as on a single device.
+ * @param  underlying The VFS used to actually access the files.
+ * @param  config     The emulated behaviour, copied. NULL emulates nothing.
+ * @return a VFS to be used with bctbx_file_open/bctbx_file_open2, destroy it with bctbx_vfs_emulation_destroy()
+ *         once all files opened with it are closed. NULL if underlying is NULL.
+ */
+BCTBX_PUBLIC bctbx_vfs_t *bctbx_vfs_emulation_create(bctbx_vfs_t *underlying,
+                                                     const bctbx_vfs_emulation_config_t *config);
+
+/**
+ * Destroy an emulation VFS created by bctbx_vfs_emulation_create().
+ * Files opened through this VFS must be closed before.
+ * @param emulationVfs The emulation VFS to destroy.
+ */
+BCTBX_PUBLIC void bctbx_vfs_emulation_destroy(bctbx_vfs_t *emulationVfs);
+
+/**
+ * Change the emulated behaviour. It applies to the next operations, including on already opened files.
+ * @param emulationVfs The emulation VFS.
+ * @param config       The emulated behaviour, copied. NULL emulates nothing.
+ */
+BCTBX_PUBLIC void bctbx_vfs_emulation_set_config(bctbx_vfs_t *emulationVfs,
+                                                 const bctbx_vfs_emulation_config_t *config);
+
+/**
+ * @param      emulationVfs The emulation VFS.
+ * @param[out] config       Filled with the current emulated behaviour.
+ */
+BCTBX_PUBLIC void bctbx_vfs_emulation_get_config(bctbx_vfs_t *emulationVfs, bctbx_vfs_emulation_config_t *config);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BCTBX_VFS_EMULATION_H */
@@ -25,6 +25,7 @@
 #include "bctoolbox/vfs.h"
 #include <functional>
 #include <memory>
+#include <utility>
 #include <vector>
 
 namespace bctoolbox {
@@ -59,6 +60,14 @@ public:
  */
 extern BCTBX_PUBLIC bctbx_vfs_t bcEncryptedVfs;
 
+/**
+ * Encrypted VFS using the direct I/O standard VFS (bcStandardDirectVfs) for the raw file, so the ciphertext is not
+ * cached by the kernel. Files created with it lay their chunks out on BCTBX_VFS_DIRECT_IO_ALIGNMENT blocks: unless
+ * the open callback sets a chunk size, the chunk size is chosen so a raw chunk fits a block. Such files use the
+ * version 1.1 header and can be opened with both encrypted VFS.
+ */
+extern BCTBX_PUBLIC bctbx_vfs_t bcEncryptedDirectVfs;
+
 /**
  * Provided encryption suites
  */
@@ -106,14 +115,19 @@ public:
 private:
 	uint16_t mVersionNumber; /**< version number of the encryption vfs */
 	size_t mChunkSize;       /**< size of the file chunks payload in bytes : default is 4kB */
-	size_t rawChunkSizeGet()
-	    const noexcept; /** return the size of a chunk including its encryption header, as stored in the raw file */
+	size_t rawChunkSizeGet() const noexcept; /** return the space used by a chunk in the raw file: encryption header and
+	                                            padding included */
+	size_t rawChunkDataSizeGet()
+	    const noexcept; /** return the size of a chunk including its encryption header, without padding */
 	std::shared_ptr<VfsEncryptionModule>
 	    m_module; /**< one of the available encryption module : if nullptr, assume we deal with regular plain file */
 	size_t mHeaderExtensionSize; /**< header extension size */
+	size_t mChunkPadding;        /**< padding after each raw chunk, to align them on direct I/O blocks */
+	size_t mDirectIoBlock;       /**< direct I/O block the raw chunks are aligned on, 0 for buffered files */
 	const std::string mFilename; /**< the filename as given to the open function */
 	uint64_t mFileSize;          /**< size of the plaintext file */
 
+	void directIoLayoutSet(); /**< align the raw chunks on direct I/O blocks, at file creation */
 	uint64_t rawFileSizeGet() const noexcept; /**< return the size of the raw file */
 	uint32_t
 	getChunkIndex(uint64_t offset) const noexcept; /**< return the chunk index where to find the given offset */
@@ -166,6 +180,15 @@ public:
 	/* Truncate the file to the given size, if given size is greater than current, pad with 0 */
 	void truncate(const uint64_t size);
 
+	/**
+	 * Translate a range of the plain file into the range of the raw file holding it: whole chunks including their
+	 * headers, and the file header when the range starts at 0.
+	 * @param[in]	offset	beginning of the plain range
+	 * @param[in]	length	length of the plain range, 0 means until the end of file
+	 * @return	the raw range as a pair offset, length. A length of 0 means until the end of file
+	 */
+	std::pair<uint64_t, uint64_t> rawRangeGet(uint64_t offset, uint64_t length) const noexcept;
+
 	/**
 	 *  Get the filename
 	 *  @return a string with the filename as given to the open function
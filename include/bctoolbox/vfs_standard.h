@@ -23,6 +23,8 @@
 #include "bctoolbox/port.h"
 #include "bctoolbox/vfs.h"
 
+#define BCTBX_VFS_DIRECT_IO_ALIGNMENT 4096 /* Direct I/O alignment when the file system does not report one */
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -32,6 +34,16 @@ extern "C" {
  */
 extern BCTBX_PUBLIC bctbx_vfs_t bcStandardVfs;
 
+/**
+ * Standard VFS bypassing the kernel page cache (O_DIRECT on Linux, F_NOCACHE on Apple platforms).
+ * Requests do not need to be aligned: unaligned ones go through a pool of aligned buffers, partially written blocks
+ * are read back first, so files opened write only are opened for reading too. Whole aligned blocks are the fast path,
+ * the alignment is queried from the file system when the file is opened.
+ * When the file system does not support direct I/O, requires an alignment larger than 64 KiB, or the file is opened
+ * in append mode, it is opened in buffered mode.
+ */
+extern BCTBX_PUBLIC bctbx_vfs_t bcStandardDirectVfs;
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2025 Belledonne Communications SARL.
+ *
+ * This file is part of bctoolbox.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BCTBX_VFS_STATS_H
+#define BCTBX_VFS_STATS_H
+
+#include "bctoolbox/logging.h"
+#include "bctoolbox/port.h"
+#include "bctoolbox/vfs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Operations instrumented by the stats VFS.
+ */
+typedef enum bctbx_vfs_stats_op_t {
+	BCTBX_VFS_STATS_OP_OPEN = 0,
+	BCTBX_VFS_STATS_OP_READ,
+	BCTBX_VFS_STATS_OP_WRITE,
+	BCTBX_VFS_STATS_OP_SYNC,
+	BCTBX_VFS_STATS_OP_TRUNCATE,
+	BCTBX_VFS_STATS_OP_SIZE,
+	BCTBX_VFS_STATS_OP_COUNT /* number of operations, not an operation */
+} bctbx_vfs_stats_op_t;
+
+/**
+ * Statistics of one operation. Latencies are in microseconds, percentiles are approximated by the upper bound of
+ * the histogram bucket holding them (less than 25% above the actual value).
+ */
+typedef struct bctbx_vfs_stats_op_snapshot_t {
+	uint64_t count;    /* number of calls */
+	uint64_t errors;   /* number of calls which returned an error */
+	uint64_t bytes;    /* bytes transferred by read and write */
+	uint64_t total_us; /* cumulated latency */
+	uint64_t p50_us;   /* median latency */
+	uint64_t p99_us;   /* 99th percentile latency */
+	uint64_t max_us;   /* maximum latency */
+} bctbx_vfs_stats_op_snapshot_t;
+
+/**
+ * Statistics of all the operations, indexed by bctbx_vfs_stats_op_t.
+ */
+typedef struct bctbx_vfs_stats_snapshot_t {
+	bctbx_vfs_stats_op_snapshot_t ops[BCTBX_VFS_STATS_OP_COUNT];
+} bctbx_vfs_stats_snapshot_t;
+
+/**
+ * Create a VFS recording statistics on the operations performed on top of another one.
+ * Statistics are kept for the VFS as a whole and for each file opened through it.
+ * Recording is enabled at creation, see bctbx_vfs_stats_set_enabled().
+ * @param  underlying The VFS used to actually access the files.
+ * @return a VFS to be used with bctbx_file_open/bctbx_file_open2, destroy it with bctbx_vfs_stats_destroy()
+ *         once all files opened with it are closed. NULL if underlying is NULL.
+ */
+BCTBX_PUBLIC bctbx_vfs_t *bctbx_vfs_stats_create(bctbx_vfs_t *underlying);
+
+/**
+ * Destroy a stats VFS created by bctbx_vfs_stats_create().
+ * Files opened through this VFS must be closed before.
+ * @param statsVfs The stats VFS to destroy.
+ */
+BCTBX_PUBLIC void bctbx_vfs_stats_destroy(bctbx_vfs_t *statsVfs);
+
+/**
+ * Enable or disable the recording. When disabled, operations are forwarded to the underlying VFS without any
+ * measurement.
+ * @param statsVfs The stats VFS.
+ * @param enabled  TRUE to record statistics.
+ */
+BCTBX_PUBLIC void bctbx_vfs_stats_set_enabled(bctbx_vfs_t *statsVfs, bool_t enabled);
+
+/**
+ * @param  statsVfs The stats VFS.
+ * @return TRUE if the recording is enabled.
+ */
+BCTBX_PUBLIC bool_t bctbx_vfs_stats_is_enabled(bctbx_vfs_t *statsVfs);
+
+/**
+ * Get the statistics of all the files opened through a stats VFS since its creation or last reset.
+ * @param      statsVfs The stats VFS.
+ * @param[out] snapshot Filled with the statistics.
+ */
+BCTBX_PUBLIC void bctbx_vfs_stats_get_snapshot(bctbx_vfs_t *statsVfs, bctbx_vfs_stats_snapshot_t *snapshot);
+
+/**
+ * Get the statistics of a file opened through a stats VFS. The open operation is accounted in the VFS statistics only.
+ * @param      pFile    File handle pointer.
+ * @param[out] snapshot Filled with the statistics.
+ * @return BCTBX_VFS_OK on success, BCTBX_VFS_ERROR if the file was not opened through a stats VFS.
+ */
+BCTBX_PUBLIC int bctbx_file_stats_get_snapshot(bctbx_vfs_file_t *pFile, bctbx_vfs_stats_snapshot_t *snapshot);
+
+/**
+ * Reset the statistics of a stats VFS and of all the files currently opened through it.
+ * @param statsVfs The stats VFS.
+ */
+BCTBX_PUBLIC void bctbx_vfs_stats_reset(bctbx_vfs_t *statsVfs);
+
+/**
+ * Dump the statistics of a stats VFS and of all the files currently opened through it to the logs.
+ * @param statsVfs The stats VFS.
+ * @param level    Log level used for the dump.
+ */
+BCTBX_PUBLIC void bctbx_vfs_stats_log(bctbx_vfs_t *statsVfs, BctbxLogLevel level);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BCTBX_VFS_STATS_H */
@@ -0,0 +1,560 @@
+/*
+ * Copyright (c) 2025 Belledonne Communications SARL.
+ *
+ * This file is part of bctoolbox.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "bctoolbox/logging.h"
+#include "logging_private.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+// someone does include the evil windef.h so we must undef the min and max macros to be able to use std::min and
+// std::max
+#undef min
+#undef max
+
+namespace bctoolbox {
+
+namespace {
+
+constexpr size_t kDefaultCapacity = 1024;
+constexpr size_t kInlineSize = 440; // messages up to this size, with their domain and tags, are stored in the queue
+
+/*
+ * A queued message: the domain (if any), the text, the tags as identifier and value, then the fields of a structured
+ * message are stored one after the other, the strings NUL terminated. Each field is stored as its type (one byte), its
+ * key, then its value: a string, or the 8 bytes of a number.
+ */
+struct AsyncLogEntry {
+	const char *data() const {
+		return mHeap ? mHeap : mInline;
+	}
+
+	BctbxLogLevel mLevel;
+	bool mHasDomain;
+	uint16_t mTagCount;
+	uint16_t mFieldCount;
+	char *mHeap; // used instead of mInline for the messages too large for it
+	char mInline[kInlineSize];
+};
+
+/* The sequence number tells whether the cell is free or holds a message for a given position in the queue */
+struct alignas(64) AsyncLogCell {
+	std::atomic<size_t> mSequence;
+	AsyncLogEntry mEntry;
+};
+
+/* Serialize a message in a cell, moving it to the heap only when it does not fit */
+class AsyncLogEntryWriter {
+public:
+	AsyncLogEntryWriter(AsyncLogEntry &entry) : mEntry(entry), mBuffer(entry.mInline), mCapacity(kInlineSize) {
+		mEntry.mHeap = nullptr;
+	}
+
+	void append(const char *str) {
+		size_t length = strlen(str);
+		reserve(length + 1);
+		memcpy(mBuffer + mSize, str, length + 1);
+		mSize += length + 1;
+	}
+
+	void append(const void *data, size_t size) {
+		reserve(size);
+		memcpy(mBuffer + mSize, data, size);
+		mSize += size;
+	}
+
+	void appendv(const char *fmt, va_list args) {
+		va_list cap;
+		va_copy(cap, args);
+		int n = vsnprintf(mBuffer + mSize, mCapacity - mSize, fmt, cap);
+		va_end(cap);
+		if (n < 0) {
+			append("");
+			return;
+		}
+		if ((size_t)n >= mCapacity - mSize) {
+			reserve((size_t)n + 1);
+			va_copy(cap, args);
+			vsnprintf(mBuffer + mSize, mCapacity - mSize, fmt, cap);
+			va_end(cap);
+		}
+		mSize += (size_t)n + 1;
+	}
+
+private:
+	void reserve(size_t size) {
+		if (mSize + size <= mCapacity) return;
+		mCapacity = std::max(2 * mCapacity, mSize + size);
+		char *heap = (char *)bctbx_malloc(mCapacity);
+		memcpy(heap, mBuffer, mSize);
+		if (mEntry.mHeap) bctbx_free(mEntry.mHeap);
+		mEntry.mHeap = mBuffer = heap;
+	}
+
+	AsyncLogEntry &mEntry;
+	char *mBuffer;
+	size_t mCapacity;
+	size_t mSize = 0;
+};
+
+void fillHeader(AsyncLogEntry &entry, AsyncLogEntryWriter &writer, const char *domain, BctbxLogLevel level) {
+	entry.mLevel = level;
+	entry.mHasDomain = (domain != nullptr);
+	if (domain) writer.append(domain);
+}
+
+/* The tags of the logging thread, the writer thread has its own */
+void fillTags(AsyncLogEntry &entry, AsyncLogEntryWriter &writer) {
+	size_t count = 0;
+	const bctbx_log_field_t *tags = bctbx_get_log_tag_fields(&count);
+	count = std::min(count, (size_t)UINT16_MAX);
+	for (size_t i = 0; i < count; i++) {
+		writer.append(tags[i].key);
+		writer.append(tags[i].value.string_value);
+	}
+	entry.mTagCount = (uint16_t)count;
+}
+
+void fillEntry(AsyncLogEntry &entry, const char *domain, BctbxLogLevel level, const char *fmt, va_list args) {
+	AsyncLogEntryWriter writer(entry);
+	fillHeader(entry, writer, domain, level);
+	writer.appendv(fmt, args);
+	fillTags(entry, writer);
+	entry.mFieldCount = 0;
+}
+
+void fillEntry(AsyncLogEntry &entry,
+               const char *domain,
+               BctbxLogLevel level,
+               const char *msg,
+               const bctbx_log_field_t *fields,
+               size_t count) {
+	AsyncLogEntryWriter writer(entry);
+	fillHeader(entry, writer, domain, level);
+	writer.append(msg ? msg : "");
+	fillTags(entry, writer);
+	count = std::min(count, (size_t)UINT16_MAX);
+	for (size_t i = 0; i < count; i++) {
+		const bctbx_log_field_t &field = fields[i];
+		char type = (char)field.type;
+		writer.append(&type, 1);
+		writer.append(field.key);
+		switch (field.type) {
+			case BCTBX_LOG_FIELD_STRING:
+				writer.append(field.value.string_value ? field.value.string_value : "(null)");
+				break;
+			case BCTBX_LOG_FIELD_BOOL: {
+				uint64_t value = field.value.bool_value ? 1 : 0;
+				writer.append(&value, sizeof(value));
+			} break;
+			default:
+				writer.append(&field.value, 8);
+				break;
+		}
+	}
+	entry.mFieldCount = (uint16_t)count;
+}
+
+std::atomic<uint64_t> sDroppedCount{0};
+
+/**
+ * Bounded multi-producer queue of log messages, consumed by a writer thread giving them to the handlers.
+ * Cells are claimed and released with a compare and swap on the enqueue and dequeue positions, the sequence number of
+ * each cell publishing its state. The dequeue side accepts several consumers, so that producers can drop the oldest
+ * message with the overwrite policy.
+ */
+class AsyncLogger {
+public:
+	AsyncLogger(size_t capacity, BctbxLogOverflowPolicy policy) : mPolicy(policy) {
+		size_t size = 2;
+		while (size < capacity) size <<= 1;
+		mMask = size - 1;
+		mCells.reset(new AsyncLogCell[size]);
+		for (size_t i = 0; i < size; i++) {
+			mCells[i].mSequence.store(i, std::memory_order_relaxed);
+			mCells[i].mEntry.mHeap = nullptr;
+		}
+	}
+
+	bool start() {
+		std::lock_guard<std::mutex> lock(mMutex); // the writer waits for mWriterId to be set
+		try {
+			mThread = std::thread(&AsyncLogger::run, this);
+		} catch (const std::system_error &) {
+			return false;
+		}
+		mWriterId = mThread.get_id();
+		return true;
+	}
+
+	/* Give all the queued messages to the handlers and stop the writer thread. No producer must be pushing. */
+	void stop() {
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mStopping = true;
+			mWakeCv.notify_one();
+		}
+		if (mThread.joinable()) mThread.join();
+	}
+
+	bool isWriterThread() const {
+		return std::this_thread::get_id() == mWriterId;
+	}
+
+	/* Queue a message, the fill function serializing it in a free cell */
+	template <typename Fill>
+	void push(Fill fill) {
+		for (;;) {
+			size_t position;
+			AsyncLogCell *cell = claim(position);
+			if (cell) {
+				fill(cell->mEntry);
+				// sequentially consistent, so that either the writer sees the message or we see it sleeping
+				cell->mSequence.store(position + 1);
+				wakeWriter();
+				return;
+			}
+			switch (mPolicy) {
+				case BCTBX_LOG_OVERFLOW_DROP:
+					mDropped.fetch_add(1, std::memory_order_relaxed);
+					sDroppedCount.fetch_add(1, std::memory_order_relaxed);
+					return;
+				case BCTBX_LOG_OVERFLOW_OVERWRITE:
+					dropOldest();
+					break;
+				case BCTBX_LOG_OVERFLOW_BLOCK:
+					waitForRoom();
+					break;
+			}
+		}
+	}
+
+	/* Wait until the messages queued before the call are given to the handlers or dropped */
+	void flush() {
+		size_t target = mEnqueuePosition.load();
+		std::unique_lock<std::mutex> lock(mMutex);
+		mFlushWaiters++;
+		while (mWriterPosition.load() < target) {
+			mWakeCv.notify_one();
+			mFlushCv.wait_for(lock, std::chrono::milliseconds(10));
+		}
+		mFlushWaiters--;
+	}
+
+private:
+	AsyncLogCell *claim(size_t &position) {
+		position = mEnqueuePosition.load(std::memory_order_relaxed);
+		for (;;) {
+			AsyncLogCell *cell = &mCells[position & mMask];
+			size_t sequence = cell->mSequence.load(std::memory_order_acquire);
+			intptr_t diff = (intptr_t)sequence - (intptr_t)position;
+			if (diff == 0) {
+				if (mEnqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+					return cell;
+				}
+			} else if (diff < 0) {
+				return nullptr; // full
+			} else {
+				position = mEnqueuePosition.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	/* @return the oldest message, nullptr if there is none or if its producer has not finished writing it */
+	AsyncLogCell *take(size_t &position) {
+		position = mDequeuePosition.load(std::memory_order_relaxed);
+		for (;;) {
+			AsyncLogCell *cell = &mCells[position & mMask];
+			size_t sequence = cell->mSequence.load(std::memory_order_acquire);
+			intptr_t diff = (intptr_t)sequence - (intptr_t)(position + 1);
+			if (diff == 0) {
+				if (mDequeuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+					return cell;
+				}
+			} else if (diff < 0) {
+				return nullptr;
+			} else {
+				position = mDequeuePosition.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	void release(AsyncLogCell *cell, size_t position) {
+		if (cell->mEntry.mHeap) {
+			bctbx_free(cell->mEntry.mHeap);
+			cell->mEntry.mHeap = nullptr;
+		}
+		cell->mSequence.store(position + mMask + 1, std::memory_order_release);
+		if (mRoomWaiters.load() > 0) {
+			std::lock_guard<std::mutex> lock(mMutex);
+			mRoomCv.notify_all();
+		}
+	}
+
+	void dropOldest() {
+		size_t position;
+		AsyncLogCell *cell = take(position);
+		if (cell == nullptr) {
+			std::this_thread::yield(); // the oldest message is being written by its producer
+			return;
+		}
+		release(cell, position);
+		mDropped.fetch_add(1, std::memory_order_relaxed);
+		sDroppedCount.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	bool isFull() {
+		size_t position = mEnqueuePosition.load();
+		return mCells[position & mMask].mSequence.load() != position;
+	}
+
+	bool hasReadyEntry() {
+		size_t position = mDequeuePosition.load();
+		return mCells[position & mMask].mSequence.load() == position + 1;
+	}
+
+	void waitForRoom() {
+		std::unique_lock<std::mutex> lock(mMutex);
+		mRoomWaiters++;
+		if (isFull()) mRoomCv.wait_for(lock, std::chrono::milliseconds(10));
+		mRoomWaiters--;
+	}
+
+	void wakeWriter() {
+		if (mWriterSleeping.load()) {
+			std::lock_guard<std::mutex> lock(mMutex);
+			mWakeCv.notify_one();
+		}
+	}
+
+	void dispatch(const AsyncLogEntry &entry) {
+		const char *domain = nullptr;
+		const char *data = entry.data();
+		if (entry.mHasDomain) {
+			domain = data;
+			data += strlen(data) + 1;
+		}
+		const char *msg = data;
+		data += strlen(data) + 1;
+		if (entry.mTagCount > 0) {
+			mTags.resize(entry.mTagCount);
+			for (uint16_t i = 0; i < entry.mTagCount; i++) {
+				const char *key = data;
+				data += strlen(data) + 1;
+				mTags[i] = bctbx_log_field_string(key, data);
+				data += strlen(data) + 1;
+			}
+			bctbx_set_dispatched_log_tags(mTags.data(), mTags.size());
+		}
+		if (entry.mFieldCount > 0) {
+			mFields.resize(entry.mFieldCount);
+			for (uint16_t i = 0; i < entry.mFieldCount; i++) {
+				bctbx_log_field_t &field = mFields[i];
+				field.type = (BctbxLogFieldType)*data++;
+				field.key = data;
+				data += strlen(data) + 1;
+				if (field.type == BCTBX_LOG_FIELD_STRING) {
+					field.value.string_value = data;
+					data += strlen(data) + 1;
+				} else if (field.type == BCTBX_LOG_FIELD_BOOL) {
+					uint64_t value;
+					memcpy(&value, data, sizeof(value));
+					field.value.bool_value = value ? TRUE : FALSE;
+					data += 8;
+				} else {
+					memcpy(&field.value, data, 8);
+					data += 8;
+				}
+			}
+			bctbx_log_dispatch_fields(domain, entry.mLevel, msg, mFields.data(), mFields.size());
+		} else {
+			bctbx_log_dispatch_message(domain, entry.mLevel, msg);
+		}
+		if (entry.mTagCount > 0) bctbx_set_dispatched_log_tags(nullptr, 0);
+	}
+
+	void reportDropped() {
+		uint64_t dropped = mDropped.load(std::memory_order_relaxed);
+		if (dropped == mReportedDropped) return;
+		char msg[128];
+		snprintf(msg, sizeof(msg), "Asynchronous logging: %llu messages dropped, the queue was full.",
+		         (unsigned long long)(dropped - mReportedDropped));
+		mReportedDropped = dropped;
+		bctbx_log_dispatch_message(BCTBX_LOG_DOMAIN, BCTBX_LOG_WARNING, msg);
+	}
+
+	void run() {
+		{ std::lock_guard<std::mutex> lock(mMutex); }
+		for (;;) {
+			// the messages before the dequeue position are either handled by this thread or dropped by producers
+			mWriterPosition.store(mDequeuePosition.load());
+			if (mFlushWaiters.load() > 0) {
+				std::lock_guard<std::mutex> lock(mMutex);
+				mFlushCv.notify_all();
+			}
+			size_t position;
+			AsyncLogCell *cell = take(position);
+			if (cell) {
+				dispatch(cell->mEntry);
+				release(cell, position);
+				continue;
+			}
+			reportDropped();
+
+			std::unique_lock<std::mutex> lock(mMutex);
+			if (mStopping && mDequeuePosition.load() == mEnqueuePosition.load()) break;
+			mWriterSleeping.store(true);
+			if (!hasReadyEntry()) mWakeCv.wait_for(lock, std::chrono::milliseconds(100));
+			mWriterSleeping.store(false);
+		}
+	}
+
+	std::unique_ptr<AsyncLogCell[]> mCells;
+	size_t mMask;
+	const BctbxLogOverflowPolicy mPolicy;
+	alignas(64) std::atomic<size_t> mEnqueuePosition{0};
+	alignas(64) std::atomic<size_t> mDequeuePosition{0};
+	// the writer is done with the messages before it: the dequeue position before each take, as the producers dropping
+	// the oldest messages with the overwrite policy also move the dequeue position forward
+	alignas(64) std::atomic<size_t> mWriterPosition{0};
+	std::atomic<uint64_t> mDropped{0};
+	uint64_t mReportedDropped = 0;
+	std::vector<bctbx_log_field_t> mTags;   // the tags of the message being dispatched, for bctbx_get_log_tags()
+	std::vector<bctbx_log_field_t> mFields; // the fields of the structured message being dispatched
+
+	std::mutex mMutex;
+	std::condition_variable mWakeCv;  // wakes the writer up
+	std::condition_variable mRoomCv;  // wakes the producers waiting for room up
+	std::condition_variable mFlushCv; // wakes the threads waiting for a flush up
+	std::atomic<bool> mWriterSleeping{false};
+	std::atomic<int> mRoomWaiters{0};
+	std::atomic<int> mFlushWaiters{0};
+	bool mStopping = false;
+	std::thread mThread;
+	std::thread::id mWriterId;
+};
+
+/* The asynchronous logger is only deleted once no thread uses it: sUsers counts the threads between their two loads of
+ * sAsyncLogger, disabling waits for it to drop to zero after clearing sAsyncLogger. */
+std::atomic<AsyncLogger *> sAsyncLogger{nullptr};
+std::atomic<int> sUsers{0};
+std::mutex sControlMutex;
+bool sAtExitRegistered = false;
+
+AsyncLogger *acquireAsyncLogger() {
+	if (sAsyncLogger.load(std::memory_order_relaxed) == nullptr) return nullptr; // the common, disabled, case
+	sUsers.fetch_add(1);
+	AsyncLogger *logger = sAsyncLogger.load();
+	if (logger == nullptr) sUsers.fetch_sub(1);
+	return logger;
+}
+
+void releaseAsyncLogger() {
+	sUsers.fetch_sub(1);
+}
+
+} // namespace
+
+} // namespace bctoolbox
+
+using namespace bctoolbox;
+
+static void bctbx_async_logging_atexit(void) {
+	bctbx_disable_async_logging();
+}
+
+int bctbx_enable_async_logging(size_t capacity, BctbxLogOverflowPolicy policy) {
+	bctbx_disable_async_logging();
+
+	std::lock_guard<std::mutex> lock(sControlMutex);
+	AsyncLogger *logger = new AsyncLogger(capacity ? capacity : kDefaultCapacity, policy);
+	if (!logger->start()) {
+		delete logger;
+		return -1;
+	}
+	if (!sAtExitRegistered) {
+		atexit(bctbx_async_logging_atexit);
+		sAtExitRegistered = true;
+	}
+	sAsyncLogger.store(logger);
+	return 0;
+}
+
+void bctbx_disable_async_logging(void) {
+	std::lock_guard<std::mutex> lock(sControlMutex);
+	AsyncLogger *logger = sAsyncLogger.exchange(nullptr);
+	if (logger == nullptr) return;
+	while (sUsers.load() != 0) {
+		std::this_thread::yield();
+	}
+	logger->stop();
+	delete logger;
+}
+
+void bctbx_flush_async_logging(void) {
+	AsyncLogger *logger = acquireAsyncLogger();
+	if (logger == nullptr) return;
+	if (!logger->isWriterThread()) logger->flush();
+	releaseAsyncLogger();
+}
+
+uint64_t bctbx_get_async_logging_dropped_count(void) {
+	return sDroppedCount.load(std::memory_order_relaxed);
+}
+
+bool_t bctbx_async_logging_push(const char *domain, BctbxLogLevel level, const char *fmt, va_list args) {
+	AsyncLogger *logger = acquireAsyncLogger();
+	if (logger == nullptr) return FALSE;
+	bool_t taken = FALSE;
+	// messages logged by the handlers are dispatched right away, the queue may be full
+	if (!logger->isWriterThread()) {
+		logger->push([&](AsyncLogEntry &entry) { fillEntry(entry, domain, level, fmt, args); });
+		taken = TRUE;
+	}
+	releaseAsyncLogger();
+	return taken;
+}
+
+bool_t bctbx_async_logging_push_fields(
+    const char *domain, BctbxLogLevel level, const char *msg, const bctbx_log_field_t *fields, size_t count) {
+	AsyncLogger *logger = acquireAsyncLogger();
+	if (logger == nullptr) return FALSE;
+	bool_t taken = FALSE;
+	if (!logger->isWriterThread()) {
+		logger->push([&](AsyncLogEntry &entry) { fillEntry(entry, domain, level, msg, fields, count); });
+		taken = TRUE;
+	}
+	releaseAsyncLogger();
+	return taken;
+}
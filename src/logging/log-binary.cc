@@ -0,0 +1,712 @@
+/*
+ * Copyright (c) 2025 Belledonne Communications SARL.
+ *
+ * This file is part of bctoolbox.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "bctoolbox/logging.h"
+#include "logging_private.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// someone does include the evil windef.h so we must undef the min and max macros to be able to use std::min and
+// std::max
+#undef min
+#undef max
+
+/*
+ * Binary log stream layout. All integers are LEB128 varints, signed ones zigzag encoded.
+ * - a header, written each time the file is opened: the magic string below. It resets the identifiers and the timestamp.
+ * - kStringRecord: identifier, length, bytes. Defines a format string or a domain, before its first use.
+ * - kThreadRecord: identifier, thread. Defines a thread, before its first use.
+ * - kMessageRecord: format identifier, domain identifier (0 if none), level (one byte), difference in microseconds
+ *   with the timestamp of the previous message (the time since the epoch for the first one), thread identifier, tag
+ *   count, then each tag as length and bytes, then the arguments of the format: integers as varints, floating point
+ *   numbers as 8 bytes, strings as length + 1 (0 for NULL) and bytes.
+ */
+
+namespace bctoolbox {
+
+namespace {
+
+constexpr char kMagic[] = "BCTBXBL1";
+constexpr size_t kMagicSize = sizeof(kMagic) - 1;
+constexpr uint8_t kStringRecord = 1;
+constexpr uint8_t kMessageRecord = 2;
+constexpr uint8_t kThreadRecord = 3;
+constexpr size_t kFlushThreshold = 64 * 1024;
+constexpr size_t kReadChunkSize = 64 * 1024;        /* strings are read by chunks, their length is not trusted */
+constexpr uint64_t kMaxStringLength = 16 * 1024 * 1024; /* longer strings are taken as a corrupted file */
+
+enum class ArgClass : uint8_t { None, Signed, Unsigned, Char, Double, LongDouble, String, Pointer };
+enum class ArgLength : uint8_t { Default, Char, Short, Long, LongLong, IntMax, Size, PtrDiff };
+
+/* A conversion of a format string with the literal text preceding it */
+struct FormatSegment {
+	std::string mLiteral;
+	std::string mSpec; // the conversion rewritten for the decoder, integers being decoded as long long
+	ArgClass mClass = ArgClass::None;
+	ArgLength mLength = ArgLength::Default;
+	uint8_t mStars = 0;      // number of '*' width or precision arguments
+	int mPrecision = -1;     // -1 if none, -2 if given by an argument
+};
+
+/*
+ * Split a printf format into segments. Returns false for the formats whose arguments cannot be recorded (positional
+ * arguments, wide strings, %n or non standard conversions): their messages are recorded formatted.
+ */
+bool parseFormat(const char *fmt, std::vector<FormatSegment> &segments) {
+	FormatSegment segment;
+	const char *p = fmt;
+	while (*p != '\0') {
+		if (*p != '%') {
+			segment.mLiteral += *p++;
+			continue;
+		}
+		if (p[1] == '%') {
+			segment.mLiteral += '%';
+			p += 2;
+			continue;
+		}
+		std::string spec = "%";
+		p++;
+		while (*p != '\0' && strchr("-+ #0", *p))
+			spec += *p++;
+		if (*p == '*') {
+			spec += *p++;
+			segment.mStars++;
+		} else {
+			while (*p >= '0' && *p <= '9')
+				spec += *p++;
+			if (*p == '$') return false;
+		}
+		if (*p == '.') {
+			spec += *p++;
+			if (*p == '*') {
+				spec += *p++;
+				segment.mStars++;
+				segment.mPrecision = -2;
+			} else {
+				segment.mPrecision = 0;
+				while (*p >= '0' && *p <= '9') {
+					segment.mPrecision = segment.mPrecision * 10 + (*p - '0');
+					spec += *p++;
+				}
+			}
+		}
+		bool longDouble = false;
+		switch (*p) {
+			case 'h':
+				segment.mLength = (*++p == 'h') ? (p++, ArgLength::Char) : ArgLength::Short;
+				break;
+			case 'l':
+				segment.mLength = (*++p == 'l') ? (p++, ArgLength::LongLong) : ArgLength::Long;
+				break;
+			case 'q':
+				p++;
+				segment.mLength = ArgLength::LongLong;
+				break;
+			case 'j':
+				p++;
+				segment.mLength = ArgLength::IntMax;
+				break;
+			case 'z':
+				p++;
+				segment.mLength = ArgLength::Size;
+				break;
+			case 't':
+				p++;
+				segment.mLength = ArgLength::PtrDiff;
+				break;
+			case 'L':
+				p++;
+				longDouble = true;
+				break;
+			default:
+				break;
+		}
+		char conversion = *p++;
+		switch (conversion) {
+			case 'd':
+			case 'i':
+				segment.mClass = ArgClass::Signed;
+				spec += "ll";
+				break;
+			case 'u':
+			case 'o':
+			case 'x':
+			case 'X':
+				segment.mClass = ArgClass::Unsigned;
+				spec += "ll";
+				break;
+			case 'c':
+				segment.mClass = ArgClass::Char;
+				break;
+			case 's':
+				segment.mClass = ArgClass::String;
+				break;
+			case 'p':
+				segment.mClass = ArgClass::Pointer;
+				break;
+			case 'f':
+			case 'F':
+			case 'e':
+			case 'E':
+			case 'g':
+			case 'G':
+			case 'a':
+			case 'A':
+				if (segment.mLength != ArgLength::Default && segment.mLength != ArgLength::Long) return false;
+				segment.mClass = longDouble ? ArgClass::LongDouble : ArgClass::Double;
+				break;
+			default:
+				return false;
+		}
+		if (longDouble && segment.mClass != ArgClass::LongDouble) return false;
+		if ((segment.mClass == ArgClass::Char || segment.mClass == ArgClass::String ||
+		     segment.mClass == ArgClass::Pointer) &&
+		    segment.mLength != ArgLength::Default)
+			return false;
+		spec += conversion;
+		segment.mSpec = std::move(spec);
+		segments.push_back(std::move(segment));
+		segment = FormatSegment();
+	}
+	if (!segment.mLiteral.empty()) segments.push_back(std::move(segment));
+	return true;
+}
+
+/* A format string known by a binary log file */
+struct BinaryLogFormat {
+	uint64_t mId;
+	std::string mText;
+	std::vector<FormatSegment> mSegments;
+	bool mDeferred; // false if the messages using it are recorded formatted
+};
+
+class BinaryLogWriter {
+public:
+	BinaryLogWriter(FILE *file) : mFile(file) {
+		mBuffer.insert(mBuffer.end(), kMagic, kMagic + kMagicSize);
+	}
+
+	~BinaryLogWriter() {
+		flush();
+		fclose(mFile);
+	}
+
+	void flush() {
+		if (!mBuffer.empty()) {
+			fwrite(mBuffer.data(), 1, mBuffer.size(), mFile);
+			mBuffer.clear();
+		}
+		fflush(mFile);
+	}
+
+	void write(const char *domain, BctbxLogLevel level, const char *fmt, va_list args) {
+		struct timeval tp;
+		bctbx_gettimeofday(&tp, NULL);
+		const BinaryLogFormat &format = getFormat(fmt);
+		const BinaryLogFormat &recorded = format.mDeferred ? format : getFormat("%s");
+		uint64_t domainId = domain ? getStringId(domain) : 0;
+		uint64_t threadId = getThreadId((uint64_t)bctbx_thread_self());
+		long long timestamp = (long long)tp.tv_sec * 1000000 + tp.tv_usec;
+
+		putByte(kMessageRecord);
+		putVarint(recorded.mId);
+		putVarint(domainId);
+		putByte((uint8_t)level);
+		putSigned(timestamp - mLastTimestamp);
+		mLastTimestamp = timestamp;
+		putVarint(threadId);
+		const bctbx_list_t *tags = bctbx_get_log_tags();
+		putVarint(bctbx_list_size(tags));
+		for (const bctbx_list_t *tag = tags; tag != nullptr; tag = tag->next) {
+			putString((const char *)tag->data, (size_t)-1);
+		}
+		if (format.mDeferred) {
+			va_list ap;
+			va_copy(ap, args);
+			putArguments(format, &ap);
+			va_end(ap);
+		} else {
+			char *msg = bctbx_strdup_vprintf(fmt, args);
+			putString(msg, (size_t)-1);
+			bctbx_free(msg);
+		}
+
+		if (mBuffer.size() >= kFlushThreshold || level >= BCTBX_LOG_ERROR) flush();
+	}
+
+	std::mutex mMutex;
+
+private:
+	void putByte(uint8_t byte) {
+		mBuffer.push_back(byte);
+	}
+
+	void putVarint(uint64_t value) {
+		while (value >= 0x80) {
+			mBuffer.push_back((uint8_t)(value | 0x80));
+			value >>= 7;
+		}
+		mBuffer.push_back((uint8_t)value);
+	}
+
+	void putSigned(long long value) {
+		putVarint(((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+	}
+
+	/* NULL is recorded as length 0, other strings as their length plus one, truncated to what the reader accepts */
+	void putString(const char *str, size_t maxLength) {
+		if (str == nullptr) {
+			putVarint(0);
+			return;
+		}
+		size_t length = 0;
+		maxLength = std::min(maxLength, (size_t)kMaxStringLength);
+		while (length < maxLength && str[length] != '\0')
+			length++;
+		putVarint(length + 1);
+		mBuffer.insert(mBuffer.end(), str, str + length);
+	}
+
+	void putArguments(const BinaryLogFormat &format, va_list *ap) {
+		for (const auto &segment : format.mSegments) {
+			int precision = segment.mPrecision;
+			for (uint8_t i = 0; i < segment.mStars; ++i) {
+				int value = va_arg(*ap, int);
+				putSigned(value);
+				/* the precision is the last star */
+				if (segment.mPrecision == -2 && i == segment.mStars - 1) precision = value;
+			}
+			switch (segment.mClass) {
+				case ArgClass::None:
+					break;
+				case ArgClass::Signed: {
+					long long value = 0;
+					switch (segment.mLength) {
+						case ArgLength::Default:
+							value = va_arg(*ap, int);
+							break;
+						case ArgLength::Char:
+							value = (signed char)va_arg(*ap, int);
+							break;
+						case ArgLength::Short:
+							value = (short)va_arg(*ap, int);
+							break;
+						case ArgLength::Long:
+							value = va_arg(*ap, long);
+							break;
+						case ArgLength::LongLong:
+							value = va_arg(*ap, long long);
+							break;
+						case ArgLength::IntMax:
+							value = (long long)va_arg(*ap, intmax_t);
+							break;
+						case ArgLength::Size:
+							value = (long long)(ptrdiff_t)va_arg(*ap, size_t);
+							break;
+						case ArgLength::PtrDiff:
+							value = (long long)va_arg(*ap, ptrdiff_t);
+							break;
+					}
+					putSigned(value);
+				} break;
+				case ArgClass::Unsigned: {
+					unsigned long long value = 0;
+					switch (segment.mLength) {
+						case ArgLength::Default:
+							value = va_arg(*ap, unsigned int);
+							break;
+						case ArgLength::Char:
+							value = (unsigned char)va_arg(*ap, unsigned int);
+							break;
+						case ArgLength::Short:
+							value = (unsigned short)va_arg(*ap, unsigned int);
+							break;
+						case ArgLength::Long:
+							value = va_arg(*ap, unsigned long);
+							break;
+						case ArgLength::LongLong:
+							value = va_arg(*ap, unsigned long long);
+							break;
+						case ArgLength::IntMax:
+							value = (unsigned long long)va_arg(*ap, uintmax_t);
+							break;
+						case ArgLength::Size:
+							value = (unsigned long long)va_arg(*ap, size_t);
+							break;
+						case ArgLength::PtrDiff:
+							value = (unsigned long long)va_arg(*ap, ptrdiff_t);
+							break;
+					}
+					putVarint(value);
+				} break;
+				case ArgClass::Char:
+					putSigned(va_arg(*ap, int));
+					break;
+				case ArgClass::Double:
+				case ArgClass::LongDouble: {
+					double value = segment.mClass == ArgClass::Double ? va_arg(*ap, double)
+					                                                  : (double)va_arg(*ap, long double);
+					const uint8_t *bytes = (const uint8_t *)&value;
+					mBuffer.insert(mBuffer.end(), bytes, bytes + sizeof(value));
+				} break;
+				case ArgClass::String:
+					/* a precision may limit the length of a string which is not NUL terminated */
+					putString(va_arg(*ap, const char *), precision >= 0 ? (size_t)precision : (size_t)-1);
+					break;
+				case ArgClass::Pointer:
+					putVarint((uint64_t)(uintptr_t)va_arg(*ap, void *));
+					break;
+			}
+		}
+	}
+
+	uint64_t defineString(const char *str) {
+		uint64_t id = mNextId++;
+		putByte(kStringRecord);
+		putVarint(id);
+		putString(str, (size_t)-1);
+		return id;
+	}
+
+	uint64_t getStringId(const char *str) {
+		auto it = mStrings.find(str);
+		if (it != mStrings.end()) return it->second;
+		uint64_t id = defineString(str);
+		mStrings.emplace(str, id);
+		return id;
+	}
+
+	uint64_t getThreadId(uint64_t thread) {
+		auto it = mThreads.find(thread);
+		if (it != mThreads.end()) return it->second;
+		uint64_t id = mThreads.size();
+		putByte(kThreadRecord);
+		putVarint(id);
+		putVarint(thread);
+		mThreads.emplace(thread, id);
+		return id;
+	}
+
+	/* Format strings are mostly literals: look them up by address first, checking that the text did not change */
+	const BinaryLogFormat &getFormat(const char *fmt) {
+		auto byAddress = mFormatsByAddress.find(fmt);
+		if (byAddress != mFormatsByAddress.end() && byAddress->second->mText == fmt) return *byAddress->second;
+		auto byText = mFormats.find(fmt);
+		if (byText == mFormats.end()) {
+			std::unique_ptr<BinaryLogFormat> format(new BinaryLogFormat());
+			format->mText = fmt;
+			format->mDeferred = parseFormat(fmt, format->mSegments);
+			format->mId = defineString(fmt);
+			byText = mFormats.emplace(fmt, std::move(format)).first;
+		}
+		mFormatsByAddress[fmt] = byText->second.get();
+		return *byText->second;
+	}
+
+	FILE *mFile;
+	std::vector<uint8_t> mBuffer;
+	uint64_t mNextId = 1;
+	long long mLastTimestamp = 0;
+	std::unordered_map<std::string, uint64_t> mStrings;
+	std::unordered_map<uint64_t, uint64_t> mThreads;
+	std::unordered_map<std::string, std::unique_ptr<BinaryLogFormat>> mFormats;
+	std::unordered_map<const char *, BinaryLogFormat *> mFormatsByAddress;
+};
+
+void binaryLogHandlerFunc(void *info, const char *domain, BctbxLogLevel level, const char *fmt, va_list args) {
+	BinaryLogWriter *writer = (BinaryLogWriter *)info;
+	if (writer == nullptr) return;
+	std::lock_guard<std::mutex> lock(writer->mMutex);
+	writer->write(domain, level, fmt, args);
+}
+
+void binaryLogHandlerDestroy(bctbx_log_handler_t *handler) {
+	delete (BinaryLogWriter *)bctbx_log_handler_get_user_data(handler);
+	bctbx_free(handler);
+}
+
+class BinaryLogReader {
+public:
+	BinaryLogReader(FILE *file) : mFile(file) {
+	}
+
+	bool readByte(uint8_t &byte) {
+		int c = getc(mFile);
+		if (c == EOF) return false;
+		byte = (uint8_t)c;
+		return true;
+	}
+
+	bool readVarint(uint64_t &value) {
+		value = 0;
+		for (unsigned int shift = 0; shift < 64; shift += 7) {
+			uint8_t byte;
+			if (!readByte(byte)) return false;
+			value |= (uint64_t)(byte & 0x7f) << shift;
+			if ((byte & 0x80) == 0) return true;
+		}
+		return false;
+	}
+
+	bool readSigned(long long &value) {
+		uint64_t encoded;
+		if (!readVarint(encoded)) return false;
+		value = (long long)((encoded >> 1) ^ (~(encoded & 1) + 1));
+		return true;
+	}
+
+	bool readBytes(void *data, size_t size) {
+		return fread(data, 1, size, mFile) == size;
+	}
+
+	/* Sets isNull for a NULL string. The buffer only grows with the bytes actually read, a file may be corrupted */
+	bool readString(std::string &str, bool &isNull) {
+		uint64_t length;
+		if (!readVarint(length) || length > kMaxStringLength + 1) return false;
+		isNull = length == 0;
+		size_t size = length ? (size_t)length - 1 : 0;
+		str.clear();
+		while (str.size() < size) {
+			size_t done = str.size();
+			str.resize(done + std::min(size - done, kReadChunkSize));
+			if (!readBytes(&str[done], str.size() - done)) return false;
+		}
+		return true;
+	}
+
+private:
+	FILE *mFile;
+};
+
+/* Format a single conversion, the '*' of its spec being replaced by their recorded values */
+template <typename T>
+void appendConversion(std::string &out, const std::string &spec, const std::vector<long long> &stars, T value) {
+	std::string resolved;
+	size_t star = 0;
+	for (size_t i = 0; i < spec.size(); ++i) {
+		if (spec[i] != '*') {
+			resolved += spec[i];
+		} else if (star < stars.size()) {
+			long long starValue = stars[star++];
+			/* a negative precision is taken as if the precision were omitted */
+			if (starValue < 0 && !resolved.empty() && resolved.back() == '.') resolved.pop_back();
+			else resolved += std::to_string(starValue);
+		}
+	}
+	int size = snprintf(nullptr, 0, resolved.c_str(), value);
+	if (size <= 0) return;
+	std::vector<char> buffer((size_t)size + 1);
+	snprintf(buffer.data(), buffer.size(), resolved.c_str(), value);
+	out.append(buffer.data(), (size_t)size);
+}
+
+bool decodeMessage(BinaryLogReader &reader, const std::vector<FormatSegment> &segments, std::string &msg) {
+	std::vector<long long> stars;
+	for (const auto &segment : segments) {
+		msg += segment.mLiteral;
+		stars.clear();
+		for (uint8_t i = 0; i < segment.mStars; ++i) {
+			long long value;
+			if (!reader.readSigned(value)) return false;
+			stars.push_back(value);
+		}
+		switch (segment.mClass) {
+			case ArgClass::None:
+				break;
+			case ArgClass::Signed: {
+				long long value;
+				if (!reader.readSigned(value)) return false;
+				appendConversion(msg, segment.mSpec, stars, value);
+			} break;
+			case ArgClass::Unsigned: {
+				uint64_t value;
+				if (!reader.readVarint(value)) return false;
+				appendConversion(msg, segment.mSpec, stars, (unsigned long long)value);
+			} break;
+			case ArgClass::Char: {
+				long long value;
+				if (!reader.readSigned(value)) return false;
+				appendConversion(msg, segment.mSpec, stars, (int)value);
+			} break;
+			case ArgClass::Double:
+			case ArgClass::LongDouble: {
+				double value;
+				if (!reader.readBytes(&value, sizeof(value))) return false;
+				appendConversion(msg, segment.mSpec, stars, value);
+			} break;
+			case ArgClass::String: {
+				std::string value;
+				bool isNull;
+				if (!reader.readString(value, isNull)) return false;
+				appendConversion(msg, segment.mSpec, stars, isNull ? "(null)" : value.c_str());
+			} break;
+			case ArgClass::Pointer: {
+				uint64_t value;
+				if (!reader.readVarint(value)) return false;
+				appendConversion(msg, segment.mSpec, stars, (void *)(uintptr_t)value);
+			} break;
+		}
+	}
+	return true;
+}
+
+/* A string of a binary log: a domain or a format, parsed when first used as such */
+struct DecodedString {
+	std::string mText;
+	bool mParsed = false;
+	std::vector<FormatSegment> mSegments;
+};
+
+int decodeBinaryLog(FILE *in, FILE *out, int flags) {
+	BinaryLogReader reader(in);
+	std::vector<DecodedString> strings;
+	std::vector<uint64_t> threads;
+	long long timestamp = 0;
+	std::string text, msg, tags;
+	int count = 0;
+	uint8_t type;
+	bool headerRead = false;
+
+	while (reader.readByte(type)) {
+		if (type == (uint8_t)kMagic[0]) {
+			char magic[kMagicSize];
+			magic[0] = (char)type;
+			if (!reader.readBytes(magic + 1, kMagicSize - 1) || memcmp(magic, kMagic, kMagicSize) != 0) break;
+			/* a new session, appended to the file: the identifiers start over */
+			strings.clear();
+			threads.clear();
+			timestamp = 0;
+			headerRead = true;
+			continue;
+		}
+		if (!headerRead) break;
+
+		if (type == kStringRecord) {
+			uint64_t id;
+			bool isNull;
+			if (!reader.readVarint(id) || !reader.readString(text, isNull)) break;
+			/* the identifiers are given in sequence */
+			if (id > strings.size() + 1) break;
+			if (id >= strings.size()) strings.resize((size_t)id + 1);
+			strings[(size_t)id] = DecodedString();
+			strings[(size_t)id].mText = text;
+			continue;
+		}
+		if (type == kThreadRecord) {
+			uint64_t id, thread;
+			if (!reader.readVarint(id) || !reader.readVarint(thread) || id > threads.size()) break;
+			if (id >= threads.size()) threads.resize((size_t)id + 1);
+			threads[(size_t)id] = thread;
+			continue;
+		}
+		if (type != kMessageRecord) break;
+
+		uint64_t formatId, domainId, threadId, tagCount;
+		long long elapsed;
+		uint8_t level;
+		if (!reader.readVarint(formatId) || !reader.readVarint(domainId) || !reader.readByte(level) ||
+		    !reader.readSigned(elapsed) || !reader.readVarint(threadId) || !reader.readVarint(tagCount))
+			break;
+		if (formatId == 0 || formatId >= strings.size() || domainId >= strings.size() || threadId >= threads.size())
+			break;
+		timestamp += elapsed;
+		tags.clear();
+		bool valid = true;
+		for (uint64_t i = 0; i < tagCount && valid; ++i) {
+			bool isNull;
+			valid = reader.readString(text, isNull);
+			tags += "[" + text + "]";
+		}
+		DecodedString &format = strings[(size_t)formatId];
+		if (!format.mParsed) {
+			format.mParsed = true;
+			if (!parseFormat(format.mText.c_str(), format.mSegments)) format.mSegments.clear();
+		}
+		msg.clear();
+		if (!valid || !decodeMessage(reader, format.mSegments, msg)) break;
+
+		time_t tt = (time_t)(timestamp / 1000000);
+		struct tm *lt;
+#ifdef _WIN32
+		lt = localtime(&tt);
+#else
+		struct tm tmbuf;
+		lt = localtime_r(&tt, &tmbuf);
+#endif
+		fprintf(out, "%i-%.2i-%.2i %.2i:%.2i:%.2i:%.3i ", 1900 + lt->tm_year, 1 + lt->tm_mon, lt->tm_mday,
+		        lt->tm_hour, lt->tm_min, lt->tm_sec, (int)((timestamp % 1000000) / 1000));
+		if (flags & BCTBX_BINARY_LOG_DECODE_THREADS)
+			fprintf(out, "[%llx] ", (unsigned long long)threads[(size_t)threadId]);
+		fprintf(out, "%s-%s-%s %s\n", domainId ? strings[(size_t)domainId].mText.c_str() : "bctoolbox",
+		        bctbx_log_level_name((BctbxLogLevel)level), tags.c_str(), msg.c_str());
+		count++;
+	}
+	return headerRead ? count : -1;
+}
+
+} // namespace
+
+} // namespace bctoolbox
+
+using namespace bctoolbox;
+
+bctbx_log_handler_t *bctbx_create_binary_log_handler(const char *path, const char *name) {
+	char *full_name = bctbx_strdup_printf("%s/%s", path, name);
+	FILE *f = fopen(full_name, "ab");
+	if (f == NULL) {
+		fprintf(stderr, "error while opening '%s': %s\n", full_name, strerror(errno));
+		bctbx_free(full_name);
+		return NULL;
+	}
+	bctbx_free(full_name);
+	return bctbx_create_log_handler(binaryLogHandlerFunc, binaryLogHandlerDestroy, new BinaryLogWriter(f));
+}
+
+void bctbx_binary_log_handler_flush(bctbx_log_handler_t *handler) {
+	BinaryLogWriter *writer = (BinaryLogWriter *)bctbx_log_handler_get_user_data(handler);
+	std::lock_guard<std::mutex> lock(writer->mMutex);
+	writer->flush();
+}
+
+int bctbx_decode_binary_log(FILE *in, FILE *out, int flags) {
+	try {
+		return decodeBinaryLog(in, out, flags);
+	} catch (const std::bad_alloc &) {
+		bctbx_error("bctbx_decode_binary_log: out of memory, the file may be corrupted");
+		return -1;
+	}
+}
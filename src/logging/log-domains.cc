@@ -0,0 +1,370 @@
+/*
+ * Copyright (c) 2025 Belledonne Communications SARL.
+ *
+ * This file is part of bctoolbox.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "bctoolbox/defs.h"
+#include "bctoolbox/logging.h"
+#include "logging_private.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// someone does include the evil windef.h so we must undef the min and max macros to be able to use std::min and
+// std::max
+#undef min
+#undef max
+
+/*
+ * Exclude windows and android for bctbx_set_thread_log_level() implementation.
+ * Android has lots of bugs around thread local storage and JVM.
+ */
+#if !defined(_WIN32) && !defined(__ANDROID__)
+#define THREAD_LOG_LEVEL_ENABLED 1
+#endif
+
+using namespace std;
+
+/*
+ * A log domain. Domains are never destroyed, so that a handle obtained once remains valid and can be checked without
+ * any lock.
+ */
+struct _bctbx_log_domain {
+	/* Set in the mask of a domain whose level was never set: it then follows the default domain. */
+	static constexpr unsigned int kInheritMask = 1u << 31;
+	/* The rate limit of a domain for which none was set: it then follows the default domain. */
+	static constexpr uint64_t kInheritRateLimit = ~(uint64_t)0;
+
+	_bctbx_log_domain(const char *name, unsigned int id, unsigned int mask)
+	    : mName(name ? name : ""), mId(id), mIsDefault(name == nullptr) {
+		mLogMask.store(mask, memory_order_relaxed);
+	}
+
+	const string mName;
+	const unsigned int mId; /* Dense index of the domain, 0 for the default one. */
+	const bool mIsDefault;
+	atomic<unsigned int> mLogMask{0};
+	/* Messages per second in the upper 32 bits, burst in the lower ones. */
+	atomic<uint64_t> mRateLimit{kInheritRateLimit};
+};
+
+namespace bctoolbox {
+
+namespace {
+
+using LogDomain = _bctbx_log_domain;
+
+#ifdef THREAD_LOG_LEVEL_ENABLED
+/*
+ * The log levels set for the calling thread by bctbx_set_thread_log_level(), indexed by domain ID, 0 meaning none.
+ * The count of levels set is kept apart, in a trivially constructed variable, so that the threads that never set any
+ * only pay for a single compare.
+ */
+thread_local unsigned int tThreadLevelCount = 0;
+thread_local vector<unsigned int> tThreadLevelMasks;
+
+unsigned int getThreadLogLevelMask(const LogDomain *domain) {
+	if (tThreadLevelCount == 0) return 0;
+	return domain->mId < tThreadLevelMasks.size() ? tThreadLevelMasks[domain->mId] : 0;
+}
+
+void setThreadLogLevelMask(const LogDomain *domain, unsigned int mask) {
+	if (domain->mId >= tThreadLevelMasks.size()) {
+		if (mask == 0) return;
+		tThreadLevelMasks.resize(domain->mId + 1, 0);
+	}
+	unsigned int &current = tThreadLevelMasks[domain->mId];
+	if (current == 0 && mask != 0) tThreadLevelCount++;
+	else if (current != 0 && mask == 0) tThreadLevelCount--;
+	current = mask;
+}
+#endif
+
+/*
+ * Immutable open addressing hash table of the named domains. Lookups read the current table without locking; an
+ * insertion copies it into a new one and publishes it. Replaced tables are kept, chained from the new one, because a
+ * concurrent lookup may still be reading them.
+ */
+class LogDomainTable {
+public:
+	LogDomainTable(size_t capacity, const LogDomainTable *previous)
+	    : mCapacity(capacity), mSlots(new LogDomain *[capacity]()), mPrevious(previous) {
+	}
+	LogDomainTable(const LogDomainTable &) = delete;
+
+	static uint32_t hash(const char *name) {
+		uint32_t h = 2166136261u; /* FNV-1a */
+		for (; *name != '\0'; ++name) {
+			h ^= (unsigned char)*name;
+			h *= 16777619u;
+		}
+		return h;
+	}
+
+	LogDomain *find(const char *name, uint32_t h) const {
+		for (size_t i = h & (mCapacity - 1);; i = (i + 1) & (mCapacity - 1)) {
+			LogDomain *domain = mSlots[i];
+			if (domain == nullptr) return nullptr;
+			if (strcmp(domain->mName.c_str(), name) == 0) return domain;
+		}
+	}
+
+	/* Only used while filling a table not published yet. */
+	void insert(LogDomain *domain) {
+		size_t i = hash(domain->mName.c_str()) & (mCapacity - 1);
+		while (mSlots[i] != nullptr)
+			i = (i + 1) & (mCapacity - 1);
+		mSlots[i] = domain;
+		mCount++;
+	}
+
+	/* Returns a new table holding the domains of this one plus the given one, with a load factor below 1/2. */
+	const LogDomainTable *with(LogDomain *domain) const {
+		size_t capacity = mCapacity;
+		while ((mCount + 1) * 2 > capacity)
+			capacity *= 2;
+		LogDomainTable *table = new LogDomainTable(capacity, this);
+		for (size_t i = 0; i < mCapacity; ++i) {
+			if (mSlots[i]) table->insert(mSlots[i]);
+		}
+		table->insert(domain);
+		return table;
+	}
+
+private:
+	const size_t mCapacity;
+	size_t mCount = 0;
+	LogDomain **const mSlots;
+	[[maybe_unused]] const LogDomainTable *const mPrevious;
+};
+
+class LogDomains {
+public:
+	static LogDomains &get() {
+		/* Never destroyed: logs may still be emitted by the destructors of other static objects. */
+		static LogDomains *sInstance = new LogDomains();
+		return *sInstance;
+	}
+
+	LogDomain *getDefault() {
+		return &mDefault;
+	}
+
+	/* Returns the named domain, or NULL if it does not exist. */
+	LogDomain *find(const char *name) const {
+		if (name == nullptr) return const_cast<LogDomain *>(&mDefault);
+		return mTable.load(memory_order_acquire)->find(name, LogDomainTable::hash(name));
+	}
+
+	/* Returns the named domain, creating it if needed. */
+	LogDomain *findOrCreate(const char *name) {
+		LogDomain *domain = find(name);
+		if (domain) return domain;
+		lock_guard<mutex> lock(mInsertMutex);
+		const LogDomainTable *table = mTable.load(memory_order_relaxed);
+		domain = table->find(name, LogDomainTable::hash(name));
+		if (domain == nullptr) {
+			domain = new LogDomain(name, mCount.load(memory_order_relaxed), LogDomain::kInheritMask);
+			mCount.fetch_add(1, memory_order_release);
+			mTable.store(table->with(domain), memory_order_release);
+		}
+		return domain;
+	}
+
+	unsigned int getCount() const {
+		return mCount.load(memory_order_acquire);
+	}
+
+	/* The mask applying to a domain on the calling thread. */
+	unsigned int getEffectiveMask(const LogDomain *domain) const {
+		unsigned int logmask = 0;
+#ifdef THREAD_LOG_LEVEL_ENABLED
+		logmask = getThreadLogLevelMask(domain);
+#endif
+		if (logmask != 0) return logmask;
+		logmask = domain->mLogMask.load(memory_order_relaxed);
+		if (logmask & LogDomain::kInheritMask) return getEffectiveMask(&mDefault);
+		return logmask;
+	}
+
+	void setRateLimit(LogDomain *domain, uint64_t rateLimit) {
+		domain->mRateLimit.store(rateLimit, memory_order_relaxed);
+		if (rateLimit != 0) mRateLimitSet.store(true, memory_order_relaxed);
+	}
+
+	bool hasRateLimits() const {
+		return mRateLimitSet.load(memory_order_relaxed);
+	}
+
+	/* The rate limit applying to a domain, 0 if there is none. */
+	uint64_t getEffectiveRateLimit(const LogDomain *domain) const {
+		uint64_t rateLimit = domain->mRateLimit.load(memory_order_relaxed);
+		if (rateLimit == LogDomain::kInheritRateLimit) rateLimit = mDefault.mRateLimit.load(memory_order_relaxed);
+		return rateLimit == LogDomain::kInheritRateLimit ? 0 : rateLimit;
+	}
+
+private:
+	LogDomains() : mDefault(nullptr, 0, BCTBX_LOG_WARNING | BCTBX_LOG_ERROR | BCTBX_LOG_FATAL) {
+		mTable.store(new LogDomainTable(16, nullptr), memory_order_relaxed);
+	}
+
+	LogDomain mDefault;
+	atomic<const LogDomainTable *> mTable{nullptr};
+	atomic<unsigned int> mCount{1}; /* Number of domains, including the default one. */
+	mutex mInsertMutex;
+	/* Set once a rate limit has been set for any domain, so that the others do not pay for it. */
+	atomic<bool> mRateLimitSet{false};
+};
+
+unsigned int levelToMask(BctbxLogLevel level) {
+	unsigned int levelmask = BCTBX_LOG_FATAL;
+	if (level <= BCTBX_LOG_ERROR) {
+		levelmask |= BCTBX_LOG_ERROR;
+	}
+	if (level <= BCTBX_LOG_WARNING) {
+		levelmask |= BCTBX_LOG_WARNING;
+	}
+	if (level <= BCTBX_LOG_MESSAGE) {
+		levelmask |= BCTBX_LOG_MESSAGE;
+	}
+	if (level <= BCTBX_LOG_TRACE) {
+		levelmask |= BCTBX_LOG_TRACE;
+	}
+	if (level <= BCTBX_LOG_DEBUG) {
+		levelmask |= BCTBX_LOG_DEBUG;
+	}
+	return levelmask;
+}
+
+} // namespace
+
+} // namespace bctoolbox
+
+using namespace bctoolbox;
+
+/**
+ * @ param levelmask a mask of BCTBX_DEBUG, BCTBX_MESSAGE, BCTBX_WARNING, BCTBX_ERROR
+ * BCTBX_FATAL .
+ **/
+void bctbx_set_log_level_mask(const char *domain, int levelmask) {
+	LogDomains::get().findOrCreate(domain)->mLogMask.store((unsigned int)levelmask & ~LogDomain::kInheritMask,
+	                                                       memory_order_relaxed);
+}
+
+/**
+ * Set log level
+ **/
+void bctbx_set_log_level(const char *domain, BctbxLogLevel level) {
+	bctbx_set_log_level_mask(domain, (int)levelToMask(level));
+}
+
+unsigned int bctbx_get_log_level_mask(const char *domain) {
+	LogDomains &domains = LogDomains::get();
+	LogDomain *ld = domains.find(domain);
+	if (!ld) ld = domains.getDefault();
+	unsigned int logmask = ld->mLogMask.load(memory_order_relaxed);
+	if (logmask & LogDomain::kInheritMask) logmask = domains.getDefault()->mLogMask.load(memory_order_relaxed);
+	return logmask;
+}
+
+int bctbx_log_level_enabled(const char *domain, BctbxLogLevel level) {
+	LogDomains &domains = LogDomains::get();
+	LogDomain *ld = domains.find(domain);
+	if (!ld) ld = domains.getDefault();
+	return (domains.getEffectiveMask(ld) & (unsigned int)level) != 0;
+}
+
+bctbx_log_domain_handle_t bctbx_get_log_domain_handle(const char *domain) {
+	return LogDomains::get().findOrCreate(domain);
+}
+
+const char *bctbx_log_domain_handle_get_name(bctbx_log_domain_handle_t handle) {
+	if (handle == nullptr || handle->mIsDefault) return nullptr;
+	return handle->mName.c_str();
+}
+
+bctbx_log_domain_handle_t bctbx_find_log_domain_handle(const char *domain) {
+	return LogDomains::get().find(domain);
+}
+
+unsigned int bctbx_log_domain_handle_get_id(bctbx_log_domain_handle_t handle) {
+	return handle ? handle->mId : 0;
+}
+
+unsigned int bctbx_get_log_domain_count(void) {
+	return LogDomains::get().getCount();
+}
+
+void bctbx_set_log_rate_limit(const char *domain, unsigned int rate, unsigned int burst) {
+	LogDomains &domains = LogDomains::get();
+	domains.setRateLimit(domains.findOrCreate(domain), (rate == 0) ? 0 : ((uint64_t)rate << 32) | std::max(burst, 1u));
+}
+
+bool_t bctbx_log_rate_limits_set(void) {
+	return LogDomains::get().hasRateLimits() ? TRUE : FALSE;
+}
+
+bool_t bctbx_log_domain_handle_get_rate_limit(bctbx_log_domain_handle_t handle,
+                                              unsigned int *rate,
+                                              unsigned int *burst) {
+	LogDomains &domains = LogDomains::get();
+	uint64_t rateLimit = domains.getEffectiveRateLimit(handle ? handle : domains.getDefault());
+	if (rateLimit == 0) return FALSE;
+	*rate = (unsigned int)(rateLimit >> 32);
+	*burst = (unsigned int)(rateLimit & 0xffffffffu);
+	return TRUE;
+}
+
+int bctbx_log_handle_level_enabled(bctbx_log_domain_handle_t handle, BctbxLogLevel level) {
+	LogDomains &domains = LogDomains::get();
+	return (domains.getEffectiveMask(handle ? handle : domains.getDefault()) & (unsigned int)level) != 0;
+}
+
+#ifndef _MSC_VER
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+#endif // _MSC_VER
+void bctbx_set_thread_log_level(const char *domain, BctbxLogLevel level) {
+#ifdef THREAD_LOG_LEVEL_ENABLED
+	setThreadLogLevelMask(LogDomains::get().findOrCreate(domain), levelToMask(level));
+#endif
+}
+#ifndef _MSC_VER
+#pragma GCC diagnostic pop
+#endif // _MSC_VER
+
+#ifndef _MSC_VER
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+#endif // _MSC_VER
+void bctbx_clear_thread_log_level(const char *domain) {
+#ifdef THREAD_LOG_LEVEL_ENABLED
+	LogDomain *ld = LogDomains::get().find(domain);
+	if (ld) setThreadLogLevelMask(ld, 0);
+#endif
+}
+#ifndef _MSC_VER
+#pragma GCC diagnostic pop
+#endif // _MSC_VER
@@ -0,0 +1,360 @@
+/*
+ * Copyright (c) 2025 Belledonne Communications SARL.
+ *
+ * This file is part of bctoolbox.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "bctoolbox/logging.h"
+#include "logging_private.h"
+
+#include <cerrno>
+#include <clocale>
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/* std::to_chars() is locale independent, but its floating point overloads came late in some standard libraries */
+#if defined(__has_include)
+#if __has_include(<charconv>)
+#include <charconv>
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+#define BCTBX_HAVE_TO_CHARS_DOUBLE
+#endif
+#endif
+#endif
+
+namespace bctoolbox {
+
+namespace {
+
+void appendUnsigned(std::string &out, uint64_t value, int width = 1) {
+	char digits[24];
+	int count = 0;
+	do {
+		digits[count++] = (char)('0' + value % 10);
+		value /= 10;
+	} while (value != 0);
+	while (count < width)
+		digits[count++] = '0';
+	while (count > 0)
+		out.push_back(digits[--count]);
+}
+
+void appendSigned(std::string &out, int64_t value) {
+	if (value < 0) {
+		out.push_back('-');
+		appendUnsigned(out, (uint64_t)0 - (uint64_t)value);
+	} else {
+		appendUnsigned(out, (uint64_t)value);
+	}
+}
+
+/* The shortest representation giving back the same number, with a '.' whatever the locale */
+void appendDouble(std::string &out, double value) {
+	char buffer[32];
+#ifdef BCTBX_HAVE_TO_CHARS_DOUBLE
+	std::to_chars_result result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+	out.append(buffer, result.ptr);
+#else
+	/* snprintf() and strtod() both follow LC_NUMERIC: check the round trip first, then fix the decimal point */
+	snprintf(buffer, sizeof(buffer), "%.15g", value);
+	if (strtod(buffer, nullptr) != value) snprintf(buffer, sizeof(buffer), "%.17g", value);
+	const char *decimalPoint = localeconv()->decimal_point;
+	size_t decimalPointLength = strlen(decimalPoint);
+	char *found = (decimalPointLength > 0) ? strstr(buffer, decimalPoint) : nullptr;
+	if (found) {
+		out.append(buffer, found).push_back('.');
+		out.append(found + decimalPointLength);
+	} else {
+		out.append(buffer);
+	}
+#endif
+}
+
+/* Append a value of a text message, quoted if it contains spaces, quotes or equal signs */
+void appendTextValue(std::string &out, const char *value) {
+	bool quote = (*value == '\0');
+	for (const char *c = value; *c != '\0' && !quote; ++c) {
+		quote = (*c == ' ' || *c == '"' || *c == '=' || (unsigned char)*c < 0x20);
+	}
+	if (!quote) {
+		out.append(value);
+		return;
+	}
+	out.push_back('"');
+	for (const char *c = value; *c != '\0'; ++c) {
+		if (*c == '"' || *c == '\\') out.push_back('\\');
+		if (*c == '\n') out.append("\\n");
+		else out.push_back(*c);
+	}
+	out.push_back('"');
+}
+
+void appendJsonString(std::string &out, const char *value) {
+	static const char kHexDigits[] = "0123456789abcdef";
+	out.push_back('"');
+	for (const char *c = value; *c != '\0'; ++c) {
+		unsigned char byte = (unsigned char)*c;
+		switch (byte) {
+			case '"':
+				out.append("\\\"");
+				break;
+			case '\\':
+				out.append("\\\\");
+				break;
+			case '\n':
+				out.append("\\n");
+				break;
+			case '\r':
+				out.append("\\r");
+				break;
+			case '\t':
+				out.append("\\t");
+				break;
+			default:
+				if (byte < 0x20) {
+					out.append("\\u00");
+					out.push_back(kHexDigits[byte >> 4]);
+					out.push_back(kHexDigits[byte & 0xf]);
+				} else {
+					out.push_back((char)byte);
+				}
+				break;
+		}
+	}
+	out.push_back('"');
+}
+
+void appendJsonValue(std::string &out, const bctbx_log_field_t &field) {
+	switch (field.type) {
+		case BCTBX_LOG_FIELD_STRING:
+			if (field.value.string_value) appendJsonString(out, field.value.string_value);
+			else out.append("null");
+			break;
+		case BCTBX_LOG_FIELD_INT:
+			appendSigned(out, field.value.int_value);
+			break;
+		case BCTBX_LOG_FIELD_UINT:
+			appendUnsigned(out, field.value.uint_value);
+			break;
+		case BCTBX_LOG_FIELD_DOUBLE:
+			/* JSON has no representation for them */
+			if (std::isfinite(field.value.double_value)) appendDouble(out, field.value.double_value);
+			else out.append("null");
+			break;
+		case BCTBX_LOG_FIELD_BOOL:
+			out.append(field.value.bool_value ? "true" : "false");
+			break;
+	}
+}
+
+void appendJsonObject(std::string &out, const char *name, const bctbx_log_field_t *fields, size_t count) {
+	if (count == 0) return;
+	out.append(",\"").append(name).append("\":{");
+	for (size_t i = 0; i < count; ++i) {
+		if (i > 0) out.push_back(',');
+		appendJsonString(out, fields[i].key);
+		out.push_back(':');
+		appendJsonValue(out, fields[i]);
+	}
+	out.push_back('}');
+}
+
+/*
+ * Renders the JSON lines of a thread in a buffer reused from one message to the other. The date and time are only
+ * rendered again when the second changes.
+ */
+class JsonLineRenderer {
+public:
+	static JsonLineRenderer &get() {
+		thread_local JsonLineRenderer sInstance;
+		return sInstance;
+	}
+
+	const std::string &render(
+	    const char *domain, BctbxLogLevel level, const char *msg, const bctbx_log_field_t *fields, size_t count) {
+		mLine.assign("{\"time\":\"");
+		appendTime();
+		mLine.append("\",\"domain\":");
+		appendJsonString(mLine, domain ? domain : "bctoolbox");
+		mLine.append(",\"level\":\"").append(bctbx_log_level_name(level)).append("\"");
+		size_t tagCount = 0;
+		const bctbx_log_field_t *tags = bctbx_get_log_tag_fields(&tagCount);
+		appendJsonObject(mLine, "tags", tags, tagCount);
+		mLine.append(",\"message\":");
+		appendJsonString(mLine, msg ? msg : "");
+		appendJsonObject(mLine, "fields", fields, count);
+		mLine.append("}\n");
+		return mLine;
+	}
+
+	/* Format a message, directly taking the argument of an already formatted one */
+	const char *format(const char *fmt, va_list args) {
+		va_list ap;
+		va_copy(ap, args);
+		if (strcmp(fmt, "%s") == 0) {
+			const char *msg = va_arg(ap, const char *);
+			va_end(ap);
+			return msg ? msg : "(null)";
+		}
+		int n = vsnprintf(mMessage.data(), mMessage.size(), fmt, ap);
+		va_end(ap);
+		if (n < 0) return "";
+		if ((size_t)n >= mMessage.size()) {
+			mMessage.resize((size_t)n + 1);
+			va_copy(ap, args);
+			vsnprintf(mMessage.data(), mMessage.size(), fmt, ap);
+			va_end(ap);
+		}
+		return mMessage.data();
+	}
+
+private:
+	/* ISO 8601, in UTC, with milliseconds */
+	void appendTime() {
+		struct timeval tp;
+		bctbx_gettimeofday(&tp, NULL);
+		time_t tt = (time_t)tp.tv_sec;
+		if (tt != mCachedSecond) {
+			struct tm tmbuf;
+#ifdef _WIN32
+			gmtime_s(&tmbuf, &tt);
+#else
+			gmtime_r(&tt, &tmbuf);
+#endif
+			mCachedPrefix.clear();
+			appendUnsigned(mCachedPrefix, (uint64_t)(1900 + tmbuf.tm_year), 4);
+			mCachedPrefix.push_back('-');
+			appendUnsigned(mCachedPrefix, (uint64_t)(1 + tmbuf.tm_mon), 2);
+			mCachedPrefix.push_back('-');
+			appendUnsigned(mCachedPrefix, (uint64_t)tmbuf.tm_mday, 2);
+			mCachedPrefix.push_back('T');
+			appendUnsigned(mCachedPrefix, (uint64_t)tmbuf.tm_hour, 2);
+			mCachedPrefix.push_back(':');
+			appendUnsigned(mCachedPrefix, (uint64_t)tmbuf.tm_min, 2);
+			mCachedPrefix.push_back(':');
+			appendUnsigned(mCachedPrefix, (uint64_t)tmbuf.tm_sec, 2);
+			mCachedPrefix.push_back('.');
+			mCachedSecond = tt;
+		}
+		mLine.append(mCachedPrefix);
+		appendUnsigned(mLine, (uint64_t)(tp.tv_usec / 1000), 3);
+		mLine.push_back('Z');
+	}
+
+	std::string mLine;
+	std::vector<char> mMessage = std::vector<char>(256);
+	time_t mCachedSecond = (time_t)-1;
+	std::string mCachedPrefix;
+};
+
+/* Writes the lines of a JSON log handler, each one with a single write so that they are never interleaved */
+class JsonLogWriter {
+public:
+	JsonLogWriter(FILE *file) : mFile(file) {
+	}
+	JsonLogWriter(const JsonLogWriter &) = delete;
+
+	~JsonLogWriter() {
+		fclose(mFile);
+	}
+
+	void write(const std::string &line) {
+		std::lock_guard<std::mutex> lock(mMutex);
+		fwrite(line.data(), 1, line.size(), mFile);
+		fflush(mFile);
+	}
+
+private:
+	std::mutex mMutex;
+	FILE *mFile;
+};
+
+void jsonLogHandlerFunc(void *user_info, const char *domain, BctbxLogLevel level, const char *fmt, va_list args) {
+	JsonLineRenderer &renderer = JsonLineRenderer::get();
+	((JsonLogWriter *)user_info)->write(renderer.render(domain, level, renderer.format(fmt, args), nullptr, 0));
+}
+
+void jsonLogHandlerFieldsFunc(void *user_info,
+                              const char *domain,
+                              BctbxLogLevel level,
+                              const char *msg,
+                              const bctbx_log_field_t *fields,
+                              size_t count) {
+	((JsonLogWriter *)user_info)->write(JsonLineRenderer::get().render(domain, level, msg, fields, count));
+}
+
+void jsonLogHandlerDestroy(bctbx_log_handler_t *handler) {
+	delete (JsonLogWriter *)bctbx_log_handler_get_user_data(handler);
+	bctbx_free(handler);
+}
+
+} // namespace
+
+} // namespace bctoolbox
+
+using namespace bctoolbox;
+
+char *bctbx_log_fields_to_text(const char *msg, const bctbx_log_field_t *fields, size_t count) {
+	std::string text(msg ? msg : "");
+	for (size_t i = 0; i < count; ++i) {
+		const bctbx_log_field_t &field = fields[i];
+		text.append(" ").append(field.key).append("=");
+		switch (field.type) {
+			case BCTBX_LOG_FIELD_STRING:
+				appendTextValue(text, field.value.string_value ? field.value.string_value : "(null)");
+				break;
+			case BCTBX_LOG_FIELD_INT:
+				appendSigned(text, field.value.int_value);
+				break;
+			case BCTBX_LOG_FIELD_UINT:
+				appendUnsigned(text, field.value.uint_value);
+				break;
+			case BCTBX_LOG_FIELD_DOUBLE:
+				appendDouble(text, field.value.double_value);
+				break;
+			case BCTBX_LOG_FIELD_BOOL:
+				text.append(field.value.bool_value ? "true" : "false");
+				break;
+		}
+	}
+	return bctbx_strdup(text.c_str());
+}
+
+bctbx_log_handler_t *bctbx_create_json_log_handler(const char *path, const char *name) {
+	char *full_name = bctbx_strdup_printf("%s/%s", path, name);
+	FILE *f = fopen(full_name, "a");
+	if (f == NULL) {
+		fprintf(stderr, "error while opening '%s': %s\n", full_name, strerror(errno));
+		bctbx_free(full_name);
+		return NULL;
+	}
+	bctbx_free(full_name);
+	bctbx_log_handler_t *handler =
+	    bctbx_create_log_handler(jsonLogHandlerFunc, jsonLogHandlerDestroy, new JsonLogWriter(f));
+	bctbx_log_handler_set_fields_func(handler, jsonLogHandlerFieldsFunc);
+	return handler;
+}
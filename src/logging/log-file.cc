@@ -0,0 +1,430 @@
+/*
+ * Copyright (c) 2025 Belledonne Communications SARL.
+ *
+ * This file is part of bctoolbox.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "bctoolbox/defs.h"
+#include "bctoolbox/logging.h"
+#include "logging_private.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#ifdef _MSC_VER
+#ifndef access
+#define access _access
+#endif
+#ifndef fileno
+#define fileno _fileno
+#endif
+#endif
+
+namespace bctoolbox {
+
+namespace {
+
+/* Buffered lines are written at the latest when they reach this size, whatever the flush policy. */
+constexpr size_t kMaxPendingSize = 1024 * 1024;
+
+void writeAll(int fd, const char *data, size_t size) {
+	while (size > 0) {
+#ifdef _WIN32
+		int n = _write(fd, data, (unsigned int)size);
+#else
+		ssize_t n = write(fd, data, size);
+#endif
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			return;
+		}
+		data += n;
+		size -= (size_t)n;
+	}
+}
+
+class FileLogWriter;
+
+/* The writers alive, whose buffered lines are written when the process exits */
+class FileLogWriters {
+public:
+	static FileLogWriters &get() {
+		/* Never destroyed: the writers are flushed by an atexit handler. */
+		static FileLogWriters *sInstance = new FileLogWriters();
+		return *sInstance;
+	}
+
+	void add(FileLogWriter *writer) {
+		std::lock_guard<std::mutex> lock(mMutex);
+		if (!mAtExitRegistered) {
+			atexit(flushAtExit);
+			mAtExitRegistered = true;
+		}
+		mWriters.insert(writer);
+	}
+
+	void remove(FileLogWriter *writer) {
+		std::lock_guard<std::mutex> lock(mMutex);
+		mWriters.erase(writer);
+	}
+
+private:
+	static void flushAtExit();
+
+	std::mutex mMutex;
+	std::set<FileLogWriter *> mWriters;
+	bool mAtExitRegistered = false;
+};
+
+/*
+ * Writes the lines of a file log handler, either directly or through a buffer according to its flush policy. The
+ * rotation of the files, the reopening and the periodic flushes are done by a worker thread, started the first time
+ * it is needed: meanwhile the lines are buffered. Each writer has its own mutex, so that handlers writing to different
+ * files do not wait for each other.
+ */
+class FileLogWriter {
+public:
+	FileLogWriter(FILE *file, const char *path, const char *name, uint64_t maxSize, uint64_t size)
+	    : mPath(path ? path : ""), mName(name ? name : ""), mMaxSize(maxSize), mSize(size), mFile(file) {
+		FileLogWriters::get().add(this);
+	}
+	FileLogWriter(const FileLogWriter &) = delete;
+
+	~FileLogWriter() {
+		FileLogWriters::get().remove(this);
+		stopWorker();
+		std::lock_guard<std::mutex> lock(mMutex);
+		writePending();
+		if (mFile) fclose(mFile);
+	}
+
+	void setFile(FILE *file) {
+		std::lock_guard<std::mutex> lock(mMutex);
+		writePending();
+		mFile = file;
+	}
+
+	void log(BctbxLogLevel level, const char *line, size_t length) {
+		std::lock_guard<std::mutex> lock(mMutex);
+		if (mFile == nullptr && !mRotating) return;
+		if (mPolicy == BCTBX_LOG_FLUSH_EVERY_MESSAGE && !mRotating && mPending.empty()) {
+			size_t written = fwrite(line, 1, length, mFile);
+			fflush(mFile);
+			mSize += written;
+		} else {
+			mPending.insert(mPending.end(), line, line + length);
+			if (!mRotating && mustFlush(level)) writePending();
+		}
+		/* Reopening a log file that has reached the size limit automatically triggers the rotation. */
+		if (mMaxSize > 0 && mSize > mMaxSize) requestReopenLocked();
+	}
+
+	void requestReopen() {
+		std::lock_guard<std::mutex> lock(mMutex);
+		requestReopenLocked();
+	}
+
+	void setFlushPolicy(BctbxLogFlushPolicy policy, uint64_t value) {
+		/* the worker would not wait between two flushes */
+		if (policy == BCTBX_LOG_FLUSH_INTERVAL && value == 0) policy = BCTBX_LOG_FLUSH_EVERY_MESSAGE;
+		std::lock_guard<std::mutex> lock(mMutex);
+		mPolicy = policy;
+		mPolicyValue = value;
+		writePending();
+		if (policy == BCTBX_LOG_FLUSH_INTERVAL) wakeWorker();
+	}
+
+	void flush() {
+		std::lock_guard<std::mutex> lock(mMutex);
+		if (!mRotating) writePending();
+	}
+
+private:
+	/* Must be called with mMutex held. */
+	void requestReopenLocked() {
+		if (mRotating || mName.empty()) return;
+		mRotating = true;
+		wakeWorker();
+	}
+
+	bool mustFlush(BctbxLogLevel level) const {
+		if (mPending.size() >= kMaxPendingSize || level == BCTBX_LOG_FATAL) return true;
+		switch (mPolicy) {
+			case BCTBX_LOG_FLUSH_EVERY_MESSAGE:
+				return true;
+			case BCTBX_LOG_FLUSH_INTERVAL:
+				return false; // the worker takes care of it
+			case BCTBX_LOG_FLUSH_SIZE:
+				return mPending.size() >= mPolicyValue;
+			case BCTBX_LOG_FLUSH_WARNING:
+				return level >= BCTBX_LOG_WARNING;
+		}
+		return true;
+	}
+
+	/* Must be called with mMutex held. */
+	void writePending() {
+		if (mPending.empty() || mFile == nullptr) return;
+		fflush(mFile);
+		writeAll(fileno(mFile), mPending.data(), mPending.size());
+		mSize += mPending.size();
+		mPending.clear();
+	}
+
+	/* Must be called with mMutex held. */
+	void wakeWorker() {
+		{
+			std::lock_guard<std::mutex> lock(mWorkerMutex);
+			mWorkerWakeUp = true;
+		}
+		if (!mWorker.joinable()) mWorker = std::thread(&FileLogWriter::run, this);
+		mWorkerCondition.notify_one();
+	}
+
+	void stopWorker() {
+		{
+			std::lock_guard<std::mutex> lock(mWorkerMutex);
+			mWorkerStop = true;
+		}
+		mWorkerCondition.notify_one();
+		if (mWorker.joinable()) mWorker.join();
+	}
+
+	void run() {
+		bool stop = false;
+		while (!stop) {
+			{
+				std::unique_lock<std::mutex> lock(mWorkerMutex);
+				auto wakeUp = [this]() { return mWorkerWakeUp || mWorkerStop; };
+				if (mPolicy == BCTBX_LOG_FLUSH_INTERVAL) {
+					mWorkerCondition.wait_for(lock, std::chrono::milliseconds(mPolicyValue.load()), wakeUp);
+				} else {
+					mWorkerCondition.wait(lock, wakeUp);
+				}
+				mWorkerWakeUp = false;
+				stop = mWorkerStop;
+			}
+
+			FILE *previous;
+			{
+				std::lock_guard<std::mutex> lock(mMutex);
+				writePending();
+				if (!mRotating) continue;
+				/* The lines logged while the files are renamed are kept in the buffer. */
+				previous = mFile;
+				mFile = nullptr;
+			}
+
+			if (previous) fclose(previous);
+			uint64_t size = 0;
+			FILE *file = open(&size);
+
+			std::lock_guard<std::mutex> lock(mMutex);
+			mFile = file;
+			mSize = size;
+			mRotating = false;
+			writePending();
+		}
+	}
+
+	std::string getFileName(int index) const {
+		std::string fileName = mPath + "/" + mName;
+		if (index > 0) fileName += "_" + std::to_string(index);
+		return fileName;
+	}
+
+	FILE *tryOpen(uint64_t *size) const {
+		FILE *file = fopen(getFileName(0).c_str(), "a");
+		if (file == nullptr) return nullptr;
+
+		struct stat statbuf;
+		fstat(fileno(file), &statbuf);
+		if ((uint64_t)statbuf.st_size > mMaxSize) {
+			fclose(file);
+			return nullptr;
+		}
+		*size = (uint64_t)statbuf.st_size;
+		return file;
+	}
+
+	void rotate() const {
+		int n = 1;
+		while (access(getFileName(n).c_str(), F_OK) != -1) {
+			// file exists
+			n++;
+		}
+		for (; n > 0; --n) {
+			rename(getFileName(n - 1).c_str(), getFileName(n).c_str());
+		}
+	}
+
+	FILE *open(uint64_t *size) const {
+		FILE *file = tryOpen(size);
+		if (file == nullptr) {
+			rotate();
+			file = tryOpen(size);
+		}
+		return file;
+	}
+
+	std::mutex mMutex;
+	const std::string mPath;
+	const std::string mName;
+	const uint64_t mMaxSize;
+	uint64_t mSize;
+	FILE *mFile;
+	std::vector<char> mPending;
+	bool mRotating = false; // the worker is reopening the file
+	std::atomic<BctbxLogFlushPolicy> mPolicy{BCTBX_LOG_FLUSH_EVERY_MESSAGE};
+	std::atomic<uint64_t> mPolicyValue{0};
+
+	std::thread mWorker;
+	std::mutex mWorkerMutex;
+	std::condition_variable mWorkerCondition;
+	bool mWorkerWakeUp = false;
+	bool mWorkerStop = false;
+};
+
+void FileLogWriters::flushAtExit() {
+	FileLogWriters &writers = get();
+	std::lock_guard<std::mutex> lock(writers.mMutex);
+	for (FileLogWriter *writer : writers.mWriters) {
+		writer->flush();
+	}
+}
+
+void fileLogHandlerUninit(bctbx_log_handler_t *handler) {
+	delete (FileLogWriter *)handler->user_info;
+	handler->user_info = nullptr;
+}
+
+void fileLogHandlerDestroy(bctbx_log_handler_t *handler) {
+	fileLogHandlerUninit(handler);
+	if (handler->domain) bctbx_free(handler->domain);
+	bctbx_free(handler);
+}
+
+} // namespace
+
+} // namespace bctoolbox
+
+using namespace bctoolbox;
+
+bctbx_log_handler_t *bctbx_create_file_log_handler(uint64_t max_size, const char *path, const char *name) {
+	bctbx_log_handler_t *handler = NULL;
+	char *full_name = bctbx_strdup_printf("%s/%s", path, name);
+	struct stat buf = {};
+
+	FILE *f = fopen(full_name, "a");
+	if (f == NULL) {
+		fprintf(stderr, "error while opening '%s': %s\n", full_name, strerror(errno));
+		goto end;
+	}
+	if (stat(full_name, &buf) != 0) {
+		fprintf(stderr, "error while gathering info about '%s': %s", full_name, strerror(errno));
+		fclose(f);
+		goto end;
+	}
+
+	handler = bctbx_new0(bctbx_log_handler_t, 1);
+	handler->func = bctbx_logv_file;
+	handler->destroy = fileLogHandlerDestroy;
+	handler->user_info = new FileLogWriter(f, path, name, max_size, (uint64_t)buf.st_size);
+
+end:
+	bctbx_free(full_name);
+	return handler;
+}
+
+void bctbx_file_log_handler_reopen(bctbx_log_handler_t *file_log_handler) {
+	((FileLogWriter *)file_log_handler->user_info)->requestReopen();
+}
+
+void bctbx_file_log_handler_set_flush_policy(bctbx_log_handler_t *file_log_handler,
+                                             BctbxLogFlushPolicy policy,
+                                             uint64_t value) {
+	((FileLogWriter *)file_log_handler->user_info)->setFlushPolicy(policy, value);
+}
+
+void bctbx_file_log_handler_flush(bctbx_log_handler_t *file_log_handler) {
+	((FileLogWriter *)file_log_handler->user_info)->flush();
+}
+
+void bctbx_set_log_file(FILE *f) {
+	static bctbx_log_handler_t handler = {};
+	handler.func = bctbx_logv_file;
+	handler.destroy = fileLogHandlerUninit;
+	if (handler.user_info) {
+		((FileLogWriter *)handler.user_info)->setFile(f);
+	} else {
+		handler.user_info = new FileLogWriter(f, nullptr, nullptr, (uint64_t)-1, 0);
+	}
+	bctbx_add_log_handler(&handler);
+}
+
+void bctbx_logv_file(void *user_info, const char *domain, BctbxLogLevel lev, const char *fmt, va_list args) {
+	size_t length, msg_offset;
+	/* the line is rendered in a buffer of the calling thread, out of the lock */
+	const char *line = bctbx_log_render_line(domain, lev, fmt, args, &length, &msg_offset);
+
+#if defined(_MSC_VER) && !defined(_WIN32_WCE)
+#ifndef _UNICODE
+	OutputDebugStringA(line + msg_offset);
+#else
+	{
+		size_t len = length - msg_offset;
+		wchar_t *tmp = (wchar_t *)bctbx_malloc0((len + 1) * sizeof(wchar_t));
+		mbstowcs(tmp, line + msg_offset, len);
+		OutputDebugStringW(tmp);
+		bctbx_free(tmp);
+	}
+#endif
+#else
+	(void)msg_offset;
+#endif
+
+	FileLogWriter *writer = (FileLogWriter *)user_info;
+	if (writer) {
+		writer->log(lev, line, length);
+	} else {
+		/* a single fwrite() is atomic with respect to the other threads writing to the same stream */
+		fwrite(line, 1, length, stdout);
+		fflush(stdout);
+	}
+}
@@ -0,0 +1,219 @@
+/*
+ * Copyright (c) 2025 Belledonne Communications SARL.
+ *
+ * This file is part of bctoolbox.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "bctoolbox/logging.h"
+#include "logging_private.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <vector>
+
+// someone does include the evil windef.h so we must undef the min and max macros to be able to use std::min and
+// std::max
+#undef min
+#undef max
+
+#if !defined(BCTBX_WINDOWS_UWP) && (defined(_WIN32) || defined(_WIN32_WCE))
+#define ENDLINE "\r\n"
+#else
+#define ENDLINE "\n"
+#endif
+
+namespace bctoolbox {
+
+namespace {
+
+std::atomic<int> sTimestampSource{BCTBX_LOG_TIMESTAMP_WALL_CLOCK};
+const std::chrono::steady_clock::time_point sMonotonicOrigin = std::chrono::steady_clock::now();
+
+/*
+ * Renders the log lines of a thread in a buffer reused from one message to the other. The date and time prefix is
+ * only rendered again when the second changes.
+ */
+class LogLineRenderer {
+public:
+	static LogLineRenderer &get() {
+		thread_local LogLineRenderer sInstance;
+		return sInstance;
+	}
+
+	const char *render(const char *domain,
+	                   BctbxLogLevel level,
+	                   const char *fmt,
+	                   va_list args,
+	                   size_t *length,
+	                   size_t *messageOffset) {
+		mSize = 0;
+		appendTimestamp();
+		append(' ');
+		append(domain ? domain : "bctoolbox");
+		append('-');
+		append(bctbx_log_level_name(level));
+		append('-');
+		append(bctbx_get_log_tags_string());
+		append(' ');
+		*messageOffset = mSize;
+		appendMessage(fmt, args);
+		append(ENDLINE);
+		append('\0');
+		*length = mSize - 1;
+		return mBuffer.data();
+	}
+
+private:
+	void reserve(size_t size) {
+		if (mSize + size > mBuffer.size()) mBuffer.resize(std::max(mSize + size, 2 * mBuffer.size()));
+	}
+
+	void append(char c) {
+		reserve(1);
+		mBuffer[mSize++] = c;
+	}
+
+	void append(const char *str) {
+		size_t length = strlen(str);
+		reserve(length);
+		memcpy(mBuffer.data() + mSize, str, length);
+		mSize += length;
+	}
+
+	/* Append a positive number, left padded with zeros to the given width */
+	void appendNumber(unsigned long long value, int width) {
+		char digits[24];
+		int count = 0;
+		do {
+			digits[count++] = (char)('0' + value % 10);
+			value /= 10;
+		} while (value != 0 && count < (int)sizeof(digits));
+		while (count < width && count < (int)sizeof(digits))
+			digits[count++] = '0';
+		reserve((size_t)count);
+		while (count > 0)
+			mBuffer[mSize++] = digits[--count];
+	}
+
+	void appendTimestamp() {
+		if (sTimestampSource.load(std::memory_order_relaxed) == BCTBX_LOG_TIMESTAMP_MONOTONIC) {
+			auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() -
+			                                                                      sMonotonicOrigin)
+			                   .count();
+			appendNumber((unsigned long long)elapsed / 1000000, 1);
+			append('.');
+			appendNumber((unsigned long long)elapsed % 1000000, 6);
+			return;
+		}
+
+		struct timeval tp;
+		bctbx_gettimeofday(&tp, NULL);
+		time_t tt = (time_t)tp.tv_sec;
+		if (tt != mCachedSecond) {
+			struct tm *lt;
+#ifdef _WIN32
+			lt = localtime(&tt);
+#else
+			struct tm tmbuf;
+			lt = localtime_r(&tt, &tmbuf);
+#endif
+			mCachedPrefixLength = (size_t)snprintf(mCachedPrefix, sizeof(mCachedPrefix), "%i-%.2i-%.2i %.2i:%.2i:%.2i:",
+			                                       1900 + lt->tm_year, 1 + lt->tm_mon, lt->tm_mday, lt->tm_hour,
+			                                       lt->tm_min, lt->tm_sec);
+			if (mCachedPrefixLength >= sizeof(mCachedPrefix)) mCachedPrefixLength = sizeof(mCachedPrefix) - 1;
+			mCachedSecond = tt;
+		}
+		reserve(mCachedPrefixLength);
+		memcpy(mBuffer.data() + mSize, mCachedPrefix, mCachedPrefixLength);
+		mSize += mCachedPrefixLength;
+		appendNumber((unsigned long long)(tp.tv_usec / 1000), 3);
+	}
+
+	/* Format the message directly in the buffer, growing it if needed */
+	void appendMessage(const char *fmt, va_list args) {
+		if (fmt[0] == '%' && fmt[1] == 's' && fmt[2] == '\0') {
+			/* an already formatted message, from the C++ log streams for example */
+			va_list ap;
+			va_copy(ap, args);
+			const char *msg = va_arg(ap, const char *);
+			va_end(ap);
+			append(msg ? msg : "(null)");
+			return;
+		}
+		for (;;) {
+			size_t available = mBuffer.size() - mSize;
+			va_list ap;
+			va_copy(ap, args);
+			int n = vsnprintf(mBuffer.data() + mSize, available, fmt, ap);
+			va_end(ap);
+			if (n < 0) return;
+			if ((size_t)n < available) {
+				mSize += (size_t)n;
+				return;
+			}
+			reserve((size_t)n + 1);
+		}
+	}
+
+	std::vector<char> mBuffer = std::vector<char>(256);
+	size_t mSize = 0;
+	time_t mCachedSecond = (time_t)-1;
+	char mCachedPrefix[32];
+	size_t mCachedPrefixLength = 0;
+};
+
+} // namespace
+
+} // namespace bctoolbox
+
+using namespace bctoolbox;
+
+void bctbx_set_log_timestamp_source(BctbxLogTimestampSource source) {
+	sTimestampSource.store(source, std::memory_order_relaxed);
+}
+
+const char *bctbx_log_level_name(BctbxLogLevel level) {
+	switch (level) {
+		case BCTBX_LOG_DEBUG:
+			return "debug";
+		case BCTBX_LOG_TRACE:
+			return "trace";
+		case BCTBX_LOG_MESSAGE:
+			return "message";
+		case BCTBX_LOG_WARNING:
+			return "warning";
+		case BCTBX_LOG_ERROR:
+			return "error";
+		case BCTBX_LOG_FATAL:
+			return "fatal";
+		default:
+			return "badlevel";
+	}
+}
+
+const char *bctbx_log_render_line(
+    const char *domain, BctbxLogLevel level, const char *fmt, va_list args, size_t *length, size_t *message_offset) {
+	return LogLineRenderer::get().render(domain, level, fmt, args, length, message_offset);
+}
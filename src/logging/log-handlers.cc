@@ -0,0 +1,339 @@
+/*
+ * Copyright (c) 2025 Belledonne Communications SARL.
+ *
+ * This file is part of bctoolbox.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "bctoolbox/logging.h"
+#include "logging_private.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdarg>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// someone does include the evil windef.h so we must undef the min and max macros to be able to use std::min and
+// std::max
+#undef min
+#undef max
+
+namespace bctoolbox {
+
+namespace {
+
+/* A registered handler, with a copy of its domain taken when the snapshot was built */
+struct HandlerEntry {
+	bool accepts(const char *domain) const {
+		return mAllDomains || domain == nullptr || mDomain == domain;
+	}
+
+	bctbx_log_handler_t *mHandler;
+	std::string mDomain;
+	bool mAllDomains;
+};
+
+/* The handlers accepting a given domain */
+using HandlerRoute = std::vector<bctbx_log_handler_t *>;
+
+/*
+ * The handlers registered at a given time. A snapshot is never modified once published, except for the routes of the
+ * domains which are computed the first time a message is dispatched to them.
+ */
+class HandlerSnapshot {
+public:
+	HandlerSnapshot(const bctbx_list_t *handlers)
+	    : mRouteCount(std::max(64u, 2 * bctbx_get_log_domain_count())),
+	      mRoutes(new std::atomic<const HandlerRoute *>[mRouteCount]()) {
+		for (const bctbx_list_t *it = handlers; it != nullptr; it = it->next) {
+			bctbx_log_handler_t *handler = (bctbx_log_handler_t *)it->data;
+			if (handler == nullptr) continue;
+			mEntries.push_back({handler, handler->domain ? handler->domain : "", handler->domain == nullptr});
+		}
+	}
+	HandlerSnapshot(const HandlerSnapshot &) = delete;
+
+	~HandlerSnapshot() {
+		for (size_t i = 0; i < mRouteCount; ++i) {
+			delete mRoutes[i].load(std::memory_order_relaxed);
+		}
+	}
+
+	const std::vector<HandlerEntry> &getEntries() const {
+		return mEntries;
+	}
+
+	bool holds(const bctbx_log_handler_t *handler) const {
+		return std::any_of(mEntries.cbegin(), mEntries.cend(),
+		                   [handler](const HandlerEntry &entry) { return entry.mHandler == handler; });
+	}
+
+	/*
+	 * Returns the handlers accepting a domain, NULL if the domain is unknown or was created after the snapshot was
+	 * built
+	 */
+	const HandlerRoute *getRoute(bctbx_log_domain_handle_t handle) const {
+		if (handle == nullptr) return nullptr;
+		unsigned int id = bctbx_log_domain_handle_get_id(handle);
+		if (id >= mRouteCount) return nullptr;
+		const HandlerRoute *route = mRoutes[id].load(std::memory_order_acquire);
+		if (route) return route;
+
+		const char *domain = bctbx_log_domain_handle_get_name(handle);
+		HandlerRoute *computed = new HandlerRoute();
+		for (const auto &entry : mEntries) {
+			if (entry.accepts(domain)) computed->push_back(entry.mHandler);
+		}
+		if (!mRoutes[id].compare_exchange_strong(route, computed, std::memory_order_acq_rel)) {
+			delete computed; // another thread computed it first
+			return route;
+		}
+		return computed;
+	}
+
+private:
+	std::vector<HandlerEntry> mEntries;
+	const size_t mRouteCount;
+	std::unique_ptr<std::atomic<const HandlerRoute *>[]> mRoutes;
+};
+
+/* The snapshot a thread is dispatching a message to, so that it is not freed meanwhile */
+struct HazardSlot {
+	std::atomic<const HandlerSnapshot *> mSnapshot{nullptr};
+	std::atomic<bool> mInUse{true};
+	HazardSlot *mNext = nullptr;
+};
+
+thread_local HazardSlot *sOwnSlot = nullptr;
+thread_local int sDispatchDepth = 0;
+
+/* Give the slot of a thread back when it exits */
+struct HazardSlotReleaser {
+	~HazardSlotReleaser() {
+		if (sOwnSlot) sOwnSlot->mInUse.store(false, std::memory_order_release);
+		sOwnSlot = nullptr;
+	}
+};
+
+class HandlerRegistry {
+public:
+	static HandlerRegistry &get() {
+		/* Never destroyed: logs may still be emitted by the destructors of other static objects. */
+		static HandlerRegistry *sInstance = new HandlerRegistry();
+		return *sInstance;
+	}
+
+	void publish(const bctbx_list_t *handlers) {
+		const HandlerSnapshot *snapshot = new HandlerSnapshot(handlers);
+		{
+			std::lock_guard<std::mutex> lock(mRetiredMutex);
+			const HandlerSnapshot *previous = mCurrent.exchange(snapshot);
+			mHasHandlers.store(handlers != nullptr, std::memory_order_relaxed);
+			if (previous) mRetired.push_back(previous);
+			// a removed handler added back is not destroyed anymore
+			mRetiredHandlers.erase(std::remove_if(mRetiredHandlers.begin(), mRetiredHandlers.end(),
+			                                      [snapshot](bctbx_log_handler_t *handler) {
+				                                      return snapshot->holds(handler);
+			                                      }),
+			                       mRetiredHandlers.end());
+			mHasRetired.store(!mRetired.empty() || !mRetiredHandlers.empty());
+		}
+		reclaim();
+	}
+
+	/*
+	 * Destroy a removed handler once the snapshots still holding it are freed. It never waits for the dispatching
+	 * threads: the last of them destroys it when releasing its snapshot.
+	 */
+	void retire(bctbx_log_handler_t *handler) {
+		{
+			std::lock_guard<std::mutex> lock(mRetiredMutex);
+			const HandlerSnapshot *current = mCurrent.load();
+			if (current && current->holds(handler)) return; // added back since it was removed
+			if (std::find(mRetiredHandlers.cbegin(), mRetiredHandlers.cend(), handler) == mRetiredHandlers.cend()) {
+				mRetiredHandlers.push_back(handler);
+			}
+			mHasRetired.store(true);
+		}
+		reclaim();
+	}
+
+	bool hasHandlers() const {
+		return mHasHandlers.load(std::memory_order_relaxed);
+	}
+
+	/* Returns the current snapshot and protects it from being freed until release() */
+	const HandlerSnapshot *acquire() {
+		HazardSlot *slot = getOwnSlot();
+		if (sDispatchDepth++ > 0) {
+			/* A handler logging: keep on using the snapshot protected by the outer dispatch. */
+			return slot->mSnapshot.load(std::memory_order_relaxed);
+		}
+		const HandlerSnapshot *snapshot;
+		do {
+			snapshot = mCurrent.load();
+			slot->mSnapshot.store(snapshot);
+		} while (snapshot != mCurrent.load());
+		return snapshot;
+	}
+
+	void release() {
+		if (--sDispatchDepth > 0) return;
+		sOwnSlot->mSnapshot.store(nullptr);
+		if (mHasRetired.load()) reclaim();
+	}
+
+private:
+	HandlerRegistry() = default;
+
+	HazardSlot *getOwnSlot() {
+		if (sOwnSlot) return sOwnSlot;
+		static thread_local HazardSlotReleaser sReleaser;
+		(void)sReleaser;
+		for (HazardSlot *slot = mSlots.load(); slot != nullptr; slot = slot->mNext) {
+			bool inUse = false;
+			if (slot->mInUse.compare_exchange_strong(inUse, true)) return sOwnSlot = slot;
+		}
+		HazardSlot *slot = new HazardSlot();
+		slot->mNext = mSlots.load();
+		while (!mSlots.compare_exchange_weak(slot->mNext, slot)) {
+		}
+		return sOwnSlot = slot;
+	}
+
+	/*
+	 * Free the replaced snapshots no thread is dispatching to anymore, then destroy the removed handlers neither the
+	 * remaining ones nor the current one holds: a handler may be added back before being retired. The handlers are
+	 * destroyed without the mutex held, as they may log.
+	 */
+	void reclaim() {
+		std::vector<bctbx_log_handler_t *> destroyed;
+		{
+			std::lock_guard<std::mutex> lock(mRetiredMutex);
+			mRetired.erase(std::remove_if(mRetired.begin(), mRetired.end(),
+			                              [this](const HandlerSnapshot *snapshot) {
+				                              for (HazardSlot *slot = mSlots.load(); slot != nullptr;
+				                                   slot = slot->mNext) {
+					                              if (slot->mSnapshot.load() == snapshot) return false;
+				                              }
+				                              delete snapshot;
+				                              return true;
+			                              }),
+			               mRetired.end());
+			const HandlerSnapshot *current = mCurrent.load();
+			mRetiredHandlers.erase(std::remove_if(mRetiredHandlers.begin(), mRetiredHandlers.end(),
+			                                      [this, current, &destroyed](bctbx_log_handler_t *handler) {
+				                                      if (current && current->holds(handler)) return false;
+				                                      for (const HandlerSnapshot *snapshot : mRetired) {
+					                                      if (snapshot->holds(handler)) return false;
+				                                      }
+				                                      destroyed.push_back(handler);
+				                                      return true;
+			                                      }),
+			                       mRetiredHandlers.end());
+			mHasRetired.store(!mRetired.empty() || !mRetiredHandlers.empty());
+		}
+		for (bctbx_log_handler_t *handler : destroyed) {
+			handler->destroy(handler);
+		}
+	}
+
+	std::atomic<const HandlerSnapshot *> mCurrent{nullptr};
+	std::atomic<bool> mHasHandlers{false};
+	std::atomic<HazardSlot *> mSlots{nullptr};
+	std::atomic<bool> mHasRetired{false};
+	std::mutex mRetiredMutex;
+	std::vector<const HandlerSnapshot *> mRetired;
+	std::vector<bctbx_log_handler_t *> mRetiredHandlers;
+};
+
+/* Call a function for each handler accepting a domain */
+template <typename Function>
+void forEachHandler(const char *domain, Function function) {
+	HandlerRegistry &registry = HandlerRegistry::get();
+	const HandlerSnapshot *snapshot = registry.acquire();
+	if (snapshot) {
+		/* the domains are only created by the configuration functions, not by logging to them */
+		const HandlerRoute *route = snapshot->getRoute(bctbx_find_log_domain_handle(domain));
+		if (route) {
+			for (bctbx_log_handler_t *handler : *route) {
+				function(handler);
+			}
+		} else {
+			/* an unknown domain or a domain created after the snapshot */
+			for (const auto &entry : snapshot->getEntries()) {
+				if (entry.accepts(domain)) function(entry.mHandler);
+			}
+		}
+	}
+	registry.release();
+}
+
+void callHandler(bctbx_log_handler_t *handler, const char *domain, BctbxLogLevel level, const char *fmt, va_list args) {
+	va_list tmp;
+	va_copy(tmp, args);
+	handler->func(handler->user_info, domain, level, fmt, tmp);
+	va_end(tmp);
+}
+
+void callHandlerf(bctbx_log_handler_t *handler, const char *domain, BctbxLogLevel level, const char *fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+	handler->func(handler->user_info, domain, level, fmt, args);
+	va_end(args);
+}
+
+} // namespace
+
+} // namespace bctoolbox
+
+using namespace bctoolbox;
+
+void bctbx_log_handlers_publish(const bctbx_list_t *handlers) {
+	HandlerRegistry::get().publish(handlers);
+}
+
+void bctbx_log_handlers_retire(bctbx_log_handler_t *handler) {
+	HandlerRegistry::get().retire(handler);
+}
+
+bool_t bctbx_has_log_handlers(void) {
+	return HandlerRegistry::get().hasHandlers() ? TRUE : FALSE;
+}
+
+void bctbx_logv_dispatch(const char *domain, BctbxLogLevel level, const char *fmt, va_list args) {
+	forEachHandler(domain, [&](bctbx_log_handler_t *handler) { callHandler(handler, domain, level, fmt, args); });
+}
+
+void bctbx_log_dispatch_fields(
+    const char *domain, BctbxLogLevel level, const char *msg, const bctbx_log_field_t *fields, size_t count) {
+	char *text = nullptr; // rendered for the first handler not taking the fields
+	forEachHandler(domain, [&](bctbx_log_handler_t *handler) {
+		if (handler->fields_func) {
+			handler->fields_func(handler->user_info, domain, level, msg, fields, count);
+			return;
+		}
+		if (text == nullptr) text = bctbx_log_fields_to_text(msg, fields, count);
+		callHandlerf(handler, domain, level, "%s", text);
+	});
+	if (text) bctbx_free(text);
+}
@@ -0,0 +1,231 @@
+/*
+ * Copyright (c) 2025 Belledonne Communications SARL.
+ *
+ * This file is part of bctoolbox.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "bctoolbox/logging.h"
+#include "logging_private.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// someone does include the evil windef.h so we must undef the min and max macros to be able to use std::min and
+// std::max
+#undef min
+#undef max
+
+namespace bctoolbox {
+
+namespace {
+
+/*
+ * A call site: its domain and the address of the format string literal of its messages, or a hash of the text for
+ * the messages built at runtime, whose address may be reused by unrelated ones.
+ */
+struct CallSite {
+	bool operator==(const CallSite &other) const {
+		return mDomain == other.mDomain && mKey == other.mKey;
+	}
+
+	bctbx_log_domain_handle_t mDomain;
+	uint64_t mKey;
+};
+
+struct CallSiteHash {
+	size_t operator()(const CallSite &site) const {
+		return std::hash<uint64_t>()(site.mKey) * 31 + std::hash<const void *>()(site.mDomain);
+	}
+};
+
+/* 64 bits FNV-1a */
+uint64_t hashText(const char *text) {
+	uint64_t hash = 14695981039346656037ULL;
+	for (const char *c = text; *c != '\0'; ++c) {
+		hash = (hash ^ (uint8_t)*c) * 1099511628211ULL;
+	}
+	return hash;
+}
+
+/* The token bucket of a call site */
+struct CallSiteBucket {
+	double mTokens;
+	std::chrono::steady_clock::time_point mLastRefill;
+	unsigned int mSuppressed;
+	BctbxLogLevel mLevel; /**< the level of the last message dropped */
+	std::string mFormat;  /**< to report the dropped messages, the text may not outlive the call */
+};
+
+/* The messages dropped at a call site whose storm ended, to be reported */
+struct SuppressedReport {
+	std::string mFormat;
+	BctbxLogLevel mLevel;
+	unsigned int mSuppressed;
+};
+
+/*
+ * The token buckets of the call sites, spread over independently locked stripes so that threads logging from different
+ * call sites rarely wait for each other.
+ */
+class RateLimiter {
+public:
+	static RateLimiter &get() {
+		/* Never destroyed: logs may still be emitted by the destructors of other static objects. */
+		static RateLimiter *sInstance = new RateLimiter();
+		return *sInstance;
+	}
+
+	/* Returns false if the message must be dropped, otherwise gives the number of messages dropped before it. */
+	bool allow(const CallSite &site,
+	           const char *fmt,
+	           BctbxLogLevel level,
+	           unsigned int rate,
+	           unsigned int burst,
+	           unsigned int *suppressed) {
+		Stripe &stripe = getStripe(site);
+		auto now = std::chrono::steady_clock::now();
+		std::lock_guard<std::mutex> lock(stripe.mMutex);
+		auto it = stripe.mBuckets.find(site);
+		if (it == stripe.mBuckets.end()) {
+			/* formats built at runtime would make the table grow forever */
+			if (stripe.mBuckets.size() >= kMaxBucketsPerStripe) stripe.mBuckets.clear();
+			it = stripe.mBuckets.emplace(site, CallSiteBucket{(double)burst, now, 0, level, fmt}).first;
+		}
+		CallSiteBucket &bucket = it->second;
+		refill(bucket, now, rate, burst);
+		if (bucket.mTokens < 1.0) {
+			/* reported with the next message of the call site, or of the domain once the storm is over */
+			if (bucket.mSuppressed++ == 0) addPending(site);
+			bucket.mLevel = level;
+			return false;
+		}
+		bucket.mTokens -= 1.0;
+		*suppressed = bucket.mSuppressed;
+		bucket.mSuppressed = 0;
+		return true;
+	}
+
+	/*
+	 * Returns the messages dropped at the call sites of a domain which could log again but did not since, so that the
+	 * last messages of a storm are reported even when its call site stays silent.
+	 */
+	std::vector<SuppressedReport> takeEnded(bctbx_log_domain_handle_t domain, unsigned int rate, unsigned int burst) {
+		std::vector<SuppressedReport> reports;
+		if (mPendingCount.load(std::memory_order_relaxed) == 0) return reports;
+
+		std::vector<CallSite> sites;
+		{
+			std::lock_guard<std::mutex> lock(mPendingMutex);
+			auto end = std::partition(mPending.begin(), mPending.end(),
+			                          [domain](const CallSite &site) { return site.mDomain != domain; });
+			sites.assign(end, mPending.end());
+			mPending.erase(end, mPending.end());
+			mPendingCount.store(mPending.size(), std::memory_order_relaxed);
+		}
+		auto now = std::chrono::steady_clock::now();
+		for (const auto &site : sites) {
+			Stripe &stripe = getStripe(site);
+			std::lock_guard<std::mutex> lock(stripe.mMutex);
+			auto it = stripe.mBuckets.find(site);
+			if (it == stripe.mBuckets.end() || it->second.mSuppressed == 0) continue;
+			CallSiteBucket &bucket = it->second;
+			refill(bucket, now, rate, burst);
+			if (bucket.mTokens < 1.0) {
+				addPending(site); // still dropping messages
+				continue;
+			}
+			reports.push_back({bucket.mFormat, bucket.mLevel, bucket.mSuppressed});
+			bucket.mSuppressed = 0;
+		}
+		return reports;
+	}
+
+private:
+	static constexpr size_t kStripeCount = 64;
+	static constexpr size_t kMaxBucketsPerStripe = 1024;
+
+	struct Stripe {
+		std::mutex mMutex;
+		std::unordered_map<CallSite, CallSiteBucket, CallSiteHash> mBuckets;
+	};
+
+	RateLimiter() = default;
+
+	Stripe &getStripe(const CallSite &site) {
+		return mStripes[CallSiteHash()(site) % kStripeCount];
+	}
+
+	static void
+	refill(CallSiteBucket &bucket, std::chrono::steady_clock::time_point now, unsigned int rate, unsigned int burst) {
+		double elapsed = std::chrono::duration<double>(now - bucket.mLastRefill).count();
+		bucket.mTokens = std::min((double)burst, bucket.mTokens + elapsed * rate);
+		bucket.mLastRefill = now;
+	}
+
+	/* May be called with the mutex of a stripe held, never the other way around */
+	void addPending(const CallSite &site) {
+		std::lock_guard<std::mutex> lock(mPendingMutex);
+		mPending.push_back(site);
+		mPendingCount.store(mPending.size(), std::memory_order_relaxed);
+	}
+
+	Stripe mStripes[kStripeCount];
+	std::mutex mPendingMutex;
+	std::vector<CallSite> mPending; /**< the call sites which dropped messages not reported yet */
+	std::atomic<size_t> mPendingCount{0};
+};
+
+} // namespace
+
+} // namespace bctoolbox
+
+using namespace bctoolbox;
+
+bool_t bctbx_log_rate_limited(bctbx_log_domain_handle_t handle,
+                              BctbxLogLevel level,
+                              const char *fmt,
+                              bool_t by_content,
+                              unsigned int *suppressed) {
+	unsigned int rate, burst;
+	*suppressed = 0;
+	if (!bctbx_log_domain_handle_get_rate_limit(handle, &rate, &burst)) return FALSE;
+	/* the messages already formatted by the C++ log streams cannot be told apart */
+	if (!by_content && strcmp(fmt, "%s") == 0) return FALSE;
+	if (handle == NULL) handle = bctbx_find_log_domain_handle(NULL);
+	CallSite site{handle, by_content ? hashText(fmt) : (uint64_t)(uintptr_t)fmt};
+	return RateLimiter::get().allow(site, fmt, level, rate, burst, suppressed) ? FALSE : TRUE;
+}
+
+void bctbx_log_rate_limit_report(bctbx_log_domain_handle_t handle, BctbxLogSuppressedFunc func, void *user_data) {
+	unsigned int rate, burst;
+	if (!bctbx_log_domain_handle_get_rate_limit(handle, &rate, &burst)) return;
+	if (handle == NULL) handle = bctbx_find_log_domain_handle(NULL);
+	for (const auto &report : RateLimiter::get().takeEnded(handle, rate, burst)) {
+		func(user_data, report.mFormat.c_str(), report.mLevel, report.mSuppressed);
+	}
+}
@@ -23,86 +23,200 @@
 
 #include "bctoolbox/defs.h"
 #include "bctoolbox/logging.h"
+#include "logging_private.h"
 
-#include <list>
-#include <map>
-#include <stack>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <mutex>
 #include <string>
+#include <utility>
+#include <vector>
 
 using namespace std;
 
+/*
+ * A copy of the tags of a thread. It is immutable and reference counted, so that the same copy is handed out again
+ * as long as the tags of the thread do not change.
+ */
+struct _bctbx_log_tags {
+	atomic<int> mRefCount{1};
+	vector<pair<unsigned int, string>> mTags; /* tag type ID and value */
+};
+
 namespace bctoolbox {
 
+namespace {
+
+/*
+ * The tag types known so far, indexed by their ID. A table is never modified once published: adding a type copies it
+ * into a new one. Replaced tables are kept, chained from the new one, because a concurrent lookup may still be reading
+ * them.
+ */
+struct TagTypeTable {
+	int find(const char *name) const {
+		for (size_t i = 0; i < mNames.size(); ++i) {
+			if (strcmp(mNames[i].c_str(), name) == 0) return (int)i;
+		}
+		return -1;
+	}
+
+	vector<string> mNames;
+	vector<unsigned int> mSortedIds; /* IDs sorted by type name, the order in which the tags are rendered */
+	const TagTypeTable *mPrevious = nullptr;
+};
+
+class TagTypes {
+public:
+	static TagTypes &get() {
+		/* Never destroyed: logs may still be emitted by the destructors of other static objects. */
+		static TagTypes *sInstance = new TagTypes();
+		return *sInstance;
+	}
+
+	const TagTypeTable &getTable() const {
+		return *mTable.load(memory_order_acquire);
+	}
+
+	/* Returns the ID of a tag type, -1 if it was never interned. */
+	int find(const char *name) const {
+		return getTable().find(name);
+	}
+
+	/* Returns the ID of a tag type, interning it if needed. */
+	unsigned int intern(const char *name) {
+		int id = find(name);
+		if (id >= 0) return (unsigned int)id;
+		lock_guard<mutex> lock(mInsertMutex);
+		const TagTypeTable *table = mTable.load(memory_order_relaxed);
+		id = table->find(name);
+		if (id >= 0) return (unsigned int)id;
+
+		TagTypeTable *newTable = new TagTypeTable(*table);
+		newTable->mPrevious = table;
+		unsigned int newId = (unsigned int)newTable->mNames.size();
+		newTable->mNames.emplace_back(name);
+		auto position = lower_bound(newTable->mSortedIds.begin(), newTable->mSortedIds.end(), name,
+		                            [newTable](unsigned int other, const char *value) {
+			                            return strcmp(newTable->mNames[other].c_str(), value) < 0;
+		                            });
+		newTable->mSortedIds.insert(position, newId);
+		mTable.store(newTable, memory_order_release);
+		return newId;
+	}
+
+private:
+	TagTypes() {
+		mTable.store(new TagTypeTable(), memory_order_relaxed);
+	}
+
+	atomic<const TagTypeTable *> mTable{nullptr};
+	mutex mInsertMutex;
+};
+
+} // namespace
+
 class LogTags {
 public:
 	static LogTags &get() {
 		return sThreadLocalInstance;
 	}
-	void pushTag(const string &tagType, const string &tagValue) {
-		auto &tagStack = mTags[tagType];
-		if (tagStack.empty() || tagStack.top().mValue != tagValue) {
-			tagStack.push({tagValue, 1});
-		} else {
-			tagStack.top().mCount++;
+	void pushTag(const char *tagType, const char *tagValue) {
+		pushTag(TagTypes::get().intern(tagType), tagValue);
+	}
+	void pushTag(unsigned int tagTypeId, const char *tagValue) {
+		if (tagTypeId >= mTags.size()) mTags.resize(tagTypeId + 1);
+		auto &tagStack = mTags[tagTypeId];
+		TagValue *top = tagStack.top();
+		if (top && top->mValue == tagValue) {
+			top->mCount++;
+			return;
 		}
-		mTagsModfied = true;
+		if (tagStack.mDepth == tagStack.mValues.size()) tagStack.mValues.emplace_back();
+		TagValue &value = tagStack.mValues[tagStack.mDepth++];
+		value.mValue.assign(tagValue); // reuses the storage of a previously popped value
+		value.mCount = 1;
+		markModified();
 	}
-	void popTag(const string &tagType) {
-		auto &tagStack = mTags[tagType];
-		if (tagStack.empty()) {
-			bctbx_error("logging: no tag type '%s' pushed previously. Check your code.", tagType.c_str());
+	void popTag(const char *tagType) {
+		int tagTypeId = TagTypes::get().find(tagType);
+		TagValue *top = (tagTypeId >= 0 && (size_t)tagTypeId < mTags.size()) ? mTags[tagTypeId].top() : nullptr;
+		if (top == nullptr) {
+			bctbx_error("logging: no tag type '%s' pushed previously. Check your code.", tagType);
 			return;
 		} else {
-			if (--tagStack.top().mCount == 0) {
-				tagStack.pop();
-				mTagsModfied = true;
+			if (--top->mCount == 0) {
+				mTags[tagTypeId].mDepth--;
+				markModified();
 			}
 		}
 	}
-	const list<string> &getTags() {
-		if (mTagsModfied) {
-			mCurrentTags.clear();
-			bctbx_list_free(mCurrentTagsCList);
-			mCurrentTagsCList = nullptr;
-			for (auto it = mTags.rbegin(); it != mTags.rend(); ++it) {
-				auto &tagStack = (*it).second;
-				if (!tagStack.empty()) {
-					const string &value = tagStack.top().mValue;
-					mCurrentTags.emplace_front(value);
-					mCurrentTagsCList = bctbx_list_prepend(mCurrentTagsCList, const_cast<char *>(value.c_str()));
-				}
-			}
-			mTagsModfied = false;
+	const bctbx_list_t *getTagsAsCList() {
+		if (mDispatchedTags) return mDispatchedTagsCList.empty() ? nullptr : mDispatchedTagsCList.data();
+		updateCurrentTags();
+		return mCurrentTagsCList.empty() ? nullptr : mCurrentTagsCList.data();
+	}
+	/* The current tags rendered as "[tag1][tag2]", only rebuilt when the tags change. */
+	const string &getTagsString() {
+		if (mDispatchedTags) return mDispatchedTagsString;
+		updateCurrentTags();
+		return mCurrentTagsString;
+	}
+	/* The current tags as string fields keyed by their type, only rebuilt when the tags change. */
+	const bctbx_log_field_t *getTagFields(size_t *count) {
+		if (mDispatchedTags) {
+			*count = mDispatchedTagCount;
+			return mDispatchedTags;
 		}
-		return mCurrentTags;
+		updateCurrentTags();
+		*count = mCurrentTagFields.size();
+		return mCurrentTagFields.data();
 	}
-	const bctbx_list_t *getTagsAsCList() {
-		getTags();
-		return mCurrentTagsCList;
-	}
-	/* bctbx_log_tags_t is the C opaque typedef for the ContextCopy */
-	typedef map<string, string> ContextCopy;
-	ContextCopy createCopy() {
-		ContextCopy ret;
-		for (auto &tag : mTags) {
-			auto &tagStack = tag.second;
-			if (!tagStack.empty()) {
-				ret[tag.first] = tagStack.top().mValue;
+	void setDispatchedTags(const bctbx_log_field_t *tags, size_t count) {
+		mDispatchedTags = tags;
+		mDispatchedTagCount = count;
+		mDispatchedTagsCList.clear();
+		mDispatchedTagsString.clear();
+		if (tags == nullptr) return;
+		for (size_t i = 0; i < count; ++i) {
+			bctbx_list_t node = {};
+			node.data = const_cast<char *>(tags[i].value.string_value);
+			mDispatchedTagsCList.push_back(node);
+			mDispatchedTagsString.append("[").append(tags[i].value.string_value).append("]");
+		}
+		linkNodes(mDispatchedTagsCList);
+	}
+	/* Returns a new reference to a copy of the current tags, shared while they do not change. */
+	_bctbx_log_tags *createCopy() {
+		if (mCopy == nullptr || mCopyOutdated) {
+			releaseCopy(mCopy);
+			mCopy = new _bctbx_log_tags();
+			for (size_t id = 0; id < mTags.size(); ++id) {
+				const TagValue *top = mTags[id].top();
+				if (top) mCopy->mTags.emplace_back((unsigned int)id, top->mValue);
 			}
+			mCopyOutdated = false;
 		}
-		return ret;
+		mCopy->mRefCount.fetch_add(1, memory_order_relaxed);
+		return mCopy;
+	}
+	static void releaseCopy(_bctbx_log_tags *copy) {
+		if (copy && copy->mRefCount.fetch_sub(1, memory_order_acq_rel) == 1) delete copy;
 	}
-	void paste(const ContextCopy &ctx) {
-		if (!mTags.empty()) {
-			bctbx_error("logging: assigning log tags to an non-empty context - not recommended, pre-existing tags will "
-			            "be lost.");
+	void paste(const _bctbx_log_tags &copy) {
+		for (const auto &tagStack : mTags) {
+			if (tagStack.mDepth > 0) {
+				bctbx_error("logging: assigning log tags to an non-empty context - not recommended, pre-existing "
+				            "tags will be lost.");
+				break;
+			}
 		}
-		for (auto &p : ctx) {
-			pushTag(p.first, p.second);
+		for (const auto &tag : copy.mTags) {
+			pushTag(tag.first, tag.second.c_str());
 		}
 	}
 	~LogTags() {
-		bctbx_list_free(mCurrentTagsCList);
+		releaseCopy(mCopy);
 	}
 
 private:
@@ -111,10 +225,58 @@ private:
 		string mValue;
 		int mCount = 0;
 	};
-	map<string, stack<TagValue>> mTags;
-	list<string> mCurrentTags;
-	bctbx_list_t *mCurrentTagsCList = nullptr;
+	/* The values pushed for a tag type. Popped values are kept to reuse their storage. */
+	struct TagStack {
+		TagValue *top() {
+			return mDepth > 0 ? &mValues[mDepth - 1] : nullptr;
+		}
+		vector<TagValue> mValues;
+		size_t mDepth = 0;
+	};
+
+	void markModified() {
+		mTagsModfied = true;
+		mCopyOutdated = true;
+	}
+
+	void updateCurrentTags() {
+		if (!mTagsModfied) return;
+		mCurrentTagsCList.clear();
+		mCurrentTagsString.clear();
+		mCurrentTagFields.clear();
+		/* the tables are never freed, the names of the types can be referenced */
+		const TagTypeTable &table = TagTypes::get().getTable();
+		for (unsigned int id : table.mSortedIds) {
+			const TagValue *top = id < mTags.size() ? mTags[id].top() : nullptr;
+			if (top == nullptr) continue;
+			bctbx_list_t node = {};
+			node.data = const_cast<char *>(top->mValue.c_str());
+			mCurrentTagsCList.push_back(node);
+			mCurrentTagsString.append("[").append(top->mValue).append("]");
+			mCurrentTagFields.push_back(bctbx_log_field_string(table.mNames[id].c_str(), top->mValue.c_str()));
+		}
+		linkNodes(mCurrentTagsCList);
+		mTagsModfied = false;
+	}
+
+	static void linkNodes(vector<bctbx_list_t> &nodes) {
+		for (size_t i = 0; i < nodes.size(); ++i) {
+			nodes[i].prev = (i > 0) ? &nodes[i - 1] : nullptr;
+			nodes[i].next = (i + 1 < nodes.size()) ? &nodes[i + 1] : nullptr;
+		}
+	}
+
+	vector<TagStack> mTags; // indexed by tag type ID
+	vector<bctbx_list_t> mCurrentTagsCList;
+	string mCurrentTagsString;
+	vector<bctbx_log_field_t> mCurrentTagFields;
+	const bctbx_log_field_t *mDispatchedTags = nullptr; // tags of a message logged by another thread being dispatched
+	size_t mDispatchedTagCount = 0;
+	vector<bctbx_list_t> mDispatchedTagsCList;
+	string mDispatchedTagsString;
+	_bctbx_log_tags *mCopy = nullptr; // the last copy handed out, shared until the tags change
 	bool mTagsModfied = false;
+	bool mCopyOutdated = false;
 	thread_local static LogTags sThreadLocalInstance;
 };
 
@@ -134,14 +296,26 @@ const bctbx_list_t *bctbx_get_log_tags(void) {
 	return bctoolbox::LogTags::get().getTagsAsCList();
 }
 
+const char *bctbx_get_log_tags_string(void) {
+	return bctoolbox::LogTags::get().getTagsString().c_str();
+}
+
+const bctbx_log_field_t *bctbx_get_log_tag_fields(size_t *count) {
+	return bctoolbox::LogTags::get().getTagFields(count);
+}
+
+void bctbx_set_dispatched_log_tags(const bctbx_log_field_t *tags, size_t count) {
+	bctoolbox::LogTags::get().setDispatchedTags(tags, count);
+}
+
 bctbx_log_tags_t *bctbx_create_log_tags_copy(void) {
-	return (bctbx_log_tags_t *)new bctoolbox::LogTags::ContextCopy(bctoolbox::LogTags::get().createCopy());
+	return bctoolbox::LogTags::get().createCopy();
 }
 
 BCTBX_PUBLIC void bctbx_paste_log_tags(const bctbx_log_tags_t *log_tags) {
-	bctoolbox::LogTags::get().paste(*(const bctoolbox::LogTags::ContextCopy *)log_tags);
+	bctoolbox::LogTags::get().paste(*log_tags);
 }
 
 BCTBX_PUBLIC void bctbx_log_tags_destroy(bctbx_log_tags_t *log_tags) {
-	delete (bctoolbox::LogTags::ContextCopy *)log_tags;
+	bctoolbox::LogTags::releaseCopy(log_tags);
 }
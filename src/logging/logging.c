@@ -23,120 +23,37 @@
 
 #include "bctoolbox/defs.h"
 #include "bctoolbox/logging.h"
+#include "logging_private.h"
 
 #ifdef _WIN32
 extern void setStackTraceHooks();
 #endif
 
 #include <stdio.h>
-#include <sys/stat.h>
-#include <sys/types.h>
 #include <time.h>
 
-#ifdef _MSC_VER
-#ifndef access
-#define access _access
-#endif
-#ifndef fileno
-#define fileno _fileno
-#endif
-#endif
-
-/*
- * Exclude windows and android for bctbx_set_thread_log_level() implementation.
- * Android has lots of bugs around thread local storage and JVM.
- */
-#if !defined(_WIN32) && !defined(__ANDROID__)
-#define THREAD_LOG_LEVEL_ENABLED 1
-#endif
-
 #ifdef __ANDROID__
 #include <android/log.h>
 #endif /* __ANDROID__ */
 
-typedef struct {
-	char *domain;
-	unsigned int logmask;
-#ifdef THREAD_LOG_LEVEL_ENABLED
-	int thread_level_set; /* Set to 1 if a thread specific log level has been set. This enables an optimisation
-	            only for the case of an app that never uses per-thread log levels.*/
-	pthread_key_t thread_level_key; /* The key to access the thread specific level. */
-#endif
-} BctoolboxLogDomain;
-
-#ifdef THREAD_LOG_LEVEL_ENABLED
-static void thread_level_key_destroy(void *ptr) {
-	bctbx_free(ptr);
-}
-#endif
-
-static BctoolboxLogDomain *bctbx_log_domain_new(const char *domain, unsigned int logmask) {
-	BctoolboxLogDomain *ld = bctbx_new0(BctoolboxLogDomain, 1);
-	ld->domain = domain ? bctbx_strdup(domain) : NULL;
-	ld->logmask = logmask;
-#ifdef THREAD_LOG_LEVEL_ENABLED
-	ld->thread_level_set = FALSE;
-	pthread_key_create(&ld->thread_level_key, thread_level_key_destroy);
-#endif
-	return ld;
-}
-
-void bctbx_log_domain_destroy(BctoolboxLogDomain *obj) {
-#if THREAD_LOG_LEVEL_ENABLED
-	pthread_key_delete(obj->thread_level_key);
-#endif
-	if (obj->domain) bctbx_free(obj->domain);
-	bctbx_free(obj);
-}
-
-#if THREAD_LOG_LEVEL_ENABLED
-unsigned int bctbx_log_domain_get_thread_log_level_mask(BctoolboxLogDomain *ld) {
-	unsigned int *specific = (unsigned int *)pthread_getspecific(ld->thread_level_key);
-	if (!specific) return 0;
-	return *specific;
-}
-#endif
-
 typedef struct _bctbx_logger_t {
-	BctoolboxLogDomain *default_log_domain;
+	bool_t initialized;
 	bctbx_list_t *logv_outs;
 	unsigned long log_thread_id;
 	bctbx_list_t *log_stored_messages_list;
-	bctbx_list_t *log_domains;
 	bctbx_mutex_t log_stored_messages_mutex;
-	bctbx_mutex_t domains_mutex;
-	bctbx_mutex_t log_mutex;
+	bctbx_mutex_t log_mutex; /* protects the registration of the handlers, each handler has its own lock */
 	bctbx_log_handler_t *default_handler;
 } bctbx_logger_t;
 
-struct _bctbx_log_handler_t {
-	BctbxLogHandlerFunc func;
-	BctbxLogHandlerDestroyFunc destroy;
-	char *domain; /*domain this log handler is limited to. NULL for all*/
-	void *user_info;
-};
-
-typedef struct _bctbx_file_log_handler_t {
-	char *path;
-	char *name;
-	uint64_t max_size;
-	uint64_t size;
-	FILE *file;
-	bool_t reopen_requested;
-} bctbx_file_log_handler_t;
-
 void bctbx_logv_out_cb(void *user_info, const char *domain, BctbxLogLevel lev, const char *fmt, va_list args);
 
-static char *format_tags(void);
-
 static void wrapper(void *info, const char *domain, BctbxLogLevel lev, const char *fmt, va_list args) {
 	BctbxLogFunc func = (BctbxLogFunc)info;
 	if (func) func(domain, lev, fmt, args);
 }
 
 static void bctbx_handler_uninit(bctbx_log_handler_t *handler);
-static void bctbx_handler_logv_file_uninit(bctbx_log_handler_t *handler);
-static void bctbx_handler_logv_file_destroy(bctbx_log_handler_t *handler);
 
 static bctbx_logger_t main_logger = {0};
 static bctbx_log_handler_t static_handler = {0};
@@ -150,10 +67,8 @@ static void initialize_default_handler(void) {
 }
 
 static bctbx_logger_t *bctbx_get_logger(void) {
-	if (main_logger.default_log_domain == NULL) {
-		main_logger.default_log_domain =
-		    bctbx_log_domain_new(NULL, BCTBX_LOG_WARNING | BCTBX_LOG_ERROR | BCTBX_LOG_FATAL);
-		bctbx_mutex_init(&main_logger.domains_mutex, NULL);
+	if (!main_logger.initialized) {
+		main_logger.initialized = TRUE;
 		bctbx_mutex_init(&main_logger.log_mutex, NULL);
 #if ENABLE_DEFAULT_LOG_HANDLER
 		initialize_default_handler();
@@ -181,13 +96,10 @@ void bctbx_uninit_logger(void) {
 #if 0
 	bctbx_logger_t * logger = bctbx_get_logger();
 	bctbx_logv_flush();
-	bctbx_mutex_destroy(&logger->domains_mutex);
 	bctbx_mutex_destroy(&logger->log_mutex);
 	bctbx_log_handlers_free();
 	logger->logv_outs = bctbx_list_free(logger->logv_outs);
-	logger->log_domains = bctbx_list_free_with_data(logger->log_domains, (void (*)(void*))bctbx_log_domain_destroy);
-	bctbx_log_domain_destroy(logger->default_log_domain);
-	logger->default_log_domain = NULL;
+	logger->initialized = FALSE;
 #endif
 }
 
@@ -207,70 +119,46 @@ void *bctbx_log_handler_get_user_data(const bctbx_log_handler_t *log_handler) {
 	return log_handler->user_info;
 }
 
+void bctbx_log_handler_set_fields_func(bctbx_log_handler_t *log_handler, BctbxLogHandlerFieldsFunc func) {
+	log_handler->fields_func = func;
+}
+
 void bctbx_log_handler_set_domain(bctbx_log_handler_t *log_handler, const char *domain) {
+	bctbx_logger_t *logger = bctbx_get_logger();
+	bctbx_mutex_lock(&logger->log_mutex);
 	if (log_handler->domain) bctbx_free(log_handler->domain);
 	if (domain) {
 		log_handler->domain = bctbx_strdup(domain);
 	} else {
 		log_handler->domain = NULL;
 	}
-}
-bctbx_log_handler_t *bctbx_create_file_log_handler(uint64_t max_size, const char *path, const char *name) {
-	bctbx_log_handler_t *handler = NULL;
-	bctbx_file_log_handler_t *filehandler = NULL;
-	char *full_name = bctbx_strdup_printf("%s/%s", path, name);
-	struct stat buf = {0};
-
-	FILE *f = fopen(full_name, "a");
-	if (f == NULL) {
-		fprintf(stderr, "error while opening '%s': %s\n", full_name, strerror(errno));
-		goto end;
-	}
-	if (stat(full_name, &buf) != 0) {
-		fprintf(stderr, "error while gathering info about '%s': %s", full_name, strerror(errno));
-		goto end;
-	}
-
-	filehandler = bctbx_new0(bctbx_file_log_handler_t, 1);
-	filehandler->max_size = max_size;
-	filehandler->size = buf.st_size;
-	filehandler->path = bctbx_strdup(path);
-	filehandler->name = bctbx_strdup(name);
-	filehandler->file = f;
-
-	handler = bctbx_new0(bctbx_log_handler_t, 1);
-	handler->func = bctbx_logv_file;
-	handler->destroy = bctbx_handler_logv_file_destroy;
-	handler->user_info = filehandler;
-
-end:
-	bctbx_free(full_name);
-	return handler;
-}
-
-void bctbx_file_log_handler_reopen(bctbx_log_handler_t *file_log_handler) {
-	bctbx_file_log_handler_t *filehandler = (bctbx_file_log_handler_t *)file_log_handler->user_info;
-	bctbx_logger_t *logger = bctbx_get_logger();
-	bctbx_mutex_lock(&logger->log_mutex);
-	filehandler->reopen_requested = TRUE;
+	/* the dispatching threads use a copy of the domain, taken when the handlers are published */
+	if (bctbx_list_find(logger->logv_outs, log_handler)) bctbx_log_handlers_publish(logger->logv_outs);
 	bctbx_mutex_unlock(&logger->log_mutex);
 }
-
 /**
  *@param func: your logging function, compatible with the BctoolboxLogFunc prototype.
  *
  **/
 void bctbx_add_log_handler(bctbx_log_handler_t *handler) {
 	bctbx_logger_t *logger = bctbx_get_logger();
-	if (handler && !bctbx_list_find(logger->logv_outs, handler))
+	bctbx_mutex_lock(&logger->log_mutex);
+	if (handler && !bctbx_list_find(logger->logv_outs, handler)) {
 		logger->logv_outs = bctbx_list_append(logger->logv_outs, (void *)handler);
+		bctbx_log_handlers_publish(logger->logv_outs);
+	}
 	/*else, already in*/
+	bctbx_mutex_unlock(&logger->log_mutex);
 }
 
 void bctbx_remove_log_handler(bctbx_log_handler_t *handler) {
 	bctbx_logger_t *logger = bctbx_get_logger();
+	bctbx_mutex_lock(&logger->log_mutex);
 	logger->logv_outs = bctbx_list_remove(logger->logv_outs, handler);
-	handler->destroy(handler);
+	bctbx_log_handlers_publish(logger->logv_outs);
+	bctbx_mutex_unlock(&logger->log_mutex);
+	/* destroyed once the messages being dispatched to it are handled */
+	bctbx_log_handlers_retire(handler);
 	return;
 }
 
@@ -290,105 +178,10 @@ void bctbx_set_log_handler_for_domain(BctbxLogFunc func, const char *domain) {
 	bctbx_log_handler_set_domain(h, domain);
 }
 
-void bctbx_set_log_file(FILE *f) {
-	static bctbx_file_log_handler_t filehandler = {0};
-	static bctbx_log_handler_t handler = {0};
-	handler.func = bctbx_logv_file;
-	handler.destroy = (BctbxLogHandlerDestroyFunc)bctbx_handler_logv_file_uninit;
-	filehandler.max_size = -1;
-	filehandler.file = f;
-	handler.user_info = (void *)&filehandler;
-	bctbx_add_log_handler(&handler);
-}
-
 bctbx_list_t *bctbx_get_log_handlers(void) {
 	return bctbx_get_logger()->logv_outs;
 }
 
-static BctoolboxLogDomain *get_log_domain(const char *domain) {
-	bctbx_list_t *it;
-	bctbx_logger_t *logger = bctbx_get_logger();
-
-	if (domain == NULL) return logger->default_log_domain;
-	for (it = logger->log_domains; it != NULL; it = bctbx_list_next(it)) {
-		BctoolboxLogDomain *ld = (BctoolboxLogDomain *)bctbx_list_get_data(it);
-		if (ld->domain && strcmp(ld->domain, domain) == 0) {
-			return ld;
-		}
-	}
-	return NULL;
-}
-
-static BctoolboxLogDomain *get_log_domain_rw(const char *domain) {
-	BctoolboxLogDomain *ret;
-	bctbx_logger_t *logger = bctbx_get_logger();
-
-	ret = get_log_domain(domain);
-	if (ret) return ret;
-	/*it does not exist, hence create it by taking the mutex*/
-	bctbx_mutex_lock(&logger->domains_mutex);
-	ret = get_log_domain(domain);
-	if (!ret) {
-		ret = bctbx_log_domain_new(domain, logger->default_log_domain->logmask);
-		logger->log_domains = bctbx_list_prepend(logger->log_domains, ret);
-	}
-	bctbx_mutex_unlock(&logger->domains_mutex);
-	return ret;
-}
-
-/**
- * @ param levelmask a mask of BCTBX_DEBUG, BCTBX_MESSAGE, BCTBX_WARNING, BCTBX_ERROR
- * BCTBX_FATAL .
- **/
-void bctbx_set_log_level_mask(const char *domain, int levelmask) {
-	get_log_domain_rw(domain)->logmask = levelmask;
-}
-
-static unsigned int level_to_mask(BctbxLogLevel level) {
-	unsigned int levelmask = BCTBX_LOG_FATAL;
-	if (level <= BCTBX_LOG_ERROR) {
-		levelmask |= BCTBX_LOG_ERROR;
-	}
-	if (level <= BCTBX_LOG_WARNING) {
-		levelmask |= BCTBX_LOG_WARNING;
-	}
-	if (level <= BCTBX_LOG_MESSAGE) {
-		levelmask |= BCTBX_LOG_MESSAGE;
-	}
-	if (level <= BCTBX_LOG_TRACE) {
-		levelmask |= BCTBX_LOG_TRACE;
-	}
-	if (level <= BCTBX_LOG_DEBUG) {
-		levelmask |= BCTBX_LOG_DEBUG;
-	}
-	return levelmask;
-}
-
-/**
- * Set log level
- **/
-void bctbx_set_log_level(const char *domain, BctbxLogLevel level) {
-	bctbx_set_log_level_mask(domain, level_to_mask(level));
-}
-
-unsigned int bctbx_get_log_level_mask(const char *domain) {
-	BctoolboxLogDomain *ld = get_log_domain(domain);
-	if (!ld) ld = bctbx_get_logger()->default_log_domain;
-	return ld->logmask;
-}
-
-int bctbx_log_level_enabled(const char *domain, BctbxLogLevel level) {
-	unsigned int logmask = 0;
-	BctoolboxLogDomain *ld = get_log_domain(domain);
-	if (!ld) ld = bctbx_get_logger()->default_log_domain;
-
-#ifdef THREAD_LOG_LEVEL_ENABLED
-	if (ld->thread_level_set) logmask = bctbx_log_domain_get_thread_log_level_mask(ld);
-#endif
-	if (logmask == 0) logmask = ld->logmask; /* if there is no thread specific log level, revert to global log level.*/
-	return (logmask & (unsigned int)level) != 0;
-}
-
 void bctbx_set_log_thread_id(unsigned long thread_id) {
 	bctbx_logger_t *logger = bctbx_get_logger();
 	if (thread_id == 0) {
@@ -472,416 +265,219 @@ char *bctbx_strcat_printf(char *dst, const char *fmt, ...) {
 	return ret;
 }
 
-#if !defined(BCTBX_WINDOWS_UWP) && (defined(_WIN32) || defined(_WIN32_WCE))
-#define ENDLINE "\r\n"
-#else
-#define ENDLINE "\n"
-#endif
-
 typedef struct {
 	int level;
 	char *msg;
 	char *domain;
 } bctbx_stored_log_t;
 
-void _bctbx_logv_flush(int dummy, ...) {
+static void bctbx_log_dispatch(const char *domain, BctbxLogLevel level, const char *fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+	bctbx_logv_dispatch(domain, level, fmt, args);
+	va_end(args);
+}
+
+void bctbx_log_dispatch_message(const char *domain, BctbxLogLevel level, const char *msg) {
+	bctbx_log_dispatch(domain, level, "%s", msg);
+}
+
+void bctbx_logv_flush(void) {
 	bctbx_list_t *elem;
 	bctbx_list_t *msglist;
-	va_list empty_va_list;
-	va_start(empty_va_list, dummy);
-
 	bctbx_logger_t *logger = bctbx_get_logger();
 
 	bctbx_mutex_lock(&logger->log_stored_messages_mutex);
 	msglist = logger->log_stored_messages_list;
 	logger->log_stored_messages_list = NULL;
 	bctbx_mutex_unlock(&logger->log_stored_messages_mutex);
-	for (elem = msglist; elem != NULL; elem = bctbx_list_next(elem)) {
+	/* messages are prepended when stored, the oldest is the last one */
+	for (elem = bctbx_list_last_elem(msglist); elem != NULL; elem = elem->prev) {
 		bctbx_stored_log_t *l = (bctbx_stored_log_t *)bctbx_list_get_data(elem);
-		bctbx_list_t *handlers = bctbx_list_first_elem(logger->logv_outs);
-#ifdef _WIN32
-		while (handlers) {
-			bctbx_log_handler_t *handler = (bctbx_log_handler_t *)handlers->data;
-			if (handler) {
-				va_list cap;
-				va_copy(cap, empty_va_list);
-				handler->func(handler->user_info, l->domain, l->level, l->msg, cap);
-				va_end(cap);
-			}
-			handlers = handlers->next;
-		}
-#else
-
-		while (handlers) {
-			bctbx_log_handler_t *handler = (bctbx_log_handler_t *)handlers->data;
-			if (handler) {
-				va_list cap;
-				va_copy(cap, empty_va_list);
-				handler->func(handler->user_info, l->domain, l->level, l->msg, cap);
-				va_end(cap);
-			}
-			handlers = handlers->next;
-		}
-
-#endif
+		bctbx_log_dispatch_message(l->domain, l->level, l->msg);
 		if (l->domain) bctbx_free(l->domain);
 		bctbx_free(l->msg);
 		bctbx_free(l);
 	}
 	bctbx_list_free(msglist);
-	va_end(empty_va_list);
 }
 
-void bctbx_logv_flush(void) {
-	_bctbx_logv_flush(0);
-}
-
-void bctbx_logv(const char *domain, BctbxLogLevel level, const char *fmt, va_list args) {
+/* Output a message whose level is enabled */
+static void bctbx_logv_enabled(const char *domain, BctbxLogLevel level, const char *fmt, va_list args) {
 	bctbx_logger_t *logger = bctbx_get_logger();
 
-	if ((logger->logv_outs != NULL) && bctbx_log_level_enabled(domain, level)) {
-		if (logger->log_thread_id == 0) {
-			bctbx_list_t *handlers = bctbx_list_first_elem(logger->logv_outs);
-			while (handlers) {
-				bctbx_log_handler_t *handler = (bctbx_log_handler_t *)handlers->data;
-				if (handler && (!handler->domain || !domain || strcmp(handler->domain, domain) == 0)) {
-					va_list tmp;
-					va_copy(tmp, args);
-					handler->func(handler->user_info, domain, level, fmt, tmp);
-					va_end(tmp);
-				}
-				handlers = handlers->next;
-			}
-		} else if (logger->log_thread_id == bctbx_thread_self()) {
-			bctbx_list_t *handlers;
-			bctbx_logv_flush();
-			handlers = bctbx_list_first_elem(logger->logv_outs);
-			while (handlers) {
-				bctbx_log_handler_t *handler = (bctbx_log_handler_t *)handlers->data;
-				if (handler && (!handler->domain || !domain || strcmp(handler->domain, domain) == 0)) {
-					va_list tmp;
-					va_copy(tmp, args);
-					handler->func(handler->user_info, domain, level, fmt, tmp);
-					va_end(tmp);
-				}
-				handlers = handlers->next;
-			}
-		} else {
-			bctbx_stored_log_t *l = bctbx_new(bctbx_stored_log_t, 1);
-			l->domain = domain ? bctbx_strdup(domain) : NULL;
-			l->level = level;
-			l->msg = bctbx_strdup_vprintf(fmt, args);
-			bctbx_mutex_lock(&logger->log_stored_messages_mutex);
-			logger->log_stored_messages_list = bctbx_list_append(logger->log_stored_messages_list, l);
-			bctbx_mutex_unlock(&logger->log_stored_messages_mutex);
-		}
-	}
-#if !defined(_WIN32_WCE)
-	if (level == BCTBX_LOG_FATAL) {
+	if (bctbx_async_logging_push(domain, level, fmt, args)) {
+		/* the writer thread takes care of it */
+	} else if (logger->log_thread_id == 0) {
+		bctbx_logv_dispatch(domain, level, fmt, args);
+	} else if (logger->log_thread_id == bctbx_thread_self()) {
 		bctbx_logv_flush();
-#ifdef __ANDROID__
-		// Act as a flush + abort
-		__android_log_assert(NULL, NULL, "%s", "Aborting");
-#else
-		abort();
-#endif
+		bctbx_logv_dispatch(domain, level, fmt, args);
+	} else {
+		bctbx_stored_log_t *l = bctbx_new(bctbx_stored_log_t, 1);
+		l->domain = domain ? bctbx_strdup(domain) : NULL;
+		l->level = level;
+		l->msg = bctbx_strdup_vprintf(fmt, args);
+		bctbx_mutex_lock(&logger->log_stored_messages_mutex);
+		logger->log_stored_messages_list = bctbx_list_prepend(logger->log_stored_messages_list, l);
+		bctbx_mutex_unlock(&logger->log_stored_messages_mutex);
 	}
-#endif
 }
-void bctbx_logv_out(const char *domain, BctbxLogLevel lev, const char *fmt, va_list args) {
-	bctbx_logv_out_cb(NULL, domain, lev, fmt, args);
+
+static void bctbx_log_enabled(const char *domain, BctbxLogLevel level, const char *fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+	bctbx_logv_enabled(domain, level, fmt, args);
+	va_end(args);
 }
-/*This function does the default formatting and output to file*/
-void bctbx_logv_out_cb(
-    BCTBX_UNUSED(void *user_info), const char *domain, BctbxLogLevel lev, const char *fmt, va_list args) {
-	const char *lname = "undef";
-	char *msg, *tags = NULL;
-	struct timeval tp;
-	struct tm *lt;
-#ifndef _WIN32
-	struct tm tmbuf;
-#endif
-	time_t tt;
-	FILE *std = stdout;
-	bctbx_gettimeofday(&tp, NULL);
-	tt = (time_t)tp.tv_sec;
 
-#ifdef _WIN32
-	lt = localtime(&tt);
-#else
-	lt = localtime_r(&tt, &tmbuf);
-#endif
+static void bctbx_log_report_suppressed(void *domain, const char *fmt, BctbxLogLevel level, unsigned int suppressed) {
+	bctbx_log_enabled((const char *)domain, level, "%u messages \"%s\" suppressed", suppressed, fmt);
+}
 
-	switch (lev) {
-		case BCTBX_LOG_DEBUG:
-			lname = "debug";
-			break;
-		case BCTBX_LOG_MESSAGE:
-			lname = "message";
-			break;
-		case BCTBX_LOG_WARNING:
-			lname = "warning";
-			break;
-		case BCTBX_LOG_ERROR:
-			lname = "error";
-			std = stderr;
-			break;
-		case BCTBX_LOG_FATAL:
-			lname = "fatal";
-			std = stderr;
-			break;
-		default:
-			lname = "badlevel";
-	}
+/* Apply the rate limit of the domain of a message, report the messages dropped before it */
+static bool_t bctbx_log_apply_rate_limit(
+    bctbx_log_domain_handle_t handle, const char *domain, BctbxLogLevel level, const char *fmt, bool_t by_content) {
+	unsigned int suppressed = 0;
+	if (level != BCTBX_LOG_FATAL && bctbx_log_rate_limited(handle, level, fmt, by_content, &suppressed)) return FALSE;
+	bctbx_log_rate_limit_report(handle, bctbx_log_report_suppressed, (void *)domain);
+	if (suppressed > 0) bctbx_log_enabled(domain, level, "last message repeated %u times", suppressed);
+	return TRUE;
+}
 
-	msg = bctbx_strdup_vprintf(fmt, args);
-#if defined(_MSC_VER) && !defined(_WIN32_WCE)
-#ifndef _UNICODE
-	OutputDebugStringA(msg);
-	OutputDebugStringA("\r\n");
+/* Output a message whose level is enabled, unless the rate limit of its domain drops it */
+static void bctbx_logv_rate_limited(bctbx_log_domain_handle_t handle,
+                                    const char *domain,
+                                    BctbxLogLevel level,
+                                    const char *fmt,
+                                    va_list args) {
+	if (bctbx_log_apply_rate_limit(handle, domain, level, fmt, FALSE)) bctbx_logv_enabled(domain, level, fmt, args);
+}
+
+static void bctbx_log_abort(void) {
+#if !defined(_WIN32_WCE)
+	bctbx_flush_async_logging();
+	bctbx_logv_flush();
+#ifdef __ANDROID__
+	// Act as a flush + abort
+	__android_log_assert(NULL, NULL, "%s", "Aborting");
 #else
-	{
-		size_t len = strlen(msg);
-		wchar_t *tmp = (wchar_t *)bctbx_malloc0((len + 1) * sizeof(wchar_t));
-		mbstowcs(tmp, msg, len);
-		OutputDebugStringW(tmp);
-		OutputDebugStringW(L"\r\n");
-		bctbx_free(tmp);
-	}
+	abort();
 #endif
 #endif
-	tags = format_tags();
-	fprintf(std, "%i-%.2i-%.2i %.2i:%.2i:%.2i:%.3i %s-%s-%s %s" ENDLINE, 1900 + lt->tm_year, 1 + lt->tm_mon,
-	        lt->tm_mday, lt->tm_hour, lt->tm_min, lt->tm_sec, (int)(tp.tv_usec / 1000), (domain ? domain : "bctoolbox"),
-	        lname, tags ? tags : "", msg);
-	fflush(std);
-	bctbx_free(msg);
-	if (tags) bctbx_free(tags);
 }
 
-static void bctbx_handler_uninit(bctbx_log_handler_t *handler) {
-	handler->user_info = NULL;
-}
-
-static int _try_open_log_collection_file(bctbx_file_log_handler_t *filehandler) {
-	struct stat statbuf;
-	char *log_filename;
-
-	log_filename = bctbx_strdup_printf("%s/%s", filehandler->path, filehandler->name);
-	filehandler->file = fopen(log_filename, "a");
-	bctbx_free(log_filename);
-	if (filehandler->file == NULL) return -1;
-
-	fstat(fileno(filehandler->file), &statbuf);
-	if ((uint64_t)statbuf.st_size > filehandler->max_size) {
-		fclose(filehandler->file);
-		return -1;
+void bctbx_logv(const char *domain, BctbxLogLevel level, const char *fmt, va_list args) {
+	if (bctbx_has_log_handlers() && bctbx_log_level_enabled(domain, level)) {
+		if (bctbx_log_rate_limits_set()) {
+			bctbx_logv_rate_limited(bctbx_find_log_domain_handle(domain), domain, level, fmt, args);
+		} else {
+			bctbx_logv_enabled(domain, level, fmt, args);
+		}
 	}
-
-	filehandler->size = statbuf.st_size;
-	return 0;
+	if (level == BCTBX_LOG_FATAL) bctbx_log_abort();
 }
 
-static void _rotate_log_collection_files(bctbx_file_log_handler_t *filehandler) {
-	char *log_filename;
-	char *log_filename2;
-	int n = 1;
-
-	log_filename = bctbx_strdup_printf("%s/%s_1", filehandler->path, filehandler->name);
-	while (access(log_filename, F_OK) != -1) {
-		// file exists
-		n++;
-		bctbx_free(log_filename);
-		log_filename = bctbx_strdup_printf("%s/%s_%d", filehandler->path, filehandler->name, n);
-	}
-
-	while (n > 1) {
-		bctbx_free(log_filename);
-		log_filename = bctbx_strdup_printf("%s/%s_%d", filehandler->path, filehandler->name, n - 1);
-		log_filename2 = bctbx_strdup_printf("%s/%s_%d", filehandler->path, filehandler->name, n);
+/* Output a structured message whose level is enabled */
+static void bctbx_log_fields_enabled(bctbx_log_domain_handle_t handle,
+                                     const char *domain,
+                                     BctbxLogLevel level,
+                                     const char *msg,
+                                     const bctbx_log_field_t *fields,
+                                     size_t count) {
+	bctbx_logger_t *logger = bctbx_get_logger();
 
-		n--;
-		rename(log_filename, log_filename2);
-		bctbx_free(log_filename2);
-	}
-	bctbx_free(log_filename);
-	log_filename = bctbx_strdup_printf("%s/%s", filehandler->path, filehandler->name);
-	log_filename2 = bctbx_strdup_printf("%s/%s_1", filehandler->path, filehandler->name);
-	rename(log_filename, log_filename2);
-	bctbx_free(log_filename);
-	bctbx_free(log_filename2);
-}
-
-static void _open_log_collection_file(bctbx_file_log_handler_t *filehandler) {
-	if (_try_open_log_collection_file(filehandler) < 0) {
-		_rotate_log_collection_files(filehandler);
-		_try_open_log_collection_file(filehandler);
+	if (msg == NULL) msg = "";
+	/* the message is the call site, as the format string of the other messages. It may be built at runtime (ie: by
+	 * LogFields::log()), its text identifies it. */
+	if (bctbx_log_rate_limits_set() && !bctbx_log_apply_rate_limit(handle, domain, level, msg, TRUE)) return;
+	if (bctbx_async_logging_push_fields(domain, level, msg, fields, count)) {
+		/* the writer thread takes care of it */
+	} else if (logger->log_thread_id == 0) {
+		bctbx_log_dispatch_fields(domain, level, msg, fields, count);
+	} else if (logger->log_thread_id == bctbx_thread_self()) {
+		bctbx_logv_flush();
+		bctbx_log_dispatch_fields(domain, level, msg, fields, count);
+	} else {
+		/* the messages stored for the log thread are given to the handlers as text */
+		bctbx_stored_log_t *l = bctbx_new(bctbx_stored_log_t, 1);
+		l->domain = domain ? bctbx_strdup(domain) : NULL;
+		l->level = level;
+		l->msg = bctbx_log_fields_to_text(msg, fields, count);
+		bctbx_mutex_lock(&logger->log_stored_messages_mutex);
+		logger->log_stored_messages_list = bctbx_list_prepend(logger->log_stored_messages_list, l);
+		bctbx_mutex_unlock(&logger->log_stored_messages_mutex);
 	}
 }
 
-static void _close_log_collection_file(bctbx_file_log_handler_t *filehandler) {
-	if (filehandler->file) {
-		fclose(filehandler->file);
-		filehandler->file = NULL;
-		filehandler->size = 0;
+void bctbx_log_fields(
+    const char *domain, BctbxLogLevel level, const char *msg, const bctbx_log_field_t *fields, size_t count) {
+	if (bctbx_has_log_handlers() && bctbx_log_level_enabled(domain, level)) {
+		bctbx_log_fields_enabled(bctbx_find_log_domain_handle(domain), domain, level, msg, fields, count);
 	}
+	if (level == BCTBX_LOG_FATAL) bctbx_log_abort();
 }
 
-static char *format_tags(void) {
-	const bctbx_list_t *tags = bctbx_get_log_tags();
-	const bctbx_list_t *elem;
-	char *tags_str = NULL;
-	for (elem = tags; elem != NULL; elem = elem->next) {
-		const char *tag = (const char *)elem->data;
-		if (tags_str == NULL) tags_str = bctbx_strdup_printf("[%s]", tag);
-		else {
-			char *new_tags_str = bctbx_strdup_printf("%s[%s]", tags_str, tag);
-			bctbx_free(tags_str);
-			tags_str = new_tags_str;
-		}
+void bctbx_log_handle_fields(bctbx_log_domain_handle_t handle,
+                             BctbxLogLevel level,
+                             const char *msg,
+                             const bctbx_log_field_t *fields,
+                             size_t count) {
+	if (bctbx_has_log_handlers() && bctbx_log_handle_level_enabled(handle, level)) {
+		bctbx_log_fields_enabled(handle, bctbx_log_domain_handle_get_name(handle), level, msg, fields, count);
 	}
-	return tags_str;
+	if (level == BCTBX_LOG_FATAL) bctbx_log_abort();
 }
 
-void bctbx_logv_file(void *user_info, const char *domain, BctbxLogLevel lev, const char *fmt, va_list args) {
-	const char *lname = "undef";
-	char *msg = NULL;
-	char *tags = NULL;
-	struct timeval tp;
-	struct tm *lt;
-#ifndef _WIN32
-	struct tm tmbuf;
-#endif
-	time_t tt;
-	int ret = -1;
-	bctbx_file_log_handler_t *filehandler = (bctbx_file_log_handler_t *)user_info;
-	bctbx_logger_t *logger = bctbx_get_logger();
-
-	bctbx_mutex_lock(&logger->log_mutex);
-	FILE *f = filehandler ? filehandler->file : stdout;
-	bctbx_gettimeofday(&tp, NULL);
-	tt = (time_t)tp.tv_sec;
-
-#ifdef _WIN32
-	lt = localtime(&tt);
-#else
-	lt = localtime_r(&tt, &tmbuf);
-#endif
+void bctbx_log_message(const char *domain, BctbxLogLevel level, const char *msg) {
+	if (bctbx_has_log_handlers()) bctbx_log_enabled(domain, level, "%s", msg);
+	if (level == BCTBX_LOG_FATAL) bctbx_log_abort();
+}
 
-	if (!f) goto end;
+void bctbx_log_handle_message(bctbx_log_domain_handle_t handle, BctbxLogLevel level, const char *msg) {
+	bctbx_log_message(bctbx_log_domain_handle_get_name(handle), level, msg);
+}
 
-	switch (lev) {
-		case BCTBX_LOG_DEBUG:
-			lname = "debug";
-			break;
-		case BCTBX_LOG_MESSAGE:
-			lname = "message";
-			break;
-		case BCTBX_LOG_WARNING:
-			lname = "warning";
-			break;
-		case BCTBX_LOG_ERROR:
-			lname = "error";
-			break;
-		case BCTBX_LOG_FATAL:
-			lname = "fatal";
-			break;
-		default:
-			lname = "badlevel";
+void bctbx_logv_handle(bctbx_log_domain_handle_t handle, BctbxLogLevel level, const char *fmt, va_list args) {
+	if (bctbx_has_log_handlers() && bctbx_log_handle_level_enabled(handle, level)) {
+		if (bctbx_log_rate_limits_set()) {
+			bctbx_logv_rate_limited(handle, bctbx_log_domain_handle_get_name(handle), level, fmt, args);
+		} else {
+			bctbx_logv_enabled(bctbx_log_domain_handle_get_name(handle), level, fmt, args);
+		}
 	}
+	if (level == BCTBX_LOG_FATAL) bctbx_log_abort();
+}
+void bctbx_logv_out(const char *domain, BctbxLogLevel lev, const char *fmt, va_list args) {
+	bctbx_logv_out_cb(NULL, domain, lev, fmt, args);
+}
+/*This function does the default formatting and output to file*/
+void bctbx_logv_out_cb(
+    BCTBX_UNUSED(void *user_info), const char *domain, BctbxLogLevel lev, const char *fmt, va_list args) {
+	size_t length, msg_offset;
+	FILE *std = (lev == BCTBX_LOG_ERROR || lev == BCTBX_LOG_FATAL) ? stderr : stdout;
+	const char *line = bctbx_log_render_line(domain, lev, fmt, args, &length, &msg_offset);
 
-	msg = bctbx_strdup_vprintf(fmt, args);
 #if defined(_MSC_VER) && !defined(_WIN32_WCE)
 #ifndef _UNICODE
-	OutputDebugStringA(msg);
-	OutputDebugStringA("\r\n");
+	OutputDebugStringA(line + msg_offset);
 #else
 	{
-		size_t len = strlen(msg);
+		size_t len = length - msg_offset;
 		wchar_t *tmp = (wchar_t *)bctbx_malloc0((len + 1) * sizeof(wchar_t));
-		mbstowcs(tmp, msg, len);
+		mbstowcs(tmp, line + msg_offset, len);
 		OutputDebugStringW(tmp);
-		OutputDebugStringW(L"\r\n");
 		bctbx_free(tmp);
 	}
 #endif
 #endif
-	tags = format_tags();
-	ret = fprintf(f, "%i-%.2i-%.2i %.2i:%.2i:%.2i:%.3i %s-%s-%s %s" ENDLINE, 1900 + lt->tm_year, 1 + lt->tm_mon,
-	              lt->tm_mday, lt->tm_hour, lt->tm_min, lt->tm_sec, (int)(tp.tv_usec / 1000),
-	              (domain ? domain : "bctoolbox"), lname, tags ? tags : "", msg);
-	fflush(f);
-	if (tags) bctbx_free(tags);
-
-	/* reopen the log file when either the size limit has been exceeded, or reopen has been required
-	   by the user. Reopening a log file that has reached the size limit automatically trigger log rotation
-	   while opening. */
-	if (filehandler) {
-		bool_t reopen_requested = filehandler->reopen_requested;
-		if (filehandler->max_size > 0 && ret > 0) {
-			filehandler->size += ret;
-			reopen_requested = reopen_requested || filehandler->size > filehandler->max_size;
-		}
-		if (reopen_requested) {
-			_close_log_collection_file(filehandler);
-			_open_log_collection_file(filehandler);
-			filehandler->reopen_requested = FALSE;
-		}
-	}
-
-end:
-	bctbx_mutex_unlock(&logger->log_mutex);
-	if (msg) bctbx_free(msg);
-}
-
-static void bctbx_handler_logv_file_uninit(bctbx_log_handler_t *handler) {
-	bctbx_file_log_handler_t *filehandler = (bctbx_file_log_handler_t *)handler->user_info;
-	fclose(filehandler->file);
-	bctbx_free(filehandler->path);
-	bctbx_free(filehandler->name);
-	bctbx_handler_uninit(handler);
-}
-
-static void bctbx_handler_logv_file_destroy(bctbx_log_handler_t *handler) {
-	bctbx_file_log_handler_t *filehandler = (bctbx_file_log_handler_t *)handler->user_info;
-	bctbx_handler_logv_file_uninit(handler);
-	bctbx_free(filehandler);
-	bctbx_handler_uninit(handler);
-	bctbx_free(handler);
-}
-
-#ifndef _MSC_VER
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wunused-parameter"
-#endif // _MSC_VER
-void bctbx_set_thread_log_level(const char *domain, BctbxLogLevel level) {
-#ifdef THREAD_LOG_LEVEL_ENABLED
-	BctoolboxLogDomain *ld = get_log_domain(domain);
-	unsigned int *specific = (unsigned int *)pthread_getspecific(ld->thread_level_key);
-	if (!specific) specific = bctbx_new0(unsigned int, 1);
-	*specific = level_to_mask(level);
-	pthread_setspecific(ld->thread_level_key, specific);
-	ld->thread_level_set = TRUE;
-#endif
+	fwrite(line, 1, length, std);
+	fflush(std);
 }
-#ifndef _MSC_VER
-#pragma GCC diagnostic pop
-#endif // _MSC_VER
-
-#ifndef _MSC_VER
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wunused-parameter"
-#endif // _MSC_VER
-void bctbx_clear_thread_log_level(const char *domain) {
-#ifdef THREAD_LOG_LEVEL_ENABLED
-	BctoolboxLogDomain *ld = get_log_domain(domain);
-	unsigned int *specific = (unsigned int *)pthread_getspecific(ld->thread_level_key);
-	if (specific) *specific = 0;
-#endif
+
+static void bctbx_handler_uninit(bctbx_log_handler_t *handler) {
+	handler->user_info = NULL;
 }
-#ifndef _MSC_VER
-#pragma GCC diagnostic pop
-#endif // _MSC_VER
 
 #ifdef __QNX__
 #include <slog2.h>
@@ -0,0 +1,160 @@
+/*
+ * Copyright (c) 2025 Belledonne Communications SARL.
+ *
+ * This file is part of bctoolbox.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BCTBX_LOGGING_PRIVATE_H
+#define BCTBX_LOGGING_PRIVATE_H
+
+#include "bctoolbox/logging.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Functions shared by the logging implementation files, not part of the public API */
+
+struct _bctbx_log_handler_t {
+	BctbxLogHandlerFunc func;
+	BctbxLogHandlerDestroyFunc destroy;
+	char *domain; /*domain this log handler is limited to. NULL for all*/
+	void *user_info;
+	BctbxLogHandlerFieldsFunc fields_func; /* receives the structured messages, NULL to receive them as text */
+};
+
+/**
+ * Returns the handle of a log domain if it exists, without creating it. NULL gives the default domain.
+ */
+bctbx_log_domain_handle_t bctbx_find_log_domain_handle(const char *domain);
+
+/**
+ * Returns the index of a log domain, between 0 (the default domain) and bctbx_get_log_domain_count() excluded.
+ */
+unsigned int bctbx_log_domain_handle_get_id(bctbx_log_domain_handle_t handle);
+unsigned int bctbx_get_log_domain_count(void);
+
+/**
+ * Returns TRUE once a rate limit has been set for any domain.
+ */
+bool_t bctbx_log_rate_limits_set(void);
+
+/**
+ * Gives the rate limit applying to a domain, following the default domain if none was set for it.
+ * @return FALSE if the domain is not rate limited
+ */
+bool_t bctbx_log_domain_handle_get_rate_limit(bctbx_log_domain_handle_t handle, unsigned int *rate, unsigned int *burst);
+
+/**
+ * Apply the rate limit of a domain to a message, before it is formatted.
+ * @param[in] by_content the call site is identified by the text of fmt instead of its address, for the messages which
+ * may be built at runtime
+ * @param[out] suppressed the number of messages of the same call site dropped since the previous one let through
+ * @return TRUE if the message must be dropped
+ */
+bool_t bctbx_log_rate_limited(bctbx_log_domain_handle_t handle,
+                              BctbxLogLevel level,
+                              const char *fmt,
+                              bool_t by_content,
+                              unsigned int *suppressed);
+
+typedef void (*BctbxLogSuppressedFunc)(void *user_data, const char *fmt, BctbxLogLevel level, unsigned int suppressed);
+
+/**
+ * Give the number of messages dropped at the other call sites of a domain whose storm ended, so that they are
+ * reported even if these call sites do not log anymore. Called for each message of the domain let through.
+ */
+void bctbx_log_rate_limit_report(bctbx_log_domain_handle_t handle, BctbxLogSuppressedFunc func, void *user_data);
+
+/**
+ * Replace the handlers messages are dispatched to. Must be called with the logger mutex held, each time the list of
+ * handlers or the domain of one of them changes.
+ */
+void bctbx_log_handlers_publish(const bctbx_list_t *handlers);
+
+/**
+ * Destroy a handler removed by bctbx_log_handlers_publish() once no thread is dispatching a message to it anymore.
+ * It does not wait: the handler may be destroyed later, by the last thread dispatching to it. A handler published
+ * again before being destroyed is kept. Must be called without the logger mutex held.
+ */
+void bctbx_log_handlers_retire(bctbx_log_handler_t *handler);
+
+/**
+ * Returns TRUE if at least one handler is registered.
+ */
+bool_t bctbx_has_log_handlers(void);
+
+/**
+ * Returns the name of a log level, as written in the log lines.
+ */
+const char *bctbx_log_level_name(BctbxLogLevel level);
+
+/**
+ * Render the log line of a message, "YYYY-MM-DD HH:MM:SS:mmm domain-level-[tags] message" and an end of line, in a
+ * buffer of the calling thread which remains valid until its next call.
+ * @param[out] length the length of the line
+ * @param[out] message_offset the position of the message in the line
+ */
+const char *bctbx_log_render_line(
+    const char *domain, BctbxLogLevel level, const char *fmt, va_list args, size_t *length, size_t *message_offset);
+
+/**
+ * Give a message to all the handlers accepting its domain, on the calling thread.
+ */
+void bctbx_logv_dispatch(const char *domain, BctbxLogLevel level, const char *fmt, va_list args);
+
+/**
+ * Give an already formatted message to all the handlers accepting its domain, on the calling thread.
+ */
+void bctbx_log_dispatch_message(const char *domain, BctbxLogLevel level, const char *msg);
+
+/**
+ * Give a structured message to all the handlers accepting its domain, on the calling thread.
+ */
+void bctbx_log_dispatch_fields(
+    const char *domain, BctbxLogLevel level, const char *msg, const bctbx_log_field_t *fields, size_t count);
+
+/**
+ * Render a structured message as text, the fields being appended to the message as key=value.
+ * @return a string to free with bctbx_free()
+ */
+char *bctbx_log_fields_to_text(const char *msg, const bctbx_log_field_t *fields, size_t count);
+
+/**
+ * Queue a message for the asynchronous logging writer thread.
+ * @return TRUE if the message was taken by the asynchronous logging (queued or dropped), FALSE if it is not enabled or
+ *         if the message must be dispatched on the calling thread.
+ */
+bool_t bctbx_async_logging_push(const char *domain, BctbxLogLevel level, const char *fmt, va_list args);
+
+/**
+ * Same as bctbx_async_logging_push() for a structured message, queued with its fields.
+ */
+bool_t bctbx_async_logging_push_fields(
+    const char *domain, BctbxLogLevel level, const char *msg, const bctbx_log_field_t *fields, size_t count);
+
+/**
+ * Make bctbx_get_log_tags() and bctbx_get_log_tag_fields() return the given tags, as given by
+ * bctbx_get_log_tag_fields(), on the calling thread instead of its own ones, until called again with NULL. Used to
+ * dispatch messages logged by other threads with their tags.
+ */
+void bctbx_set_dispatched_log_tags(const bctbx_log_field_t *tags, size_t count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BCTBX_LOGGING_PRIVATE_H */
@@ -0,0 +1,620 @@
+/*
+ * Copyright (c) 2025 Belledonne Communications SARL.
+ *
+ * This file is part of bctoolbox.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "bctoolbox/logging.h"
+#include "bctoolbox/port.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#if defined(__linux__) && defined(SYS_getdents64)
+#define BCTBX_HAVE_GETDENTS64
+#endif
+
+#define DIR_SCAN_BUFFER_SIZE (64 * 1024) /* size of the batches of entries read from the kernel */
+
+/* Filter applied to each entry: the suffix length is computed once per scan */
+typedef struct dir_scan_filter_t {
+	const char *suffix;
+	size_t suffixLength;
+	bctbx_dir_scan_cb_t cb;
+	void *userData;
+} dir_scan_filter_t;
+
+/**
+ * Skip . and .. and the entries not matching the suffix, then give the entry to the callback.
+ * @return the value returned by the callback, 0 for skipped entries
+ */
+static int dir_scan_entry(const dir_scan_filter_t *filter,
+                          const char *name,
+                          size_t nameLength,
+                          bctbx_dir_entry_type_t type,
+                          int dirFd) {
+	if (name[0] == '.' && (nameLength == 1 || (nameLength == 2 && name[1] == '.'))) return 0;
+	if (filter->suffixLength > 0 &&
+	    (nameLength < filter->suffixLength ||
+	     memcmp(name + nameLength - filter->suffixLength, filter->suffix, filter->suffixLength) != 0)) {
+		return 0;
+	}
+
+#ifndef _WIN32
+	// the file system does not give the type, ask for it (only for entries matching the filter)
+	if (type == BCTBX_DIR_ENTRY_UNKNOWN) {
+		struct stat sStat;
+		if (fstatat(dirFd, name, &sStat, AT_SYMLINK_NOFOLLOW) == 0) {
+			if (S_ISREG(sStat.st_mode)) type = BCTBX_DIR_ENTRY_FILE;
+			else if (S_ISDIR(sStat.st_mode)) type = BCTBX_DIR_ENTRY_DIRECTORY;
+			else if (S_ISLNK(sStat.st_mode)) type = BCTBX_DIR_ENTRY_SYMLINK;
+			else type = BCTBX_DIR_ENTRY_OTHER;
+		}
+	}
+#else
+	(void)dirFd;
+#endif
+
+	bctbx_dir_entry_t entry;
+	entry.name = name;
+	entry.name_length = nameLength;
+	entry.type = type;
+	return filter->cb(filter->userData, &entry);
+}
+
+#ifndef _WIN32
+static bctbx_dir_entry_type_t dir_entry_type(unsigned char d_type) {
+	switch (d_type) {
+		case DT_REG:
+			return BCTBX_DIR_ENTRY_FILE;
+		case DT_DIR:
+			return BCTBX_DIR_ENTRY_DIRECTORY;
+		case DT_LNK:
+			return BCTBX_DIR_ENTRY_SYMLINK;
+		case DT_UNKNOWN:
+			return BCTBX_DIR_ENTRY_UNKNOWN;
+		default:
+			return BCTBX_DIR_ENTRY_OTHER;
+	}
+}
+
+#ifdef BCTBX_HAVE_GETDENTS64
+/* layout of the records returned by the getdents64 system call */
+struct linux_dirent64 {
+	uint64_t d_ino;
+	int64_t d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[];
+};
+#endif
+
+/**
+ * Scan a directory given by an opened file descriptor, the descriptor is not closed.
+ * @param buffer A buffer of DIR_SCAN_BUFFER_SIZE bytes to read the entries with getdents64, NULL to allocate one
+ * @return 0 once all the entries are visited, the non zero value returned by the callback, -errno on error
+ */
+static int dir_scan_fd(int fd, const dir_scan_filter_t *filter, char *buffer) {
+	int ret = 0;
+#ifdef BCTBX_HAVE_GETDENTS64
+	// read the entries by large batches straight from the kernel
+	char *ownBuffer = (buffer == NULL) ? bctbx_malloc(DIR_SCAN_BUFFER_SIZE) : NULL;
+	if (ownBuffer) buffer = ownBuffer;
+	while (ret == 0) {
+		long size = syscall(SYS_getdents64, fd, buffer, DIR_SCAN_BUFFER_SIZE);
+		if (size < 0) {
+			if (errno == EINTR) continue;
+			ret = -errno;
+			break;
+		}
+		if (size == 0) break; // end of directory
+		for (long position = 0; position < size && ret == 0;) {
+			struct linux_dirent64 *dirent = (struct linux_dirent64 *)(buffer + position);
+			ret = dir_scan_entry(filter, dirent->d_name, strlen(dirent->d_name), dir_entry_type(dirent->d_type), fd);
+			position += dirent->d_reclen;
+		}
+	}
+	if (ownBuffer) bctbx_free(ownBuffer);
+#else
+	(void)buffer;
+	int dupFd = dup(fd);
+	DIR *dir = (dupFd < 0) ? NULL : fdopendir(dupFd);
+	if (dir == NULL) {
+		ret = -errno;
+		if (dupFd >= 0) close(dupFd);
+		return ret;
+	}
+	struct dirent *ent;
+	errno = 0;
+	while (ret == 0 && (ent = readdir(dir)) != NULL) {
+		ret = dir_scan_entry(filter, ent->d_name, strlen(ent->d_name), dir_entry_type(ent->d_type), fd);
+	}
+	if (ret == 0 && errno != 0) ret = -errno;
+	closedir(dir);
+#endif
+	return ret;
+}
+#endif /* _WIN32 */
+
+int bctbx_dir_scan(const char *path, const char *suffix, bctbx_dir_scan_cb_t cb, void *user_data) {
+	if (path == NULL || cb == NULL) return -EINVAL;
+	dir_scan_filter_t filter;
+	filter.suffix = suffix;
+	filter.suffixLength = (suffix != NULL) ? strlen(suffix) : 0;
+	filter.cb = cb;
+	filter.userData = user_data;
+
+#ifdef _WIN32
+	WIN32_FIND_DATAA fileData;
+	char *pattern = bctbx_strdup_printf("%s\\*", path);
+	HANDLE hSearch =
+	    FindFirstFileExA(pattern, FindExInfoBasic, &fileData, FindExSearchNameMatch, NULL, FIND_FIRST_EX_LARGE_FETCH);
+	bctbx_free(pattern);
+	if (hSearch == INVALID_HANDLE_VALUE) {
+		return (GetLastError() == ERROR_FILE_NOT_FOUND) ? 0 : -ENOENT;
+	}
+	int ret = 0;
+	do {
+		bctbx_dir_entry_type_t type = BCTBX_DIR_ENTRY_FILE;
+		if (fileData.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) type = BCTBX_DIR_ENTRY_SYMLINK;
+		else if (fileData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) type = BCTBX_DIR_ENTRY_DIRECTORY;
+		ret = dir_scan_entry(&filter, fileData.cFileName, strlen(fileData.cFileName), type, -1);
+	} while (ret == 0 && FindNextFileA(hSearch, &fileData));
+	FindClose(hSearch);
+	return ret;
+#else
+	int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd < 0) return -errno;
+	int ret = dir_scan_fd(fd, &filter, NULL);
+	close(fd);
+	return ret;
+#endif
+}
+
+/* Entries are collected with their name offset in a single names buffer, turned into pointers once complete */
+typedef struct dir_list_builder_t {
+	bctbx_dir_entry_t *entries;
+	size_t count;
+	size_t capacity;
+	char *names;
+	size_t namesSize;
+	size_t namesCapacity;
+} dir_list_builder_t;
+
+static int dir_list_add(void *user_data, const bctbx_dir_entry_t *entry) {
+	dir_list_builder_t *builder = (dir_list_builder_t *)user_data;
+	if (builder->count == builder->capacity) {
+		builder->capacity = (builder->capacity == 0) ? 64 : builder->capacity * 2;
+		builder->entries = bctbx_realloc(builder->entries, builder->capacity * sizeof(bctbx_dir_entry_t));
+	}
+	if (builder->namesSize + entry->name_length + 1 > builder->namesCapacity) {
+		builder->namesCapacity = (builder->namesCapacity == 0) ? 4096 : builder->namesCapacity * 2;
+		if (builder->namesCapacity < builder->namesSize + entry->name_length + 1) {
+			builder->namesCapacity = builder->namesSize + entry->name_length + 1;
+		}
+		builder->names = bctbx_realloc(builder->names, builder->namesCapacity);
+	}
+	memcpy(builder->names + builder->namesSize, entry->name, entry->name_length + 1);
+	bctbx_dir_entry_t *added = &builder->entries[builder->count++];
+	added->name = (const char *)(uintptr_t)builder->namesSize; // offset until the list is complete
+	added->name_length = entry->name_length;
+	added->type = entry->type;
+	builder->namesSize += entry->name_length + 1;
+	return 0;
+}
+
+bctbx_dir_list_t *bctbx_dir_list(const char *path, const char *suffix) {
+	dir_list_builder_t builder;
+	memset(&builder, 0, sizeof(builder));
+	int ret = bctbx_dir_scan(path, suffix, dir_list_add, &builder);
+	if (ret < 0) {
+		bctbx_error("Couldn't read [%s] directory: %s.", path, strerror(-ret));
+		bctbx_free(builder.entries);
+		bctbx_free(builder.names);
+		return NULL;
+	}
+
+	for (size_t i = 0; i < builder.count; i++) {
+		builder.entries[i].name = builder.names + (uintptr_t)builder.entries[i].name;
+	}
+	bctbx_dir_list_t *list = bctbx_new0(bctbx_dir_list_t, 1);
+	list->entries = builder.entries;
+	list->count = builder.count;
+	list->names = builder.names;
+	return list;
+}
+
+void bctbx_dir_list_free(bctbx_dir_list_t *list) {
+	if (list == NULL) return;
+	bctbx_free(list->entries);
+	bctbx_free(list->names);
+	bctbx_free(list);
+}
+
+/*
+ * Directories down to this depth stay open while their content is walked. Deeper ones are listed first and closed
+ * while their subdirectories are walked, so that a walk holds a bounded number of descriptors and scan buffers.
+ */
+#define TREE_WALK_OPEN_LEVELS 16
+
+/* State of a tree walk: the path of the current entry grows and shrinks as the walk goes down and up the tree */
+typedef struct tree_walker_t {
+	char *path;
+	size_t pathLength;
+	size_t pathCapacity;
+	bctbx_tree_walk_cb_t cb;
+	void *userData;
+	char *buffers[TREE_WALK_OPEN_LEVELS + 1]; /* scan buffer of each open level, the last one shared by the deeper */
+} tree_walker_t;
+
+/* A directory whose content is being walked */
+typedef struct tree_walk_dir_t {
+	tree_walker_t *walker;
+	int fd;
+	int depth;
+	int stop; /* value returned by the callback to stop the walk */
+} tree_walk_dir_t;
+
+static int tree_walk_report(tree_walker_t *walker,
+                            int dirFd,
+                            size_t nameOffset,
+                            bctbx_dir_entry_type_t type,
+                            int depth,
+                            bctbx_tree_walk_event_t event,
+                            int error) {
+	bctbx_tree_walk_entry_t entry;
+	entry.path = walker->path;
+	entry.name = walker->path + nameOffset; // computed at each report, the path buffer moves when it grows
+	entry.type = type;
+	entry.depth = depth;
+	entry.dir_fd = dirFd;
+	entry.event = event;
+	entry.error = error;
+	return walker->cb(walker->userData, &entry);
+}
+
+static int tree_walk_child(void *user_data, const bctbx_dir_entry_t *entry);
+
+#ifndef _WIN32
+/* The scan buffer of a level, allocated on first use and kept until the end of the walk */
+static char *tree_walk_buffer(tree_walker_t *walker, int depth) {
+#ifdef BCTBX_HAVE_GETDENTS64
+	if (depth > TREE_WALK_OPEN_LEVELS) depth = TREE_WALK_OPEN_LEVELS;
+	if (walker->buffers[depth] == NULL) walker->buffers[depth] = bctbx_malloc(DIR_SCAN_BUFFER_SIZE);
+	return walker->buffers[depth];
+#else
+	(void)walker;
+	(void)depth;
+	return NULL; // readdir has its own buffer
+#endif
+}
+
+/* Open again a directory of the walk closed by a deeper level: the one whose path ends at the given length */
+static int tree_walk_reopen(tree_walker_t *walker, size_t length) {
+	char saved = walker->path[length];
+	walker->path[length] = '\0';
+	int fd = open(walker->path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+	walker->path[length] = saved;
+	return fd;
+}
+
+/* Walk the content of a directory deeper than TREE_WALK_OPEN_LEVELS: its entries are read before walking them */
+static int tree_walk_listed(tree_walk_dir_t *dir) {
+	tree_walker_t *walker = dir->walker;
+	dir_list_builder_t builder;
+	memset(&builder, 0, sizeof(builder));
+	dir_scan_filter_t filter;
+	filter.suffix = NULL;
+	filter.suffixLength = 0;
+	filter.cb = dir_list_add;
+	filter.userData = &builder;
+	int ret = dir_scan_fd(dir->fd, &filter, tree_walk_buffer(walker, dir->depth));
+	for (size_t i = 0; ret == 0 && dir->stop == 0 && i < builder.count; i++) {
+		if (dir->fd < 0) { // closed while walking the previous subdirectory
+			dir->fd = tree_walk_reopen(walker, walker->pathLength);
+			if (dir->fd < 0) {
+				ret = -errno;
+				break;
+			}
+		}
+		bctbx_dir_entry_t entry = builder.entries[i];
+		entry.name = builder.names + (uintptr_t)entry.name;
+		tree_walk_child(dir, &entry);
+	}
+	bctbx_free(builder.entries);
+	bctbx_free(builder.names);
+	return ret;
+}
+#endif /* _WIN32 */
+
+static int
+tree_walk_entry(tree_walker_t *walker, int *dirFd, size_t nameOffset, bctbx_dir_entry_type_t type, int depth) {
+	int ret;
+	if (type != BCTBX_DIR_ENTRY_DIRECTORY) {
+		ret = tree_walk_report(walker, *dirFd, nameOffset, type, depth, BCTBX_TREE_WALK_ENTRY, 0);
+		return (ret == BCTBX_TREE_WALK_SKIP_SUBTREE) ? 0 : ret;
+	}
+
+	ret = tree_walk_report(walker, *dirFd, nameOffset, type, depth, BCTBX_TREE_WALK_DIRECTORY_PRE, 0);
+	if (ret == BCTBX_TREE_WALK_SKIP_SUBTREE) return 0;
+	if (ret != 0) return ret;
+
+	tree_walk_dir_t dir;
+	dir.walker = walker;
+	dir.depth = depth;
+	dir.stop = 0;
+#ifdef _WIN32
+	dir.fd = -1;
+	ret = bctbx_dir_scan(walker->path, NULL, tree_walk_child, &dir);
+#else
+	dir.fd = openat(*dirFd, walker->path + nameOffset, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+	if (dir.fd < 0) {
+		ret = -errno;
+	} else if (depth < TREE_WALK_OPEN_LEVELS) {
+		dir_scan_filter_t filter;
+		filter.suffix = NULL;
+		filter.suffixLength = 0;
+		filter.cb = tree_walk_child;
+		filter.userData = &dir;
+		ret = dir_scan_fd(dir.fd, &filter, tree_walk_buffer(walker, depth));
+	} else {
+		if (depth > TREE_WALK_OPEN_LEVELS) { // the parent is listed, it opens itself again when needed
+			close(*dirFd);
+			*dirFd = -1;
+		}
+		ret = tree_walk_listed(&dir);
+	}
+	if (dir.fd >= 0) close(dir.fd);
+#endif
+	if (dir.stop != 0) return dir.stop;
+
+#ifndef _WIN32
+	if (*dirFd < 0) {
+		*dirFd = tree_walk_reopen(walker, nameOffset - 1);
+		if (*dirFd < 0 && ret == 0) ret = -errno;
+	}
+#endif
+	// errors reading the directory are given to the callback
+	ret = tree_walk_report(walker, *dirFd, nameOffset, type, depth, BCTBX_TREE_WALK_DIRECTORY_POST, ret);
+	return (ret == BCTBX_TREE_WALK_SKIP_SUBTREE) ? 0 : ret;
+}
+
+static int tree_walk_child(void *user_data, const bctbx_dir_entry_t *entry) {
+	tree_walk_dir_t *dir = (tree_walk_dir_t *)user_data;
+	tree_walker_t *walker = dir->walker;
+	size_t parentLength = walker->pathLength;
+	size_t needed = parentLength + 1 + entry->name_length + 1;
+	if (needed > walker->pathCapacity) {
+		walker->pathCapacity = (needed > 2 * walker->pathCapacity) ? needed : 2 * walker->pathCapacity;
+		walker->path = bctbx_realloc(walker->path, walker->pathCapacity);
+	}
+	walker->path[parentLength] = '/';
+	memcpy(walker->path + parentLength + 1, entry->name, entry->name_length + 1);
+	walker->pathLength = needed - 1;
+
+	dir->stop = tree_walk_entry(walker, &dir->fd, parentLength + 1, entry->type, dir->depth + 1);
+
+	walker->pathLength = parentLength;
+	walker->path[parentLength] = '\0';
+	return (dir->stop != 0) ? 1 : 0;
+}
+
+int bctbx_tree_walk(const char *path, bctbx_tree_walk_cb_t cb, void *user_data) {
+	if (path == NULL || cb == NULL) return -EINVAL;
+
+	bctbx_dir_entry_type_t type;
+#ifdef _WIN32
+	DWORD attributes = GetFileAttributesA(path);
+	if (attributes == INVALID_FILE_ATTRIBUTES) return -ENOENT;
+	if (attributes & FILE_ATTRIBUTE_REPARSE_POINT) type = BCTBX_DIR_ENTRY_SYMLINK;
+	else if (attributes & FILE_ATTRIBUTE_DIRECTORY) type = BCTBX_DIR_ENTRY_DIRECTORY;
+	else type = BCTBX_DIR_ENTRY_FILE;
+	int rootFd = -1;
+#else
+	struct stat sStat;
+	if (fstatat(AT_FDCWD, path, &sStat, AT_SYMLINK_NOFOLLOW) != 0) return -errno;
+	if (S_ISREG(sStat.st_mode)) type = BCTBX_DIR_ENTRY_FILE;
+	else if (S_ISDIR(sStat.st_mode)) type = BCTBX_DIR_ENTRY_DIRECTORY;
+	else if (S_ISLNK(sStat.st_mode)) type = BCTBX_DIR_ENTRY_SYMLINK;
+	else type = BCTBX_DIR_ENTRY_OTHER;
+	int rootFd = AT_FDCWD;
+#endif
+
+	tree_walker_t walker;
+	walker.pathLength = strlen(path);
+	walker.pathCapacity = walker.pathLength + 256;
+	walker.path = bctbx_malloc(walker.pathCapacity);
+	memcpy(walker.path, path, walker.pathLength + 1);
+	walker.cb = cb;
+	walker.userData = user_data;
+	memset(walker.buffers, 0, sizeof(walker.buffers));
+	int ret = tree_walk_entry(&walker, &rootFd, 0, type, 0);
+	for (int i = 0; i <= TREE_WALK_OPEN_LEVELS; i++) {
+		if (walker.buffers[i]) bctbx_free(walker.buffers[i]);
+	}
+	bctbx_free(walker.path);
+	return ret;
+}
+
+/* Delete the entry reported by a walk, directories once empty */
+static int tree_walk_remove(const bctbx_tree_walk_entry_t *entry) {
+	switch (entry->event) {
+		case BCTBX_TREE_WALK_ENTRY:
+#ifdef _WIN32
+			return remove(entry->path);
+#else
+			return unlinkat(entry->dir_fd, entry->name, 0);
+#endif
+		case BCTBX_TREE_WALK_DIRECTORY_POST:
+#ifdef _WIN32
+			return _rmdir(entry->path);
+#else
+			return unlinkat(entry->dir_fd, entry->name, AT_REMOVEDIR);
+#endif
+		default:
+			return 0;
+	}
+}
+
+static int tree_remove_entry(void *user_data, const bctbx_tree_walk_entry_t *entry) {
+	int *failures = (int *)user_data;
+	if (entry->error != 0 || tree_walk_remove(entry) != 0) (*failures)++;
+	return 0; // keep on deleting what can be
+}
+
+/* A directory deleted by the workers pool */
+typedef struct rmdir_node_t {
+	char *path;
+	struct rmdir_node_t *parent;
+	int pending; /* 1 while the directory is emptied, plus 1 for each of its subdirectories not deleted yet */
+} rmdir_node_t;
+
+typedef struct rmdir_pool_t {
+	bctbx_mutex_t mutex;
+	bctbx_cond_t cond;
+	bctbx_list_t *queue; /* directories to empty, the last found first to keep the number of pending ones low */
+	int busy;            /* number of workers emptying a directory, they may queue more */
+	int failures;
+} rmdir_pool_t;
+
+typedef struct rmdir_job_t {
+	rmdir_pool_t *pool;
+	rmdir_node_t *node;
+} rmdir_job_t;
+
+/* Walk callback emptying one directory: files are deleted, subdirectories are queued for any worker */
+static int rmdir_pool_empty_entry(void *user_data, const bctbx_tree_walk_entry_t *entry) {
+	rmdir_job_t *job = (rmdir_job_t *)user_data;
+	rmdir_pool_t *pool = job->pool;
+	int failed = 0;
+	if (entry->depth == 0) {
+		failed = (entry->error != 0);
+	} else if (entry->event == BCTBX_TREE_WALK_DIRECTORY_PRE) {
+		rmdir_node_t *child = bctbx_new0(rmdir_node_t, 1);
+		child->path = bctbx_strdup(entry->path);
+		child->parent = job->node;
+		child->pending = 1;
+		bctbx_mutex_lock(&pool->mutex);
+		job->node->pending++;
+		pool->queue = bctbx_list_prepend(pool->queue, child);
+		bctbx_cond_signal(&pool->cond);
+		bctbx_mutex_unlock(&pool->mutex);
+		return BCTBX_TREE_WALK_SKIP_SUBTREE;
+	} else {
+		failed = (tree_walk_remove(entry) != 0);
+	}
+	if (failed) {
+		bctbx_mutex_lock(&pool->mutex);
+		pool->failures++;
+		bctbx_mutex_unlock(&pool->mutex);
+	}
+	return 0;
+}
+
+/* Called with the pool mutex locked: delete the directories which are done, going up the tree */
+static void rmdir_pool_release(rmdir_pool_t *pool, rmdir_node_t *node) {
+	while (node != NULL && --node->pending == 0) {
+#ifdef _WIN32
+		if (_rmdir(node->path) != 0) pool->failures++;
+#else
+		if (rmdir(node->path) != 0) pool->failures++;
+#endif
+		rmdir_node_t *parent = node->parent;
+		bctbx_free(node->path);
+		bctbx_free(node);
+		node = parent;
+	}
+}
+
+static void *rmdir_pool_worker(void *data) {
+	rmdir_pool_t *pool = (rmdir_pool_t *)data;
+	bctbx_mutex_lock(&pool->mutex);
+	for (;;) {
+		while (pool->queue == NULL && pool->busy > 0) {
+			bctbx_cond_wait(&pool->cond, &pool->mutex);
+		}
+		if (pool->queue == NULL) break; // nothing left to do and nobody to queue more
+
+		rmdir_job_t job;
+		job.pool = pool;
+		pool->queue = bctbx_list_pop_front(pool->queue, (void **)&job.node);
+		pool->busy++;
+		bctbx_mutex_unlock(&pool->mutex);
+
+		int ret = bctbx_tree_walk(job.node->path, rmdir_pool_empty_entry, &job);
+
+		bctbx_mutex_lock(&pool->mutex);
+		if (ret != 0) pool->failures++;
+		rmdir_pool_release(pool, job.node);
+		pool->busy--;
+		if (pool->busy == 0 && pool->queue == NULL) bctbx_cond_broadcast(&pool->cond);
+	}
+	bctbx_mutex_unlock(&pool->mutex);
+	return NULL;
+}
+
+int bctbx_rmdir_parallel(const char *path, int max_workers) {
+	if (!bctbx_directory_exists(path)) return -1;
+
+	if (max_workers <= 1) {
+		int failures = 0;
+		int ret = bctbx_tree_walk(path, tree_remove_entry, &failures);
+		return (ret == 0 && failures == 0) ? 0 : -1;
+	}
+
+	rmdir_pool_t pool;
+	memset(&pool, 0, sizeof(pool));
+	bctbx_mutex_init(&pool.mutex, NULL);
+	bctbx_cond_init(&pool.cond, NULL);
+	rmdir_node_t *root = bctbx_new0(rmdir_node_t, 1);
+	root->path = bctbx_strdup(path);
+	root->pending = 1;
+	pool.queue = bctbx_list_prepend(NULL, root);
+
+	// the calling thread is one of the workers
+	int threadCount = 0;
+	bctbx_thread_t *threads = bctbx_new0(bctbx_thread_t, max_workers - 1);
+	for (int i = 0; i < max_workers - 1; i++) {
+		if (bctbx_thread_create(&threads[threadCount], NULL, rmdir_pool_worker, &pool) == 0) threadCount++;
+	}
+	rmdir_pool_worker(&pool);
+	for (int i = 0; i < threadCount; i++) {
+		bctbx_thread_join(threads[i], NULL);
+	}
+	bctbx_free(threads);
+
+	bctbx_cond_destroy(&pool.cond);
+	bctbx_mutex_destroy(&pool.mutex);
+	return (pool.failures == 0) ? 0 : -1;
+}
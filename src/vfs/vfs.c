@@ -26,6 +26,7 @@
 #include "bctoolbox/port.h"
 #include "bctoolbox/vfs.h"
 #include "bctoolbox/vfs_standard.h"
+#include "vfs_private.h"
 #include <errno.h>
 #include <stdarg.h>
 #include <sys/types.h>
@@ -145,6 +146,15 @@ bctbx_vfs_file_t *bctbx_file_open2(bctbx_vfs_t *pVfs, const char *fName, const i
 	return NULL;
 }
 
+/* the fprintf page is the fPage array unless its size was changed by bctbx_file_set_printf_page_size */
+static char *printf_page(bctbx_vfs_file_t *pFile) {
+	return (pFile->fPageBuffer != NULL) ? pFile->fPageBuffer : pFile->fPage;
+}
+
+static size_t printf_page_size(const bctbx_vfs_file_t *pFile) {
+	return (pFile->fPageBuffer != NULL) ? pFile->fPageSize : BCTBX_VFS_PRINTF_PAGE_SIZE;
+}
+
 static ssize_t bctbx_file_flush(bctbx_vfs_file_t *pFile) {
 	if (pFile->fSize == 0) {
 		return 0;
@@ -152,7 +162,7 @@ static ssize_t bctbx_file_flush(bctbx_vfs_file_t *pFile) {
 	size_t fSize = pFile->fSize; // save the size so we could restore it if something goes wrong
 	pFile->fSize =
 	    0; // set it to 0 now so when we call write it won't enter in an infinite loop(as write will call flush)
-	ssize_t r = bctbx_file_write(pFile, pFile->fPage, fSize, pFile->fPageOffset);
+	ssize_t r = bctbx_file_write(pFile, printf_page(pFile), fSize, pFile->fPageOffset);
 	if (r < 0) { // something went wrong, restore the page size
 		pFile->fSize = fSize;
 	}
@@ -194,7 +204,7 @@ int bctbx_file_close(bctbx_vfs_file_t *pFile) {
 		}
 		/* clean the fprint and getline cache as they might hold the plain version of an encrypted file */
 		if (bctbx_file_is_encrypted(pFile)) {
-			bctbx_clean(pFile->fPage, BCTBX_VFS_PRINTF_PAGE_SIZE);
+			bctbx_clean(printf_page(pFile), printf_page_size(pFile));
 			bctbx_clean(pFile->gPage, BCTBX_VFS_GETLINE_PAGE_SIZE);
 		}
 
@@ -202,6 +212,7 @@ int bctbx_file_close(bctbx_vfs_file_t *pFile) {
 		if (ret != 0) {
 			bctbx_error("bctbx_file_close: Error %s freeing file handle anyway", strerror(-(ret)));
 		}
+		if (pFile->fPageBuffer) bctbx_free(pFile->fPageBuffer);
 	}
 	bctbx_free(pFile);
 	return ret;
@@ -248,65 +259,315 @@ int bctbx_file_truncate(bctbx_vfs_file_t *pFile, int64_t size) {
 	return ret;
 }
 
+/* Copy by reading a large buffer and writing it */
+static int64_t file_copy_stream(
+    bctbx_vfs_file_t *src, bctbx_vfs_file_t *dst, int64_t srcOffset, int64_t dstOffset, int64_t length) {
+	int64_t copied = 0;
+	char *buffer = bctbx_malloc(BCTBX_VFS_COPY_BUFFER_SIZE);
+	if (buffer == NULL) return BCTBX_VFS_ERROR;
+
+	while (copied < length) {
+		size_t count = (size_t)MIN((int64_t)BCTBX_VFS_COPY_BUFFER_SIZE, length - copied);
+		ssize_t readSize = bctbx_file_read(src, buffer, count, (off_t)(srcOffset + copied));
+		if (readSize <= 0) {
+			if (readSize < 0) copied = BCTBX_VFS_ERROR;
+			break;
+		}
+		if (bctbx_file_write(dst, buffer, (size_t)readSize, (off_t)(dstOffset + copied)) != readSize) {
+			copied = BCTBX_VFS_ERROR;
+			break;
+		}
+		copied += readSize;
+	}
+	bctbx_free(buffer);
+	return copied;
+}
+
+/* Double buffering state of a pipelined copy: a reader thread fills a buffer while the other one is written */
+typedef struct file_copy_pipeline_t {
+	bctbx_vfs_file_t *src;
+	int64_t offset;       /* where to read next in the source file */
+	int64_t remaining;    /* number of bytes the reader still has to read */
+	char *buffers[2];     /* the two buffers, used alternatively */
+	ssize_t sizes[2];     /* number of bytes read in each buffer, 0 at end of file, negative on error */
+	bool_t filled[2];     /* the buffer was filled by the reader and not yet written */
+	bool_t stop;          /* set by the writer to stop the reader on error */
+	bctbx_mutex_t mutex;
+	bctbx_cond_t cond;
+} file_copy_pipeline_t;
+
+static void *file_copy_reader(void *arg) {
+	file_copy_pipeline_t *pipeline = (file_copy_pipeline_t *)arg;
+	int index = 0;
+	while (TRUE) {
+		bctbx_mutex_lock(&pipeline->mutex);
+		while (pipeline->filled[index] && !pipeline->stop) {
+			bctbx_cond_wait(&pipeline->cond, &pipeline->mutex);
+		}
+		bool_t stop = pipeline->stop;
+		bctbx_mutex_unlock(&pipeline->mutex);
+		if (stop) break;
+
+		size_t count = (size_t)MIN((int64_t)BCTBX_VFS_COPY_BUFFER_SIZE, pipeline->remaining);
+		ssize_t readSize =
+		    (count > 0) ? bctbx_file_read(pipeline->src, pipeline->buffers[index], count, (off_t)pipeline->offset) : 0;
+		if (readSize > 0) {
+			pipeline->offset += readSize;
+			pipeline->remaining -= readSize;
+		}
+
+		bctbx_mutex_lock(&pipeline->mutex);
+		pipeline->sizes[index] = readSize;
+		pipeline->filled[index] = TRUE;
+		bctbx_cond_signal(&pipeline->cond);
+		bctbx_mutex_unlock(&pipeline->mutex);
+		if (readSize <= 0) break;
+		index ^= 1;
+	}
+	return NULL;
+}
+
+/* Copy with reads and writes running in parallel, useful when one side encrypts or decrypts */
+static int64_t file_copy_pipelined(
+    bctbx_vfs_file_t *src, bctbx_vfs_file_t *dst, int64_t srcOffset, int64_t dstOffset, int64_t length) {
+	file_copy_pipeline_t pipeline;
+	bctbx_thread_t reader;
+	int64_t copied = 0;
+	int index = 0;
+
+	memset(&pipeline, 0, sizeof(pipeline));
+	pipeline.src = src;
+	pipeline.offset = srcOffset;
+	pipeline.remaining = length;
+	pipeline.buffers[0] = bctbx_malloc(BCTBX_VFS_COPY_BUFFER_SIZE);
+	pipeline.buffers[1] = bctbx_malloc(BCTBX_VFS_COPY_BUFFER_SIZE);
+	if (pipeline.buffers[0] == NULL || pipeline.buffers[1] == NULL) {
+		bctbx_free(pipeline.buffers[0]);
+		bctbx_free(pipeline.buffers[1]);
+		return BCTBX_VFS_ERROR;
+	}
+	bctbx_mutex_init(&pipeline.mutex, NULL);
+	bctbx_cond_init(&pipeline.cond, NULL);
+	if (bctbx_thread_create(&reader, NULL, file_copy_reader, &pipeline) != 0) {
+		bctbx_mutex_destroy(&pipeline.mutex);
+		bctbx_cond_destroy(&pipeline.cond);
+		bctbx_free(pipeline.buffers[0]);
+		bctbx_free(pipeline.buffers[1]);
+		return file_copy_stream(src, dst, srcOffset, dstOffset, length);
+	}
+
+	while (TRUE) {
+		bctbx_mutex_lock(&pipeline.mutex);
+		while (!pipeline.filled[index]) {
+			bctbx_cond_wait(&pipeline.cond, &pipeline.mutex);
+		}
+		ssize_t size = pipeline.sizes[index];
+		bctbx_mutex_unlock(&pipeline.mutex);
+		if (size <= 0) {
+			if (size < 0) copied = BCTBX_VFS_ERROR;
+			break;
+		}
+
+		ssize_t written = bctbx_file_write(dst, pipeline.buffers[index], (size_t)size, (off_t)(dstOffset + copied));
+
+		bctbx_mutex_lock(&pipeline.mutex);
+		pipeline.filled[index] = FALSE;
+		if (written != size) pipeline.stop = TRUE;
+		bctbx_cond_signal(&pipeline.cond);
+		bctbx_mutex_unlock(&pipeline.mutex);
+		if (written != size) {
+			copied = BCTBX_VFS_ERROR;
+			break;
+		}
+		copied += size;
+		index ^= 1;
+	}
+
+	bctbx_thread_join(reader, NULL);
+	bctbx_mutex_destroy(&pipeline.mutex);
+	bctbx_cond_destroy(&pipeline.cond);
+	if (bctbx_file_is_encrypted(src)) { // buffers hold plain text
+		bctbx_clean(pipeline.buffers[0], BCTBX_VFS_COPY_BUFFER_SIZE);
+		bctbx_clean(pipeline.buffers[1], BCTBX_VFS_COPY_BUFFER_SIZE);
+	}
+	bctbx_free(pipeline.buffers[0]);
+	bctbx_free(pipeline.buffers[1]);
+	return copied;
+}
+
+int64_t bctbx_file_copy(
+    bctbx_vfs_file_t *src, bctbx_vfs_file_t *dst, int64_t srcOffset, int64_t dstOffset, int64_t length) {
+	if (src == NULL || dst == NULL || src == dst || srcOffset < 0 || dstOffset < 0) {
+		return BCTBX_VFS_ERROR;
+	}
+	if (bctbx_file_flush(src) < 0 || bctbx_file_flush(dst) < 0) {
+		return BCTBX_VFS_ERROR;
+	}
+
+	if (length < 0) {
+		ssize_t srcSize = bctbx_file_size(src);
+		if (srcSize < 0) return BCTBX_VFS_ERROR;
+		length = MAX((int64_t)srcSize - srcOffset, 0);
+	}
+	if (length == 0) return 0;
+	dst->gSize = 0; // cancel get cache, as it might be dirty now
+
+	int64_t ret = bctbx_vfs_standard_copy(src, dst, srcOffset, dstOffset, length);
+	if (ret == -ENOTSUP) {
+		if (bctbx_file_is_encrypted(src) || bctbx_file_is_encrypted(dst)) {
+			ret = file_copy_pipelined(src, dst, srcOffset, dstOffset, length);
+		} else {
+			ret = file_copy_stream(src, dst, srcOffset, dstOffset, length);
+		}
+	}
+	if (ret < 0) {
+		bctbx_error("bctbx_file_copy: Error copy %s", strerror((int)-(ret)));
+		return BCTBX_VFS_ERROR;
+	}
+	return ret;
+}
+
+int bctbx_file_allocate(bctbx_vfs_file_t *pFile, int64_t offset, int64_t len) {
+	int ret = BCTBX_VFS_ERROR;
+	if (pFile) {
+		if (offset < 0 || len <= 0) {
+			return BCTBX_VFS_ERROR;
+		}
+		if (pFile->pMethods->pFuncAllocate == NULL) { // preallocation is an optimization only
+			return BCTBX_VFS_OK;
+		}
+		ret = pFile->pMethods->pFuncAllocate(pFile, offset, len);
+		if (ret < 0) {
+			bctbx_error("bctbx_file_allocate: Error allocate %s", strerror((int)-(ret)));
+			ret = BCTBX_VFS_ERROR;
+		}
+	}
+	return ret;
+}
+
+int bctbx_file_advise(bctbx_vfs_file_t *pFile, int64_t offset, int64_t len, bctbx_vfs_advice_t advice) {
+	int ret = BCTBX_VFS_ERROR;
+	if (pFile) {
+		if (offset < 0 || len < 0) {
+			return BCTBX_VFS_ERROR;
+		}
+		if (pFile->pMethods->pFuncAdvise == NULL) { // advice is a hint only
+			return BCTBX_VFS_OK;
+		}
+		ret = pFile->pMethods->pFuncAdvise(pFile, offset, len, advice);
+		if (ret < 0) {
+			bctbx_error("bctbx_file_advise: Error advise %s", strerror((int)-(ret)));
+			ret = BCTBX_VFS_ERROR;
+		}
+	}
+	return ret;
+}
+
 ssize_t bctbx_file_fprintf(bctbx_vfs_file_t *pFile, off_t offset, const char *fmt, ...) {
-	char *ret = NULL;
 	va_list args;
-	ssize_t r = BCTBX_VFS_ERROR;
-	size_t count = 0;
+	va_list argsCopy;
+	ssize_t r;
+	int formatted;
+	size_t count;
+
+	if (pFile == NULL) {
+		return BCTBX_VFS_ERROR;
+	}
+
+	if (offset != 0) {
+		bctbx_file_flush(pFile);
+		pFile->offset = offset;
+	}
 
+	// Format directly in the remaining space of the page, vsnprintf tells us if it did fit
+	char *page = printf_page(pFile);
+	size_t available = printf_page_size(pFile) - pFile->fSize;
 	va_start(args, fmt);
-	ret = bctbx_strdup_vprintf(fmt, args);
-	if (ret != NULL) {
-		va_end(args);
-		count = strlen(ret);
+	va_copy(argsCopy, args);
+	formatted = vsnprintf(page + pFile->fSize, available, fmt, args);
+	va_end(args);
+#ifdef _WIN32
+	if (formatted < 0) { // vsnprintf is _vsnprintf: it returns -1 when the output is truncated, get the actual size
+		va_list argsSize;
+		va_copy(argsSize, argsCopy);
+		formatted = _vscprintf(fmt, argsSize);
+		va_end(argsSize);
+	}
+#endif
+	if (formatted < 0) {
+		va_end(argsCopy);
+		return BCTBX_VFS_ERROR;
+	}
+	count = (size_t)formatted;
 
-		if (offset != 0) {
-			bctbx_file_flush(pFile);
-			pFile->offset = offset;
-		}
+	if (pFile->fSize == 0) {
+		pFile->fPageOffset = pFile->offset;
+	}
+	pFile->gSize = 0; // cancel get cache, as it might be dirty now
 
-		// Shall we write in cache or in the file
-		if (count + pFile->fSize < BCTBX_VFS_PRINTF_PAGE_SIZE) { // Data fits in current page
-			memcpy(pFile->fPage + pFile->fSize, ret, count);
-			if (pFile->fSize == 0) {
-				pFile->fPageOffset = pFile->offset;
-			}
-			bctbx_free(ret);
-			pFile->offset += (off_t)count;
-			pFile->fSize += count;
-			pFile->gSize = 0; // cancel get cache, as it might be dirty now
-			return (ssize_t)count;
-		} else if (pFile->fSize >
-		           0) { // There is a cache but the new data won't fit in : write the cache and the new data
-			char *buf = bctbx_malloc(
-			    count +
-			    pFile->fSize); // allocate a temporary buffer, to store the current cache and the data to be written
-			if (buf == NULL) {
-				bctbx_free(ret);
-				return BCTBX_VFS_ERROR;
-			}
-			memcpy(buf, pFile->fPage, pFile->fSize); // concatenate the cache and new data
-			memcpy(buf + pFile->fSize, ret, count);
-			bctbx_free(ret);
-
-			// We are flushing the cache along the new data to write
-			size_t fSizeBkp = pFile->fSize; // save the size so we could restore it if something goes wrong
-			pFile->fSize = 0;               // cache empty: so the write try to flush it as we are already doing it
-			r = bctbx_file_write(pFile, buf, fSizeBkp + count, pFile->fPageOffset); // write all
-			bctbx_free(buf);
-			if (r < 0) {
-				pFile->fSize = fSizeBkp;
-				return r;
-			}
-			pFile->offset += (off_t)count;
-			return (ssize_t)count;
+	if (count < available) { // Data fits in current page (vsnprintf needs room for the terminating \0)
+		va_end(argsCopy);
+		pFile->offset += (off_t)count;
+		pFile->fSize += count;
+		return (ssize_t)count;
+	}
+
+	// Spill: the output does not fit, format it again after the cached data and write everything at once
+	char *buf = bctbx_malloc(pFile->fSize + count + 1);
+	if (buf == NULL) {
+		va_end(argsCopy);
+		return BCTBX_VFS_ERROR;
+	}
+	memcpy(buf, page, pFile->fSize);
+	vsnprintf(buf + pFile->fSize, count + 1, fmt, argsCopy);
+	va_end(argsCopy);
+
+	// We are flushing the cache along the new data to write
+	size_t fSizeBkp = pFile->fSize; // save the size so we could restore it if something goes wrong
+	pFile->fSize = 0;               // cache empty: so the write try to flush it as we are already doing it
+	r = bctbx_file_write(pFile, buf, fSizeBkp + count, pFile->fPageOffset); // write all
+	if (bctbx_file_is_encrypted(pFile)) {
+		bctbx_clean(buf, fSizeBkp + count);
+	}
+	bctbx_free(buf);
+	if (r < 0) {
+		pFile->fSize = fSizeBkp;
+		return r;
+	}
+	pFile->offset += (off_t)count;
+	return (ssize_t)count;
+}
+
+int bctbx_file_set_printf_page_size(bctbx_vfs_file_t *pFile, size_t size) {
+	if (pFile == NULL) {
+		return BCTBX_VFS_ERROR;
+	}
+	if (bctbx_file_flush(pFile) < 0) {
+		return BCTBX_VFS_ERROR;
+	}
+	if (size == 0) {
+		size = BCTBX_VFS_PRINTF_PAGE_SIZE;
+	}
+	if (size == printf_page_size(pFile)) {
+		return BCTBX_VFS_OK;
+	}
+
+	char *buffer = NULL;
+	if (size != BCTBX_VFS_PRINTF_PAGE_SIZE) {
+		buffer = bctbx_malloc(size);
+		if (buffer == NULL) {
+			return BCTBX_VFS_ERROR;
 		}
-		// no cache and more than one page to write, just write it
-		r = bctbx_file_write(pFile, ret, count, pFile->offset);
-		bctbx_free(ret);
-		if (r > 0) pFile->offset += (off_t)r;
 	}
-	return r;
+	if (pFile->fPageBuffer != NULL) {
+		if (bctbx_file_is_encrypted(pFile)) {
+			bctbx_clean(pFile->fPageBuffer, pFile->fPageSize);
+		}
+		bctbx_free(pFile->fPageBuffer);
+	}
+	pFile->fPageBuffer = buffer;
+	pFile->fPageSize = (buffer != NULL) ? size : 0;
+	return BCTBX_VFS_OK;
 }
 
 /**
@@ -342,15 +603,7 @@ off_t bctbx_file_seek(bctbx_vfs_file_t *pFile, off_t offset, int whence) {
 }
 
 static char *findNextLine(const char *buf) {
-	char *pNextLine = NULL;
-	char *pNextLineR = NULL;
-	char *pNextLineN = NULL;
-	pNextLineR = strchr(buf, '\r');
-	pNextLineN = strchr(buf, '\n');
-	if ((pNextLineR != NULL) && (pNextLineN != NULL)) pNextLine = MIN(pNextLineR, pNextLineN);
-	else if (pNextLineR != NULL) pNextLine = pNextLineR;
-	else if (pNextLineN != NULL) pNextLine = pNextLineN;
-	return pNextLine;
+	return strpbrk(buf, "\r\n"); // one pass for both terminators
 }
 /* a generic implementation of get_nxt_line
  * if a vfs does not specify one, use this one
@@ -473,6 +726,109 @@ int bctbx_file_get_nxtline(bctbx_vfs_file_t *pFile, char *s, int maxlen) {
 	return BCTBX_VFS_ERROR;
 }
 
+struct bctbx_vfs_line_iterator_t {
+	bctbx_vfs_file_t *pFile;
+	char *buffer;      /* read data, one extra byte is always available to terminate the current line */
+	size_t capacity;   /* size of buffer, excluding the extra byte */
+	size_t start;      /* beginning of the next line in buffer */
+	size_t end;        /* end of the data in buffer */
+	size_t nextLF;     /* index of the next \n at or after start, end if there is none in buffer */
+	size_t nextCR;     /* index of the next \r at or after start, end if there is none in buffer */
+	off_t readOffset;  /* file offset of the data following the buffer content */
+	size_t readSize;   /* size of each read on the file */
+	bool_t eof;        /* the end of file was reached */
+};
+
+/* memchr scans each byte at most once per terminator: the position of the next \r and \n are kept */
+static size_t line_iterator_find(const bctbx_vfs_line_iterator_t *it, size_t from, char c) {
+	const char *p = memchr(it->buffer + from, c, it->end - from);
+	return p ? (size_t)(p - it->buffer) : it->end;
+}
+
+/* Append data to the buffer, moving the unread data to its beginning or growing it when needed */
+static int line_iterator_refill(bctbx_vfs_line_iterator_t *it) {
+	if (it->start > 0) {
+		memmove(it->buffer, it->buffer + it->start, it->end - it->start);
+		it->end -= it->start;
+		it->nextLF -= it->start;
+		it->nextCR -= it->start;
+		it->start = 0;
+	}
+	if (it->capacity - it->end < it->readSize) {
+		size_t capacity = MAX(it->capacity * 2, it->end + it->readSize);
+		char *buffer = bctbx_realloc(it->buffer, capacity + 1);
+		if (buffer == NULL) return BCTBX_VFS_ERROR;
+		it->buffer = buffer;
+		it->capacity = capacity;
+	}
+
+	ssize_t ret = bctbx_file_read(it->pFile, it->buffer + it->end, it->capacity - it->end, it->readOffset);
+	if (ret < 0) return BCTBX_VFS_ERROR;
+	if (ret == 0) {
+		it->eof = TRUE;
+		return BCTBX_VFS_OK;
+	}
+	size_t previousEnd = it->end;
+	it->end += (size_t)ret;
+	it->readOffset += (off_t)ret;
+	if (it->nextLF == previousEnd) it->nextLF = line_iterator_find(it, previousEnd, '\n');
+	if (it->nextCR == previousEnd) it->nextCR = line_iterator_find(it, previousEnd, '\r');
+	return BCTBX_VFS_OK;
+}
+
+bctbx_vfs_line_iterator_t *bctbx_file_line_iterator_new(bctbx_vfs_file_t *pFile, size_t readSize) {
+	if (pFile == NULL) return NULL;
+	bctbx_vfs_line_iterator_t *it = bctbx_new0(bctbx_vfs_line_iterator_t, 1);
+	it->pFile = pFile;
+	it->readOffset = pFile->offset;
+	it->readSize = (readSize > 0) ? readSize : BCTBX_VFS_LINE_ITERATOR_READ_SIZE;
+	return it;
+}
+
+int bctbx_file_line_iterator_next(bctbx_vfs_line_iterator_t *it, const char **line, size_t *length) {
+	if (it == NULL || line == NULL) return BCTBX_VFS_ERROR;
+
+	while (TRUE) {
+		size_t eol = MIN(it->nextLF, it->nextCR);
+		size_t next;
+		if (eol < it->end) {
+			if (it->buffer[eol] == '\r' && eol + 1 == it->end && !it->eof) {
+				// a \r ending the buffer may be followed by a \n: get more data first
+				if (line_iterator_refill(it) < 0) return BCTBX_VFS_ERROR;
+				continue;
+			}
+			next = eol + 1;
+			if (it->buffer[eol] == '\r' && next < it->end && it->buffer[next] == '\n') next++;
+		} else if (it->eof) {
+			if (it->start == it->end) return 0;
+			eol = next = it->end; // last line has no terminator
+		} else {
+			if (line_iterator_refill(it) < 0) return BCTBX_VFS_ERROR;
+			continue;
+		}
+
+		*line = it->buffer + it->start;
+		if (length) *length = eol - it->start;
+		it->buffer[eol] = '\0';
+		it->pFile->offset += (off_t)(next - it->start);
+		it->start = next;
+		if (it->nextLF < next) it->nextLF = line_iterator_find(it, next, '\n');
+		if (it->nextCR < next) it->nextCR = line_iterator_find(it, next, '\r');
+		return 1;
+	}
+}
+
+void bctbx_file_line_iterator_destroy(bctbx_vfs_line_iterator_t *it) {
+	if (it == NULL) return;
+	if (it->buffer) {
+		if (bctbx_file_is_encrypted(it->pFile)) {
+			bctbx_clean(it->buffer, it->capacity);
+		}
+		bctbx_free(it->buffer);
+	}
+	bctbx_free(it);
+}
+
 bool_t bctbx_file_is_encrypted(bctbx_vfs_file_t *pFile) {
 	if (pFile && pFile->pMethods && pFile->pMethods->pFuncIsEncrypted) {
 		return pFile->pMethods->pFuncIsEncrypted(pFile);
@@ -0,0 +1,641 @@
+/*
+ * Copyright (c) 2025 Belledonne Communications SARL.
+ *
+ * This file is part of bctoolbox.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "bctoolbox/vfs_cache.h"
+#include "bctoolbox/defs.h"
+#include "bctoolbox/logging.h"
+#include "bctoolbox/vfs.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <list>
+#include <map>
+#include <mutex>
+#include <vector>
+
+// MSVC does not define O_ACCMODE...
+#ifndef O_ACCMODE
+#define O_ACCMODE (_O_RDONLY | _O_WRONLY | _O_RDWR)
+#endif
+
+// someone does include the evil windef.h so we must undef the min and max macros to be able to use std::min and
+// std::max
+#undef min
+#undef max
+
+namespace bctoolbox {
+
+namespace {
+
+constexpr size_t pageSize = BCTBX_VFS_CACHE_PAGE_SIZE;
+constexpr size_t maxReadAheadPages = 32; // on miss, read at most this number of consecutive missing pages in one call
+
+class CachedFile;
+
+struct CachePage {
+	CachedFile *mFile;
+	uint64_t mIndex;
+	std::vector<uint8_t> mData; /**< always pageSize long, bytes after mSize are 0 */
+	size_t mSize;               /**< number of valid bytes in the page */
+	bool mDirty;
+	uint64_t mVersion; /**< incremented by each write, tells whether a page was modified while written back */
+	bool mInFlight;    /**< being written back by a sync, the page must not be evicted */
+};
+
+using PageList = std::list<CachePage>;
+
+/** Store in the bctbx_vfs_file_t userData field the cache state of an opened file */
+class CachedFile {
+public:
+	CachedFile(bctbx_vfs_file_t *underlyingFp, bool append)
+	    : pFileUnderlying(underlyingFp), mFileSize(0), mAppend(append), mEncrypted(false) {
+	}
+
+	bctbx_vfs_file_t *pFileUnderlying; /**< the file opened with the underlying vfs */
+	uint64_t mFileSize;                /**< file size including the data still in dirty pages */
+	bool mAppend;                      /**< file opened with O_APPEND: the actual write offset is unknown, write through */
+	bool mEncrypted;                   /**< the underlying file is encrypted: pages hold plain text, clean them */
+	bool mSyncing = false;             /**< a sync is writing pages back without the cache mutex held */
+	std::map<uint64_t, PageList::iterator> mPages; /**< cached pages of this file, ordered by index */
+};
+
+/* overwrite a buffer holding plain text of an encrypted file, the volatile prevents the compiler to drop it */
+void cleanBuffer(std::vector<uint8_t> &buffer) {
+	volatile uint8_t *p = buffer.data();
+	for (size_t i = 0; i < buffer.size(); i++) {
+		p[i] = 0;
+	}
+}
+
+/* Consecutive dirty pages copied to be written back in one call */
+struct DirtyRun {
+	uint64_t mOffset;
+	std::vector<uint8_t> mData;
+	std::vector<std::pair<uint64_t, uint64_t>> mPages; /**< index and version of the pages of the run */
+};
+
+/**
+ * The page cache shared by all files opened through any caching vfs.
+ * Pages are kept in a single LRU list (front is the most recently used), each file indexes its own pages.
+ * All operations, including the underlying vfs accesses, are performed with the cache mutex held, except for sync:
+ * it writes copies of the dirty pages and syncs the underlying file without it, so that a slow sync does not block the
+ * other files. Meanwhile the pages being written back are not evicted, and the operations writing to the underlying
+ * file directly (close, truncate, append) wait for the end of the sync.
+ */
+class PageCache {
+public:
+	static PageCache &get() {
+		static PageCache sInstance;
+		return sInstance;
+	}
+
+	ssize_t read(CachedFile &file, void *buf, size_t count, off_t offset);
+	ssize_t write(CachedFile &file, const void *buf, size_t count, off_t offset);
+	int sync(CachedFile &file);
+	int truncate(CachedFile &file, int64_t newSize);
+	int close(CachedFile &file);
+	ssize_t fileSize(CachedFile &file);
+	void open(CachedFile &file);
+
+	void setBudget(size_t budget);
+	size_t getBudget();
+	void getStats(bctbx_vfs_cache_stats_t *stats);
+	float getHitRatio();
+	void resetStats();
+
+private:
+	PageCache() = default;
+
+	PageList::iterator lookup(CachedFile &file, uint64_t index);
+	PageList::iterator insert(CachedFile &file, uint64_t index);
+	void release(PageList::iterator page);
+	ssize_t fill(CachedFile &file, uint64_t index, size_t pageCount);
+	int flush(CachedFile &file);
+	std::vector<DirtyRun> collectDirtyRuns(CachedFile &file);
+	ssize_t writeRun(CachedFile &file, DirtyRun &run);
+	void completeRun(CachedFile &file, const DirtyRun &run, bool written);
+	void waitSync(std::unique_lock<std::mutex> &lock, CachedFile &file);
+	void drop(CachedFile &file, uint64_t fromIndex);
+	void enforceBudget();
+
+	std::mutex mMutex;
+	std::condition_variable mSyncDone;
+	PageList mLru;
+	size_t mBudget = BCTBX_VFS_CACHE_DEFAULT_MEMORY_BUDGET;
+	size_t mMemoryUsed = 0;
+	uint64_t mHits = 0;
+	uint64_t mMisses = 0;
+	uint64_t mEvictions = 0;
+	uint64_t mWritebacks = 0;
+};
+
+/* Find a page and move it to the front of the LRU list, returns mLru.end() if it is not in cache */
+PageList::iterator PageCache::lookup(CachedFile &file, uint64_t index) {
+	auto it = file.mPages.find(index);
+	if (it == file.mPages.end()) return mLru.end();
+	mLru.splice(mLru.begin(), mLru, it->second);
+	return it->second;
+}
+
+/* Create an empty page at the front of the LRU list */
+PageList::iterator PageCache::insert(CachedFile &file, uint64_t index) {
+	mLru.push_front({&file, index, std::vector<uint8_t>(pageSize, 0), 0, false, 0, false});
+	file.mPages[index] = mLru.begin();
+	mMemoryUsed += pageSize;
+	return mLru.begin();
+}
+
+/* Remove a page from the cache, its content is discarded */
+void PageCache::release(PageList::iterator page) {
+	if (page->mFile->mEncrypted) {
+		cleanBuffer(page->mData);
+	}
+	page->mFile->mPages.erase(page->mIndex);
+	mLru.erase(page);
+	mMemoryUsed -= pageSize;
+}
+
+/**
+ * Load pageCount consecutive pages, starting at index, from the underlying file in one read.
+ * Data beyond what the underlying file holds and up to the cached file size is set to 0: it is a gap
+ * created by a write beyond the end of file not yet written back.
+ * @return the number of bytes read from the underlying file, a negative value on error
+ */
+ssize_t PageCache::fill(CachedFile &file, uint64_t index, size_t pageCount) {
+	std::vector<uint8_t> buffer(pageCount * pageSize, 0);
+	ssize_t ret = bctbx_file_read(file.pFileUnderlying, buffer.data(), buffer.size(), (off_t)(index * pageSize));
+	if (ret < 0) return ret;
+
+	for (size_t i = 0; i < pageCount; i++) {
+		uint64_t pageOffset = (index + i) * pageSize;
+		auto page = insert(file, index + i);
+		std::memcpy(page->mData.data(), buffer.data() + i * pageSize, pageSize);
+		page->mSize = (size_t)std::min<uint64_t>(pageSize, file.mFileSize - std::min(pageOffset, file.mFileSize));
+	}
+	mMisses += pageCount;
+	if (file.mEncrypted) {
+		cleanBuffer(buffer);
+	}
+	return ret;
+}
+
+/* Copy the dirty pages of a file in runs of consecutive pages, only the last page of a run may be incomplete */
+std::vector<DirtyRun> PageCache::collectDirtyRuns(CachedFile &file) {
+	std::vector<DirtyRun> runs;
+	uint64_t nextIndex = 0;
+	for (const auto &entry : file.mPages) {
+		const CachePage &page = *entry.second;
+		if (!page.mDirty) continue;
+		if (runs.empty() || entry.first != nextIndex || runs.back().mData.size() % pageSize != 0) {
+			runs.push_back({entry.first * pageSize, {}, {}});
+		}
+		DirtyRun &run = runs.back();
+		run.mData.insert(run.mData.end(), page.mData.cbegin(), page.mData.cbegin() + page.mSize);
+		run.mPages.emplace_back(entry.first, page.mVersion);
+		nextIndex = entry.first + 1;
+	}
+	return runs;
+}
+
+ssize_t PageCache::writeRun(CachedFile &file, DirtyRun &run) {
+	ssize_t ret = bctbx_file_write(file.pFileUnderlying, run.mData.data(), run.mData.size(), (off_t)run.mOffset);
+	if (ret < 0) {
+		bctbx_error("vfs cache: unable to write back %zu page(s) at offset %llu", run.mPages.size(),
+		            (unsigned long long)run.mOffset);
+	}
+	if (file.mEncrypted) {
+		cleanBuffer(run.mData);
+	}
+	return ret;
+}
+
+/* Mark the pages of a run clean once written back, unless they were modified meanwhile */
+void PageCache::completeRun(CachedFile &file, const DirtyRun &run, bool written) {
+	for (const auto &runPage : run.mPages) {
+		auto it = file.mPages.find(runPage.first);
+		if (it == file.mPages.end()) continue;
+		it->second->mInFlight = false;
+		if (written && it->second->mVersion == runPage.second) it->second->mDirty = false;
+	}
+	if (written) mWritebacks += run.mPages.size();
+}
+
+/* Write back all the dirty pages of a file, consecutive full pages are written in one call */
+int PageCache::flush(CachedFile &file) {
+	for (auto &run : collectDirtyRuns(file)) {
+		bool written = writeRun(file, run) >= 0;
+		completeRun(file, run, written);
+		if (!written) return BCTBX_VFS_ERROR;
+	}
+	return BCTBX_VFS_OK;
+}
+
+/* Wait until no sync is writing back the pages of a file */
+void PageCache::waitSync(std::unique_lock<std::mutex> &lock, CachedFile &file) {
+	mSyncDone.wait(lock, [&file]() { return !file.mSyncing; });
+}
+
+/* Discard all pages of a file with an index greater or equal to fromIndex, dirty or not */
+void PageCache::drop(CachedFile &file, uint64_t fromIndex) {
+	auto it = file.mPages.lower_bound(fromIndex);
+	while (it != file.mPages.end()) {
+		auto page = (it++)->second;
+		release(page);
+	}
+}
+
+/* Evict least recently used pages until the memory budget is respected */
+void PageCache::enforceBudget() {
+	while (mMemoryUsed > mBudget) {
+		auto page = mLru.end();
+		for (auto it = mLru.rbegin(); it != mLru.rend(); ++it) {
+			if (!it->mInFlight) {
+				page = std::prev(it.base());
+				break;
+			}
+		}
+		// only pages being written back by a sync are left, enforced again at its end
+		if (page == mLru.end()) return;
+		if (page->mDirty) {
+			ssize_t ret = bctbx_file_write(page->mFile->pFileUnderlying, page->mData.data(), page->mSize,
+			                               (off_t)(page->mIndex * pageSize));
+			if (ret < 0) {
+				// do not loose data: keep the page and let the cache overshoot its budget until the next sync
+				bctbx_error("vfs cache: unable to write back evicted page, cache is over its memory budget");
+				return;
+			}
+			mWritebacks++;
+		}
+		release(page);
+		mEvictions++;
+	}
+}
+
+void PageCache::open(CachedFile &file) {
+	std::lock_guard<std::mutex> lock(mMutex);
+	ssize_t size = bctbx_file_size(file.pFileUnderlying);
+	file.mFileSize = size > 0 ? (uint64_t)size : 0;
+	file.mEncrypted = bctbx_file_is_encrypted(file.pFileUnderlying);
+}
+
+ssize_t PageCache::read(CachedFile &file, void *buf, size_t count, off_t offset) {
+	if (offset < 0) return BCTBX_VFS_ERROR;
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	uint64_t position = (uint64_t)offset;
+	if (position >= file.mFileSize || count == 0) return 0;
+	uint64_t end = std::min<uint64_t>(position + count, file.mFileSize);
+	uint64_t lastIndex = (end - 1) / pageSize;
+	uint64_t filledUntil = 0; // pages loaded by this read are not counted as hits
+	uint8_t *out = static_cast<uint8_t *>(buf);
+
+	while (position < end) {
+		uint64_t index = position / pageSize;
+		auto page = lookup(file, index);
+		if (page == mLru.end()) {
+			// read ahead all the consecutive missing pages needed by this read
+			size_t pageCount = 1;
+			while (pageCount < maxReadAheadPages && index + pageCount <= lastIndex &&
+			       file.mPages.find(index + pageCount) == file.mPages.end()) {
+				pageCount++;
+			}
+			if (fill(file, index, pageCount) < 0) return BCTBX_VFS_ERROR;
+			filledUntil = index + pageCount;
+			page = lookup(file, index);
+		} else if (index >= filledUntil) {
+			mHits++;
+		}
+
+		size_t inPageOffset = (size_t)(position % pageSize);
+		size_t size = (size_t)std::min<uint64_t>(pageSize - inPageOffset, end - position);
+		std::memcpy(out, page->mData.data() + inPageOffset, size);
+		out += size;
+		position += size;
+		enforceBudget();
+	}
+	return (ssize_t)(end - (uint64_t)offset);
+}
+
+ssize_t PageCache::write(CachedFile &file, const void *buf, size_t count, off_t offset) {
+	if (offset < 0) return BCTBX_VFS_ERROR;
+	std::unique_lock<std::mutex> lock(mMutex);
+
+	if (file.mAppend) {
+		// the underlying vfs decides where data goes, keep ordering and cache coherency by writing through
+		waitSync(lock, file);
+		if (flush(file) != BCTBX_VFS_OK) return BCTBX_VFS_ERROR;
+		drop(file, 0);
+		ssize_t ret = bctbx_file_write(file.pFileUnderlying, buf, count, offset);
+		ssize_t size = bctbx_file_size(file.pFileUnderlying);
+		file.mFileSize = size > 0 ? (uint64_t)size : 0;
+		return ret;
+	}
+
+	uint64_t position = (uint64_t)offset;
+	uint64_t end = position + count;
+	const uint8_t *in = static_cast<const uint8_t *>(buf);
+
+	while (position < end) {
+		uint64_t index = position / pageSize;
+		size_t inPageOffset = (size_t)(position % pageSize);
+		size_t size = (size_t)std::min<uint64_t>(pageSize - inPageOffset, end - position);
+
+		auto page = lookup(file, index);
+		if (page == mLru.end()) {
+			if (size == pageSize || index * pageSize >= file.mFileSize) {
+				// whole page overwritten or beyond end of file: nothing to load
+				page = insert(file, index);
+			} else {
+				if (fill(file, index, 1) < 0) return BCTBX_VFS_ERROR;
+				page = lookup(file, index);
+			}
+		} else {
+			mHits++;
+		}
+
+		std::memcpy(page->mData.data() + inPageOffset, in, size);
+		page->mSize = std::max(page->mSize, inPageOffset + size);
+		page->mDirty = true;
+		page->mVersion++;
+		in += size;
+		position += size;
+		file.mFileSize = std::max(file.mFileSize, position);
+		enforceBudget();
+	}
+	return (ssize_t)count;
+}
+
+int PageCache::sync(CachedFile &file) {
+	std::unique_lock<std::mutex> lock(mMutex);
+	waitSync(lock, file);
+	file.mSyncing = true;
+	std::vector<DirtyRun> runs = collectDirtyRuns(file);
+	for (const auto &run : runs) {
+		for (const auto &page : run.mPages) {
+			file.mPages[page.first]->mInFlight = true;
+		}
+	}
+	lock.unlock();
+
+	int ret = BCTBX_VFS_OK;
+	size_t writtenRuns = 0;
+	for (auto &run : runs) {
+		if (writeRun(file, run) < 0) {
+			ret = BCTBX_VFS_ERROR;
+			break;
+		}
+		writtenRuns++;
+	}
+	if (ret == BCTBX_VFS_OK) ret = bctbx_file_sync(file.pFileUnderlying);
+
+	lock.lock();
+	for (size_t i = 0; i < runs.size(); i++) {
+		completeRun(file, runs[i], i < writtenRuns);
+	}
+	file.mSyncing = false;
+	mSyncDone.notify_all();
+	enforceBudget();
+	return ret;
+}
+
+int PageCache::truncate(CachedFile &file, int64_t newSize) {
+	if (newSize < 0) return BCTBX_VFS_ERROR;
+	std::unique_lock<std::mutex> lock(mMutex);
+	waitSync(lock, file);
+
+	// truncate first, so that the dirty pages are kept if it fails
+	int ret = bctbx_file_truncate(file.pFileUnderlying, newSize);
+	if (ret < 0) return ret;
+
+	uint64_t size = (uint64_t)newSize;
+	// drop pages after the new end of file, adjust the one holding the new end of file
+	drop(file, (size + pageSize - 1) / pageSize);
+	auto it = file.mPages.find(size / pageSize);
+	if (it != file.mPages.end() && size % pageSize != 0) {
+		auto page = it->second;
+		size_t validSize = (size_t)(size % pageSize);
+		if (page->mSize > validSize) {
+			std::fill(page->mData.begin() + validSize, page->mData.end(), 0);
+			page->mSize = validSize;
+		}
+	}
+	file.mFileSize = size;
+	return 0;
+}
+
+int PageCache::close(CachedFile &file) {
+	std::unique_lock<std::mutex> lock(mMutex);
+	waitSync(lock, file);
+	int ret = flush(file);
+	drop(file, 0);
+	return ret;
+}
+
+ssize_t PageCache::fileSize(CachedFile &file) {
+	std::lock_guard<std::mutex> lock(mMutex);
+	return (ssize_t)file.mFileSize;
+}
+
+void PageCache::setBudget(size_t budget) {
+	std::lock_guard<std::mutex> lock(mMutex);
+	mBudget = budget;
+	enforceBudget();
+}
+
+size_t PageCache::getBudget() {
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mBudget;
+}
+
+void PageCache::getStats(bctbx_vfs_cache_stats_t *stats) {
+	std::lock_guard<std::mutex> lock(mMutex);
+	stats->hits = mHits;
+	stats->misses = mMisses;
+	stats->evictions = mEvictions;
+	stats->writebacks = mWritebacks;
+	stats->memory_used = mMemoryUsed;
+	stats->memory_budget = mBudget;
+}
+
+float PageCache::getHitRatio() {
+	std::lock_guard<std::mutex> lock(mMutex);
+	if (mHits + mMisses == 0) return 0.0f;
+	return (float)mHits / (float)(mHits + mMisses);
+}
+
+void PageCache::resetStats() {
+	std::lock_guard<std::mutex> lock(mMutex);
+	mHits = 0;
+	mMisses = 0;
+	mEvictions = 0;
+	mWritebacks = 0;
+}
+
+/* A caching vfs: the bctbx_vfs_t must be the first member so the pointer given to pFuncOpen can be cast back */
+struct CacheVfs {
+	bctbx_vfs_t mVfs;
+	bctbx_vfs_t *mUnderlying;
+};
+
+} // namespace
+
+} // namespace bctoolbox
+
+using namespace bctoolbox;
+
+static int bcClose(bctbx_vfs_file_t *pFile) {
+	int ret = BCTBX_VFS_ERROR;
+	if (pFile && pFile->pUserData) {
+		CachedFile *ctx = static_cast<CachedFile *>(pFile->pUserData);
+		ret = PageCache::get().close(*ctx);
+		int closeRet = bctbx_file_close(ctx->pFileUnderlying);
+		if (ret == BCTBX_VFS_OK) ret = closeRet;
+		delete ctx;
+		pFile->pUserData = NULL;
+	}
+	return ret;
+}
+
+static ssize_t bcRead(bctbx_vfs_file_t *pFile, void *buf, size_t count, off_t offset) {
+	if (pFile && pFile->pUserData) {
+		return PageCache::get().read(*static_cast<CachedFile *>(pFile->pUserData), buf, count, offset);
+	}
+	return BCTBX_VFS_ERROR;
+}
+
+static ssize_t bcWrite(bctbx_vfs_file_t *pFile, const void *buf, size_t count, off_t offset) {
+	if (pFile && pFile->pUserData) {
+		return PageCache::get().write(*static_cast<CachedFile *>(pFile->pUserData), buf, count, offset);
+	}
+	return BCTBX_VFS_ERROR;
+}
+
+static int bcTruncate(bctbx_vfs_file_t *pFile, int64_t new_size) {
+	if (pFile && pFile->pUserData) {
+		return PageCache::get().truncate(*static_cast<CachedFile *>(pFile->pUserData), new_size);
+	}
+	return BCTBX_VFS_ERROR;
+}
+
+static ssize_t bcFileSize(bctbx_vfs_file_t *pFile) {
+	if (pFile && pFile->pUserData) {
+		return PageCache::get().fileSize(*static_cast<CachedFile *>(pFile->pUserData));
+	}
+	return BCTBX_VFS_ERROR;
+}
+
+static int bcSync(bctbx_vfs_file_t *pFile) {
+	if (pFile && pFile->pUserData) {
+		return PageCache::get().sync(*static_cast<CachedFile *>(pFile->pUserData));
+	}
+	return BCTBX_VFS_ERROR;
+}
+
+static bool_t bcIsEncrypted(bctbx_vfs_file_t *pFile) {
+	if (pFile && pFile->pUserData) {
+		return bctbx_file_is_encrypted(static_cast<CachedFile *>(pFile->pUserData)->pFileUnderlying);
+	}
+	return FALSE;
+}
+
+static int bcAllocate(bctbx_vfs_file_t *pFile, int64_t offset, int64_t len) {
+	if (pFile && pFile->pUserData) {
+		return bctbx_file_allocate(static_cast<CachedFile *>(pFile->pUserData)->pFileUnderlying, offset, len);
+	}
+	return BCTBX_VFS_ERROR;
+}
+
+static int bcAdvise(bctbx_vfs_file_t *pFile, int64_t offset, int64_t len, bctbx_vfs_advice_t advice) {
+	if (pFile && pFile->pUserData) {
+		return bctbx_file_advise(static_cast<CachedFile *>(pFile->pUserData)->pFileUnderlying, offset, len, advice);
+	}
+	return BCTBX_VFS_ERROR;
+}
+
+static const bctbx_io_methods_t bcio = {bcClose,    /* pFuncClose */
+                                        bcRead,     /* pFuncRead */
+                                        bcWrite,    /* pFuncWrite */
+                                        bcTruncate, /* pFuncTruncate */
+                                        bcFileSize, /* pFuncFileSize */
+                                        bcSync,
+                                        NULL, // use the generic get next line function
+                                        bcIsEncrypted,
+                                        bcAllocate,
+                                        bcAdvise};
+
+static int bcOpen(bctbx_vfs_t *pVfs, bctbx_vfs_file_t *pFile, const char *fName, int openFlags) {
+	if (pVfs == NULL || pFile == NULL || fName == NULL) {
+		return BCTBX_VFS_ERROR;
+	}
+	CacheVfs *cacheVfs = reinterpret_cast<CacheVfs *>(pVfs);
+
+	// pages partially written must be loaded first: the file cannot be write only
+	if ((openFlags & O_ACCMODE) == O_WRONLY) {
+		openFlags &= ~O_ACCMODE;
+		openFlags |= O_RDWR;
+	}
+
+	bctbx_vfs_file_t *underlyingFp = bctbx_file_open2(cacheVfs->mUnderlying, fName, openFlags);
+	if (underlyingFp == NULL) return BCTBX_VFS_ERROR;
+
+	CachedFile *ctx = new CachedFile(underlyingFp, (openFlags & O_APPEND) == O_APPEND);
+	PageCache::get().open(*ctx);
+
+	pFile->pMethods = &bcio;
+	pFile->pUserData = static_cast<void *>(ctx);
+	return BCTBX_VFS_OK;
+}
+
+bctbx_vfs_t *bctbx_vfs_cache_create(bctbx_vfs_t *underlying) {
+	if (underlying == NULL) return NULL;
+	CacheVfs *cacheVfs = new CacheVfs();
+	cacheVfs->mVfs.vfsName = "bctbx_cache_vfs";
+	cacheVfs->mVfs.pFuncOpen = bcOpen;
+	cacheVfs->mUnderlying = underlying;
+	return &cacheVfs->mVfs;
+}
+
+void bctbx_vfs_cache_destroy(bctbx_vfs_t *cacheVfs) {
+	delete reinterpret_cast<CacheVfs *>(cacheVfs);
+}
+
+void bctbx_vfs_cache_set_memory_budget(size_t budget) {
+	PageCache::get().setBudget(budget);
+}
+
+size_t bctbx_vfs_cache_get_memory_budget(void) {
+	return PageCache::get().getBudget();
+}
+
+void bctbx_vfs_cache_get_stats(bctbx_vfs_cache_stats_t *stats) {
+	if (stats) PageCache::get().getStats(stats);
+}
+
+float bctbx_vfs_cache_get_hit_ratio(void) {
+	return PageCache::get().getHitRatio();
+}
+
+void bctbx_vfs_cache_reset_stats(void) {
+	PageCache::get().resetStats();
+}
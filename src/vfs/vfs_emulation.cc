@@ -0,0 +1,266 @@
+/*
+ * Copyright (c) 2025 Belledonne Communications SARL.
+ *
+ * This file is part of bctoolbox.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "bctoolbox/vfs_emulation.h"
+#include "bctoolbox/vfs.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <random>
+#include <thread>
+
+// someone does include the evil windef.h so we must undef the min and max macros to be able to use std::min and
+// std::max
+#undef min
+#undef max
+
+namespace bctoolbox {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+/* An emulation vfs: the bctbx_vfs_t must be the first member so the pointer given to pFuncOpen can be cast back */
+struct EmulationVfs {
+	EmulationVfs(bctbx_vfs_t *underlying, const bctbx_vfs_emulation_config_t *config) : mUnderlying(underlying) {
+		mVfs.vfsName = "bctbx_emulation_vfs";
+		setConfig(config);
+	}
+
+	void setConfig(const bctbx_vfs_emulation_config_t *config) {
+		std::lock_guard<std::mutex> lock(mMutex);
+		if (config) {
+			mConfig = *config;
+		} else {
+			memset(&mConfig, 0, sizeof(mConfig));
+		}
+		mRandom.seed(mConfig.seed);
+		mSyncCount = 0;
+	}
+
+	bctbx_vfs_emulation_config_t getConfig() {
+		std::lock_guard<std::mutex> lock(mMutex);
+		return mConfig;
+	}
+
+	void openDelay() {
+		uint32_t latency;
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			latency = mConfig.open_latency_us;
+		}
+		if (latency) std::this_thread::sleep_for(std::chrono::microseconds(latency));
+	}
+
+	/* number of bytes actually transferred by a read or write of count bytes */
+	size_t readSize(size_t count) {
+		std::lock_guard<std::mutex> lock(mMutex);
+		return shorten(count, mConfig.short_read_percent);
+	}
+	size_t writeSize(size_t count) {
+		std::lock_guard<std::mutex> lock(mMutex);
+		return shorten(count, mConfig.short_write_percent);
+	}
+
+	void readDelay(size_t bytes) {
+		Clock::time_point deadline;
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			deadline = transferDeadline(bytes, mConfig.read_latency_us, mConfig.read_bandwidth, mReadBusyUntil);
+		}
+		std::this_thread::sleep_until(deadline);
+	}
+	void writeDelay(size_t bytes) {
+		Clock::time_point deadline;
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			deadline = transferDeadline(bytes, mConfig.write_latency_us, mConfig.write_bandwidth, mWriteBusyUntil);
+		}
+		std::this_thread::sleep_until(deadline);
+	}
+
+	void syncDelay() {
+		uint64_t latency;
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			latency = mConfig.sync_latency_us;
+			mSyncCount++;
+			if (mConfig.sync_stall_interval && (mSyncCount % mConfig.sync_stall_interval) == 0) {
+				latency += mConfig.sync_stall_us;
+			}
+		}
+		if (latency) std::this_thread::sleep_for(std::chrono::microseconds(latency));
+	}
+
+	size_t shorten(size_t count, uint32_t percent) {
+		if (count < 2 || percent == 0) return count;
+		if (std::uniform_int_distribution<uint32_t>(0, 99)(mRandom) >= percent) return count;
+		return std::uniform_int_distribution<size_t>(1, count - 1)(mRandom);
+	}
+
+	/* The device transfers one request at a time at the configured bandwidth: a request starts when the previous ones
+	 * are done, whatever the file or the thread issuing them. */
+	Clock::time_point
+	transferDeadline(size_t bytes, uint32_t latencyUs, uint64_t bandwidth, Clock::time_point &busyUntil) {
+		auto now = Clock::now();
+		if (bandwidth == 0) return now + std::chrono::microseconds(latencyUs);
+		auto start = std::max(now, busyUntil);
+		busyUntil = start + std::chrono::microseconds((uint64_t)bytes * 1000000 / bandwidth);
+		return busyUntil + std::chrono::microseconds(latencyUs);
+	}
+
+	bctbx_vfs_t mVfs{}; // must stay the first member
+	bctbx_vfs_t *mUnderlying;
+	std::mutex mMutex;
+	bctbx_vfs_emulation_config_t mConfig;
+	std::mt19937 mRandom;
+	uint64_t mSyncCount = 0;
+	Clock::time_point mReadBusyUntil{};
+	Clock::time_point mWriteBusyUntil{};
+};
+
+/** Store in the bctbx_vfs_file_t userData field the file opened with the underlying vfs */
+struct EmulatedFile {
+	bctbx_vfs_file_t *pFileUnderlying;
+	EmulationVfs *mVfs;
+};
+
+} // namespace
+
+} // namespace bctoolbox
+
+using namespace bctoolbox;
+
+static int bcClose(bctbx_vfs_file_t *pFile) {
+	int ret = BCTBX_VFS_ERROR;
+	if (pFile && pFile->pUserData) {
+		EmulatedFile *ctx = static_cast<EmulatedFile *>(pFile->pUserData);
+		ret = bctbx_file_close(ctx->pFileUnderlying);
+		delete ctx;
+		pFile->pUserData = NULL;
+	}
+	return ret;
+}
+
+static ssize_t bcRead(bctbx_vfs_file_t *pFile, void *buf, size_t count, off_t offset) {
+	if (pFile == NULL || pFile->pUserData == NULL) return BCTBX_VFS_ERROR;
+	EmulatedFile *ctx = static_cast<EmulatedFile *>(pFile->pUserData);
+	ssize_t ret = bctbx_file_read(ctx->pFileUnderlying, buf, ctx->mVfs->readSize(count), offset);
+	ctx->mVfs->readDelay((ret > 0) ? (size_t)ret : 0);
+	return ret;
+}
+
+static ssize_t bcWrite(bctbx_vfs_file_t *pFile, const void *buf, size_t count, off_t offset) {
+	if (pFile == NULL || pFile->pUserData == NULL) return BCTBX_VFS_ERROR;
+	EmulatedFile *ctx = static_cast<EmulatedFile *>(pFile->pUserData);
+	ssize_t ret = bctbx_file_write(ctx->pFileUnderlying, buf, ctx->mVfs->writeSize(count), offset);
+	ctx->mVfs->writeDelay((ret > 0) ? (size_t)ret : 0);
+	return ret;
+}
+
+static int bcTruncate(bctbx_vfs_file_t *pFile, int64_t new_size) {
+	if (pFile == NULL || pFile->pUserData == NULL) return BCTBX_VFS_ERROR;
+	return bctbx_file_truncate(static_cast<EmulatedFile *>(pFile->pUserData)->pFileUnderlying, new_size);
+}
+
+static ssize_t bcFileSize(bctbx_vfs_file_t *pFile) {
+	if (pFile == NULL || pFile->pUserData == NULL) return BCTBX_VFS_ERROR;
+	return bctbx_file_size(static_cast<EmulatedFile *>(pFile->pUserData)->pFileUnderlying);
+}
+
+static int bcSync(bctbx_vfs_file_t *pFile) {
+	if (pFile == NULL || pFile->pUserData == NULL) return BCTBX_VFS_ERROR;
+	EmulatedFile *ctx = static_cast<EmulatedFile *>(pFile->pUserData);
+	int ret = bctbx_file_sync(ctx->pFileUnderlying);
+	ctx->mVfs->syncDelay();
+	return ret;
+}
+
+static bool_t bcIsEncrypted(bctbx_vfs_file_t *pFile) {
+	if (pFile && pFile->pUserData) {
+		return bctbx_file_is_encrypted(static_cast<EmulatedFile *>(pFile->pUserData)->pFileUnderlying);
+	}
+	return FALSE;
+}
+
+static int bcAllocate(bctbx_vfs_file_t *pFile, int64_t offset, int64_t len) {
+	if (pFile && pFile->pUserData) {
+		return bctbx_file_allocate(static_cast<EmulatedFile *>(pFile->pUserData)->pFileUnderlying, offset, len);
+	}
+	return BCTBX_VFS_ERROR;
+}
+
+static int bcAdvise(bctbx_vfs_file_t *pFile, int64_t offset, int64_t len, bctbx_vfs_advice_t advice) {
+	if (pFile && pFile->pUserData) {
+		return bctbx_file_advise(static_cast<EmulatedFile *>(pFile->pUserData)->pFileUnderlying, offset, len,
+		                         advice);
+	}
+	return BCTBX_VFS_ERROR;
+}
+
+static const bctbx_io_methods_t bcio = {bcClose,    /* pFuncClose */
+                                        bcRead,     /* pFuncRead */
+                                        bcWrite,    /* pFuncWrite */
+                                        bcTruncate, /* pFuncTruncate */
+                                        bcFileSize, /* pFuncFileSize */
+                                        bcSync,
+                                        NULL, // use the generic get next line function
+                                        bcIsEncrypted,
+                                        bcAllocate,
+                                        bcAdvise};
+
+static int bcOpen(bctbx_vfs_t *pVfs, bctbx_vfs_file_t *pFile, const char *fName, int openFlags) {
+	if (pVfs == NULL || pFile == NULL || fName == NULL) {
+		return BCTBX_VFS_ERROR;
+	}
+	EmulationVfs *emulationVfs = reinterpret_cast<EmulationVfs *>(pVfs);
+
+	emulationVfs->openDelay();
+	bctbx_vfs_file_t *underlyingFp = bctbx_file_open2(emulationVfs->mUnderlying, fName, openFlags);
+	if (underlyingFp == NULL) return BCTBX_VFS_ERROR;
+
+	pFile->pMethods = &bcio;
+	pFile->pUserData = static_cast<void *>(new EmulatedFile{underlyingFp, emulationVfs});
+	return BCTBX_VFS_OK;
+}
+
+bctbx_vfs_t *bctbx_vfs_emulation_create(bctbx_vfs_t *underlying, const bctbx_vfs_emulation_config_t *config) {
+	if (underlying == NULL) return NULL;
+	EmulationVfs *emulationVfs = new EmulationVfs(underlying, config);
+	emulationVfs->mVfs.pFuncOpen = bcOpen;
+	return &emulationVfs->mVfs;
+}
+
+void bctbx_vfs_emulation_destroy(bctbx_vfs_t *emulationVfs) {
+	delete reinterpret_cast<EmulationVfs *>(emulationVfs);
+}
+
+void bctbx_vfs_emulation_set_config(bctbx_vfs_t *emulationVfs, const bctbx_vfs_emulation_config_t *config) {
+	if (emulationVfs) reinterpret_cast<EmulationVfs *>(emulationVfs)->setConfig(config);
+}
+
+void bctbx_vfs_emulation_get_config(bctbx_vfs_t *emulationVfs, bctbx_vfs_emulation_config_t *config) {
+	if (emulationVfs && config) *config = reinterpret_cast<EmulationVfs *>(emulationVfs)->getConfig();
+}
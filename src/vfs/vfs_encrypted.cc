@@ -25,8 +25,14 @@
 #include "vfs_encryption_module.hh"
 #include "vfs_encryption_module_aes256gcm_sha256.hh"
 #include "vfs_encryption_module_dummy.hh"
+#include "vfs_private.h"
 #include <algorithm>
 #include <cstdio>
+#include <cstdlib>
+#include <new>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
 
 // MSVC does not define O_ACCMODE...
 #ifndef O_ACCMODE
@@ -39,6 +45,62 @@
 #undef max
 using namespace bctoolbox;
 
+namespace bctoolbox {
+namespace {
+/**
+ * Allocator of the raw chunk buffers: aligned on the direct I/O blocks, whole chunks are then read and written by the
+ * standard vfs without going through its bounce buffers. No alignment beyond the default one when it is 0.
+ */
+template <typename T>
+class AlignedAllocator {
+public:
+	using value_type = T;
+
+	explicit AlignedAllocator(size_t alignment) noexcept : mAlignment(alignment) {
+	}
+	template <typename U>
+	AlignedAllocator(const AlignedAllocator<U> &other) noexcept : mAlignment(other.mAlignment) {
+	}
+
+	T *allocate(size_t n) {
+		if (mAlignment == 0) return static_cast<T *>(::operator new(n * sizeof(T)));
+#ifdef _WIN32
+		void *p = _aligned_malloc(n * sizeof(T), mAlignment);
+		if (p == nullptr) throw std::bad_alloc();
+#else
+		void *p = nullptr;
+		if (posix_memalign(&p, std::max(mAlignment, sizeof(void *)), n * sizeof(T)) != 0) throw std::bad_alloc();
+#endif
+		return static_cast<T *>(p);
+	}
+	void deallocate(T *p, size_t) noexcept {
+		if (mAlignment == 0) {
+			::operator delete(p);
+		} else {
+#ifdef _WIN32
+			_aligned_free(p);
+#else
+			free(p);
+#endif
+		}
+	}
+
+	template <typename U>
+	bool operator==(const AlignedAllocator<U> &other) const noexcept {
+		return mAlignment == other.mAlignment;
+	}
+	template <typename U>
+	bool operator!=(const AlignedAllocator<U> &other) const noexcept {
+		return mAlignment != other.mAlignment;
+	}
+
+	size_t mAlignment;
+};
+
+using RawBuffer = std::vector<uint8_t, AlignedAllocator<uint8_t>>;
+} // namespace
+} // namespace bctoolbox
+
 /** Helpers function: this part of the code must be updated to add modules */
 static size_t moduleFileHeaderSize(const uint16_t suite) {
 	switch (suite) {
@@ -111,9 +173,14 @@ const std::string bctoolbox::encryptionSuiteString(const EncryptionSuite suite)
  *    - [Optionnal Encryption module data - size is given by the encryption suite selected]
  *
  * base header size is 29 bytes
+ *
+ * Version 1.1 header extension:
+ *    - chunk padding: 2 bytes: number of bytes following each raw chunk, so the chunks are aligned on blocks
+ *    - zero padding up to the header extension size, so the first chunk starts on a block boundary
  */
 static const std::array BCENCRYPTEDFS = {0x62, 0x63, 0x45, 0x6e, 0x63, 0x72, 0x79, 0x70, 0x74, 0x65, 0x64, 0x46, 0x73};
 static constexpr uint16_t BcEncFS_v0100 = 0x0100;
+static constexpr uint16_t BcEncFS_v0101 = 0x0101; // header extension holds the chunk padding
 /* header cannot be less than this size, even for an empty file */
 static constexpr int64_t baseFileHeaderSize = 29;
 
@@ -129,8 +196,8 @@ VfsEncryption::VfsEncryption(bctbx_vfs_file_t *stdFp, const std::string &filenam
       mChunkSize(0), // set to 0 at creation, is will be populated by parseHeader if there is one. If we are creating a
                      // file, let a chance to the callback to set the chunk size.
       m_module(nullptr), // encryption module is set by callback or when parsing the header
-      mHeaderExtensionSize(0), mFilename(filename), mFileSize(0), mEncryptExistingPlainFile(false),
-      mIntegrityFullCheck(false), mAccessMode(accessMode), pFileStd(stdFp) {
+      mHeaderExtensionSize(0), mChunkPadding(0), mDirectIoBlock(0), mFilename(filename), mFileSize(0),
+      mEncryptExistingPlainFile(false), mIntegrityFullCheck(false), mAccessMode(accessMode), pFileStd(stdFp) {
 
 	if (stdFp == NULL) throw EVFS_EXCEPTION << "Cannot create a vfs encrytion object, vfs pointer is null";
 
@@ -153,9 +220,25 @@ VfsEncryption::VfsEncryption(bctbx_vfs_file_t *stdFp, const std::string &filenam
 		return;
 	}
 
+	// files created through the direct I/O vfs keep their raw file on it
+	bool directIo = (bctbx_vfs_standard_is_direct(pFileStd) == TRUE);
+	bctbx_vfs_t *stdVfs = directIo ? &bcStandardDirectVfs : bctbx_vfs_get_standard();
+	if (directIo) {
+		// any multiple of the alignment of the file works, keep chunks of at least the default size
+		mDirectIoBlock = std::max(bctbx_vfs_standard_alignment_get(pFileStd), (size_t)BCTBX_VFS_DIRECT_IO_ALIGNMENT);
+	}
+
 	/* check we have a valid chunk size */
-	if (mChunkSize == 0) {             // this is a file creation and the callback didn't set it
-		mChunkSize = defaultChunkSize; // assign the default one
+	if (mChunkSize == 0) { // this is a file creation and the callback didn't set it
+		if (directIo) {    // the largest chunk fitting a block with its header
+			mChunkSize =
+			    std::max((mDirectIoBlock - m_module->getChunkHeaderSize()) & ~(size_t)15, (size_t)16);
+		} else {
+			mChunkSize = defaultChunkSize; // assign the default one
+		}
+	}
+	if (directIo && (createFile || mEncryptExistingPlainFile)) {
+		directIoLayoutSet();
 	}
 
 	if (mEncryptExistingPlainFile == true) { // we have a plain file to encrypt
@@ -164,7 +247,8 @@ VfsEncryption::VfsEncryption(bctbx_vfs_file_t *stdFp, const std::string &filenam
 		tmpFilename.append(".evfs_tmp");
 		// make sure this file does not exists
 		std::remove(tmpFilename.data());
-		auto stdFdTmp = bctbx_file_open2(bctbx_vfs_get_standard(), tmpFilename.data(), O_WRONLY | O_CREAT);
+		// not write only: direct I/O may have to read back partially written blocks
+		auto stdFdTmp = bctbx_file_open2(stdVfs, tmpFilename.data(), O_RDWR | O_CREAT);
 		// read the whole file chunk by chunk and write their ciphertext to the temp file
 		char *readBuf = static_cast<char *>(bctbx_malloc(mChunkSize));
 		uint64_t index = 0;
@@ -208,7 +292,7 @@ VfsEncryption::VfsEncryption(bctbx_vfs_file_t *stdFp, const std::string &filenam
 		mEncryptExistingPlainFile = false;
 
 		// and reopen it with the standard vfs
-		pFileStd = bctbx_file_open2(bctbx_vfs_get_standard(), mFilename.data(), openFlags);
+		pFileStd = bctbx_file_open2(stdVfs, mFilename.data(), openFlags);
 
 	} else { // no migration but now we shall have all the material (settings and keys ) to check the file integrity
 		if (mFileSize > 0) { // this is not a file creation
@@ -222,7 +306,7 @@ VfsEncryption::VfsEncryption(bctbx_vfs_file_t *stdFp, const std::string &filenam
 						ssize_t readSize = bctbx_file_read(pFileStd, rawData.data(), rawData.size(),
 						                                   (off_t)getChunkOffset(chunkIndex));
 						if (readSize >= 0) {
-							rawData.resize(readSize);
+							rawData.resize(std::min((size_t)readSize, rawChunkDataSizeGet()));
 						} else {
 							throw EVFS_EXCEPTION
 							    << "fail to read file while trying to check the full integrity, file_read returned "
@@ -374,6 +458,7 @@ uint64_t VfsEncryption::rawFileSizeGet() const noexcept {
 
 	return mFileSize                                                                          // actual plain size
 	       + n * m_module->getChunkHeaderSize()                                               // all chunks' header size
+	       + ((n > 0) ? (n - 1) * mChunkPadding : 0) // padding of all chunks but the last one
 	       + baseFileHeaderSize + mHeaderExtensionSize + m_module->getModuleFileHeaderSize(); // file header size
 }
 
@@ -430,9 +515,9 @@ void VfsEncryption::parseHeader() {
 
 	// check the version number
 	mVersionNumber = r_header[index] << 8 | r_header[index + 1];
-	if (mVersionNumber != BcEncFS_v0100) {
+	if (mVersionNumber != BcEncFS_v0100 && mVersionNumber != BcEncFS_v0101) {
 		BCTBX_SLOGW << "Encrypted FS trying to open a file version " << mVersionNumber << " but supports up to "
-		            << BcEncFS_v0100 << ", this may not work, proceed anyway";
+		            << BcEncFS_v0101 << ", this may not work, proceed anyway";
 	}
 	index += 2;
 
@@ -448,6 +533,18 @@ void VfsEncryption::parseHeader() {
 	mHeaderExtensionSize = r_header[index] << 8 | r_header[index + 1];
 	index += 2;
 
+	// version 1.1 extension gives the chunk padding, keep it in the header cache so it is authenticated too
+	if (mVersionNumber == BcEncFS_v0101 && mHeaderExtensionSize >= 2) {
+		r_header.resize(baseFileHeaderSize + mHeaderExtensionSize);
+		if (bctbx_file_read(pFileStd, r_header.data() + baseFileHeaderSize, mHeaderExtensionSize,
+		                    (off_t)baseFileHeaderSize) -
+		        mHeaderExtensionSize !=
+		    0) {
+			throw EVFS_EXCEPTION << "parseHeader: unable to read encrypted vfs header extension";
+		}
+		mChunkPadding = r_header[baseFileHeaderSize] << 8 | r_header[baseFileHeaderSize + 1];
+	}
+
 	// get the file size
 	mFileSize =
 	    (static_cast<uint64_t>(r_header[index]) << 56) | (static_cast<uint64_t>(r_header[index + 1]) << 48) |
@@ -487,7 +584,7 @@ void VfsEncryption::parseHeader() {
 			chunkNb = 1;
 		}
 		chunkNb += mFileSize / rawChunkSizeGet();
-		mFileSize -= chunkNb * m_module->getChunkHeaderSize();
+		mFileSize -= chunkNb * m_module->getChunkHeaderSize() + ((chunkNb > 0) ? (chunkNb - 1) * mChunkPadding : 0);
 		BCTBX_SLOGW << "Encrypted FS: Actual file size seems to be " << mFileSize;
 	}
 }
@@ -512,9 +609,9 @@ void VfsEncryption::writeHeader(bctbx_vfs_file_t *fp) {
 	header.emplace_back(static_cast<uint8_t>(((mChunkSize / 16) >> 8) & 0xFF));
 	header.emplace_back(static_cast<uint8_t>((mChunkSize / 16) & 0xFF));
 
-	// add header extension size: none for now
-	header.emplace_back(0x00);
-	header.emplace_back(0x00);
+	// add header extension size
+	header.emplace_back(static_cast<uint8_t>((mHeaderExtensionSize >> 8) & 0xFF));
+	header.emplace_back(static_cast<uint8_t>(mHeaderExtensionSize & 0xFF));
 
 	// add file size
 	header.emplace_back(static_cast<uint8_t>((mFileSize >> 56) & 0xFF));
@@ -526,12 +623,22 @@ void VfsEncryption::writeHeader(bctbx_vfs_file_t *fp) {
 	header.emplace_back(static_cast<uint8_t>((mFileSize >> 8) & 0xFF));
 	header.emplace_back(static_cast<uint8_t>(mFileSize & 0xFF));
 
+	// add header extension: the chunk padding (version 1.1), then zeros
+	std::vector<uint8_t> extension(mHeaderExtensionSize, 0);
+	if (mVersionNumber == BcEncFS_v0101 && mHeaderExtensionSize >= 2) {
+		extension[0] = static_cast<uint8_t>((mChunkPadding >> 8) & 0xFF);
+		extension[1] = static_cast<uint8_t>(mChunkPadding & 0xFF);
+		header.insert(header.end(), extension.cbegin(), extension.cend());
+		extension.clear();
+	}
+
 	// update header cache (do not cache the encryption module data)
 	// moduleFileHeader shall depends on the file header as it probably authentify it,
 	// so do this update before asking for the encryption module header
 	r_header = header;
 
-	// add encryption module data
+	// add encryption module data, after the extension not part of the header cache if any
+	header.insert(header.end(), extension.cbegin(), extension.cend());
 	auto moduleFileHeader = m_module->getModuleFileHeader(*this);
 	header.insert(header.end(), moduleFileHeader.cbegin(), moduleFileHeader.cend());
 
@@ -551,11 +658,28 @@ int64_t VfsEncryption::fileSizeGet() const noexcept {
 	return mFileSize;
 }
 
-/** return the size of a chunk including its encryption header */
+/** return the space used by a chunk in the raw file: encryption header and padding included */
 size_t VfsEncryption::rawChunkSizeGet() const noexcept {
+	return mChunkSize + m_module->getChunkHeaderSize() + mChunkPadding;
+};
+
+/** return the size of a chunk including its encryption header */
+size_t VfsEncryption::rawChunkDataSizeGet() const noexcept {
 	return mChunkSize + m_module->getChunkHeaderSize();
 };
 
+/**
+ * Pad the raw chunks to a multiple of the direct I/O block size and the file header to a block boundary using a
+ * version 1.1 header extension, so chunks reads and writes are block aligned.
+ */
+void VfsEncryption::directIoLayoutSet() {
+	const size_t block = mDirectIoBlock;
+	mChunkPadding = (block - rawChunkDataSizeGet() % block) % block;
+	size_t headerSize = baseFileHeaderSize + 2 + m_module->getModuleFileHeaderSize(); // 2 bytes of chunk padding
+	mHeaderExtensionSize = 2 + (block - headerSize % block) % block;
+	mVersionNumber = BcEncFS_v0101;
+}
+
 /**
  * in which chunk is this offset?
  */
@@ -588,7 +712,7 @@ std::vector<uint8_t> VfsEncryption::read(size_t offset, size_t count) const {
 
 	// allocate a vector large enough to store all the data to read : number of chunks * size of raw
 	// chunk(payload+header)
-	std::vector<uint8_t> rawData((lastChunk - firstChunk + 1) * rawChunkSizeGet());
+	RawBuffer rawData((lastChunk - firstChunk + 1) * rawChunkSizeGet(), AlignedAllocator<uint8_t>(mDirectIoBlock));
 
 	/* read all chunks from actual file */
 	ssize_t readSize = bctbx_file_read(pFileStd, rawData.data(), rawData.size(), (off_t)getChunkOffset(firstChunk));
@@ -606,8 +730,8 @@ std::vector<uint8_t> VfsEncryption::read(size_t offset, size_t count) const {
 	// decrypt everything we have chunk by chunk, use firstChunk as chunk index
 	while (rawData.size() > m_module->getChunkHeaderSize()) {
 		std::vector<uint8_t> plainChunk = m_module->decryptChunk(
-		    firstChunk++,
-		    std::vector<uint8_t>(rawData.cbegin(), rawData.cbegin() + std::min(rawChunkSizeGet(), rawData.size())));
+		    firstChunk++, std::vector<uint8_t>(rawData.cbegin(),
+		                                       rawData.cbegin() + std::min(rawChunkDataSizeGet(), rawData.size())));
 		plainData.insert(plainData.end(), plainChunk.cbegin(), plainChunk.cend());
 		// remove the decrypted chunk
 		rawData.erase(rawData.begin(), rawData.begin() + std::min(rawChunkSizeGet(), rawData.size()));
@@ -649,8 +773,8 @@ size_t VfsEncryption::write(const std::vector<uint8_t> &plainData, size_t offset
 	    getChunkIndex(offset + plain.size() - 1); // -1 as we write data from indexes offset to offset + data size - 1
 	size_t rawDataSize =
 	    (lastChunk - firstChunk + 1) * rawChunkSizeGet(); // maximum size used, last chunk might be incomplete
-	std::vector<uint8_t>
-	    rawData{}; // Store the existing encrypted chunks with header that are overwritten by this operation
+	// Store the existing encrypted chunks with header that are overwritten by this operation
+	RawBuffer rawData(AlignedAllocator<uint8_t>{mDirectIoBlock});
 
 	// Are we overwritting some chunks?
 	size_t readOffset = offset - offset % mChunkSize; // we must start read/write at the begining of a chunk
@@ -667,8 +791,8 @@ size_t VfsEncryption::write(const std::vector<uint8_t> &plainData, size_t offset
 	if (readOffset < offset) { // we need to get the plain data from readOffset to offset
 		// decrypt the first chunk
 		auto plainChunk = m_module->decryptChunk(
-		    firstChunk,
-		    std::vector<uint8_t>(rawData.cbegin(), rawData.cbegin() + std::min(rawChunkSizeGet(), rawData.size())));
+		    firstChunk, std::vector<uint8_t>(rawData.cbegin(),
+		                                     rawData.cbegin() + std::min(rawChunkDataSizeGet(), rawData.size())));
 		plain.insert(plain.begin(), plainChunk.cbegin(),
 		             plainChunk.cbegin() + (offset - readOffset)); // prepend the begining to our plain buffer
 	}
@@ -680,19 +804,21 @@ size_t VfsEncryption::write(const std::vector<uint8_t> &plainData, size_t offset
 		auto plainChunk = m_module->decryptChunk(
 		    lastChunk,
 		    std::vector<uint8_t>(rawData.cbegin() + getChunkOffset(lastChunk) - getChunkOffset(firstChunk),
-		                         rawData.cbegin() + std::min(getChunkOffset(lastChunk + 1) - getChunkOffset(firstChunk),
+		                         rawData.cbegin() + std::min(getChunkOffset(lastChunk) - getChunkOffset(firstChunk) +
+		                                                         rawChunkDataSizeGet(),
 		                                                     rawData.size())));
 		plain.insert(plain.end(), plainChunk.cbegin() + (plain.size() % mChunkSize),
 		             plainChunk.cend()); // append what is over the part we will write.
 	}
 
 	// encrypt the overwritten chunks
-	std::vector<uint8_t> updatedRawData{};
+	RawBuffer updatedRawData(AlignedAllocator<uint8_t>{mDirectIoBlock});
 	updatedRawData.reserve(rawDataSize);
 	uint32_t currentChunkIndex = firstChunk;
 	while (rawData.size() > 0) {
 		// get a chunk to re-encrypt
-		std::vector<uint8_t> rawChunk(rawData.cbegin(), rawData.cbegin() + std::min(rawChunkSizeGet(), rawData.size()));
+		std::vector<uint8_t> rawChunk(rawData.cbegin(),
+		                              rawData.cbegin() + std::min(rawChunkDataSizeGet(), rawData.size()));
 		// delete it
 		rawData.erase(rawData.begin(), rawData.begin() + std::min(rawChunkSizeGet(), rawData.size()));
 		// re-encrypt
@@ -701,8 +827,9 @@ size_t VfsEncryption::write(const std::vector<uint8_t> &plainData, size_t offset
 		    std::vector<uint8_t>(plain.cbegin(), plain.cbegin() + std::min(mChunkSize, plain.size())));
 		// delete consumed plain
 		plain.erase(plain.begin(), plain.begin() + std::min(mChunkSize, plain.size()));
-		// store the result
+		// store the result, padded if other chunks follow
 		updatedRawData.insert(updatedRawData.end(), rawChunk.cbegin(), rawChunk.cend());
+		if (rawData.size() > 0 || plain.size() > 0) updatedRawData.resize(updatedRawData.size() + mChunkPadding, 0);
 	}
 
 	// add new chunks if some data remains in the plain buffer
@@ -712,8 +839,9 @@ size_t VfsEncryption::write(const std::vector<uint8_t> &plainData, size_t offset
 		    std::vector<uint8_t>(plain.cbegin(), plain.cbegin() + std::min(mChunkSize, plain.size())));
 		// delete consumed plain
 		plain.erase(plain.begin(), plain.begin() + std::min(mChunkSize, plain.size()));
-		// store the result
+		// store the result, padded if other chunks follow
 		updatedRawData.insert(updatedRawData.end(), rawChunk.cbegin(), rawChunk.cend());
+		if (plain.size() > 0) updatedRawData.resize(updatedRawData.size() + mChunkPadding, 0);
 	}
 
 	// now actually write the rawData in the file
@@ -746,7 +874,7 @@ void VfsEncryption::truncate(const uint64_t newSize) {
 		// If the last chunk is modified, we must re-encrypt it
 		if (newSize % mChunkSize != 0) {
 			// allocate a vector large enough to store a complete chunk
-			std::vector<uint8_t> rawData(rawChunkSizeGet());
+			std::vector<uint8_t> rawData(rawChunkDataSizeGet());
 
 			// read the future last chunk from actual file
 			ssize_t readSize = bctbx_file_read(pFileStd, rawData.data(), rawData.size(),
@@ -754,8 +882,7 @@ void VfsEncryption::truncate(const uint64_t newSize) {
 			rawData.resize(readSize);
 			// decrypt it
 			auto plainLastChunk = m_module->decryptChunk(
-			    getChunkIndex(newSize),
-			    std::vector<uint8_t>(rawData.cbegin(), rawData.cbegin() + std::min(rawChunkSizeGet(), rawData.size())));
+			    getChunkIndex(newSize), std::vector<uint8_t>(rawData.cbegin(), rawData.cend()));
 			// truncate the part we don't need anymore
 			plainLastChunk.resize(newSize % mChunkSize);
 			// re-encrypt it
@@ -779,6 +906,18 @@ void VfsEncryption::truncate(const uint64_t newSize) {
 	}
 }
 
+std::pair<uint64_t, uint64_t> VfsEncryption::rawRangeGet(uint64_t offset, uint64_t length) const noexcept {
+	// plain file?
+	if (m_module == nullptr) {
+		return {offset, length};
+	}
+	uint64_t rawOffset = (offset == 0) ? 0 : getChunkOffset(getChunkIndex(offset));
+	if (length == 0) {
+		return {rawOffset, 0};
+	}
+	return {rawOffset, getChunkOffset(getChunkIndex(offset + length - 1) + 1) - rawOffset};
+}
+
 std::string VfsEncryption::filenameGet() const noexcept {
 	return mFilename;
 }
@@ -800,6 +939,11 @@ bctbx_vfs_t bctoolbox::bcEncryptedVfs = {
     bcOpen,                /*xOpen */
 };
 
+bctbx_vfs_t bctoolbox::bcEncryptedDirectVfs = {
+    "bctbx_encrypted_vfs_direct", /* vfsName */
+    bcOpen,                       /*xOpen */
+};
+
 /**
  * Closes file by closing the associated file descriptor.
  * Sets the error errno in the argument pErrSrvd after allocating it
@@ -934,6 +1078,32 @@ static bool_t bcIsEncrypted(bctbx_vfs_file_t *pFile) {
 	return FALSE;
 }
 
+/*
+ ** Preallocate a range of the file
+ * Translate the plain range into the raw one and forward the request to underlying vfs
+ */
+static int bcAllocate(bctbx_vfs_file_t *pFile, int64_t offset, int64_t len) {
+	if (pFile && pFile->pUserData) {
+		VfsEncryption *ctx = static_cast<VfsEncryption *>(pFile->pUserData);
+		auto rawRange = ctx->rawRangeGet((uint64_t)offset, (uint64_t)len);
+		return bctbx_file_allocate(ctx->pFileStd, (int64_t)rawRange.first, (int64_t)rawRange.second);
+	}
+	return BCTBX_VFS_ERROR;
+}
+
+/*
+ ** Give an access pattern hint on a range of the file
+ * Translate the plain range into the raw one and forward the request to underlying vfs
+ */
+static int bcAdvise(bctbx_vfs_file_t *pFile, int64_t offset, int64_t len, bctbx_vfs_advice_t advice) {
+	if (pFile && pFile->pUserData) {
+		VfsEncryption *ctx = static_cast<VfsEncryption *>(pFile->pUserData);
+		auto rawRange = ctx->rawRangeGet((uint64_t)offset, (uint64_t)len);
+		return bctbx_file_advise(ctx->pFileStd, (int64_t)rawRange.first, (int64_t)rawRange.second, advice);
+	}
+	return BCTBX_VFS_ERROR;
+}
+
 static const bctbx_io_methods_t bcio = {bcClose,    /* pFuncClose */
                                         bcRead,     /* pFuncRead */
                                         bcWrite,    /* pFuncWrite */
@@ -941,9 +1111,11 @@ static const bctbx_io_methods_t bcio = {bcClose,    /* pFuncClose */
                                         bcFileSize, /* pFuncFileSize */
                                         bcSync,
                                         NULL, // use the generic get next line function
-                                        bcIsEncrypted};
+                                        bcIsEncrypted,
+                                        bcAllocate,
+                                        bcAdvise};
 
-static int bcOpen(BCTBX_UNUSED(bctbx_vfs_t *pVfs), bctbx_vfs_file_t *pFile, const char *fName, int openFlags) {
+static int bcOpen(bctbx_vfs_t *pVfs, bctbx_vfs_file_t *pFile, const char *fName, int openFlags) {
 	VfsEncryption *ctx = nullptr;
 	bctbx_vfs_file_t *stdFp = nullptr;
 	try {
@@ -959,7 +1131,8 @@ static int bcOpen(BCTBX_UNUSED(bctbx_vfs_t *pVfs), bctbx_vfs_file_t *pFile, cons
 			openFlags |= O_RDWR;
 		}
 
-		stdFp = bctbx_file_open2(bctbx_vfs_get_standard(), fName, openFlags);
+		stdFp = bctbx_file_open2((pVfs == &bcEncryptedDirectVfs) ? &bcStandardDirectVfs : bctbx_vfs_get_standard(),
+		                         fName, openFlags);
 		if (stdFp == NULL) return BCTBX_VFS_ERROR;
 
 		pFile->pMethods = &bcio;
@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2025 Belledonne Communications SARL.
+ *
+ * This file is part of bctoolbox.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BCTBX_VFS_PRIVATE_H
+#define BCTBX_VFS_PRIVATE_H
+
+#include "bctoolbox/vfs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Functions shared by the vfs implementations, not part of the public API */
+
+/**
+ * Make the data of a file descriptor durable. Syncs of different files run concurrently, concurrent requests for the
+ * same file are served by a single sync started after them.
+ * When called during bctbx_file_sync_batch(), the request is only recorded and performed when the batch commits.
+ * @param  fd File descriptor to sync.
+ * @return BCTBX_VFS_OK on success, -errno otherwise.
+ */
+int bctbx_vfs_sync_fd(int fd);
+
+/**
+ * Copy a range of a file to another one inside the kernel (copy_file_range or sendfile), when both are opened with
+ * the standard vfs.
+ * @param  src       Source file handle pointer.
+ * @param  dst       Destination file handle pointer.
+ * @param  srcOffset Where to start reading in the source file.
+ * @param  dstOffset Where to start writing in the destination file.
+ * @param  length    Number of bytes to copy.
+ * @return the number of bytes copied, -ENOTSUP when the copy cannot be done this way and nothing was copied,
+ *         -errno on error.
+ */
+int64_t bctbx_vfs_standard_copy(
+    bctbx_vfs_file_t *src, bctbx_vfs_file_t *dst, int64_t srcOffset, int64_t dstOffset, int64_t length);
+
+/**
+ * @param  pFile File handle pointer.
+ * @return TRUE if the file was opened with bcStandardDirectVfs.
+ */
+bool_t bctbx_vfs_standard_is_direct(bctbx_vfs_file_t *pFile);
+
+/**
+ * @param  pFile File handle pointer.
+ * @return the alignment of the direct I/O requests of the file, 0 when it has no alignment constraint.
+ */
+size_t bctbx_vfs_standard_alignment_get(bctbx_vfs_file_t *pFile);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BCTBX_VFS_PRIVATE_H */
@@ -17,6 +17,10 @@
  * along with this program. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#if !defined(_WIN32) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE /* fallocate, O_DIRECT */
+#endif
+
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
@@ -25,9 +29,16 @@
 #include "bctoolbox/logging.h"
 #include "bctoolbox/port.h"
 #include "bctoolbox/vfs.h"
+#include "bctoolbox/vfs_standard.h"
+#include "vfs_private.h"
 #include <errno.h>
 #include <stdarg.h>
+#include <stdint.h>
+#include <string.h>
 #include <sys/types.h>
+#ifdef HAVE_SENDFILE
+#include <sys/sendfile.h>
+#endif
 
 /**
  * Opens the file with filename fName, associate it to the file handle pointed
@@ -44,7 +55,12 @@ static int bcOpen(bctbx_vfs_t *pVfs, bctbx_vfs_file_t *pFile, const char *fName,
 /* User data for the standard vfs */
 typedef struct bctbx_vfs_standard_t bctbx_vfs_standard_t;
 struct bctbx_vfs_standard_t {
-	int fd; /* File descriptor */
+	int fd;           /* File descriptor */
+	bool_t direct;    /* File opened with bcStandardDirectVfs */
+	size_t alignment; /* Direct I/O: buffers, offsets and sizes must be multiple of it. 0 when there is no constraint */
+#if !defined(_WIN32) && defined(O_DIRECT)
+	bctbx_mutex_t writeMutex; /* Direct I/O: serializes the writes, which may read back blocks and restore the size */
+#endif
 };
 
 bctbx_vfs_t bcStandardVfs = {
@@ -52,6 +68,188 @@ bctbx_vfs_t bcStandardVfs = {
     bcOpen,      /*xOpen */
 };
 
+bctbx_vfs_t bcStandardDirectVfs = {
+    "bctbx_vfs_direct", /* vfsName */
+    bcOpen,             /*xOpen */
+};
+
+#if !defined(_WIN32) && defined(O_DIRECT)
+#define BCTBX_VFS_HAVE_O_DIRECT
+
+#include <sys/statvfs.h>
+
+#define DIRECT_IO_BUFFER_SIZE (64 * 1024) /* size of the bounce buffers, aligned on it: the largest alignment served */
+#define DIRECT_IO_POOL_SIZE 8             /* maximum number of bounce buffers kept for reuse */
+
+/* Pool of aligned bounce buffers, used for the direct I/O requests which are not aligned */
+static bctbx_mutex_t directIoPoolMutex = PTHREAD_MUTEX_INITIALIZER;
+static void *directIoPool[DIRECT_IO_POOL_SIZE];
+static int directIoPoolCount = 0;
+
+static uint8_t *direct_io_buffer_get(void) {
+	void *buffer = NULL;
+	bctbx_mutex_lock(&directIoPoolMutex);
+	if (directIoPoolCount > 0) buffer = directIoPool[--directIoPoolCount];
+	bctbx_mutex_unlock(&directIoPoolMutex);
+	if (buffer == NULL && posix_memalign(&buffer, DIRECT_IO_BUFFER_SIZE, DIRECT_IO_BUFFER_SIZE) != 0) {
+		return NULL;
+	}
+	return (uint8_t *)buffer;
+}
+
+static void direct_io_buffer_release(uint8_t *buffer) {
+	bctbx_mutex_lock(&directIoPoolMutex);
+	if (directIoPoolCount < DIRECT_IO_POOL_SIZE) {
+		directIoPool[directIoPoolCount++] = buffer;
+		buffer = NULL;
+	}
+	bctbx_mutex_unlock(&directIoPoolMutex);
+	free(buffer);
+}
+
+/**
+ * Get the direct I/O alignment of a file: the one reported by statx when available, the file system block size
+ * otherwise, BCTBX_VFS_DIRECT_IO_ALIGNMENT when none is known.
+ * @return the alignment, a power of two, 0 when it is larger than the bounce buffers.
+ */
+static size_t direct_io_alignment_get(int fd) {
+	size_t alignment = 0;
+#ifdef STATX_DIOALIGN
+	struct statx stx;
+	if (statx(fd, "", AT_EMPTY_PATH, STATX_DIOALIGN, &stx) == 0 && (stx.stx_mask & STATX_DIOALIGN)) {
+		alignment = (stx.stx_dio_mem_align > stx.stx_dio_offset_align) ? stx.stx_dio_mem_align
+		                                                                : stx.stx_dio_offset_align;
+		if (alignment > DIRECT_IO_BUFFER_SIZE || (alignment & (alignment - 1)) != 0) return 0;
+	}
+#endif
+	if (alignment == 0) {
+		// the block size is only the preferred one, a multiple of the actual constraint
+		struct statvfs sStatvfs;
+		if (fstatvfs(fd, &sStatvfs) == 0) alignment = (size_t)sStatvfs.f_bsize;
+		if (alignment > DIRECT_IO_BUFFER_SIZE || (alignment & (alignment - 1)) != 0) alignment = 0;
+	}
+	return (alignment != 0) ? alignment : BCTBX_VFS_DIRECT_IO_ALIGNMENT;
+}
+
+/**
+ * @return the length of the part of a request which can be done directly: its whole blocks when the buffer and the
+ *         offset are aligned, 0 otherwise.
+ */
+static size_t direct_io_aligned_head(const bctbx_vfs_standard_t *ctx, const void *buf, size_t count, off_t offset) {
+	if (((uintptr_t)buf % ctx->alignment) != 0 || ((size_t)offset % ctx->alignment) != 0) return 0;
+	return count - count % ctx->alignment;
+}
+
+/**
+ * Read from a file opened with O_DIRECT. The whole blocks of an aligned request are read directly, the rest goes
+ * through a bounce buffer covering the whole blocks holding the requested range.
+ * @return the number of bytes read, -errno on error.
+ */
+static ssize_t direct_io_read(bctbx_vfs_standard_t *ctx, uint8_t *buf, size_t count, off_t offset) {
+	size_t head = direct_io_aligned_head(ctx, buf, count, offset);
+	if (head != 0) {
+		ssize_t ret = pread(ctx->fd, buf, head, offset);
+		if (ret < 0) return -errno;
+		if (head == count || (size_t)ret < head) return ret;
+	}
+
+	uint8_t *bounce = direct_io_buffer_get();
+	if (bounce == NULL) return (head != 0) ? (ssize_t)head : -ENOMEM;
+	size_t done = head;
+	ssize_t ret = 0;
+	while (done < count) {
+		off_t position = offset + (off_t)done;
+		size_t skip = (size_t)position % ctx->alignment;
+		off_t start = position - (off_t)skip;
+		size_t span = skip + (count - done);
+		span = (span + ctx->alignment - 1) / ctx->alignment * ctx->alignment;
+		if (span > DIRECT_IO_BUFFER_SIZE) span = DIRECT_IO_BUFFER_SIZE;
+
+		ret = pread(ctx->fd, bounce, span, start);
+		if (ret < 0) {
+			ret = -errno;
+			break;
+		}
+		if ((size_t)ret <= skip) break; // end of file
+		size_t useful = (size_t)ret - skip;
+		if (useful > count - done) useful = count - done;
+		memcpy(buf + done, bounce + skip, useful);
+		done += useful;
+		if ((size_t)ret < span) break; // end of file
+	}
+	direct_io_buffer_release(bounce);
+	return (ret < 0 && done == 0) ? ret : (ssize_t)done;
+}
+
+/**
+ * Write to a file opened with O_DIRECT. The whole blocks of an aligned request are written directly. The rest reads
+ * back the partially written blocks into a bounce buffer, writes whole blocks and then restores the file size if the
+ * last block went beyond it.
+ * The writes of a file are serialized, so that the size read before an unaligned write is still the one to restore
+ * and concurrent writes never overwrite the blocks read back.
+ * @return the number of bytes written, -errno on error.
+ */
+static ssize_t direct_io_write_locked(bctbx_vfs_standard_t *ctx, const uint8_t *buf, size_t count, off_t offset) {
+	size_t head = direct_io_aligned_head(ctx, buf, count, offset);
+	if (head != 0) {
+		ssize_t ret = pwrite(ctx->fd, buf, head, offset);
+		if (ret < 0) return -errno;
+		if (head == count || (size_t)ret < head) return ret;
+	}
+
+	struct stat sStat;
+	if (fstat(ctx->fd, &sStat) < 0) return (head != 0) ? (ssize_t)head : -errno;
+	uint8_t *bounce = direct_io_buffer_get();
+	if (bounce == NULL) return (head != 0) ? (ssize_t)head : -ENOMEM;
+
+	size_t done = head;
+	off_t end = 0; // end of the last written block
+	ssize_t ret = 0;
+	while (done < count) {
+		off_t position = offset + (off_t)done;
+		size_t skip = (size_t)position % ctx->alignment;
+		off_t start = position - (off_t)skip;
+		size_t length = count - done;
+		if (length > DIRECT_IO_BUFFER_SIZE - skip) length = DIRECT_IO_BUFFER_SIZE - skip;
+		size_t span = (skip + length + ctx->alignment - 1) / ctx->alignment * ctx->alignment;
+
+		// keep the content of the partially overwritten blocks
+		if (skip != 0 || span != skip + length) {
+			memset(bounce, 0, span);
+			if (start < sStat.st_size && pread(ctx->fd, bounce, span, start) < 0) {
+				ret = -errno;
+				break;
+			}
+		}
+		memcpy(bounce + skip, buf + done, length);
+		ret = pwrite(ctx->fd, bounce, span, start);
+		if (ret < 0) {
+			ret = -errno;
+			break;
+		}
+		if ((size_t)ret < span) { // disk full
+			ret = -ENOSPC;
+			break;
+		}
+		done += length;
+		end = start + (off_t)span;
+	}
+	direct_io_buffer_release(bounce);
+
+	// the padding of the last block must not extend the file
+	off_t size = (offset + (off_t)done > sStat.st_size) ? offset + (off_t)done : sStat.st_size;
+	if (end > size && ftruncate(ctx->fd, size) < 0 && ret >= 0) ret = -errno;
+	return (ret < 0 && done == 0) ? ret : (ssize_t)done;
+}
+
+static ssize_t direct_io_write(bctbx_vfs_standard_t *ctx, const uint8_t *buf, size_t count, off_t offset) {
+	bctbx_mutex_lock(&ctx->writeMutex);
+	ssize_t ret = direct_io_write_locked(ctx, buf, count, offset);
+	bctbx_mutex_unlock(&ctx->writeMutex);
+	return ret;
+}
+#endif /* BCTBX_VFS_HAVE_O_DIRECT */
+
 /**
  * Closes file by closing the associated file descriptor.
  * Sets the error errno in the argument pErrSrvd after allocating it
@@ -69,6 +267,9 @@ static int bcClose(bctbx_vfs_file_t *pFile) {
 	} else {
 		ret = -errno;
 	}
+#ifdef BCTBX_VFS_HAVE_O_DIRECT
+	if (ctx->alignment != 0) bctbx_mutex_destroy(&ctx->writeMutex);
+#endif
 	bctbx_free(pFile->pUserData);
 	return ret;
 }
@@ -76,20 +277,14 @@ static int bcClose(bctbx_vfs_file_t *pFile) {
 /**
  * Simply sync the file contents given through the file handle
  * to the persistent media.
+ * The request is grouped with the concurrent ones, see bctbx_vfs_sync_fd.
  * @param  pFile  File handle pointer.
- * @return   BCTBX_VFS_OK on success, BCTBX_VFS_ERROR otherwise
+ * @return   BCTBX_VFS_OK on success, -errno or BCTBX_VFS_ERROR otherwise
  */
 static int bcSync(bctbx_vfs_file_t *pFile) {
 	if (pFile == NULL || pFile->pUserData == NULL) return BCTBX_VFS_ERROR;
 	bctbx_vfs_standard_t *ctx = (bctbx_vfs_standard_t *)pFile->pUserData;
-#if _WIN32
-	int ret;
-	ret = FlushFileBuffers((HANDLE)_get_osfhandle(ctx->fd));
-	return (ret != 0 ? BCTBX_VFS_OK : BCTBX_VFS_ERROR);
-#else
-	int rc = fsync(ctx->fd);
-	return (rc == 0 ? BCTBX_VFS_OK : BCTBX_VFS_ERROR);
-#endif
+	return bctbx_vfs_sync_fd(ctx->fd);
 }
 
 /**
@@ -107,6 +302,9 @@ static ssize_t bcRead(bctbx_vfs_file_t *pFile, void *buf, size_t count, off_t of
 	ssize_t nRead; /* Return value from read() */
 	if (pFile == NULL || pFile->pUserData == NULL) return BCTBX_VFS_ERROR;
 	bctbx_vfs_standard_t *ctx = (bctbx_vfs_standard_t *)pFile->pUserData;
+#ifdef BCTBX_VFS_HAVE_O_DIRECT
+	if (ctx->alignment != 0) return direct_io_read(ctx, (uint8_t *)buf, count, offset);
+#endif
 
 	if (lseek(ctx->fd, offset, SEEK_SET) < 0) {
 		if (errno) return -errno;
@@ -136,6 +334,9 @@ static ssize_t bcWrite(bctbx_vfs_file_t *pFile, const void *buf, size_t count, o
 
 	if (pFile == NULL || pFile->pUserData == NULL) return BCTBX_VFS_ERROR;
 	bctbx_vfs_standard_t *ctx = (bctbx_vfs_standard_t *)pFile->pUserData;
+#ifdef BCTBX_VFS_HAVE_O_DIRECT
+	if (ctx->alignment != 0) return direct_io_write(ctx, (const uint8_t *)buf, count, offset);
+#endif
 
 	if ((lseek(ctx->fd, offset, SEEK_SET)) < 0) {
 		if (errno) return -errno;
@@ -183,6 +384,15 @@ static int bcTruncate(bctbx_vfs_file_t *pFile, int64_t new_size) {
 
 #if _WIN32
 	ret = _chsize(ctx->fd, (long)new_size);
+#elif defined(BCTBX_VFS_HAVE_O_DIRECT)
+	// an unaligned direct I/O write restores the file size it read before writing its padded blocks
+	if (ctx->alignment != 0) bctbx_mutex_lock(&ctx->writeMutex);
+	ret = ftruncate(ctx->fd, new_size);
+	if (ctx->alignment != 0) {
+		int savedErrno = errno;
+		bctbx_mutex_unlock(&ctx->writeMutex);
+		errno = savedErrno;
+	}
 #else
 	ret = ftruncate(ctx->fd, new_size);
 #endif
@@ -193,6 +403,72 @@ static int bcTruncate(bctbx_vfs_file_t *pFile, int64_t new_size) {
 	return 0;
 }
 
+/**
+ * Reserve disk blocks for a range of the file without changing its size.
+ * @param pFile  File handle pointer.
+ * @param offset Beginning of the range.
+ * @param len    Length of the range.
+ * @return -errno if an error occurred, 0 otherwise (also when preallocation is not supported).
+ */
+static int bcAllocate(bctbx_vfs_file_t *pFile, int64_t offset, int64_t len) {
+	if (pFile == NULL || pFile->pUserData == NULL) return BCTBX_VFS_ERROR;
+#ifdef HAVE_FALLOCATE
+	bctbx_vfs_standard_t *ctx = (bctbx_vfs_standard_t *)pFile->pUserData;
+	if (fallocate(ctx->fd, FALLOC_FL_KEEP_SIZE, (off_t)offset, (off_t)len) < 0) {
+		if (errno == EOPNOTSUPP || errno == ENOSYS) return 0; // the file system cannot do it, this is not an error
+		return -errno;
+	}
+#else
+	(void)offset;
+	(void)len;
+#endif
+	return 0;
+}
+
+/**
+ * Give the kernel a hint on the way a range of the file will be accessed.
+ * @param pFile  File handle pointer.
+ * @param offset Beginning of the range.
+ * @param len    Length of the range, 0 to extend it until the end of file.
+ * @param advice The expected access pattern.
+ * @return -errno if an error occurred, 0 otherwise (also when advices are not supported).
+ */
+static int bcAdvise(bctbx_vfs_file_t *pFile, int64_t offset, int64_t len, bctbx_vfs_advice_t advice) {
+	if (pFile == NULL || pFile->pUserData == NULL) return BCTBX_VFS_ERROR;
+#ifdef HAVE_POSIX_FADVISE
+	bctbx_vfs_standard_t *ctx = (bctbx_vfs_standard_t *)pFile->pUserData;
+	int posixAdvice;
+	switch (advice) {
+		case BCTBX_VFS_ADVICE_SEQUENTIAL:
+			posixAdvice = POSIX_FADV_SEQUENTIAL;
+			break;
+		case BCTBX_VFS_ADVICE_RANDOM:
+			posixAdvice = POSIX_FADV_RANDOM;
+			break;
+		case BCTBX_VFS_ADVICE_WILLNEED:
+			posixAdvice = POSIX_FADV_WILLNEED;
+			break;
+		case BCTBX_VFS_ADVICE_DONTNEED:
+			posixAdvice = POSIX_FADV_DONTNEED;
+			break;
+		case BCTBX_VFS_ADVICE_NOREUSE:
+			posixAdvice = POSIX_FADV_NOREUSE;
+			break;
+		case BCTBX_VFS_ADVICE_NORMAL:
+		default:
+			posixAdvice = POSIX_FADV_NORMAL;
+			break;
+	}
+	int ret = posix_fadvise(ctx->fd, (off_t)offset, (off_t)len, posixAdvice); // returns the error, does not set errno
+	if (ret != 0) return -ret;
+#else
+	(void)offset;
+	(void)len;
+	(void)advice;
+#endif
+	return 0;
+}
+
 static const bctbx_io_methods_t bcio = {
     bcClose,          /* pFuncClose */
     bcRead,           /* pFuncRead */
@@ -200,10 +476,86 @@ static const bctbx_io_methods_t bcio = {
     bcTruncate,       /* pFuncTruncate */
     bcFileSize,       /* pFuncFileSize */
     bcSync,     NULL, /* use the generic implementation of getnxt line */
-    NULL              /* pFuncIsEncrypted -> no function so we will return false */
+    NULL,             /* pFuncIsEncrypted -> no function so we will return false */
+    bcAllocate,       /* pFuncAllocate */
+    bcAdvise          /* pFuncAdvise */
 };
 
-static int bcOpen(BCTBX_UNUSED(bctbx_vfs_t *pVfs), bctbx_vfs_file_t *pFile, const char *fName, int openFlags) {
+int64_t bctbx_vfs_standard_copy(
+    bctbx_vfs_file_t *src, bctbx_vfs_file_t *dst, int64_t srcOffset, int64_t dstOffset, int64_t length) {
+	if (src == NULL || dst == NULL || src->pMethods != &bcio || dst->pMethods != &bcio) return -ENOTSUP;
+	if (src->pUserData == NULL || dst->pUserData == NULL) return BCTBX_VFS_ERROR;
+	// let the generic copy go through the bounce buffers of direct I/O
+	if (((bctbx_vfs_standard_t *)src->pUserData)->alignment != 0 ||
+	    ((bctbx_vfs_standard_t *)dst->pUserData)->alignment != 0) {
+		return -ENOTSUP;
+	}
+	int srcFd = ((bctbx_vfs_standard_t *)src->pUserData)->fd;
+	int dstFd = ((bctbx_vfs_standard_t *)dst->pUserData)->fd;
+	int64_t copied = 0;
+
+#if defined(HAVE_COPY_FILE_RANGE) || defined(HAVE_SENDFILE)
+	/* copy_file_range rejects append mode destinations (EBADF) and sendfile would ignore the destination offset */
+	int dstFlags = fcntl(dstFd, F_GETFL);
+	if (dstFlags == -1) return -errno;
+	if (dstFlags & O_APPEND) return -ENOTSUP;
+#endif
+
+#ifdef HAVE_COPY_FILE_RANGE
+	/* the file system may clone the blocks (reflink) or copy them without any transfer to user space */
+	off_t in = (off_t)srcOffset;
+	off_t out = (off_t)dstOffset;
+	while (copied < length) {
+		ssize_t ret = copy_file_range(srcFd, &in, dstFd, &out, (size_t)(length - copied), 0);
+		if (ret < 0) {
+			if (errno == EINTR) continue;
+			if (copied == 0 && (errno == EXDEV || errno == ENOSYS || errno == EINVAL || errno == EOPNOTSUPP ||
+			                    errno == EBADF || errno == ETXTBSY)) {
+				break; // not supported between these files, try sendfile
+			}
+			return -errno;
+		}
+		if (ret == 0) return copied; // end of source file
+		copied += ret;
+	}
+	if (copied > 0) return copied;
+#endif
+
+#ifdef HAVE_SENDFILE
+	/* sendfile writes at the current offset of the destination file */
+	if (lseek(dstFd, (off_t)dstOffset, SEEK_SET) < 0) return -errno;
+	off_t sendOffset = (off_t)srcOffset;
+	while (copied < length) {
+		ssize_t ret = sendfile(dstFd, srcFd, &sendOffset, (size_t)(length - copied));
+		if (ret < 0) {
+			if (errno == EINTR) continue;
+			if (copied == 0 && (errno == EINVAL || errno == ENOSYS)) return -ENOTSUP;
+			return -errno;
+		}
+		if (ret == 0) break; // end of source file
+		copied += ret;
+	}
+	return copied;
+#else
+	(void)srcFd;
+	(void)dstFd;
+	(void)srcOffset;
+	(void)dstOffset;
+	return (copied > 0) ? copied : -ENOTSUP;
+#endif
+}
+
+bool_t bctbx_vfs_standard_is_direct(bctbx_vfs_file_t *pFile) {
+	if (pFile == NULL || pFile->pMethods != &bcio || pFile->pUserData == NULL) return FALSE;
+	return ((bctbx_vfs_standard_t *)pFile->pUserData)->direct;
+}
+
+size_t bctbx_vfs_standard_alignment_get(bctbx_vfs_file_t *pFile) {
+	if (pFile == NULL || pFile->pMethods != &bcio || pFile->pUserData == NULL) return 0;
+	return ((bctbx_vfs_standard_t *)pFile->pUserData)->alignment;
+}
+
+static int bcOpen(bctbx_vfs_t *pVfs, bctbx_vfs_file_t *pFile, const char *fName, int openFlags) {
 	if (pFile == NULL || fName == NULL) {
 		return BCTBX_VFS_ERROR;
 	}
@@ -212,12 +564,45 @@ static int bcOpen(BCTBX_UNUSED(bctbx_vfs_t *pVfs), bctbx_vfs_file_t *pFile, cons
 #endif
 
 	/* Create the userData structure */
-	bctbx_vfs_standard_t *userData = (bctbx_vfs_standard_t *)bctbx_malloc(sizeof(bctbx_vfs_standard_t));
+	bctbx_vfs_standard_t *userData = (bctbx_vfs_standard_t *)bctbx_malloc0(sizeof(bctbx_vfs_standard_t));
+	userData->direct = (pVfs == &bcStandardDirectVfs);
+#ifdef BCTBX_VFS_HAVE_O_DIRECT
+	if ((userData->direct || (openFlags & O_DIRECT)) && (openFlags & O_APPEND)) {
+		// appending ignores the write offsets, the padding of the unaligned writes would end up in the file
+		bctbx_warning("bctbx_vfs: direct I/O not supported in append mode for [%s], use buffered I/O", fName);
+		userData->fd = open(fName, openFlags & ~O_DIRECT, S_IRUSR | S_IWUSR);
+	} else if (userData->direct || (openFlags & O_DIRECT)) {
+		// unaligned writes read back the blocks they partially overwrite: the file cannot be write only
+		int directFlags = openFlags | O_DIRECT;
+		if ((directFlags & O_ACCMODE) == O_WRONLY) directFlags = (directFlags & ~O_ACCMODE) | O_RDWR;
+		userData->fd = open(fName, directFlags, S_IRUSR | S_IWUSR);
+		if (userData->fd != -1) {
+			userData->alignment = direct_io_alignment_get(userData->fd);
+			if (userData->alignment != 0) {
+				bctbx_mutex_init(&userData->writeMutex, NULL);
+			} else { // the bounce buffers cannot serve it
+				bctbx_warning("bctbx_vfs: direct I/O alignment too large for [%s], use buffered I/O", fName);
+				close(userData->fd);
+				userData->fd = open(fName, openFlags & ~(O_DIRECT | O_CREAT | O_EXCL), S_IRUSR | S_IWUSR);
+			}
+		} else if (errno == EINVAL) { // the file system does not support it (ie: tmpfs)
+			bctbx_warning("bctbx_vfs: direct I/O not supported for [%s], use buffered I/O", fName);
+			userData->fd = open(fName, openFlags & ~O_DIRECT, S_IRUSR | S_IWUSR);
+		}
+	} else {
+		userData->fd = open(fName, openFlags, S_IRUSR | S_IWUSR);
+	}
+#else
 	userData->fd = open(fName, openFlags, S_IRUSR | S_IWUSR);
+#endif
 	if (userData->fd == -1) {
 		bctbx_free(userData);
 		return -errno;
 	}
+#if defined(__APPLE__) && defined(F_NOCACHE)
+	// no alignment constraint, only bypass the unified buffer cache
+	if (userData->direct) fcntl(userData->fd, F_NOCACHE, 1);
+#endif
 
 	pFile->pMethods = &bcio;
 	pFile->pUserData = (void *)userData;
@@ -0,0 +1,411 @@
+/*
+ * Copyright (c) 2025 Belledonne Communications SARL.
+ *
+ * This file is part of bctoolbox.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "bctoolbox/vfs_stats.h"
+#include "bctoolbox/logging.h"
+#include "bctoolbox/vfs.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <set>
+#include <string>
+
+// someone does include the evil windef.h so we must undef the min and max macros to be able to use std::min
+#undef min
+#undef max
+
+namespace bctoolbox {
+
+namespace {
+
+constexpr std::array<const char *, BCTBX_VFS_STATS_OP_COUNT> opNames = {"open",     "read", "write", "sync",
+                                                                        "truncate", "size"};
+
+/**
+ * Latency histogram with logarithmic buckets: each power of two is split in 4 buckets, so any value is at most 25%
+ * below the upper bound of its bucket. Values 0 to 3 have their own bucket.
+ */
+class LatencyHistogram {
+public:
+	static constexpr size_t bucketCount = 4 + 62 * 4;
+
+	void record(uint64_t value) {
+		mBuckets[indexOf(value)].fetch_add(1, std::memory_order_relaxed);
+	}
+
+	/* the upper bound of the bucket holding the given quantile of count values */
+	uint64_t quantile(uint64_t count, double q) const {
+		if (count == 0) return 0;
+		uint64_t rank = (uint64_t)(q * (double)count);
+		if (rank >= count) rank = count - 1;
+		uint64_t seen = 0;
+		for (size_t i = 0; i < bucketCount; i++) {
+			seen += mBuckets[i].load(std::memory_order_relaxed);
+			if (seen > rank) return upperBound(i);
+		}
+		return upperBound(bucketCount - 1);
+	}
+
+	void reset() {
+		for (auto &bucket : mBuckets) {
+			bucket.store(0, std::memory_order_relaxed);
+		}
+	}
+
+private:
+	static int highestBit(uint64_t value) {
+#if defined(__GNUC__)
+		return 63 - __builtin_clzll(value);
+#else
+		int bit = 0;
+		while (value >>= 1) {
+			bit++;
+		}
+		return bit;
+#endif
+	}
+
+	static size_t indexOf(uint64_t value) {
+		if (value < 4) return (size_t)value;
+		int msb = highestBit(value);
+		return (size_t)(msb - 1) * 4 + (size_t)((value >> (msb - 2)) & 3);
+	}
+
+	static uint64_t upperBound(size_t index) {
+		if (index < 4) return index;
+		int msb = (int)(index / 4) + 1;
+		uint64_t lower = (4 + (uint64_t)(index % 4)) << (msb - 2);
+		return lower + (((uint64_t)1) << (msb - 2)) - 1;
+	}
+
+	std::array<std::atomic<uint64_t>, bucketCount> mBuckets{};
+};
+
+/* Statistics of one operation, updated concurrently without lock */
+class OpStats {
+public:
+	void record(uint64_t latencyUs, uint64_t bytes, bool error) {
+		mCount.fetch_add(1, std::memory_order_relaxed);
+		if (error) mErrors.fetch_add(1, std::memory_order_relaxed);
+		if (bytes) mBytes.fetch_add(bytes, std::memory_order_relaxed);
+		mTotalUs.fetch_add(latencyUs, std::memory_order_relaxed);
+		uint64_t max = mMaxUs.load(std::memory_order_relaxed);
+		while (latencyUs > max && !mMaxUs.compare_exchange_weak(max, latencyUs, std::memory_order_relaxed)) {
+		}
+		mHistogram.record(latencyUs);
+	}
+
+	void snapshot(bctbx_vfs_stats_op_snapshot_t &snapshot) const {
+		snapshot.count = mCount.load(std::memory_order_relaxed);
+		snapshot.errors = mErrors.load(std::memory_order_relaxed);
+		snapshot.bytes = mBytes.load(std::memory_order_relaxed);
+		snapshot.total_us = mTotalUs.load(std::memory_order_relaxed);
+		snapshot.max_us = mMaxUs.load(std::memory_order_relaxed);
+		// percentiles never exceed the actual maximum
+		snapshot.p50_us = std::min(mHistogram.quantile(snapshot.count, 0.50), snapshot.max_us);
+		snapshot.p99_us = std::min(mHistogram.quantile(snapshot.count, 0.99), snapshot.max_us);
+	}
+
+	void reset() {
+		mCount.store(0, std::memory_order_relaxed);
+		mErrors.store(0, std::memory_order_relaxed);
+		mBytes.store(0, std::memory_order_relaxed);
+		mTotalUs.store(0, std::memory_order_relaxed);
+		mMaxUs.store(0, std::memory_order_relaxed);
+		mHistogram.reset();
+	}
+
+private:
+	std::atomic<uint64_t> mCount{0};
+	std::atomic<uint64_t> mErrors{0};
+	std::atomic<uint64_t> mBytes{0};
+	std::atomic<uint64_t> mTotalUs{0};
+	std::atomic<uint64_t> mMaxUs{0};
+	LatencyHistogram mHistogram;
+};
+
+class Stats {
+public:
+	void record(bctbx_vfs_stats_op_t op, uint64_t latencyUs, uint64_t bytes, bool error) {
+		mOps[op].record(latencyUs, bytes, error);
+	}
+
+	void snapshot(bctbx_vfs_stats_snapshot_t *snapshot) const {
+		for (size_t i = 0; i < mOps.size(); i++) {
+			mOps[i].snapshot(snapshot->ops[i]);
+		}
+	}
+
+	void reset() {
+		for (auto &op : mOps) {
+			op.reset();
+		}
+	}
+
+	void log(BctbxLogLevel level, const std::string &prefix) const {
+		bctbx_vfs_stats_snapshot_t current;
+		snapshot(&current);
+		for (size_t i = 0; i < mOps.size(); i++) {
+			const auto &op = current.ops[i];
+			if (op.count == 0) continue;
+			BCTBX_SLOG(BCTBX_LOG_DOMAIN, level)
+			    << prefix << " " << opNames[i] << ": count=" << op.count << " errors=" << op.errors
+			    << " bytes=" << op.bytes << " avg=" << op.total_us / op.count << "us p50=" << op.p50_us
+			    << "us p99=" << op.p99_us << "us max=" << op.max_us << "us";
+		}
+	}
+
+private:
+	std::array<OpStats, BCTBX_VFS_STATS_OP_COUNT> mOps{};
+};
+
+class StatsFile;
+
+/* A stats vfs: the bctbx_vfs_t must be the first member so the pointer given to pFuncOpen can be cast back */
+struct StatsVfs {
+	bctbx_vfs_t mVfs;
+	bctbx_vfs_t *mUnderlying;
+	std::atomic<bool> mEnabled{true};
+	Stats mStats;
+	std::mutex mFilesMutex;
+	std::set<StatsFile *> mFiles; /**< files currently opened, to dump their statistics */
+};
+
+/** Store in the bctbx_vfs_file_t userData field the statistics of an opened file */
+class StatsFile {
+public:
+	StatsFile(bctbx_vfs_file_t *underlyingFp, StatsVfs *vfs, const char *name)
+	    : pFileUnderlying(underlyingFp), mVfs(vfs), mName(name) {
+	}
+
+	void record(bctbx_vfs_stats_op_t op, std::chrono::steady_clock::time_point start, uint64_t bytes, bool error) {
+		uint64_t latencyUs = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+		                         std::chrono::steady_clock::now() - start)
+		                         .count();
+		mStats.record(op, latencyUs, bytes, error);
+		mVfs->mStats.record(op, latencyUs, bytes, error);
+	}
+
+	bctbx_vfs_file_t *pFileUnderlying; /**< the file opened with the underlying vfs */
+	StatsVfs *mVfs;
+	const std::string mName;
+	Stats mStats;
+};
+
+} // namespace
+
+} // namespace bctoolbox
+
+using namespace bctoolbox;
+
+static bool enabled(StatsFile *ctx) {
+	return ctx->mVfs->mEnabled.load(std::memory_order_relaxed);
+}
+
+static int bcClose(bctbx_vfs_file_t *pFile) {
+	int ret = BCTBX_VFS_ERROR;
+	if (pFile && pFile->pUserData) {
+		StatsFile *ctx = static_cast<StatsFile *>(pFile->pUserData);
+		{
+			std::lock_guard<std::mutex> lock(ctx->mVfs->mFilesMutex);
+			ctx->mVfs->mFiles.erase(ctx);
+		}
+		ret = bctbx_file_close(ctx->pFileUnderlying);
+		delete ctx;
+		pFile->pUserData = NULL;
+	}
+	return ret;
+}
+
+static ssize_t bcRead(bctbx_vfs_file_t *pFile, void *buf, size_t count, off_t offset) {
+	if (pFile == NULL || pFile->pUserData == NULL) return BCTBX_VFS_ERROR;
+	StatsFile *ctx = static_cast<StatsFile *>(pFile->pUserData);
+	if (!enabled(ctx)) return bctbx_file_read(ctx->pFileUnderlying, buf, count, offset);
+
+	auto start = std::chrono::steady_clock::now();
+	ssize_t ret = bctbx_file_read(ctx->pFileUnderlying, buf, count, offset);
+	ctx->record(BCTBX_VFS_STATS_OP_READ, start, (ret > 0) ? (uint64_t)ret : 0, ret < 0);
+	return ret;
+}
+
+static ssize_t bcWrite(bctbx_vfs_file_t *pFile, const void *buf, size_t count, off_t offset) {
+	if (pFile == NULL || pFile->pUserData == NULL) return BCTBX_VFS_ERROR;
+	StatsFile *ctx = static_cast<StatsFile *>(pFile->pUserData);
+	if (!enabled(ctx)) return bctbx_file_write(ctx->pFileUnderlying, buf, count, offset);
+
+	auto start = std::chrono::steady_clock::now();
+	ssize_t ret = bctbx_file_write(ctx->pFileUnderlying, buf, count, offset);
+	ctx->record(BCTBX_VFS_STATS_OP_WRITE, start, (ret > 0) ? (uint64_t)ret : 0, ret < 0);
+	return ret;
+}
+
+static int bcTruncate(bctbx_vfs_file_t *pFile, int64_t new_size) {
+	if (pFile == NULL || pFile->pUserData == NULL) return BCTBX_VFS_ERROR;
+	StatsFile *ctx = static_cast<StatsFile *>(pFile->pUserData);
+	if (!enabled(ctx)) return bctbx_file_truncate(ctx->pFileUnderlying, new_size);
+
+	auto start = std::chrono::steady_clock::now();
+	int ret = bctbx_file_truncate(ctx->pFileUnderlying, new_size);
+	ctx->record(BCTBX_VFS_STATS_OP_TRUNCATE, start, 0, ret < 0);
+	return ret;
+}
+
+static ssize_t bcFileSize(bctbx_vfs_file_t *pFile) {
+	if (pFile == NULL || pFile->pUserData == NULL) return BCTBX_VFS_ERROR;
+	StatsFile *ctx = static_cast<StatsFile *>(pFile->pUserData);
+	if (!enabled(ctx)) return bctbx_file_size(ctx->pFileUnderlying);
+
+	auto start = std::chrono::steady_clock::now();
+	ssize_t ret = bctbx_file_size(ctx->pFileUnderlying);
+	ctx->record(BCTBX_VFS_STATS_OP_SIZE, start, 0, ret < 0);
+	return ret;
+}
+
+static int bcSync(bctbx_vfs_file_t *pFile) {
+	if (pFile == NULL || pFile->pUserData == NULL) return BCTBX_VFS_ERROR;
+	StatsFile *ctx = static_cast<StatsFile *>(pFile->pUserData);
+	if (!enabled(ctx)) return bctbx_file_sync(ctx->pFileUnderlying);
+
+	auto start = std::chrono::steady_clock::now();
+	int ret = bctbx_file_sync(ctx->pFileUnderlying);
+	ctx->record(BCTBX_VFS_STATS_OP_SYNC, start, 0, ret != BCTBX_VFS_OK);
+	return ret;
+}
+
+static bool_t bcIsEncrypted(bctbx_vfs_file_t *pFile) {
+	if (pFile && pFile->pUserData) {
+		return bctbx_file_is_encrypted(static_cast<StatsFile *>(pFile->pUserData)->pFileUnderlying);
+	}
+	return FALSE;
+}
+
+static int bcAllocate(bctbx_vfs_file_t *pFile, int64_t offset, int64_t len) {
+	if (pFile && pFile->pUserData) {
+		return bctbx_file_allocate(static_cast<StatsFile *>(pFile->pUserData)->pFileUnderlying, offset, len);
+	}
+	return BCTBX_VFS_ERROR;
+}
+
+static int bcAdvise(bctbx_vfs_file_t *pFile, int64_t offset, int64_t len, bctbx_vfs_advice_t advice) {
+	if (pFile && pFile->pUserData) {
+		return bctbx_file_advise(static_cast<StatsFile *>(pFile->pUserData)->pFileUnderlying, offset, len, advice);
+	}
+	return BCTBX_VFS_ERROR;
+}
+
+static const bctbx_io_methods_t bcio = {bcClose,    /* pFuncClose */
+                                        bcRead,     /* pFuncRead */
+                                        bcWrite,    /* pFuncWrite */
+                                        bcTruncate, /* pFuncTruncate */
+                                        bcFileSize, /* pFuncFileSize */
+                                        bcSync,
+                                        NULL, // use the generic get next line function
+                                        bcIsEncrypted,
+                                        bcAllocate,
+                                        bcAdvise};
+
+static int bcOpen(bctbx_vfs_t *pVfs, bctbx_vfs_file_t *pFile, const char *fName, int openFlags) {
+	if (pVfs == NULL || pFile == NULL || fName == NULL) {
+		return BCTBX_VFS_ERROR;
+	}
+	StatsVfs *statsVfs = reinterpret_cast<StatsVfs *>(pVfs);
+
+	bool measure = statsVfs->mEnabled.load(std::memory_order_relaxed);
+	auto start = std::chrono::steady_clock::now();
+	bctbx_vfs_file_t *underlyingFp = bctbx_file_open2(statsVfs->mUnderlying, fName, openFlags);
+	if (measure) {
+		statsVfs->mStats.record(BCTBX_VFS_STATS_OP_OPEN,
+		                        (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+		                            std::chrono::steady_clock::now() - start)
+		                            .count(),
+		                        0, underlyingFp == NULL);
+	}
+	if (underlyingFp == NULL) return BCTBX_VFS_ERROR;
+
+	StatsFile *ctx = new StatsFile(underlyingFp, statsVfs, fName);
+	{
+		std::lock_guard<std::mutex> lock(statsVfs->mFilesMutex);
+		statsVfs->mFiles.insert(ctx);
+	}
+
+	pFile->pMethods = &bcio;
+	pFile->pUserData = static_cast<void *>(ctx);
+	return BCTBX_VFS_OK;
+}
+
+bctbx_vfs_t *bctbx_vfs_stats_create(bctbx_vfs_t *underlying) {
+	if (underlying == NULL) return NULL;
+	StatsVfs *statsVfs = new StatsVfs();
+	statsVfs->mVfs.vfsName = "bctbx_stats_vfs";
+	statsVfs->mVfs.pFuncOpen = bcOpen;
+	statsVfs->mUnderlying = underlying;
+	return &statsVfs->mVfs;
+}
+
+void bctbx_vfs_stats_destroy(bctbx_vfs_t *statsVfs) {
+	delete reinterpret_cast<StatsVfs *>(statsVfs);
+}
+
+void bctbx_vfs_stats_set_enabled(bctbx_vfs_t *statsVfs, bool_t enabled) {
+	if (statsVfs) reinterpret_cast<StatsVfs *>(statsVfs)->mEnabled.store(enabled == TRUE, std::memory_order_relaxed);
+}
+
+bool_t bctbx_vfs_stats_is_enabled(bctbx_vfs_t *statsVfs) {
+	if (statsVfs == NULL) return FALSE;
+	return reinterpret_cast<StatsVfs *>(statsVfs)->mEnabled.load(std::memory_order_relaxed) ? TRUE : FALSE;
+}
+
+void bctbx_vfs_stats_get_snapshot(bctbx_vfs_t *statsVfs, bctbx_vfs_stats_snapshot_t *snapshot) {
+	if (statsVfs && snapshot) reinterpret_cast<StatsVfs *>(statsVfs)->mStats.snapshot(snapshot);
+}
+
+int bctbx_file_stats_get_snapshot(bctbx_vfs_file_t *pFile, bctbx_vfs_stats_snapshot_t *snapshot) {
+	if (pFile == NULL || pFile->pMethods != &bcio || pFile->pUserData == NULL || snapshot == NULL) {
+		return BCTBX_VFS_ERROR;
+	}
+	static_cast<StatsFile *>(pFile->pUserData)->mStats.snapshot(snapshot);
+	return BCTBX_VFS_OK;
+}
+
+void bctbx_vfs_stats_reset(bctbx_vfs_t *statsVfs) {
+	if (statsVfs == NULL) return;
+	StatsVfs *ctx = reinterpret_cast<StatsVfs *>(statsVfs);
+	ctx->mStats.reset();
+	std::lock_guard<std::mutex> lock(ctx->mFilesMutex);
+	for (auto file : ctx->mFiles) {
+		file->mStats.reset();
+	}
+}
+
+void bctbx_vfs_stats_log(bctbx_vfs_t *statsVfs, BctbxLogLevel level) {
+	if (statsVfs == NULL) return;
+	StatsVfs *ctx = reinterpret_cast<StatsVfs *>(statsVfs);
+	ctx->mStats.log(level, std::string("[vfs stats] ") + ctx->mUnderlying->vfsName);
+	std::lock_guard<std::mutex> lock(ctx->mFilesMutex);
+	for (auto file : ctx->mFiles) {
+		file->mStats.log(level, "[vfs stats] " + file->mName);
+	}
+}
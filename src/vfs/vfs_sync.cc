@@ -0,0 +1,176 @@
+/*
+ * Copyright (c) 2025 Belledonne Communications SARL.
+ *
+ * This file is part of bctoolbox.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "vfs_private.h"
+#include "bctoolbox/logging.h"
+#include "bctoolbox/vfs.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <io.h>
+#include <windows.h>
+#endif
+
+namespace bctoolbox {
+
+namespace {
+
+/**
+ * Group commit of file syncs.
+ * Syncs of different files run concurrently, each in the thread requesting it. Only the requests for the same file
+ * are grouped: a request arriving while a sync of its file is in progress waits for it, then either joins the sync
+ * started by another waiter meanwhile or starts the next one. A sync in progress may have started before the data
+ * of the request was written, so it does not cover the request.
+ */
+class SyncGroup {
+public:
+	static SyncGroup &get() {
+		static SyncGroup sInstance;
+		return sInstance;
+	}
+
+	int sync(int fd);
+
+	/* batch mode: requests of the current thread are recorded until commit */
+	static thread_local std::vector<int> *tBatch;
+
+private:
+	/* The syncs of a file, numbered in the order they start */
+	struct FileSyncs {
+		uint64_t mStarted = 0;
+		uint64_t mCompleted = 0;
+		uint64_t mLastError = 0; /**< number of the last sync which failed, 0 if none */
+		int mError = BCTBX_VFS_OK;
+		bool mSyncing = false;
+		unsigned int mUsers = 0;
+	};
+
+	SyncGroup() = default;
+	static int syncFd(int fd);
+
+	std::mutex mMutex;
+	std::condition_variable mCond;
+	std::map<int, FileSyncs> mFiles;
+};
+
+thread_local std::vector<int> *SyncGroup::tBatch = nullptr;
+
+int SyncGroup::syncFd(int fd) {
+#ifdef _WIN32
+	return (FlushFileBuffers((HANDLE)_get_osfhandle(fd)) != 0) ? BCTBX_VFS_OK : BCTBX_VFS_ERROR;
+#elif defined(HAVE_FDATASYNC)
+	// fdatasync skips the metadata not needed to read the data back (ie: timestamps)
+	return (fdatasync(fd) == 0) ? BCTBX_VFS_OK : -errno;
+#else
+	return (fsync(fd) == 0) ? BCTBX_VFS_OK : -errno;
+#endif
+}
+
+int SyncGroup::sync(int fd) {
+	std::unique_lock<std::mutex> lock(mMutex);
+	FileSyncs &syncs = mFiles[fd];
+	syncs.mUsers++;
+	// the first sync starting after this request covers it
+	const uint64_t needed = syncs.mStarted + 1;
+	while (syncs.mCompleted < needed) {
+		if (syncs.mSyncing) {
+			mCond.wait(lock);
+			continue;
+		}
+		uint64_t number = ++syncs.mStarted;
+		syncs.mSyncing = true;
+		lock.unlock();
+		int ret = syncFd(fd);
+		lock.lock();
+		syncs.mCompleted = number;
+		if (ret != BCTBX_VFS_OK) {
+			syncs.mLastError = number;
+			syncs.mError = ret;
+		}
+		syncs.mSyncing = false;
+		mCond.notify_all();
+	}
+	// a later sync covers the request as well, its error is reported too
+	int ret = (syncs.mLastError >= needed) ? syncs.mError : BCTBX_VFS_OK;
+	if (--syncs.mUsers == 0) mFiles.erase(fd);
+	return ret;
+}
+
+} // namespace
+
+} // namespace bctoolbox
+
+using namespace bctoolbox;
+
+int bctbx_vfs_sync_fd(int fd) {
+	if (SyncGroup::tBatch != nullptr) {
+		SyncGroup::tBatch->push_back(fd);
+		return BCTBX_VFS_OK;
+	}
+	return SyncGroup::get().sync(fd);
+}
+
+int bctbx_file_sync_batch(bctbx_vfs_file_t **files, size_t count) {
+	if (files == NULL) return BCTBX_VFS_ERROR;
+	if (SyncGroup::tBatch != nullptr) { // nested batch: the outer one commits
+		for (size_t i = 0; i < count; i++) {
+			if (bctbx_file_sync(files[i]) != BCTBX_VFS_OK) return BCTBX_VFS_ERROR;
+		}
+		return BCTBX_VFS_OK;
+	}
+
+	// let each vfs write back its buffered data, the underlying syncs are only recorded
+	std::vector<int> batch{};
+	int ret = BCTBX_VFS_OK;
+	SyncGroup::tBatch = &batch;
+	for (size_t i = 0; i < count; i++) {
+		if (bctbx_file_sync(files[i]) != BCTBX_VFS_OK) ret = BCTBX_VFS_ERROR;
+	}
+	SyncGroup::tBatch = nullptr;
+
+	// the files are synced concurrently, the calling thread taking the first one
+	std::sort(batch.begin(), batch.end());
+	batch.erase(std::unique(batch.begin(), batch.end()), batch.end());
+	std::vector<int> results(batch.size(), BCTBX_VFS_OK);
+	std::vector<std::thread> threads{};
+	for (size_t i = 1; i < batch.size(); i++) {
+		threads.emplace_back([&batch, &results, i]() { results[i] = SyncGroup::get().sync(batch[i]); });
+	}
+	if (!batch.empty()) results[0] = SyncGroup::get().sync(batch[0]);
+	for (auto &thread : threads) {
+		thread.join();
+	}
+	if (std::any_of(results.cbegin(), results.cend(), [](int result) { return result != BCTBX_VFS_OK; })) {
+		bctbx_error("bctbx_file_sync_batch: unable to sync %zu file(s)", count);
+		ret = BCTBX_VFS_ERROR;
+	}
+	return ret;
+}
@@ -21,11 +21,12 @@
 #include "bctoolbox/vfs_encrypted.hh"
 #include "bctoolbox/vfs_standard.h"
 #include "bctoolbox_tester.h"
+#include <algorithm>
 #include <fstream>
 
 using namespace bctoolbox;
 
-// default chunk size in tests is 16
+// default chunk size in tests is 16, 0 lets the vfs choose
 static size_t bctbx_vfs_tester_chunk_size = 16;
 
 /* A callback to position the key material and algorithm suite to use */
@@ -34,7 +35,7 @@ static void set_dummy_encryption_info(VfsEncryption &settings, size_t chunk_size
 	                                       0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
 	settings.encryptionSuiteSet(EncryptionSuite::dummy);
 	settings.secretMaterialSet(keyMaterial);
-	settings.chunkSizeSet(bctbx_vfs_tester_chunk_size);
+	if (bctbx_vfs_tester_chunk_size != 0) settings.chunkSizeSet(bctbx_vfs_tester_chunk_size);
 };
 
 static void set_plain_encryption_info(VfsEncryption &settings) {
@@ -47,7 +48,7 @@ static void set_aes256_encryption_info(VfsEncryption &settings, size_t chunk_siz
 	                                       0xa7, 0xa8, 0xa9, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff, 0xef};
 	settings.encryptionSuiteSet(EncryptionSuite::aes256gcm128_sha256);
 	settings.secretMaterialSet(keyMaterial);
-	settings.chunkSizeSet(bctbx_vfs_tester_chunk_size);
+	if (bctbx_vfs_tester_chunk_size != 0) settings.chunkSizeSet(bctbx_vfs_tester_chunk_size);
 };
 
 EncryptedVfsOpenCb set_encryption_info = [](VfsEncryption &settings) {
@@ -541,10 +542,207 @@ void recovery_test() {
 	VfsEncryption::openCallbackSet(nullptr);
 }
 
+/**
+ * Preallocate and give access hints on an encrypted file,
+ * check neither the plain nor the raw file size are modified and the file is still readable
+ */
+void allocate_test(bctoolbox::EncryptionSuite suite) {
+	/* get the encrypted file path */
+	char *path = bc_tester_file("allocate.");
+	std::string filePath{path};
+	filePath.append(bctoolbox::encryptionSuiteString(suite)).append(".evfs");
+	bctbx_free(path);
+
+	/* remove file if it was already there */
+	remove(filePath.data());
+
+	/* create the file */
+	bctbx_vfs_file_t *fp = bctbx_file_open2(&bcEncryptedVfs, filePath.data(), O_RDWR | O_CREAT);
+	BC_ASSERT_PTR_NOT_NULL(fp);
+	BC_ASSERT_EQUAL(bctbx_file_write(fp, message, 40, 0), 40, ssize_t, "%ld");
+	bctbx_file_close(fp);
+
+	bctbx_vfs_file_t *rawFp = bctbx_file_open2(bctbx_vfs_get_standard(), filePath.data(), O_RDONLY);
+	ssize_t rawSize = bctbx_file_size(rawFp);
+	bctbx_file_close(rawFp);
+
+	fp = bctbx_file_open2(&bcEncryptedVfs, filePath.data(), O_RDWR);
+	BC_ASSERT_EQUAL(bctbx_file_allocate(fp, 0, 4096), BCTBX_VFS_OK, int, "%d");
+	BC_ASSERT_EQUAL(bctbx_file_allocate(fp, 20, 100), BCTBX_VFS_OK, int, "%d");
+	BC_ASSERT_EQUAL(bctbx_file_advise(fp, 0, 0, BCTBX_VFS_ADVICE_SEQUENTIAL), BCTBX_VFS_OK, int, "%d");
+	BC_ASSERT_EQUAL(bctbx_file_advise(fp, 17, 5, BCTBX_VFS_ADVICE_WILLNEED), BCTBX_VFS_OK, int, "%d");
+	BC_ASSERT_EQUAL(bctbx_file_size(fp), 40, ssize_t, "%ld");
+	bctbx_file_close(fp);
+
+	rawFp = bctbx_file_open2(bctbx_vfs_get_standard(), filePath.data(), O_RDONLY);
+	BC_ASSERT_EQUAL(bctbx_file_size(rawFp), rawSize, ssize_t, "%ld");
+	bctbx_file_close(rawFp);
+
+	/* reopen, the header integrity check is not disturbed by the preallocation */
+	uint8_t readBuffer[40];
+	fp = bctbx_file_open2(&bcEncryptedVfs, filePath.data(), O_RDONLY);
+	BC_ASSERT_PTR_NOT_NULL(fp);
+	BC_ASSERT_EQUAL(bctbx_file_read(fp, readBuffer, sizeof(readBuffer), 0), 40, ssize_t, "%ld");
+	BC_ASSERT_TRUE(memcmp(readBuffer, message, 40) == 0);
+	bctbx_file_close(fp);
+
+	/* cleaning */
+	remove(filePath.data());
+}
+
+void allocate_test() {
+	/* set the encrypted vfs callback */
+	VfsEncryption::openCallbackSet(set_encryption_info);
+
+	allocate_test(EncryptionSuite::dummy);
+	allocate_test(EncryptionSuite::plain);
+	allocate_test(EncryptionSuite::aes256gcm128_sha256);
+
+	VfsEncryption::openCallbackSet(nullptr);
+}
+
+/**
+ * Copy a plain file into an encrypted one and back, large enough to go through several copy buffers
+ */
+void copy_test(bctoolbox::EncryptionSuite suite) {
+	/* get the file paths */
+	char *path = bc_tester_file("copy.");
+	std::string filePath{path};
+	filePath.append(bctoolbox::encryptionSuiteString(suite)).append(".evfs");
+	std::string plainPath{path};
+	plainPath.append("plain.txt");
+	std::string copyPath{path};
+	copyPath.append("copy.txt");
+	bctbx_free(path);
+	remove(filePath.data());
+	remove(plainPath.data());
+	remove(copyPath.data());
+
+	/* a plain file of 2.5 copy buffers */
+	const size_t size = 5 * BCTBX_VFS_COPY_BUFFER_SIZE / 2;
+	std::vector<uint8_t> data(size);
+	for (size_t i = 0; i < size; i++) {
+		data[i] = message[(i * 7) % sizeof(message)];
+	}
+	bctbx_vfs_file_t *plainFp = bctbx_file_open2(bctbx_vfs_get_standard(), plainPath.data(), O_RDWR | O_CREAT);
+	BC_ASSERT_EQUAL(bctbx_file_write(plainFp, data.data(), size, 0), (ssize_t)size, ssize_t, "%ld");
+
+	/* encrypt it */
+	bctbx_vfs_file_t *fp = bctbx_file_open2(&bcEncryptedVfs, filePath.data(), O_RDWR | O_CREAT);
+	BC_ASSERT_PTR_NOT_NULL(fp);
+	BC_ASSERT_EQUAL(bctbx_file_copy(plainFp, fp, 0, 0, -1), (int64_t)size, int64_t, "%ld");
+	bctbx_file_close(fp);
+	bctbx_file_close(plainFp);
+
+	/* decrypt it */
+	fp = bctbx_file_open2(&bcEncryptedVfs, filePath.data(), O_RDONLY);
+	BC_ASSERT_EQUAL(bctbx_file_size(fp), (ssize_t)size, ssize_t, "%ld");
+	bctbx_vfs_file_t *copyFp = bctbx_file_open2(bctbx_vfs_get_standard(), copyPath.data(), O_RDWR | O_CREAT);
+	BC_ASSERT_EQUAL(bctbx_file_copy(fp, copyFp, 0, 0, -1), (int64_t)size, int64_t, "%ld");
+	std::vector<uint8_t> readBuffer(size);
+	BC_ASSERT_EQUAL(bctbx_file_read(copyFp, readBuffer.data(), size, 0), (ssize_t)size, ssize_t, "%ld");
+	BC_ASSERT_TRUE(readBuffer == data);
+	bctbx_file_close(copyFp);
+	bctbx_file_close(fp);
+
+	/* cleaning */
+	remove(filePath.data());
+	remove(plainPath.data());
+	remove(copyPath.data());
+}
+
+void copy_test() {
+	/* set the encrypted vfs callback */
+	bctbx_vfs_tester_chunk_size = 4096; // this is the default value
+	VfsEncryption::openCallbackSet(set_encryption_info);
+
+	copy_test(EncryptionSuite::dummy);
+	copy_test(EncryptionSuite::aes256gcm128_sha256);
+
+	VfsEncryption::openCallbackSet(nullptr);
+	bctbx_vfs_tester_chunk_size = 16; // reset it for the other tests
+}
+
+/**
+ * Write through the direct I/O encrypted vfs in unaligned pieces, check the raw chunks are aligned on blocks and the
+ * file can be read back with the regular encrypted vfs
+ */
+void direct_io_test(bctoolbox::EncryptionSuite suite) {
+	/* get the file path */
+	char *path = bc_tester_file("direct_io.");
+	std::string filePath{path};
+	filePath.append(bctoolbox::encryptionSuiteString(suite)).append(".evfs");
+	bctbx_free(path);
+	remove(filePath.data());
+
+	const size_t size = 15000;
+	std::vector<uint8_t> data(size);
+	for (size_t i = 0; i < size; i++) {
+		data[i] = message[(i * 3) % sizeof(message)];
+	}
+
+	/* write it by pieces of 1000 bytes */
+	bctbx_vfs_file_t *fp = bctbx_file_open2(&bcEncryptedDirectVfs, filePath.data(), O_RDWR | O_CREAT);
+	BC_ASSERT_PTR_NOT_NULL(fp);
+	for (size_t offset = 0; offset < size; offset += 1000) {
+		BC_ASSERT_EQUAL(bctbx_file_write(fp, data.data() + offset, 1000, (off_t)offset), 1000, ssize_t, "%ld");
+	}
+	/* overwrite a range across two chunks */
+	for (size_t i = 4000; i < 4200; i++) {
+		data[i] = 0x42;
+	}
+	BC_ASSERT_EQUAL(bctbx_file_write(fp, data.data() + 4000, 200, 4000), 200, ssize_t, "%ld");
+	BC_ASSERT_EQUAL(bctbx_file_close(fp), BCTBX_VFS_OK, int, "%d");
+
+	/* the file header and every chunk but the last one fill whole blocks */
+	size_t chunkHeaderSize = (suite == bctoolbox::EncryptionSuite::dummy) ? 16 : 28;
+	size_t chunkSize = (BCTBX_VFS_DIRECT_IO_ALIGNMENT - chunkHeaderSize) & ~(size_t)15;
+	size_t lastChunkSize = size - (size / chunkSize) * chunkSize;
+	fp = bctbx_file_open2(bctbx_vfs_get_standard(), filePath.data(), O_RDONLY);
+	size_t alignedPart = (size_t)bctbx_file_size(fp) - lastChunkSize - chunkHeaderSize;
+	BC_ASSERT_EQUAL(alignedPart, BCTBX_VFS_DIRECT_IO_ALIGNMENT * (size / chunkSize + 1), size_t, "%zu");
+	bctbx_file_close(fp);
+
+	/* read it back with the regular encrypted vfs */
+	fp = bctbx_file_open2(&bcEncryptedVfs, filePath.data(), O_RDONLY);
+	BC_ASSERT_PTR_NOT_NULL(fp);
+	BC_ASSERT_EQUAL(bctbx_file_size(fp), (ssize_t)size, ssize_t, "%ld");
+	std::vector<uint8_t> readBuffer(size);
+	BC_ASSERT_EQUAL(bctbx_file_read(fp, readBuffer.data(), size, 0), (ssize_t)size, ssize_t, "%ld");
+	BC_ASSERT_TRUE(readBuffer == data);
+	bctbx_file_close(fp);
+
+	/* truncate with the direct I/O one and read back unaligned */
+	fp = bctbx_file_open2(&bcEncryptedDirectVfs, filePath.data(), O_RDWR);
+	BC_ASSERT_EQUAL(bctbx_file_truncate(fp, 5000), 0, int, "%d");
+	BC_ASSERT_EQUAL(bctbx_file_size(fp), 5000, ssize_t, "%ld");
+	BC_ASSERT_EQUAL(bctbx_file_read(fp, readBuffer.data(), 3000, 1999), 3000, ssize_t, "%ld");
+	BC_ASSERT_TRUE(std::equal(readBuffer.cbegin(), readBuffer.cbegin() + 3000, data.cbegin() + 1999));
+	bctbx_file_close(fp);
+
+	/* cleaning */
+	remove(filePath.data());
+}
+
+void direct_io_test() {
+	/* set the encrypted vfs callback, let the vfs choose the chunk size */
+	bctbx_vfs_tester_chunk_size = 0;
+	VfsEncryption::openCallbackSet(set_encryption_info);
+
+	direct_io_test(EncryptionSuite::dummy);
+	direct_io_test(EncryptionSuite::aes256gcm128_sha256);
+
+	VfsEncryption::openCallbackSet(nullptr);
+	bctbx_vfs_tester_chunk_size = 16; // reset it for the other tests
+}
+
 static test_t encrypted_vfs_tests[] = {TEST_NO_TAG("basic", basic_encryption_test),
                                        TEST_NO_TAG("Authentication failure", auth_fail_test),
                                        TEST_NO_TAG("migration", migration_test), TEST_NO_TAG("recovery", recovery_test),
-                                       TEST_NO_TAG("fprintf", fprintf_encryption_test)};
+                                       TEST_NO_TAG("fprintf", fprintf_encryption_test),
+                                       TEST_NO_TAG("allocate", allocate_test),
+                                       TEST_NO_TAG("copy", copy_test),
+                                       TEST_NO_TAG("direct io", direct_io_test)};
 
 test_suite_t encrypted_vfs_test_suite = {
     "Encrypted vfs",    NULL, NULL, NULL, NULL, sizeof(encrypted_vfs_tests) / sizeof(encrypted_vfs_tests[0]),
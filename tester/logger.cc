@@ -17,9 +17,18 @@
  * along with this program. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <clocale>
+#include <limits>
 #include <list>
+#include <memory>
+#include <mutex>
 #include <sstream>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include "bctoolbox/crypto.h"
 #include "bctoolbox/tester.h"
@@ -40,6 +49,7 @@ static void assert_tag_presence(const std::list<std::string> &expected) {
 	const std::string &currentTags = current_tags_str.str();
 	const std::string &expectedTags = expected_tags_str.str();
 	BC_ASSERT_STRING_EQUAL(currentTags.c_str(), expectedTags.c_str());
+	BC_ASSERT_STRING_EQUAL(bctbx_get_log_tags_string(), expectedTags.c_str());
 }
 
 static void test_tags(void) {
@@ -119,7 +129,939 @@ static void test_cpp_tags(void) {
 	bctbx_uninit_logger();
 }
 
-static test_t logger_tests[] = {TEST_NO_TAG("Log tags", test_tags), TEST_NO_TAG("C++ log tags", test_cpp_tags)};
+static void test_tags_copy(void) {
+	bctbx_init_logger(1);
+
+	bctbx_push_log_tag("zz-tag", "last");
+	bctbx_push_log_tag("aa-tag", "first");
+	bctbx_log_tags_t *copy = bctbx_create_log_tags_copy();
+	bctbx_log_tags_t *sameCopy = bctbx_create_log_tags_copy();
+	BC_ASSERT_PTR_EQUAL(copy, sameCopy); // shared while the tags do not change
+	bctbx_push_log_tag("aa-tag", "other");
+	bctbx_log_tags_t *newCopy = bctbx_create_log_tags_copy();
+	BC_ASSERT_PTR_NOT_EQUAL(copy, newCopy);
+
+	std::thread worker([copy, newCopy]() {
+		bctbx_paste_log_tags(copy);
+		assert_tag_presence({"first", "last"});
+		bctbx_pop_log_tag("aa-tag");
+		assert_tag_presence({"last"});
+		bctbx_pop_log_tag("zz-tag");
+		bctbx_paste_log_tags(newCopy);
+		assert_tag_presence({"other", "last"});
+	});
+	worker.join();
+	assert_tag_presence({"other", "last"});
+
+	bctbx_log_tags_destroy(copy);
+	bctbx_log_tags_destroy(sameCopy);
+	bctbx_log_tags_destroy(newCopy);
+	bctbx_pop_log_tag("aa-tag");
+	bctbx_pop_log_tag("aa-tag");
+	bctbx_pop_log_tag("zz-tag");
+	assert_tag_presence({});
+	bctbx_uninit_logger();
+}
+
+static const char *sAsyncDomain = "bctbx-async-tester";
+
+/* Collect the messages of sAsyncDomain, slowly if asked to */
+struct AsyncLogCollector {
+	std::mutex mMutex;
+	std::vector<std::string> mMessages;
+	std::string mLastTags;
+	std::thread::id mLastThread;
+	std::chrono::microseconds mDelay{0};
+};
+
+static void async_collector_log(void *info, const char *, BctbxLogLevel, const char *fmt, va_list args) {
+	AsyncLogCollector *collector = (AsyncLogCollector *)info;
+	char *msg = bctbx_strdup_vprintf(fmt, args);
+	std::string tags;
+	for (const bctbx_list_t *tag = bctbx_get_log_tags(); tag != NULL; tag = tag->next) {
+		tags += "[" + std::string((const char *)tag->data) + "]";
+	}
+	if (collector->mDelay.count() > 0) std::this_thread::sleep_for(collector->mDelay);
+	std::lock_guard<std::mutex> lock(collector->mMutex);
+	collector->mMessages.emplace_back(msg);
+	collector->mLastTags = tags;
+	collector->mLastThread = std::this_thread::get_id();
+	bctbx_free(msg);
+}
+
+static void async_collector_destroy(bctbx_log_handler_t *handler) {
+	bctbx_free(handler);
+}
+
+static void log_async_messages(int count, int threadIndex) {
+	for (int i = 0; i < count; i++) {
+		bctbx_log(sAsyncDomain, BCTBX_LOG_MESSAGE, "thread %d message %d", threadIndex, i);
+	}
+}
+
+static void test_async_logging(void) {
+	AsyncLogCollector collector;
+	bctbx_init_logger(1);
+	bctbx_set_log_level(sAsyncDomain, BCTBX_LOG_MESSAGE);
+	bctbx_log_handler_t *handler = bctbx_create_log_handler(async_collector_log, async_collector_destroy, &collector);
+	bctbx_log_handler_set_domain(handler, sAsyncDomain);
+	bctbx_add_log_handler(handler);
+
+	// blocking policy: nothing is lost and the messages of each thread stay ordered
+	BC_ASSERT_EQUAL(bctbx_enable_async_logging(16, BCTBX_LOG_OVERFLOW_BLOCK), 0, int, "%d");
+	uint64_t dropped = bctbx_get_async_logging_dropped_count();
+	std::vector<std::thread> threads;
+	for (int t = 0; t < 4; t++) {
+		threads.emplace_back(log_async_messages, 200, t);
+	}
+	for (auto &thread : threads) {
+		thread.join();
+	}
+	bctbx_flush_async_logging();
+	BC_ASSERT_EQUAL((int)collector.mMessages.size(), 800, int, "%d");
+	BC_ASSERT_EQUAL((int)(bctbx_get_async_logging_dropped_count() - dropped), 0, int, "%d");
+	int next[4] = {0, 0, 0, 0};
+	bool ordered = true;
+	for (const auto &msg : collector.mMessages) {
+		int t, i;
+		if (sscanf(msg.c_str(), "thread %d message %d", &t, &i) != 2 || t < 0 || t > 3 || next[t] != i) {
+			ordered = false;
+			break;
+		}
+		next[t]++;
+	}
+	BC_ASSERT_TRUE(ordered);
+	BC_ASSERT_TRUE(collector.mLastThread != std::this_thread::get_id());
+
+	// the tags of the logging thread and the messages too large for a queue cell are kept
+	bctbx_push_log_tag("async-tag", "value");
+	std::string longMessage(600, 'x');
+	bctbx_log(sAsyncDomain, BCTBX_LOG_MESSAGE, "%s", longMessage.c_str());
+	bctbx_flush_async_logging();
+	bctbx_pop_log_tag("async-tag");
+	BC_ASSERT_TRUE(collector.mMessages.back() == longMessage);
+	BC_ASSERT_STRING_EQUAL(collector.mLastTags.c_str(), "[value]");
+
+	// drop policy with a slow handler: every message is either handled or counted as dropped
+	collector.mMessages.clear();
+	collector.mDelay = std::chrono::microseconds(500);
+	BC_ASSERT_EQUAL(bctbx_enable_async_logging(8, BCTBX_LOG_OVERFLOW_DROP), 0, int, "%d");
+	dropped = bctbx_get_async_logging_dropped_count();
+	log_async_messages(200, 0);
+	bctbx_flush_async_logging();
+	int droppedCount = (int)(bctbx_get_async_logging_dropped_count() - dropped);
+	BC_ASSERT_TRUE(droppedCount > 0);
+	BC_ASSERT_EQUAL((int)collector.mMessages.size() + droppedCount, 200, int, "%d");
+	BC_ASSERT_TRUE(collector.mMessages.front() == "thread 0 message 0");
+
+	// overwrite policy: the oldest messages are dropped, the last one is kept
+	collector.mMessages.clear();
+	BC_ASSERT_EQUAL(bctbx_enable_async_logging(8, BCTBX_LOG_OVERFLOW_OVERWRITE), 0, int, "%d");
+	dropped = bctbx_get_async_logging_dropped_count();
+	log_async_messages(200, 0);
+	bctbx_flush_async_logging();
+	droppedCount = (int)(bctbx_get_async_logging_dropped_count() - dropped);
+	BC_ASSERT_TRUE(droppedCount > 0);
+	BC_ASSERT_EQUAL((int)collector.mMessages.size() + droppedCount, 200, int, "%d");
+	BC_ASSERT_TRUE(collector.mMessages.back() == "thread 0 message 199");
+
+	// a flush waits for the message being handled, even when newer ones are overwritten meanwhile
+	collector.mMessages.clear();
+	collector.mDelay = std::chrono::milliseconds(50);
+	bctbx_log(sAsyncDomain, BCTBX_LOG_MESSAGE, "slow");
+	std::this_thread::sleep_for(std::chrono::milliseconds(10)); // handled by the writer thread
+	std::atomic<bool> flushing{false};
+	bool slowHandled = false;
+	std::thread flusher([&]() {
+		flushing = true;
+		bctbx_flush_async_logging();
+		std::lock_guard<std::mutex> lock(collector.mMutex);
+		slowHandled = std::find(collector.mMessages.cbegin(), collector.mMessages.cend(), "slow") !=
+		              collector.mMessages.cend();
+	});
+	while (!flushing.load()) {
+		std::this_thread::yield();
+	}
+	std::this_thread::sleep_for(std::chrono::milliseconds(5));
+	log_async_messages(30, 0);
+	flusher.join();
+	BC_ASSERT_TRUE(slowHandled);
+	bctbx_flush_async_logging();
+
+	// back to synchronous logging
+	bctbx_disable_async_logging();
+	collector.mDelay = std::chrono::microseconds(0);
+	bctbx_log(sAsyncDomain, BCTBX_LOG_MESSAGE, "synchronous");
+	BC_ASSERT_TRUE(collector.mMessages.back() == "synchronous");
+	BC_ASSERT_TRUE(collector.mLastThread == std::this_thread::get_id());
+
+	bctbx_remove_log_handler(handler);
+	bctbx_uninit_logger();
+}
+
+static int sEvaluations = 0;
+
+static int count_evaluation(void) {
+	return ++sEvaluations;
+}
+
+static void test_log_domain_handles(void) {
+	const char *domainName = "bctbx-handle-tester";
+	AsyncLogCollector collector;
+	bctbx_init_logger(1);
+	unsigned int defaultMask = bctbx_get_log_level_mask(NULL);
+	bctbx_log_handler_t *handler = bctbx_create_log_handler(async_collector_log, async_collector_destroy, &collector);
+	bctbx_log_handler_set_domain(handler, domainName);
+	bctbx_add_log_handler(handler);
+
+	// a domain interned before any level is set follows the default domain
+	bctbx_log_domain_handle_t handle = bctbx_get_log_domain_handle(domainName);
+	BC_ASSERT_PTR_NOT_NULL(handle);
+	BC_ASSERT_TRUE(bctbx_get_log_domain_handle(domainName) == handle);
+	BC_ASSERT_STRING_EQUAL(bctbx_log_domain_handle_get_name(handle), domainName);
+	BC_ASSERT_PTR_NULL(bctbx_log_domain_handle_get_name(bctbx_get_log_domain_handle(NULL)));
+	bctbx_set_log_level(NULL, BCTBX_LOG_ERROR);
+	BC_ASSERT_FALSE(bctbx_log_handle_level_enabled(handle, BCTBX_LOG_WARNING));
+	BC_ASSERT_FALSE(bctbx_log_handle_level_enabled(NULL, BCTBX_LOG_WARNING));
+	bctbx_set_log_level(NULL, BCTBX_LOG_WARNING);
+	BC_ASSERT_TRUE(bctbx_log_handle_level_enabled(handle, BCTBX_LOG_WARNING));
+	BC_ASSERT_EQUAL(bctbx_get_log_level_mask(domainName), bctbx_get_log_level_mask(NULL), unsigned int, "%u");
+
+	// once set by name, the level of the domain applies to its handle and no longer follows the default one
+	bctbx_set_log_level(domainName, BCTBX_LOG_MESSAGE);
+	BC_ASSERT_TRUE(bctbx_log_handle_level_enabled(handle, BCTBX_LOG_MESSAGE));
+	BC_ASSERT_FALSE(bctbx_log_handle_level_enabled(handle, BCTBX_LOG_DEBUG));
+	bctbx_set_log_level(NULL, BCTBX_LOG_ERROR);
+	BC_ASSERT_TRUE(bctbx_log_handle_level_enabled(handle, BCTBX_LOG_MESSAGE));
+	BC_ASSERT_TRUE(bctbx_log_level_enabled(domainName, BCTBX_LOG_MESSAGE));
+
+	// the arguments of a disabled log are not evaluated
+	sEvaluations = 0;
+	BCTBX_LOG_HANDLE(handle, BCTBX_LOG_DEBUG, "not logged %d", count_evaluation());
+	BC_ASSERT_EQUAL(sEvaluations, 0, int, "%d");
+	BC_ASSERT_EQUAL((int)collector.mMessages.size(), 0, int, "%d");
+	BCTBX_LOG_HANDLE(handle, BCTBX_LOG_MESSAGE, "logged %d", count_evaluation());
+	BC_ASSERT_EQUAL(sEvaluations, 1, int, "%d");
+	BC_ASSERT_EQUAL((int)collector.mMessages.size(), 1, int, "%d");
+	if (!collector.mMessages.empty()) BC_ASSERT_STRING_EQUAL(collector.mMessages.back().c_str(), "logged 1");
+
+	BCTBX_SLOG(handle, BCTBX_LOG_WARNING) << "stream " << 42;
+	BCTBX_SLOG(handle, BCTBX_LOG_DEBUG) << "not logged";
+	BC_ASSERT_EQUAL((int)collector.mMessages.size(), 2, int, "%d");
+	if (!collector.mMessages.empty()) BC_ASSERT_STRING_EQUAL(collector.mMessages.back().c_str(), "stream 42");
+
+	bctbx_remove_log_handler(handler);
+	bctbx_set_log_level_mask(NULL, (int)defaultMask);
+	bctbx_uninit_logger();
+}
+
+struct RoutedHandlerState {
+	std::atomic<int> mReceived{0};
+	std::atomic<bool> mDestroyed{false};
+	std::atomic<int> *mUsedAfterDestroy = nullptr;
+	void *mHandler = nullptr;
+};
+
+static void routed_handler_log(void *info, const char *, BctbxLogLevel, const char *, va_list) {
+	RoutedHandlerState *state = (RoutedHandlerState *)info;
+	if (state->mDestroyed.load()) (*state->mUsedAfterDestroy)++;
+	state->mReceived++;
+}
+
+static void routed_handler_destroy(bctbx_log_handler_t *handler) {
+	RoutedHandlerState *state = (RoutedHandlerState *)bctbx_log_handler_get_user_data(handler);
+	state->mDestroyed.store(true);
+	bctbx_free(handler);
+}
+
+static void self_removing_handler_log(void *info, const char *, BctbxLogLevel, const char *, va_list) {
+	RoutedHandlerState *state = (RoutedHandlerState *)info;
+	state->mReceived++;
+	// removal does not wait for the dispatch in progress, which still holds the handler
+	bctbx_remove_log_handler((bctbx_log_handler_t *)state->mHandler);
+	if (state->mDestroyed.load()) (*state->mUsedAfterDestroy)++;
+}
+
+static void readding_handler_log(void *info, const char *, BctbxLogLevel, const char *, va_list) {
+	RoutedHandlerState *state = (RoutedHandlerState *)info;
+	if (state->mDestroyed.load()) (*state->mUsedAfterDestroy)++;
+	if (state->mReceived++ > 0) return;
+	// removed while the dispatch in progress holds it, then added back before it is destroyed
+	bctbx_remove_log_handler((bctbx_log_handler_t *)state->mHandler);
+	bctbx_add_log_handler((bctbx_log_handler_t *)state->mHandler);
+}
+
+static void test_handler_routing(void) {
+	const char *domainName = "bctbx-routing-tester";
+	bctbx_init_logger(1);
+	bctbx_set_log_level(domainName, BCTBX_LOG_MESSAGE);
+	std::atomic<int> usedAfterDestroy{0};
+
+	// handlers only receive the messages of their domain
+	RoutedHandlerState mine, other;
+	mine.mUsedAfterDestroy = other.mUsedAfterDestroy = &usedAfterDestroy;
+	bctbx_log_handler_t *mineHandler = bctbx_create_log_handler(routed_handler_log, routed_handler_destroy, &mine);
+	bctbx_log_handler_t *otherHandler = bctbx_create_log_handler(routed_handler_log, routed_handler_destroy, &other);
+	bctbx_log_handler_set_domain(mineHandler, domainName);
+	bctbx_log_handler_set_domain(otherHandler, "bctbx-routing-tester-other");
+	bctbx_add_log_handler(mineHandler);
+	bctbx_add_log_handler(otherHandler);
+	bctbx_log(domainName, BCTBX_LOG_MESSAGE, "routed");
+	BC_ASSERT_EQUAL(mine.mReceived.load(), 1, int, "%d");
+	BC_ASSERT_EQUAL(other.mReceived.load(), 0, int, "%d");
+
+	// changing the domain of a registered handler changes its routing
+	bctbx_log_handler_set_domain(otherHandler, domainName);
+	bctbx_log(domainName, BCTBX_LOG_MESSAGE, "routed");
+	BC_ASSERT_EQUAL(mine.mReceived.load(), 2, int, "%d");
+	BC_ASSERT_EQUAL(other.mReceived.load(), 1, int, "%d");
+	bctbx_remove_log_handler(otherHandler);
+	BC_ASSERT_TRUE(other.mDestroyed.load());
+
+	// handlers added and removed while other threads are logging are never called once destroyed
+	std::atomic<int> running{4};
+	std::vector<std::thread> threads;
+	for (int t = 0; t < 4; t++) {
+		threads.emplace_back([&running, domainName]() {
+			for (int i = 0; i < 250; i++) {
+				bctbx_log(domainName, BCTBX_LOG_MESSAGE, "concurrent %d", i);
+			}
+			running--;
+		});
+	}
+	std::vector<std::unique_ptr<RoutedHandlerState>> states;
+	while (running.load() > 0) {
+		states.emplace_back(new RoutedHandlerState());
+		states.back()->mUsedAfterDestroy = &usedAfterDestroy;
+		bctbx_log_handler_t *handler =
+		    bctbx_create_log_handler(routed_handler_log, routed_handler_destroy, states.back().get());
+		bctbx_log_handler_set_domain(handler, domainName);
+		bctbx_add_log_handler(handler);
+		bctbx_remove_log_handler(handler);
+	}
+	for (auto &thread : threads) {
+		thread.join();
+	}
+	BC_ASSERT_EQUAL(usedAfterDestroy.load(), 0, int, "%d");
+	BC_ASSERT_TRUE(mine.mReceived.load() > 2);
+	// the last thread dispatching to a removed handler destroyed it
+	BC_ASSERT_TRUE(std::all_of(states.cbegin(), states.cend(), [](const std::unique_ptr<RoutedHandlerState> &state) {
+		return state->mDestroyed.load();
+	}));
+
+	// a handler removing itself is destroyed once the message is dispatched
+	RoutedHandlerState selfRemoving;
+	selfRemoving.mUsedAfterDestroy = &usedAfterDestroy;
+	bctbx_log_handler_t *selfRemovingHandler =
+	    bctbx_create_log_handler(self_removing_handler_log, routed_handler_destroy, &selfRemoving);
+	selfRemoving.mHandler = selfRemovingHandler;
+	bctbx_add_log_handler(selfRemovingHandler);
+	bctbx_log(domainName, BCTBX_LOG_MESSAGE, "self removing");
+	BC_ASSERT_EQUAL(selfRemoving.mReceived.load(), 1, int, "%d");
+	BC_ASSERT_TRUE(selfRemoving.mDestroyed.load());
+	BC_ASSERT_EQUAL(usedAfterDestroy.load(), 0, int, "%d");
+
+	// a handler added back after its removal is not destroyed
+	RoutedHandlerState readding;
+	readding.mUsedAfterDestroy = &usedAfterDestroy;
+	bctbx_log_handler_t *readdingHandler =
+	    bctbx_create_log_handler(readding_handler_log, routed_handler_destroy, &readding);
+	readding.mHandler = readdingHandler;
+	bctbx_add_log_handler(readdingHandler);
+	bctbx_log(domainName, BCTBX_LOG_MESSAGE, "removed and added back");
+	BC_ASSERT_FALSE(readding.mDestroyed.load());
+	bctbx_log(domainName, BCTBX_LOG_MESSAGE, "still registered");
+	BC_ASSERT_EQUAL(readding.mReceived.load(), 2, int, "%d");
+	BC_ASSERT_EQUAL(usedAfterDestroy.load(), 0, int, "%d");
+	bctbx_remove_log_handler(readdingHandler);
+	BC_ASSERT_TRUE(readding.mDestroyed.load());
+
+	bctbx_remove_log_handler(mineHandler);
+	bctbx_uninit_logger();
+}
+
+static void test_binary_log_handler(void) {
+	const char *domainName = "bctbx-binary-tester";
+	const char *fileName = "binary_log_handler.bin";
+	char *path = bc_tester_file(fileName);
+	remove(path);
+	bctbx_init_logger(1);
+	bctbx_set_log_level(domainName, BCTBX_LOG_MESSAGE);
+	bctbx_log_handler_t *handler = bctbx_create_binary_log_handler(bc_tester_get_writable_dir_prefix(), fileName);
+	if (!BC_ASSERT_PTR_NOT_NULL(handler)) {
+		bctbx_free(path);
+		return;
+	}
+	bctbx_log_handler_set_domain(handler, domainName);
+	bctbx_add_log_handler(handler);
+
+	// the decoded messages are the ones vsnprintf would have produced
+	std::vector<std::string> expected;
+	const char notTerminated[] = {'a', 'b', 'c', 'd'};
+	const char *nullString = NULL;
+	auto log = [&](const char *fmt, auto... args) {
+		char *msg = bctbx_strdup_printf(fmt, args...);
+		expected.push_back(msg);
+		bctbx_free(msg);
+		bctbx_log(domainName, BCTBX_LOG_MESSAGE, fmt, args...);
+	};
+	log("plain text with a %% sign");
+	log("int %d, negative %i, unsigned %u, hex %#x, octal %o", 42, -7, 3000000000u, 255, 8);
+	log("hh %hhd %hhu, h %hd, l %ld, ll %lld, z %zu, j %jd", 300, 300, 70000, -1234567890L, -123456789012345LL,
+	    (size_t)77, (intmax_t)-5);
+	log("char %c, width %5d|%-5d|%05d, star %*d|%-*d", 'x', 1, 2, 3, 6, 4, 3, 5);
+	log("double %f %.2e %g %10.3f, long double %Lf", 3.5, 12345.678, 0.0001, -2.25, (long double)1.5);
+	log("string %s, precision %.2s, star precision %.*s, not terminated %.3s", "hello", "world", 3, "abcdef",
+	    notTerminated);
+	log("null %s, negative precision %.*s", nullString, -1, "all");
+	bctbx_push_log_tag("binary-tag", "value");
+	log("tagged %s", "message");
+	bctbx_pop_log_tag("binary-tag");
+	// not recordable: formatted when logged
+	log("positional %1$d %1$d", 9);
+
+	// a typical message is recorded in a fraction of its text size
+	size_t textSize = 0;
+	for (int i = 0; i < 200; i++) {
+		textSize += strlen("2025-01-01 12:00:00:000 bctbx-binary-tester-message- ");
+		char *msg = bctbx_strdup_printf("Call %p: received %d bytes from %s in %d ms", handler, i * 13, "192.168.1.10",
+		                                i % 50);
+		textSize += strlen(msg) + 1;
+		bctbx_free(msg);
+		bctbx_log(domainName, BCTBX_LOG_MESSAGE, "Call %p: received %d bytes from %s in %d ms", handler, i * 13,
+		          "192.168.1.10", i % 50);
+	}
+	bctbx_binary_log_handler_flush(handler);
+	bctbx_remove_log_handler(handler);
+
+	FILE *in = fopen(path, "rb");
+	BC_ASSERT_PTR_NOT_NULL(in);
+	if (in) {
+		fseek(in, 0, SEEK_END);
+		long binarySize = ftell(in);
+		rewind(in);
+		BC_ASSERT_TRUE(binarySize > 0 && (size_t)binarySize * 3 < textSize);
+		FILE *out = tmpfile();
+		BC_ASSERT_EQUAL(bctbx_decode_binary_log(in, out, 0), (int)expected.size() + 200, int, "%d");
+		fclose(in);
+		rewind(out);
+		char line[512];
+		std::string prefix = std::string(" ") + domainName + "-message-";
+		for (size_t i = 0; i < expected.size() && fgets(line, sizeof(line), out); i++) {
+			std::string decoded(line);
+			size_t start = decoded.find(prefix);
+			BC_ASSERT_TRUE(start != std::string::npos);
+			if (start == std::string::npos) continue;
+			decoded = decoded.substr(start + prefix.size());
+			decoded.pop_back(); // end of line
+			std::string message = ((i == expected.size() - 2) ? "[value] " : " ") + expected[i];
+			BC_ASSERT_STRING_EQUAL(decoded.c_str(), message.c_str());
+		}
+		fclose(out);
+	}
+
+	// a corrupted string length stops the decoding
+	const uint8_t corrupted[] = {'B',  'C',  'T',  'B',  'X',  'B',  'L',  '1',  1,    1,
+	                             0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 1};
+	in = tmpfile();
+	fwrite(corrupted, 1, sizeof(corrupted), in);
+	rewind(in);
+	FILE *out = tmpfile();
+	BC_ASSERT_EQUAL(bctbx_decode_binary_log(in, out, 0), 0, int, "%d");
+	fclose(out);
+	fclose(in);
+
+	remove(path);
+	bctbx_free(path);
+	bctbx_uninit_logger();
+}
+
+static void test_log_line_rendering(void) {
+	const char *domainName = "bctbx-rendering-tester";
+	const char *fileName = "log_line_rendering.log";
+	char *path = bc_tester_file(fileName);
+	remove(path);
+	bctbx_init_logger(1);
+	bctbx_set_log_level(domainName, BCTBX_LOG_MESSAGE);
+	bctbx_log_handler_t *handler = bctbx_create_file_log_handler(0, bc_tester_get_writable_dir_prefix(), fileName);
+	if (!BC_ASSERT_PTR_NOT_NULL(handler)) {
+		bctbx_free(path);
+		return;
+	}
+	bctbx_log_handler_set_domain(handler, domainName);
+	bctbx_add_log_handler(handler);
+
+	std::string longMessage(1000, 'y');
+	bctbx_log(domainName, BCTBX_LOG_WARNING, "first %d", 1);
+	bctbx_push_log_tag("render-tag", "value");
+	bctbx_log(domainName, BCTBX_LOG_MESSAGE, "long %s", longMessage.c_str());
+	bctbx_pop_log_tag("render-tag");
+	bctbx_set_log_timestamp_source(BCTBX_LOG_TIMESTAMP_MONOTONIC);
+	bctbx_log(domainName, BCTBX_LOG_ERROR, "monotonic");
+	bctbx_set_log_timestamp_source(BCTBX_LOG_TIMESTAMP_WALL_CLOCK);
+	bctbx_remove_log_handler(handler);
+
+	FILE *f = fopen(path, "r");
+	BC_ASSERT_PTR_NOT_NULL(f);
+	if (f) {
+		std::vector<char> line(2048);
+		int year, month, day, hour, minute, second, millisecond, n = 0;
+		BC_ASSERT_PTR_NOT_NULL(fgets(line.data(), (int)line.size(), f));
+		int fields = sscanf(line.data(), "%d-%d-%d %d:%d:%d:%d %n", &year, &month, &day, &hour, &minute, &second,
+		                    &millisecond, &n);
+		BC_ASSERT_EQUAL(fields, 7, int, "%d");
+		BC_ASSERT_STRING_EQUAL(line.data() + n, "bctbx-rendering-tester-warning- first 1\n");
+		BC_ASSERT_TRUE(year >= 2024 && month >= 1 && month <= 12 && millisecond >= 0 && millisecond < 1000);
+
+		BC_ASSERT_PTR_NOT_NULL(fgets(line.data(), (int)line.size(), f));
+		std::string expected = "bctbx-rendering-tester-message-[value] long " + longMessage + "\n";
+		std::string rendered(line.data());
+		BC_ASSERT_TRUE(rendered.size() > 24 && rendered.substr(24) == expected);
+
+		long seconds, microseconds;
+		BC_ASSERT_PTR_NOT_NULL(fgets(line.data(), (int)line.size(), f));
+		fields = sscanf(line.data(), "%ld.%ld %n", &seconds, &microseconds, &n);
+		BC_ASSERT_EQUAL(fields, 2, int, "%d");
+		BC_ASSERT_STRING_EQUAL(line.data() + n, "bctbx-rendering-tester-error- monotonic\n");
+		fclose(f);
+	}
+
+	remove(path);
+	bctbx_free(path);
+	bctbx_uninit_logger();
+}
+
+static long file_size(const char *path) {
+	FILE *f = fopen(path, "rb");
+	if (f == NULL) return -1;
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	fclose(f);
+	return size;
+}
+
+static void test_file_log_flush_policies(void) {
+	const char *domainName = "bctbx-flush-tester";
+	const char *fileName = "log_flush_policies.log";
+	char *path = bc_tester_file(fileName);
+	remove(path);
+	bctbx_init_logger(1);
+	bctbx_set_log_level(domainName, BCTBX_LOG_MESSAGE);
+	bctbx_log_handler_t *handler = bctbx_create_file_log_handler(0, bc_tester_get_writable_dir_prefix(), fileName);
+	if (!BC_ASSERT_PTR_NOT_NULL(handler)) {
+		bctbx_free(path);
+		return;
+	}
+	bctbx_log_handler_set_domain(handler, domainName);
+	bctbx_add_log_handler(handler);
+
+	bctbx_log(domainName, BCTBX_LOG_MESSAGE, "written right away");
+	long size = file_size(path);
+	BC_ASSERT_GREATER(size, 1, long, "%ld");
+
+	bctbx_file_log_handler_set_flush_policy(handler, BCTBX_LOG_FLUSH_SIZE, 64 * 1024);
+	for (int i = 0; i < 10; i++) {
+		bctbx_log(domainName, BCTBX_LOG_MESSAGE, "buffered %d", i);
+	}
+	BC_ASSERT_EQUAL(file_size(path), size, long, "%ld");
+	bctbx_file_log_handler_flush(handler);
+	BC_ASSERT_GREATER(file_size(path), size + 1, long, "%ld");
+	size = file_size(path);
+
+	bctbx_file_log_handler_set_flush_policy(handler, BCTBX_LOG_FLUSH_WARNING, 0);
+	bctbx_log(domainName, BCTBX_LOG_MESSAGE, "buffered until a warning");
+	BC_ASSERT_EQUAL(file_size(path), size, long, "%ld");
+	bctbx_log(domainName, BCTBX_LOG_WARNING, "a warning");
+	BC_ASSERT_GREATER(file_size(path), size + 1, long, "%ld");
+	size = file_size(path);
+
+	bctbx_file_log_handler_set_flush_policy(handler, BCTBX_LOG_FLUSH_INTERVAL, 20);
+	bctbx_log(domainName, BCTBX_LOG_MESSAGE, "written by the worker");
+	for (int i = 0; i < 100 && file_size(path) == size; i++) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	BC_ASSERT_GREATER(file_size(path), size + 1, long, "%ld");
+	size = file_size(path);
+
+	// an interval of 0 writes each message right away
+	bctbx_file_log_handler_set_flush_policy(handler, BCTBX_LOG_FLUSH_INTERVAL, 0);
+	bctbx_log(domainName, BCTBX_LOG_MESSAGE, "written right away again");
+	BC_ASSERT_GREATER(file_size(path), size + 1, long, "%ld");
+	bctbx_remove_log_handler(handler);
+	remove(path);
+
+	/* rotation, done by the worker while the messages are buffered */
+	handler = bctbx_create_file_log_handler(4096, bc_tester_get_writable_dir_prefix(), fileName);
+	if (BC_ASSERT_PTR_NOT_NULL(handler)) {
+		bctbx_log_handler_set_domain(handler, domainName);
+		bctbx_add_log_handler(handler);
+		for (int i = 0; i < 200; i++) {
+			bctbx_log(domainName, BCTBX_LOG_MESSAGE, "rotated message %d", i);
+		}
+		bctbx_remove_log_handler(handler);
+		char *rotated = bctbx_strdup_printf("%s_1", path);
+		BC_ASSERT_GREATER(file_size(rotated), 4096, long, "%ld");
+		bctbx_free(rotated);
+		for (int i = 1; i < 100; i++) {
+			rotated = bctbx_strdup_printf("%s_%d", path, i);
+			int ret = remove(rotated);
+			bctbx_free(rotated);
+			if (ret != 0) break;
+		}
+	}
+
+	remove(path);
+	bctbx_free(path);
+	bctbx_uninit_logger();
+}
+
+static void test_parallel_file_log_handlers(void) {
+	const char *domainNames[] = {"bctbx-parallel-tester-0", "bctbx-parallel-tester-1"};
+	const char *fileNames[] = {"log_parallel_0.log", "log_parallel_1.log"};
+	const int messageCount = 500;
+	bctbx_log_handler_t *handlers[2];
+	bctbx_init_logger(1);
+	for (int i = 0; i < 2; i++) {
+		char *path = bc_tester_file(fileNames[i]);
+		remove(path);
+		bctbx_free(path);
+		bctbx_set_log_level(domainNames[i], BCTBX_LOG_MESSAGE);
+		handlers[i] = bctbx_create_file_log_handler(0, bc_tester_get_writable_dir_prefix(), fileNames[i]);
+		if (!BC_ASSERT_PTR_NOT_NULL(handlers[i])) return;
+		bctbx_log_handler_set_domain(handlers[i], domainNames[i]);
+		bctbx_add_log_handler(handlers[i]);
+	}
+
+	/* two threads per file */
+	std::vector<std::thread> threads;
+	for (int t = 0; t < 4; t++) {
+		threads.emplace_back([t, &domainNames]() {
+			for (int i = 0; i < messageCount; i++) {
+				bctbx_log(domainNames[t % 2], BCTBX_LOG_MESSAGE, "thread %d message %d", t, i);
+			}
+		});
+	}
+	for (auto &thread : threads) {
+		thread.join();
+	}
+
+	for (int i = 0; i < 2; i++) {
+		bctbx_remove_log_handler(handlers[i]);
+		char *path = bc_tester_file(fileNames[i]);
+		FILE *f = fopen(path, "r");
+		int lines = 0, intact = 0;
+		if (BC_ASSERT_PTR_NOT_NULL(f)) {
+			char line[256];
+			while (fgets(line, sizeof(line), f)) {
+				lines++;
+				if (strstr(line, domainNames[i]) && strstr(line, " message ")) intact++;
+			}
+			fclose(f);
+		}
+		BC_ASSERT_EQUAL(lines, 2 * messageCount, int, "%d");
+		BC_ASSERT_EQUAL(intact, lines, int, "%d");
+		remove(path);
+		bctbx_free(path);
+	}
+	bctbx_uninit_logger();
+}
+
+static void test_log_rate_limit(void) {
+	const char *domainName = "bctbx-rate-tester";
+	bctbx_init_logger(1);
+	bctbx_set_log_level(domainName, BCTBX_LOG_MESSAGE);
+	AsyncLogCollector collector;
+	bctbx_log_handler_t *handler = bctbx_create_log_handler(async_collector_log, async_collector_destroy, &collector);
+	bctbx_log_handler_set_domain(handler, domainName);
+	bctbx_add_log_handler(handler);
+	bctbx_set_log_rate_limit(domainName, 10, 5);
+
+	// a storm from one call site is cut after the burst, other call sites are not affected
+	for (int i = 0; i < 100; i++) {
+		bctbx_log(domainName, BCTBX_LOG_ERROR, "storm %d", i);
+	}
+	bctbx_log(domainName, BCTBX_LOG_MESSAGE, "another call site");
+	size_t received = collector.mMessages.size();
+	BC_ASSERT_GREATER((int)received, 6, int, "%d");
+	BC_ASSERT_LOWER((int)received, 8, int, "%d");
+	BC_ASSERT_STRING_EQUAL(collector.mMessages.back().c_str(), "another call site");
+
+	// once tokens are back, the number of dropped messages is reported first
+	std::this_thread::sleep_for(std::chrono::milliseconds(200));
+	bctbx_log(domainName, BCTBX_LOG_ERROR, "storm %d", 100);
+	BC_ASSERT_EQUAL((int)collector.mMessages.size(), (int)received + 2, int, "%d");
+	if (collector.mMessages.size() == received + 2) {
+		int repeated = 0;
+		int fields = sscanf(collector.mMessages[received].c_str(), "last message repeated %d times", &repeated);
+		BC_ASSERT_EQUAL(fields, 1, int, "%d");
+		BC_ASSERT_EQUAL(repeated, 100 - ((int)received - 1), int, "%d");
+		BC_ASSERT_STRING_EQUAL(collector.mMessages[received + 1].c_str(), "storm 100");
+	}
+
+	// the end of a storm is reported with the next message of the domain, even from another call site
+	for (int i = 0; i < 50; i++) {
+		bctbx_log(domainName, BCTBX_LOG_ERROR, "storm %d", i);
+	}
+	std::this_thread::sleep_for(std::chrono::milliseconds(200));
+	received = collector.mMessages.size();
+	bctbx_log(domainName, BCTBX_LOG_MESSAGE, "another call site");
+	BC_ASSERT_EQUAL((int)collector.mMessages.size(), (int)received + 2, int, "%d");
+	if (collector.mMessages.size() == received + 2) {
+		int suppressed = 0;
+		int fields = sscanf(collector.mMessages[received].c_str(), "%d messages \"storm", &suppressed);
+		BC_ASSERT_EQUAL(fields, 1, int, "%d");
+		BC_ASSERT_GREATER(suppressed, 40, int, "%d");
+		BC_ASSERT_STRING_EQUAL(collector.mMessages[received + 1].c_str(), "another call site");
+	}
+
+	// removing the limit
+	bctbx_set_log_rate_limit(domainName, 0, 0);
+	received = collector.mMessages.size();
+	for (int i = 0; i < 20; i++) {
+		bctbx_log(domainName, BCTBX_LOG_ERROR, "storm %d", i);
+	}
+	BC_ASSERT_EQUAL((int)collector.mMessages.size(), (int)received + 20, int, "%d");
+
+	bctbx_remove_log_handler(handler);
+	bctbx_uninit_logger();
+}
+
+struct LoggedWhenPrinted {
+	const char *mDomain;
+};
+
+static std::ostream &operator<<(std::ostream &os, const LoggedWhenPrinted &value) {
+	BCTBX_SLOG(value.mDomain, BCTBX_LOG_MESSAGE) << "nested " << 1;
+	return os << "printed";
+}
+
+static void test_log_streams(void) {
+	const char *domainName = "bctbx-stream-tester";
+	bctbx_init_logger(1);
+	bctbx_set_log_level(domainName, BCTBX_LOG_MESSAGE);
+	AsyncLogCollector collector;
+	bctbx_log_handler_t *handler = bctbx_create_log_handler(async_collector_log, async_collector_destroy, &collector);
+	bctbx_log_handler_set_domain(handler, domainName);
+	bctbx_add_log_handler(handler);
+
+	std::string text = "string";
+	char buffer[] = "buffer";
+	BCTBX_SLOG(domainName, BCTBX_LOG_MESSAGE) << "literal " << text << ' ' << buffer << " " << -42 << " " << 42u << " "
+	                                          << std::numeric_limits<long long>::min() << " " << (size_t)7 << " "
+	                                          << true << " " << 1.5;
+	BCTBX_SLOG(domainName, BCTBX_LOG_MESSAGE) << std::hex << 255 << " " << std::setw(4) << std::setfill('0') << 7
+	                                          << " " << std::showpos << std::dec << 3;
+	// the manipulators of a statement do not leak into the next one
+	BCTBX_SLOG(domainName, BCTBX_LOG_MESSAGE) << 255 << " " << std::string(300, 'z').size();
+	BCTBX_SLOG(domainName, BCTBX_LOG_MESSAGE) << "outer " << LoggedWhenPrinted{domainName} << " end";
+	BCTBX_SLOG(domainName, BCTBX_LOG_DEBUG) << "not logged";
+
+	BC_ASSERT_EQUAL((int)collector.mMessages.size(), 5, int, "%d");
+	if (collector.mMessages.size() == 5) {
+		BC_ASSERT_STRING_EQUAL(collector.mMessages[0].c_str(),
+		                       "literal string buffer -42 42 -9223372036854775808 7 1 1.5");
+		BC_ASSERT_STRING_EQUAL(collector.mMessages[1].c_str(), "ff 0007 +3");
+		BC_ASSERT_STRING_EQUAL(collector.mMessages[2].c_str(), "255 300");
+		BC_ASSERT_STRING_EQUAL(collector.mMessages[3].c_str(), "nested 1");
+		BC_ASSERT_STRING_EQUAL(collector.mMessages[4].c_str(), "outer printed end");
+	}
+
+	bctbx_remove_log_handler(handler);
+	bctbx_uninit_logger();
+}
+
+static void test_thread_log_levels(void) {
+#if !defined(_WIN32) && !defined(__ANDROID__)
+	const char *domainName = "bctbx-thread-level-tester";
+	bctbx_set_log_level(domainName, BCTBX_LOG_WARNING);
+	bctbx_log_domain_handle_t handle = bctbx_get_log_domain_handle(domainName);
+
+	bctbx_set_thread_log_level(domainName, BCTBX_LOG_DEBUG);
+	BC_ASSERT_TRUE(bctbx_log_level_enabled(domainName, BCTBX_LOG_DEBUG));
+	BC_ASSERT_TRUE(bctbx_log_handle_level_enabled(handle, BCTBX_LOG_DEBUG));
+
+	// the level of this thread does not apply to the others
+	bool otherEnabled = true;
+	std::thread other([&otherEnabled, domainName]() {
+		otherEnabled = bctbx_log_level_enabled(domainName, BCTBX_LOG_DEBUG) != 0;
+	});
+	other.join();
+	BC_ASSERT_FALSE(otherEnabled);
+
+	// a domain created after the thread level was set
+	const char *laterDomainName = "bctbx-thread-level-tester-later";
+	bctbx_set_log_level(laterDomainName, BCTBX_LOG_ERROR);
+	BC_ASSERT_FALSE(bctbx_log_level_enabled(laterDomainName, BCTBX_LOG_WARNING));
+	bctbx_set_thread_log_level(laterDomainName, BCTBX_LOG_WARNING);
+	BC_ASSERT_TRUE(bctbx_log_level_enabled(laterDomainName, BCTBX_LOG_WARNING));
+	BC_ASSERT_FALSE(bctbx_log_level_enabled(laterDomainName, BCTBX_LOG_MESSAGE));
+
+	bctbx_clear_thread_log_level(domainName);
+	BC_ASSERT_FALSE(bctbx_log_level_enabled(domainName, BCTBX_LOG_DEBUG));
+	BC_ASSERT_TRUE(bctbx_log_level_enabled(laterDomainName, BCTBX_LOG_WARNING));
+	bctbx_clear_thread_log_level(laterDomainName);
+	BC_ASSERT_FALSE(bctbx_log_level_enabled(laterDomainName, BCTBX_LOG_WARNING));
+	// clearing twice is harmless
+	bctbx_clear_thread_log_level(laterDomainName);
+	BC_ASSERT_TRUE(bctbx_log_level_enabled(laterDomainName, BCTBX_LOG_ERROR));
+#endif
+}
+
+static void test_structured_logging(void) {
+	const char *domainName = "bctbx-fields-tester";
+	const char *fileName = "structured_logging.json";
+	char *path = bc_tester_file(fileName);
+	remove(path);
+	bctbx_init_logger(1);
+	bctbx_set_log_level(domainName, BCTBX_LOG_MESSAGE);
+	bctbx_log_handler_t *jsonHandler = bctbx_create_json_log_handler(bc_tester_get_writable_dir_prefix(), fileName);
+	if (!BC_ASSERT_PTR_NOT_NULL(jsonHandler)) {
+		bctbx_free(path);
+		return;
+	}
+	bctbx_log_handler_set_domain(jsonHandler, domainName);
+	bctbx_add_log_handler(jsonHandler);
+	// a handler without fields function receives the structured messages as text
+	AsyncLogCollector collector;
+	bctbx_log_handler_t *handler = bctbx_create_log_handler(async_collector_log, async_collector_destroy, &collector);
+	bctbx_log_handler_set_domain(handler, domainName);
+	bctbx_add_log_handler(handler);
+
+	bctbx_push_log_tag("call", "1234");
+	bctbx_log_field_t fields[] = {bctbx_log_field_string("call-id", "a b"), bctbx_log_field_int("errors", -5),
+	                              bctbx_log_field_uint("packets", 7), bctbx_log_field_double("duration", 1.5),
+	                              bctbx_log_field_bool("ok", TRUE)};
+	bctbx_log_fields(domainName, BCTBX_LOG_MESSAGE, "Call ended", fields, sizeof(fields) / sizeof(fields[0]));
+	bctoolbox::LogFields(domainName, BCTBX_LOG_WARNING).add("count", 3).add("name", std::string("x\"y")).log("built");
+	bctoolbox::LogFields(domainName, BCTBX_LOG_DEBUG).add("count", 4).log("not logged");
+	bctbx_log(domainName, BCTBX_LOG_ERROR, "plain %d", 1);
+
+	// the fields and the tags are queued with the message by the asynchronous logging
+	BC_ASSERT_EQUAL(bctbx_enable_async_logging(0, BCTBX_LOG_OVERFLOW_BLOCK), 0, int, "%d");
+	bctbx_log_field_t queuedFields[] = {bctbx_log_field_int("id", 42), bctbx_log_field_string("peer", "sip:b")};
+	bctbx_log_fields(domainName, BCTBX_LOG_MESSAGE, "queued", queuedFields, 2);
+	bctbx_flush_async_logging();
+	bctbx_disable_async_logging();
+	bctbx_pop_log_tag("call");
+
+	bctbx_remove_log_handler(handler);
+	bctbx_remove_log_handler(jsonHandler);
+
+	BC_ASSERT_EQUAL((int)collector.mMessages.size(), 4, int, "%d");
+	if (collector.mMessages.size() == 4) {
+		BC_ASSERT_STRING_EQUAL(collector.mMessages[0].c_str(),
+		                       "Call ended call-id=\"a b\" errors=-5 packets=7 duration=1.5 ok=true");
+		BC_ASSERT_STRING_EQUAL(collector.mMessages[1].c_str(), "built count=3 name=\"x\\\"y\"");
+		BC_ASSERT_STRING_EQUAL(collector.mMessages[2].c_str(), "plain 1");
+		BC_ASSERT_STRING_EQUAL(collector.mMessages[3].c_str(), "queued id=42 peer=sip:b");
+	}
+
+	const char *expected[] = {
+	    "\"domain\":\"bctbx-fields-tester\",\"level\":\"message\",\"tags\":{\"call\":\"1234\"},\"message\":\"Call "
+	    "ended\",\"fields\":{\"call-id\":\"a b\",\"errors\":-5,\"packets\":7,\"duration\":1.5,\"ok\":true}}\n",
+	    "\"domain\":\"bctbx-fields-tester\",\"level\":\"warning\",\"tags\":{\"call\":\"1234\"},\"message\":\"built\","
+	    "\"fields\":{\"count\":3,\"name\":\"x\\\"y\"}}\n",
+	    "\"domain\":\"bctbx-fields-tester\",\"level\":\"error\",\"tags\":{\"call\":\"1234\"},\"message\":\"plain 1\"}\n",
+	    "\"domain\":\"bctbx-fields-tester\",\"level\":\"message\",\"tags\":{\"call\":\"1234\"},\"message\":\"queued\","
+	    "\"fields\":{\"id\":42,\"peer\":\"sip:b\"}}\n"};
+	FILE *f = fopen(path, "r");
+	BC_ASSERT_PTR_NOT_NULL(f);
+	if (f) {
+		std::vector<char> line(1024);
+		for (const char *expectedLine : expected) {
+			if (!BC_ASSERT_PTR_NOT_NULL(fgets(line.data(), (int)line.size(), f))) break;
+			std::string rendered(line.data());
+			// {"time":"YYYY-MM-DDTHH:MM:SS.mmmZ",
+			BC_ASSERT_TRUE(rendered.compare(0, 9, "{\"time\":\"") == 0);
+			BC_ASSERT_TRUE(rendered.size() > 35 && rendered[32] == 'Z' && rendered[19] == 'T');
+			BC_ASSERT_STRING_EQUAL(rendered.size() > 35 ? rendered.c_str() + 35 : "", expectedLine);
+		}
+		BC_ASSERT_PTR_NULL(fgets(line.data(), (int)line.size(), f));
+		fclose(f);
+	}
+
+	// messages built at runtime are rate limited according to their text, not to their address
+	AsyncLogCollector limited;
+	handler = bctbx_create_log_handler(async_collector_log, async_collector_destroy, &limited);
+	bctbx_log_handler_set_domain(handler, domainName);
+	bctbx_add_log_handler(handler);
+	bctbx_set_log_rate_limit(domainName, 1, 2);
+	for (int i = 0; i < 6; i++) {
+		std::string msg = std::string("runtime ") + ((i % 2) ? "a" : "b");
+		bctoolbox::LogFields(domainName, BCTBX_LOG_MESSAGE).add("i", i).log(msg);
+	}
+	BC_ASSERT_EQUAL((int)limited.mMessages.size(), 4, int, "%d");
+	bctbx_set_log_rate_limit(domainName, 0, 0);
+
+	// the decimal point of the doubles does not depend on the locale
+	std::string previousLocale = setlocale(LC_NUMERIC, nullptr);
+	if (setlocale(LC_NUMERIC, "de_DE.UTF-8") || setlocale(LC_NUMERIC, "fr_FR.UTF-8")) {
+		bctbx_log_field_t decimal[] = {bctbx_log_field_double("duration", 1.5)};
+		bctbx_log_fields(domainName, BCTBX_LOG_MESSAGE, "decimal", decimal, 1);
+		setlocale(LC_NUMERIC, previousLocale.c_str());
+		BC_ASSERT_STRING_EQUAL(limited.mMessages.back().c_str(), "decimal duration=1.5");
+	}
+	bctbx_remove_log_handler(handler);
+
+	remove(path);
+	bctbx_free(path);
+	bctbx_uninit_logger();
+}
+
+// the statements below are compiled as in a component whose floor is the warning level
+#undef BCTBX_LOG_DOMAIN_MIN_LEVEL
+#define BCTBX_LOG_DOMAIN_MIN_LEVEL BCTBX_LOG_WARNING
+
+static void test_log_level_floor(void) {
+	const char *domainName = "bctbx-floor-tester";
+	bctbx_init_logger(1);
+	bctbx_set_log_level(domainName, BCTBX_LOG_DEBUG);
+	AsyncLogCollector collector;
+	bctbx_log_handler_t *handler = bctbx_create_log_handler(async_collector_log, async_collector_destroy, &collector);
+	bctbx_log_handler_set_domain(handler, domainName);
+	bctbx_add_log_handler(handler);
+	bctbx_log_domain_handle_t handle = bctbx_get_log_domain_handle(domainName);
+
+	int evaluated = 0;
+	auto evaluate = [&evaluated]() { return ++evaluated; };
+	bctbx_log(domainName, BCTBX_LOG_MESSAGE, "compiled out %d", evaluate());
+	bctbx_message("compiled out %d", evaluate());
+	BCTBX_LOG_HANDLE(handle, BCTBX_LOG_DEBUG, "compiled out %d", evaluate());
+	BCTBX_SLOG(domainName, BCTBX_LOG_MESSAGE) << "compiled out " << evaluate();
+	BC_ASSERT_EQUAL(evaluated, 0, int, "%d");
+
+	bctbx_log(domainName, BCTBX_LOG_WARNING, "compiled %d", evaluate());
+	BCTBX_LOG_HANDLE(handle, BCTBX_LOG_ERROR, "compiled %d", evaluate());
+	BCTBX_SLOG(domainName, BCTBX_LOG_WARNING) << "compiled " << evaluate();
+	BC_ASSERT_EQUAL(evaluated, 3, int, "%d");
+	BC_ASSERT_EQUAL((int)collector.mMessages.size(), 3, int, "%d");
+	if (collector.mMessages.size() == 3) {
+		BC_ASSERT_STRING_EQUAL(collector.mMessages[0].c_str(), "compiled 1");
+		BC_ASSERT_STRING_EQUAL(collector.mMessages[1].c_str(), "compiled 2");
+		BC_ASSERT_STRING_EQUAL(collector.mMessages[2].c_str(), "compiled 3");
+	}
+
+	bctbx_remove_log_handler(handler);
+	bctbx_uninit_logger();
+}
+
+#undef BCTBX_LOG_DOMAIN_MIN_LEVEL
+#define BCTBX_LOG_DOMAIN_MIN_LEVEL BCTBX_LOG_DEBUG
+
+static test_t logger_tests[] = {TEST_NO_TAG("Log tags", test_tags), TEST_NO_TAG("C++ log tags", test_cpp_tags),
+                                TEST_NO_TAG("Log tags copy", test_tags_copy),
+                                TEST_NO_TAG("Asynchronous logging", test_async_logging),
+                                TEST_NO_TAG("Log domain handles", test_log_domain_handles),
+                                TEST_NO_TAG("Log handler routing", test_handler_routing),
+                                TEST_NO_TAG("Binary log handler", test_binary_log_handler),
+                                TEST_NO_TAG("Log line rendering", test_log_line_rendering),
+                                TEST_NO_TAG("File log flush policies", test_file_log_flush_policies),
+                                TEST_NO_TAG("Parallel file log handlers", test_parallel_file_log_handlers),
+                                TEST_NO_TAG("Log rate limit", test_log_rate_limit),
+                                TEST_NO_TAG("C++ log streams", test_log_streams),
+                                TEST_NO_TAG("Thread log levels", test_thread_log_levels),
+                                TEST_NO_TAG("Structured logging", test_structured_logging),
+                                TEST_NO_TAG("Compile-time log level floor", test_log_level_floor)};
 
 test_suite_t logger_test_suite = {"Logging",    NULL, NULL, NULL, NULL, sizeof(logger_tests) / sizeof(logger_tests[0]),
                                   logger_tests, 0};
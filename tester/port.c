@@ -255,9 +255,206 @@ static void bctbx_directory_utils_test(void) {
 	bctbx_free(filename3);
 }
 
+static int count_scanned_files(void *user_data, const bctbx_dir_entry_t *entry) {
+	int *count = (int *)user_data;
+	if (entry->type == BCTBX_DIR_ENTRY_FILE) (*count)++;
+	return (*count == 10) ? 42 : 0; // stop after 10 files
+}
+
+static void bctbx_directory_scan_test(void) {
+	char *tmpDirPath = bctbx_strdup_printf("%s/tmp_scan_dir", bc_tester_get_writable_dir_prefix());
+	bctbx_rmdir(tmpDirPath, TRUE); // left over by a failed run
+	BC_ASSERT_EQUAL(bctbx_mkdir(tmpDirPath), 0, int, "%d");
+
+	// 300 files (more than a batch of entries in small buffers), a third of them with a suffix, and a subdirectory
+	bctbx_vfs_t *stdVfs = bctbx_vfs_get_standard();
+	int i;
+	for (i = 0; i < 300; i++) {
+		char *filename = bctbx_strdup_printf("%s/file_with_a_long_name_%d%s", tmpDirPath, i, (i < 100) ? ".wav" : "");
+		bctbx_vfs_file_t *fp = bctbx_file_open(stdVfs, filename, "w");
+		bctbx_file_close(fp);
+		bctbx_free(filename);
+	}
+	char *subDirPath = bctbx_strdup_printf("%s/sub.wav", tmpDirPath);
+	BC_ASSERT_EQUAL(bctbx_mkdir(subDirPath), 0, int, "%d");
+
+	// list everything
+	bctbx_dir_list_t *list = bctbx_dir_list(tmpDirPath, NULL);
+	BC_ASSERT_PTR_NOT_NULL(list);
+	if (list) {
+		BC_ASSERT_EQUAL((int)list->count, 301, int, "%d");
+		int files = 0, directories = 0;
+		size_t j;
+		for (j = 0; j < list->count; j++) {
+			if (list->entries[j].type == BCTBX_DIR_ENTRY_FILE) files++;
+			if (list->entries[j].type == BCTBX_DIR_ENTRY_DIRECTORY) {
+				directories++;
+				BC_ASSERT_STRING_EQUAL(list->entries[j].name, "sub.wav");
+			}
+			BC_ASSERT_EQUAL((int)list->entries[j].name_length, (int)strlen(list->entries[j].name), int, "%d");
+		}
+		BC_ASSERT_EQUAL(files, 300, int, "%d");
+		BC_ASSERT_EQUAL(directories, 1, int, "%d");
+		bctbx_dir_list_free(list);
+	}
+
+	// filter on suffix
+	list = bctbx_dir_list(tmpDirPath, ".wav");
+	BC_ASSERT_PTR_NOT_NULL(list);
+	if (list) {
+		BC_ASSERT_EQUAL((int)list->count, 101, int, "%d");
+		bctbx_dir_list_free(list);
+	}
+	bctbx_list_t *fileList = bctbx_parse_directory(tmpDirPath, ".wav");
+	BC_ASSERT_EQUAL((int)bctbx_list_size(fileList), 101, int, "%d");
+	BC_ASSERT_TRUE(strncmp((const char *)fileList->data, tmpDirPath, strlen(tmpDirPath)) == 0);
+	bctbx_list_free_with_data(fileList, bctbx_free);
+
+	// the callback stops the scan
+	int count = 0;
+	BC_ASSERT_EQUAL(bctbx_dir_scan(tmpDirPath, NULL, count_scanned_files, &count), 42, int, "%d");
+	BC_ASSERT_EQUAL(count, 10, int, "%d");
+
+	// missing directory
+	BC_ASSERT_PTR_NULL(bctbx_dir_list("/this/does/not/exist", NULL));
+	BC_ASSERT_TRUE(bctbx_dir_scan("/this/does/not/exist", NULL, count_scanned_files, &count) < 0);
+
+	// cleaning
+	BC_ASSERT_EQUAL(bctbx_rmdir(tmpDirPath, TRUE), 0, int, "%d");
+	bctbx_free(subDirPath);
+	bctbx_free(tmpDirPath);
+}
+
+typedef struct tree_walk_counts_t {
+	int files;
+	int pre;
+	int post;
+	int maxDepth;
+	bool_t skip;
+	size_t maxOpenFds; /* counted at each directory when not 0 */
+} tree_walk_counts_t;
+
+static size_t count_open_fds(void) {
+#ifdef __linux__
+	bctbx_dir_list_t *list = bctbx_dir_list("/proc/self/fd", NULL);
+	size_t count = list ? list->count : 0;
+	bctbx_dir_list_free(list);
+	return count;
+#else
+	return 0;
+#endif
+}
+
+static int count_walked_entries(void *user_data, const bctbx_tree_walk_entry_t *entry) {
+	tree_walk_counts_t *counts = (tree_walk_counts_t *)user_data;
+	if (entry->depth > counts->maxDepth) counts->maxDepth = entry->depth;
+	switch (entry->event) {
+		case BCTBX_TREE_WALK_ENTRY:
+			counts->files++;
+			break;
+		case BCTBX_TREE_WALK_DIRECTORY_PRE:
+			counts->pre++;
+			if (counts->maxOpenFds > 0) {
+				size_t openFds = count_open_fds();
+				if (openFds > counts->maxOpenFds) counts->maxOpenFds = openFds;
+			}
+			if (counts->skip && entry->depth == 1 && strcmp(entry->name, "d1") == 0) return BCTBX_TREE_WALK_SKIP_SUBTREE;
+			break;
+		case BCTBX_TREE_WALK_DIRECTORY_POST:
+			counts->post++;
+			break;
+	}
+	return 0;
+}
+
+/* build 3 levels of 4 directories each holding 20 files */
+static void create_test_tree(const char *path, int level) {
+	bctbx_vfs_t *stdVfs = bctbx_vfs_get_standard();
+	BC_ASSERT_EQUAL(bctbx_mkdir(path), 0, int, "%d");
+	int i;
+	for (i = 0; i < 20; i++) {
+		char *filename = bctbx_strdup_printf("%s/f%d", path, i);
+		bctbx_vfs_file_t *fp = bctbx_file_open(stdVfs, filename, "w");
+		bctbx_file_close(fp);
+		bctbx_free(filename);
+	}
+	if (level == 3) return;
+	for (i = 0; i < 4; i++) {
+		char *subDirPath = bctbx_strdup_printf("%s/d%d", path, i);
+		create_test_tree(subDirPath, level + 1);
+		bctbx_free(subDirPath);
+	}
+}
+
+static void bctbx_tree_walk_test(void) {
+	char *tmpDirPath = bctbx_strdup_printf("%s/tmp_walk_dir", bc_tester_get_writable_dir_prefix());
+	bctbx_rmdir(tmpDirPath, TRUE); // left over by a failed run
+
+	// 1 + 4 + 16 + 64 directories, 20 files in each
+	create_test_tree(tmpDirPath, 0);
+	tree_walk_counts_t counts;
+	memset(&counts, 0, sizeof(counts));
+	BC_ASSERT_EQUAL(bctbx_tree_walk(tmpDirPath, count_walked_entries, &counts), 0, int, "%d");
+	BC_ASSERT_EQUAL(counts.files, 85 * 20, int, "%d");
+	BC_ASSERT_EQUAL(counts.pre, 85, int, "%d");
+	BC_ASSERT_EQUAL(counts.post, 85, int, "%d");
+	BC_ASSERT_EQUAL(counts.maxDepth, 4, int, "%d");
+
+	// skip the content of the first level d1: 21 directories (d1 is still reported before its content)
+	memset(&counts, 0, sizeof(counts));
+	counts.skip = TRUE;
+	BC_ASSERT_EQUAL(bctbx_tree_walk(tmpDirPath, count_walked_entries, &counts), 0, int, "%d");
+	BC_ASSERT_EQUAL(counts.files, (85 - 21) * 20, int, "%d");
+	BC_ASSERT_EQUAL(counts.pre, 85 - 20, int, "%d");
+	BC_ASSERT_EQUAL(counts.post, 85 - 21, int, "%d");
+
+	// missing root
+	BC_ASSERT_TRUE(bctbx_tree_walk("/this/does/not/exist", count_walked_entries, &counts) < 0);
+
+	// parallel delete
+	BC_ASSERT_EQUAL(bctbx_rmdir_parallel(tmpDirPath, 4), 0, int, "%d");
+	BC_ASSERT_FALSE(bctbx_directory_exists(tmpDirPath));
+	BC_ASSERT_NOT_EQUAL(bctbx_rmdir_parallel(tmpDirPath, 4), 0, int, "%d");
+
+	// sequential delete
+	create_test_tree(tmpDirPath, 0);
+	BC_ASSERT_EQUAL(bctbx_rmdir(tmpDirPath, TRUE), 0, int, "%d");
+	BC_ASSERT_FALSE(bctbx_directory_exists(tmpDirPath));
+
+	// a tree deeper than the directories kept open during a walk: 41 nested directories holding 2 files each
+	char *deepPath = bctbx_strdup(tmpDirPath);
+	int level;
+	for (level = 0; level <= 40; level++) {
+		BC_ASSERT_EQUAL(bctbx_mkdir(deepPath), 0, int, "%d");
+		for (int i = 0; i < 2; i++) {
+			char *filename = bctbx_strdup_printf("%s/f%d", deepPath, i);
+			bctbx_vfs_file_t *fp = bctbx_file_open(bctbx_vfs_get_standard(), filename, "w");
+			bctbx_file_close(fp);
+			bctbx_free(filename);
+		}
+		char *subDirPath = bctbx_strdup_printf("%s/d", deepPath);
+		bctbx_free(deepPath);
+		deepPath = subDirPath;
+	}
+	bctbx_free(deepPath);
+	memset(&counts, 0, sizeof(counts));
+	size_t openFds = count_open_fds();
+	counts.maxOpenFds = openFds;
+	BC_ASSERT_EQUAL(bctbx_tree_walk(tmpDirPath, count_walked_entries, &counts), 0, int, "%d");
+	BC_ASSERT_TRUE(counts.maxOpenFds <= openFds + 20); // 16 open levels, the deepest ones and the one counting
+	BC_ASSERT_EQUAL(counts.files, 41 * 2, int, "%d");
+	BC_ASSERT_EQUAL(counts.pre, 41, int, "%d");
+	BC_ASSERT_EQUAL(counts.post, 41, int, "%d");
+	BC_ASSERT_EQUAL(counts.maxDepth, 41, int, "%d");
+	BC_ASSERT_EQUAL(bctbx_rmdir(tmpDirPath, TRUE), 0, int, "%d");
+	BC_ASSERT_FALSE(bctbx_directory_exists(tmpDirPath));
+	bctbx_free(tmpDirPath);
+}
+
 static test_t utils_tests[] = {
     TEST_NO_TAG("Bytes to/from Hexa strings", bytes_to_from_hexa_strings), TEST_NO_TAG("Time", time_functions),
-    TEST_NO_TAG("Addrinfo sort", bctbx_addrinfo_sort_test), TEST_NO_TAG("Directory utils", bctbx_directory_utils_test)};
+    TEST_NO_TAG("Addrinfo sort", bctbx_addrinfo_sort_test), TEST_NO_TAG("Directory utils", bctbx_directory_utils_test),
+    TEST_NO_TAG("Directory scan", bctbx_directory_scan_test), TEST_NO_TAG("Tree walk", bctbx_tree_walk_test)};
 
 test_suite_t utils_test_suite = {"Utils",     NULL, NULL, NULL, NULL, sizeof(utils_tests) / sizeof(utils_tests[0]),
                                  utils_tests, 0};
@@ -19,6 +19,9 @@
 
 #include "bctoolbox/vfs.h"
 #include "bctoolbox/logging.h"
+#include "bctoolbox/vfs_cache.h"
+#include "bctoolbox/vfs_emulation.h"
+#include "bctoolbox/vfs_stats.h"
 #include "bctoolbox/vfs_standard.h"
 #include "bctoolbox_tester.h"
 
@@ -172,6 +175,54 @@ void file_fprint_and_write_test() {
 	bctbx_free(path);
 }
 
+void file_fprint_page_size_test() {
+	char out_buf[F_SIZE];
+	char expected[F_SIZE];
+	size_t expectedSize = 0;
+	int i;
+	memset(out_buf, 0, F_SIZE);
+
+	/* create a file */
+	char *path = bc_tester_file("vfs_fprintf_page_size.txt");
+	remove(path);                                                                    // make sure it does not exist
+	bctbx_vfs_file_t *fp = bctbx_file_open2(&bcStandardVfs, path, O_RDWR | O_CREAT); // open using standard vfs
+	BC_ASSERT_PTR_NOT_NULL(fp);
+
+	/* a tiny page: the first print fits, the second one spills along with the cached data */
+	BC_ASSERT_EQUAL(bctbx_file_set_printf_page_size(fp, 16), BCTBX_VFS_OK, int, "%d");
+	BC_ASSERT_TRUE(bctbx_file_fprintf(fp, 0, "%d-%s", 42, "a") - 4 == 0);
+	expectedSize += sprintf(expected + expectedSize, "%d-%s", 42, "a");
+	bctbx_vfs_file_t *stdFp = bctbx_file_open2(&bcStandardVfs, path, O_RDONLY);
+	BC_ASSERT_EQUAL((int)bctbx_file_size(stdFp), 0, int, "%d"); // still in the page
+	BC_ASSERT_TRUE(bctbx_file_fprintf(fp, 0, "%s", patterns[0]) - strlen(patterns[0]) == 0);
+	expectedSize += sprintf(expected + expectedSize, "%s", patterns[0]);
+	BC_ASSERT_EQUAL((int)bctbx_file_size(stdFp), (int)expectedSize, int, "%d"); // spilled
+	bctbx_file_close(stdFp);
+
+	/* many small prints across page boundaries */
+	for (i = 0; i < 100; i++) {
+		BC_ASSERT_TRUE(bctbx_file_fprintf(fp, 0, "%d;", i) > 0);
+		expectedSize += sprintf(expected + expectedSize, "%d;", i);
+	}
+
+	/* a page larger than the default one, changing the size flushes the current page */
+	BC_ASSERT_EQUAL(bctbx_file_set_printf_page_size(fp, 2 * BCTBX_VFS_PRINTF_PAGE_SIZE), BCTBX_VFS_OK, int, "%d");
+	BC_ASSERT_TRUE(bctbx_file_fprintf(fp, 0, "%s", patterns[1]) - strlen(patterns[1]) == 0);
+	expectedSize += sprintf(expected + expectedSize, "%s", patterns[1]);
+	BC_ASSERT_EQUAL(bctbx_file_set_printf_page_size(fp, 0), BCTBX_VFS_OK, int, "%d"); // back to default
+	BC_ASSERT_TRUE(bctbx_file_fprintf(fp, 0, "%s", patterns[0]) - strlen(patterns[0]) == 0);
+	expectedSize += sprintf(expected + expectedSize, "%s", patterns[0]);
+
+	ssize_t readSize = bctbx_file_read(fp, out_buf, F_SIZE, 0);
+	BC_ASSERT_EQUAL((int)readSize, (int)expectedSize, int, "%d");
+	BC_ASSERT_TRUE(memcmp(expected, out_buf, expectedSize) == 0);
+
+	/* cleaning */
+	BC_ASSERT_NOT_EQUAL(bctbx_file_close(fp), BCTBX_VFS_ERROR, int, "%d");
+	remove(path);
+	bctbx_free(path);
+}
+
 void file_get_nxtline_test() {
 	// char in_buf[F_SIZE];
 	char out_buf[2 * G_SIZE];
@@ -284,9 +335,598 @@ void file_get_nxtline_test() {
 	bctbx_free(path);
 }
 
+void file_line_iterator_test() {
+	const char *line = NULL;
+	size_t length = 0;
+	int i, count = 0;
+
+	/* create a file */
+	char *path = bc_tester_file("vfs_line_iterator.txt");
+	remove(path);                                                                    // make sure it does not exist
+	bctbx_vfs_file_t *fp = bctbx_file_open2(&bcStandardVfs, path, O_RDWR | O_CREAT); // open using standard vfs
+	BC_ASSERT_PTR_NOT_NULL(fp);
+
+	/* alternate line endings, an empty line, a line longer than the getline page and no terminator at the end */
+	bctbx_file_fprintf(fp, 0, "%s\n%s\r%s\r\n\n", patterns[0], patterns[1], patterns[0]);
+	size_t written = 0;
+	while (written < BCTBX_VFS_GETLINE_PAGE_SIZE + 1000) {
+		bctbx_file_fprintf(fp, 0, "%s", patterns[1]);
+		count++;
+		written += strlen(patterns[1]);
+	}
+	bctbx_file_fprintf(fp, 0, "\r\n%s", patterns[0]);
+
+	/* parse it with small reads so the \r\n and the lines cross the read boundaries */
+	bctbx_file_seek(fp, 0, SEEK_SET);
+	bctbx_vfs_line_iterator_t *it = bctbx_file_line_iterator_new(fp, 7);
+	BC_ASSERT_PTR_NOT_NULL(it);
+	BC_ASSERT_EQUAL(bctbx_file_line_iterator_next(it, &line, &length), 1, int, "%d");
+	BC_ASSERT_EQUAL((int)length, (int)strlen(patterns[0]), int, "%d");
+	BC_ASSERT_STRING_EQUAL(line, patterns[0]);
+	BC_ASSERT_EQUAL(bctbx_file_line_iterator_next(it, &line, &length), 1, int, "%d");
+	BC_ASSERT_STRING_EQUAL(line, patterns[1]);
+	BC_ASSERT_EQUAL(bctbx_file_line_iterator_next(it, &line, &length), 1, int, "%d");
+	BC_ASSERT_STRING_EQUAL(line, patterns[0]);
+	BC_ASSERT_EQUAL(bctbx_file_line_iterator_next(it, &line, &length), 1, int, "%d");
+	BC_ASSERT_EQUAL((int)length, 0, int, "%d");
+	BC_ASSERT_EQUAL(bctbx_file_line_iterator_next(it, &line, &length), 1, int, "%d");
+	BC_ASSERT_EQUAL((int)length, (int)written, int, "%d");
+	for (i = 0; i < count; i++) {
+		BC_ASSERT_TRUE(memcmp(line + i * strlen(patterns[1]), patterns[1], strlen(patterns[1])) == 0);
+	}
+	/* the file offset follows the iterator */
+	BC_ASSERT_EQUAL((int)fp->offset, (int)(bctbx_file_size(fp) - strlen(patterns[0])), int, "%d");
+	BC_ASSERT_EQUAL(bctbx_file_line_iterator_next(it, &line, &length), 1, int, "%d");
+	BC_ASSERT_STRING_EQUAL(line, patterns[0]);
+	BC_ASSERT_EQUAL(bctbx_file_line_iterator_next(it, &line, &length), 0, int, "%d");
+	bctbx_file_line_iterator_destroy(it);
+
+	/* default read size */
+	bctbx_file_seek(fp, 0, SEEK_SET);
+	it = bctbx_file_line_iterator_new(fp, 0);
+	count = 0;
+	while (bctbx_file_line_iterator_next(it, &line, NULL) == 1) {
+		count++;
+	}
+	BC_ASSERT_EQUAL(count, 6, int, "%d");
+	bctbx_file_line_iterator_destroy(it);
+
+	/* cleaning */
+	bctbx_file_close(fp);
+	remove(path);
+	bctbx_free(path);
+}
+
+void file_allocate_test() {
+	/* create a file */
+	char *path = bc_tester_file("vfs_allocate.bin");
+	remove(path);                                                                    // make sure it does not exist
+	bctbx_vfs_file_t *fp = bctbx_file_open2(&bcStandardVfs, path, O_RDWR | O_CREAT); // open using standard vfs
+	BC_ASSERT_PTR_NOT_NULL(fp);
+
+	/* preallocation does not change the file size */
+	BC_ASSERT_EQUAL(bctbx_file_allocate(fp, 0, 1024 * 1024), BCTBX_VFS_OK, int, "%d");
+	BC_ASSERT_EQUAL((int)bctbx_file_size(fp), 0, int, "%d");
+	BC_ASSERT_EQUAL(bctbx_file_allocate(fp, 0, 0), BCTBX_VFS_ERROR, int, "%d");
+
+	BC_ASSERT_EQUAL(bctbx_file_advise(fp, 0, 0, BCTBX_VFS_ADVICE_SEQUENTIAL), BCTBX_VFS_OK, int, "%d");
+	BC_ASSERT_EQUAL(bctbx_file_advise(fp, 0, 4096, BCTBX_VFS_ADVICE_DONTNEED), BCTBX_VFS_OK, int, "%d");
+	BC_ASSERT_EQUAL((int)bctbx_file_write(fp, patterns[0], strlen(patterns[0]), 10), (int)strlen(patterns[0]), int,
+	                "%d");
+	BC_ASSERT_EQUAL((int)bctbx_file_size(fp), (int)(10 + strlen(patterns[0])), int, "%d");
+
+	/* cleaning */
+	BC_ASSERT_NOT_EQUAL(bctbx_file_close(fp), BCTBX_VFS_ERROR, int, "%d");
+	remove(path);
+	bctbx_free(path);
+}
+
+#define SYNC_FILES_NB 6
+
+static void *sync_thread(void *arg) {
+	bctbx_vfs_file_t *fp = (bctbx_vfs_file_t *)arg;
+	int i;
+	intptr_t failures = 0;
+	for (i = 0; i < 10; i++) {
+		bctbx_file_write(fp, patterns[0], strlen(patterns[0]), (off_t)(i * strlen(patterns[0])));
+		if (bctbx_file_sync(fp) != BCTBX_VFS_OK) failures++;
+	}
+	return (void *)failures;
+}
+
+void file_sync_batch_test() {
+	bctbx_vfs_file_t *files[SYNC_FILES_NB];
+	char *paths[SYNC_FILES_NB];
+	bctbx_thread_t threads[SYNC_FILES_NB];
+	bctbx_vfs_t *cacheVfs = bctbx_vfs_cache_create(&bcStandardVfs);
+	int i;
+
+	/* create files, one of them goes through the cache vfs: its pages must be written back by the batch */
+	for (i = 0; i < SYNC_FILES_NB; i++) {
+		char name[32];
+		snprintf(name, sizeof(name), "vfs_sync_batch_%d.txt", i);
+		paths[i] = bc_tester_file(name);
+		remove(paths[i]);
+		files[i] = bctbx_file_open2((i == 0) ? cacheVfs : &bcStandardVfs, paths[i], O_RDWR | O_CREAT);
+		BC_ASSERT_PTR_NOT_NULL(files[i]);
+		BC_ASSERT_TRUE(bctbx_file_fprintf(files[i], 0, "%s", patterns[i & 1]) > 0);
+	}
+
+	BC_ASSERT_EQUAL(bctbx_file_sync_batch(files, SYNC_FILES_NB), BCTBX_VFS_OK, int, "%d");
+	for (i = 0; i < SYNC_FILES_NB; i++) {
+		bctbx_vfs_file_t *fp = bctbx_file_open2(&bcStandardVfs, paths[i], O_RDONLY);
+		int expectedSize = (int)strlen(patterns[i & 1]);
+		BC_ASSERT_EQUAL((int)bctbx_file_size(fp), expectedSize, int, "%d");
+		bctbx_file_close(fp);
+	}
+
+	/* concurrent syncs are grouped */
+	for (i = 0; i < SYNC_FILES_NB; i++) {
+		bctbx_thread_create(&threads[i], NULL, sync_thread, files[i]);
+	}
+	for (i = 0; i < SYNC_FILES_NB; i++) {
+		void *failures = NULL;
+		bctbx_thread_join(threads[i], &failures);
+		BC_ASSERT_PTR_NULL(failures);
+	}
+
+	/* cleaning */
+	for (i = 0; i < SYNC_FILES_NB; i++) {
+		bctbx_file_close(files[i]);
+		remove(paths[i]);
+		bctbx_free(paths[i]);
+	}
+	bctbx_vfs_cache_destroy(cacheVfs);
+}
+
+typedef struct {
+	bctbx_vfs_file_t *fp;
+	uint64_t end;
+} timed_sync_t;
+
+static void *timed_sync_thread(void *arg) {
+	timed_sync_t *sync = (timed_sync_t *)arg;
+	bctbx_file_sync(sync->fp);
+	sync->end = bctbx_get_cur_time_ms();
+	return NULL;
+}
+
+#define SLOW_SYNC_SIZE (64 * 1024 * 1024)
+#define SLOW_SYNC_CHUNK (1024 * 1024)
+
+void file_sync_concurrency_test() {
+	char *bigPath = bc_tester_file("vfs_sync_big.bin");
+	/* file systems may serialize the syncs of their files (ie: ext4 journal commits), use another one if any */
+	char *smallPath = bctbx_directory_exists("/dev/shm") ? bctbx_strdup("/dev/shm/bctbx_vfs_sync_small.txt")
+	                                                     : bc_tester_file("vfs_sync_small.txt");
+	remove(bigPath);
+	remove(smallPath);
+	bctbx_vfs_file_t *big = bctbx_file_open2(&bcStandardVfs, bigPath, O_RDWR | O_CREAT);
+	bctbx_vfs_file_t *small = bctbx_file_open2(&bcStandardVfs, smallPath, O_RDWR | O_CREAT);
+	BC_ASSERT_PTR_NOT_NULL(big);
+	BC_ASSERT_PTR_NOT_NULL(small);
+	uint8_t *chunk = (uint8_t *)bctbx_malloc(SLOW_SYNC_CHUNK);
+	bool_t measured = FALSE, concurrent = FALSE;
+	int attempt, i;
+	struct stat bigStat, smallStat;
+	bctbx_file_write(small, patterns[0], strlen(patterns[0]), 0);
+	bool_t sameDevice =
+	    stat(bigPath, &bigStat) != 0 || stat(smallPath, &smallStat) != 0 || bigStat.st_dev == smallStat.st_dev;
+
+	/* the sync of a small file does not wait for the sync of a large one started before: when the large one is slow
+	 * enough to tell, the small one ends first */
+	for (attempt = 0; attempt < 3 && !measured && !sameDevice; attempt++) {
+		memset(chunk, attempt + 1, SLOW_SYNC_CHUNK);
+		for (i = 0; i < SLOW_SYNC_SIZE / SLOW_SYNC_CHUNK; i++) {
+			bctbx_file_write(big, chunk, SLOW_SYNC_CHUNK, (off_t)i * SLOW_SYNC_CHUNK);
+		}
+		bctbx_file_write(small, patterns[0], strlen(patterns[0]), 0);
+
+		timed_sync_t bigSync = {big, 0};
+		bctbx_thread_t thread;
+		uint64_t start = bctbx_get_cur_time_ms();
+		bctbx_thread_create(&thread, NULL, timed_sync_thread, &bigSync);
+		bctbx_sleep_ms(5);
+		BC_ASSERT_EQUAL(bctbx_file_sync(small), BCTBX_VFS_OK, int, "%d");
+		uint64_t smallEnd = bctbx_get_cur_time_ms();
+		bctbx_thread_join(thread, NULL);
+		if (bigSync.end - start >= 20) {
+			measured = TRUE;
+			concurrent = smallEnd < bigSync.end;
+		}
+	}
+	if (measured) {
+		BC_ASSERT_TRUE(concurrent);
+	} else {
+		bctbx_message("file_sync_concurrency_test: syncs too fast to check their concurrency");
+	}
+
+	bctbx_free(chunk);
+	bctbx_file_close(big);
+	bctbx_file_close(small);
+	remove(bigPath);
+	remove(smallPath);
+	bctbx_free(bigPath);
+	bctbx_free(smallPath);
+}
+
+void file_copy_test() {
+	char in_buf[F_SIZE];
+	char out_buf[F_SIZE];
+	size_t i;
+	for (i = 0; i < F_SIZE; i++) {
+		in_buf[i] = (char)(i * 13 + 1);
+	}
+
+	char *srcPath = bc_tester_file("vfs_copy_src.bin");
+	char *dstPath = bc_tester_file("vfs_copy_dst.bin");
+	remove(srcPath);
+	remove(dstPath);
+	bctbx_vfs_file_t *src = bctbx_file_open2(&bcStandardVfs, srcPath, O_RDWR | O_CREAT);
+	bctbx_vfs_file_t *dst = bctbx_file_open2(&bcStandardVfs, dstPath, O_RDWR | O_CREAT);
+	BC_ASSERT_PTR_NOT_NULL(src);
+	BC_ASSERT_PTR_NOT_NULL(dst);
+	BC_ASSERT_EQUAL((int)bctbx_file_write(src, in_buf, F_SIZE - 100, 0), F_SIZE - 100, int, "%d");
+	/* data still in the fprintf page of the source is copied too */
+	BC_ASSERT_TRUE(bctbx_file_fprintf(src, F_SIZE - 100, "%s", patterns[0]) - strlen(patterns[0]) == 0);
+	memcpy(in_buf + F_SIZE - 100, patterns[0], strlen(patterns[0]));
+	int srcSize = F_SIZE - 100 + (int)strlen(patterns[0]);
+
+	/* whole file, between standard files */
+	BC_ASSERT_EQUAL((int)bctbx_file_copy(src, dst, 0, 0, -1), srcSize, int, "%d");
+	BC_ASSERT_EQUAL((int)bctbx_file_read(dst, out_buf, F_SIZE, 0), srcSize, int, "%d");
+	BC_ASSERT_TRUE(memcmp(in_buf, out_buf, srcSize) == 0);
+
+	/* a range, at another offset */
+	BC_ASSERT_EQUAL((int)bctbx_file_copy(src, dst, 10, srcSize, 100), 100, int, "%d");
+	BC_ASSERT_EQUAL((int)bctbx_file_read(dst, out_buf, 100, srcSize), 100, int, "%d");
+	BC_ASSERT_TRUE(memcmp(in_buf + 10, out_buf, 100) == 0);
+
+	/* a range going past the end of the source file */
+	BC_ASSERT_EQUAL((int)bctbx_file_copy(src, dst, srcSize - 20, 0, 100), 20, int, "%d");
+	BC_ASSERT_EQUAL((int)bctbx_file_copy(src, dst, srcSize + 20, 0, 100), 0, int, "%d");
+	BC_ASSERT_EQUAL((int)bctbx_file_copy(src, src, 0, 0, 100), BCTBX_VFS_ERROR, int, "%d");
+	bctbx_file_close(dst);
+	remove(dstPath);
+
+	/* destination through the cache vfs: streaming copy */
+	bctbx_vfs_t *cacheVfs = bctbx_vfs_cache_create(&bcStandardVfs);
+	dst = bctbx_file_open2(cacheVfs, dstPath, O_RDWR | O_CREAT);
+	BC_ASSERT_EQUAL((int)bctbx_file_copy(src, dst, 0, 0, -1), srcSize, int, "%d");
+	memset(out_buf, 0, F_SIZE);
+	BC_ASSERT_EQUAL((int)bctbx_file_read(dst, out_buf, F_SIZE, 0), srcSize, int, "%d");
+	BC_ASSERT_TRUE(memcmp(in_buf, out_buf, srcSize) == 0);
+	bctbx_file_close(dst);
+	bctbx_vfs_cache_destroy(cacheVfs);
+	remove(dstPath);
+
+	/* append mode destination: no kernel copy, streaming copy */
+	dst = bctbx_file_open2(&bcStandardVfs, dstPath, O_RDWR | O_CREAT | O_APPEND);
+	BC_ASSERT_EQUAL((int)bctbx_file_copy(src, dst, 0, 0, -1), srcSize, int, "%d");
+	memset(out_buf, 0, F_SIZE);
+	BC_ASSERT_EQUAL((int)bctbx_file_read(dst, out_buf, F_SIZE, 0), srcSize, int, "%d");
+	BC_ASSERT_TRUE(memcmp(in_buf, out_buf, srcSize) == 0);
+	bctbx_file_close(dst);
+
+	/* cleaning */
+	bctbx_file_close(src);
+	remove(srcPath);
+	remove(dstPath);
+	bctbx_free(srcPath);
+	bctbx_free(dstPath);
+}
+
+void file_cache_vfs_test() {
+	uint8_t in_buf[4 * BCTBX_VFS_CACHE_PAGE_SIZE];
+	uint8_t out_buf[4 * BCTBX_VFS_CACHE_PAGE_SIZE];
+	bctbx_vfs_cache_stats_t stats;
+	size_t i;
+	for (i = 0; i < sizeof(in_buf); i++) {
+		in_buf[i] = (uint8_t)(i * 7 + 3);
+	}
+	memset(out_buf, 0, sizeof(out_buf));
+
+	bctbx_vfs_t *cacheVfs = bctbx_vfs_cache_create(&bcStandardVfs);
+	BC_ASSERT_PTR_NOT_NULL(cacheVfs);
+	size_t savedBudget = bctbx_vfs_cache_get_memory_budget();
+	bctbx_vfs_cache_reset_stats();
+
+	/* create a file */
+	char *path = bc_tester_file("vfs_cache.bin");
+	remove(path); // make sure it does not exist
+	bctbx_vfs_file_t *fp = bctbx_file_open2(cacheVfs, path, O_RDWR | O_CREAT);
+	BC_ASSERT_PTR_NOT_NULL(fp);
+
+	/* write across page boundaries, nothing is written to disk before sync */
+	BC_ASSERT_EQUAL((int)bctbx_file_write(fp, in_buf, 100, 0), 100, int, "%d");
+	BC_ASSERT_EQUAL((int)bctbx_file_write(fp, in_buf + 100, sizeof(in_buf) - 200, 100), (int)sizeof(in_buf) - 200,
+	                int, "%d");
+	BC_ASSERT_EQUAL((int)bctbx_file_size(fp), (int)sizeof(in_buf) - 100, int, "%d");
+	bctbx_vfs_file_t *stdFp = bctbx_file_open2(&bcStandardVfs, path, O_RDONLY);
+	BC_ASSERT_PTR_NOT_NULL(stdFp);
+	BC_ASSERT_EQUAL((int)bctbx_file_size(stdFp), 0, int, "%d");
+
+	/* read back from the cache */
+	BC_ASSERT_EQUAL((int)bctbx_file_read(fp, out_buf, sizeof(out_buf), 0), (int)sizeof(in_buf) - 100, int, "%d");
+	BC_ASSERT_TRUE(memcmp(in_buf, out_buf, sizeof(in_buf) - 100) == 0);
+
+	/* sync writes back to the underlying file */
+	BC_ASSERT_EQUAL(bctbx_file_sync(fp), BCTBX_VFS_OK, int, "%d");
+	BC_ASSERT_EQUAL((int)bctbx_file_size(stdFp), (int)sizeof(in_buf) - 100, int, "%d");
+	memset(out_buf, 0, sizeof(out_buf));
+	BC_ASSERT_EQUAL((int)bctbx_file_read(stdFp, out_buf, sizeof(out_buf), 0), (int)sizeof(in_buf) - 100, int, "%d");
+	BC_ASSERT_TRUE(memcmp(in_buf, out_buf, sizeof(in_buf) - 100) == 0);
+	bctbx_file_close(stdFp);
+
+	/* truncate and reopen: pages are loaded from the underlying file */
+	BC_ASSERT_EQUAL(bctbx_file_truncate(fp, BCTBX_VFS_CACHE_PAGE_SIZE + 10), 0, int, "%d");
+	BC_ASSERT_NOT_EQUAL(bctbx_file_close(fp), BCTBX_VFS_ERROR, int, "%d");
+	bctbx_vfs_cache_get_stats(&stats);
+	BC_ASSERT_EQUAL((int)stats.memory_used, 0, int, "%d");
+	bctbx_vfs_cache_reset_stats();
+	fp = bctbx_file_open2(cacheVfs, path, O_RDWR);
+	BC_ASSERT_PTR_NOT_NULL(fp);
+	BC_ASSERT_EQUAL((int)bctbx_file_size(fp), BCTBX_VFS_CACHE_PAGE_SIZE + 10, int, "%d");
+	memset(out_buf, 0, sizeof(out_buf));
+	BC_ASSERT_EQUAL((int)bctbx_file_read(fp, out_buf, sizeof(out_buf), 0), BCTBX_VFS_CACHE_PAGE_SIZE + 10, int, "%d");
+	BC_ASSERT_TRUE(memcmp(in_buf, out_buf, BCTBX_VFS_CACHE_PAGE_SIZE + 10) == 0);
+	BC_ASSERT_EQUAL((int)bctbx_file_read(fp, out_buf, 10, BCTBX_VFS_CACHE_PAGE_SIZE), 10, int, "%d");
+	bctbx_vfs_cache_get_stats(&stats);
+	BC_ASSERT_EQUAL((int)stats.misses, 2, int, "%d");
+	BC_ASSERT_EQUAL((int)stats.hits, 1, int, "%d");
+	BC_ASSERT_TRUE(bctbx_vfs_cache_get_hit_ratio() > 0.3f);
+
+	/* a budget of one page forces eviction and write back of dirty pages */
+	bctbx_vfs_cache_set_memory_budget(BCTBX_VFS_CACHE_PAGE_SIZE);
+	bctbx_vfs_cache_reset_stats();
+	BC_ASSERT_EQUAL((int)bctbx_file_write(fp, in_buf, sizeof(in_buf), 0), (int)sizeof(in_buf), int, "%d");
+	bctbx_vfs_cache_get_stats(&stats);
+	BC_ASSERT_TRUE(stats.memory_used <= BCTBX_VFS_CACHE_PAGE_SIZE);
+	BC_ASSERT_EQUAL((int)stats.evictions, 4, int, "%d"); // the page cached before the write is evicted too
+	BC_ASSERT_EQUAL((int)stats.writebacks, 3, int, "%d");
+	memset(out_buf, 0, sizeof(out_buf));
+	BC_ASSERT_EQUAL((int)bctbx_file_read(fp, out_buf, sizeof(out_buf), 0), (int)sizeof(in_buf), int, "%d");
+	BC_ASSERT_TRUE(memcmp(in_buf, out_buf, sizeof(in_buf)) == 0);
+
+	/* cleaning */
+	BC_ASSERT_NOT_EQUAL(bctbx_file_close(fp), BCTBX_VFS_ERROR, int, "%d");
+	fp = bctbx_file_open2(&bcStandardVfs, path, O_RDONLY);
+	BC_ASSERT_EQUAL((int)bctbx_file_size(fp), (int)sizeof(in_buf), int, "%d");
+	bctbx_file_close(fp);
+	bctbx_vfs_cache_set_memory_budget(savedBudget);
+	bctbx_vfs_cache_destroy(cacheVfs);
+	remove(path);
+	bctbx_free(path);
+}
+
+void file_stats_vfs_test() {
+	uint8_t buf[1000];
+	bctbx_vfs_stats_snapshot_t snapshot;
+	memset(buf, 0x5a, sizeof(buf));
+
+	bctbx_vfs_t *statsVfs = bctbx_vfs_stats_create(&bcStandardVfs);
+	BC_ASSERT_PTR_NOT_NULL(statsVfs);
+	BC_ASSERT_TRUE(bctbx_vfs_stats_is_enabled(statsVfs));
+
+	char *path = bc_tester_file("vfs_stats.bin");
+	char *path2 = bc_tester_file("vfs_stats2.bin");
+	remove(path);
+	remove(path2);
+	bctbx_vfs_file_t *fp = bctbx_file_open2(statsVfs, path, O_RDWR | O_CREAT);
+	bctbx_vfs_file_t *fp2 = bctbx_file_open2(statsVfs, path2, O_RDWR | O_CREAT);
+	BC_ASSERT_PTR_NOT_NULL(fp);
+	BC_ASSERT_PTR_NOT_NULL(fp2);
+
+	BC_ASSERT_EQUAL((int)bctbx_file_write(fp, buf, sizeof(buf), 0), (int)sizeof(buf), int, "%d");
+	BC_ASSERT_EQUAL((int)bctbx_file_write(fp, buf, 500, sizeof(buf)), 500, int, "%d");
+	BC_ASSERT_EQUAL((int)bctbx_file_read(fp, buf, sizeof(buf), 1000), 500, int, "%d");
+	BC_ASSERT_EQUAL(bctbx_file_sync(fp), BCTBX_VFS_OK, int, "%d");
+	BC_ASSERT_EQUAL((int)bctbx_file_write(fp2, buf, 10, 0), 10, int, "%d");
+	BC_ASSERT_EQUAL((int)bctbx_file_size(fp2), 10, int, "%d");
+	BC_ASSERT_EQUAL(bctbx_file_truncate(fp2, 5), 0, int, "%d");
+
+	/* per file statistics */
+	BC_ASSERT_EQUAL(bctbx_file_stats_get_snapshot(fp, &snapshot), BCTBX_VFS_OK, int, "%d");
+	BC_ASSERT_EQUAL((int)snapshot.ops[BCTBX_VFS_STATS_OP_OPEN].count, 0, int, "%d");
+	BC_ASSERT_EQUAL((int)snapshot.ops[BCTBX_VFS_STATS_OP_WRITE].count, 2, int, "%d");
+	BC_ASSERT_EQUAL((int)snapshot.ops[BCTBX_VFS_STATS_OP_WRITE].bytes, 1500, int, "%d");
+	BC_ASSERT_EQUAL((int)snapshot.ops[BCTBX_VFS_STATS_OP_READ].count, 1, int, "%d");
+	BC_ASSERT_EQUAL((int)snapshot.ops[BCTBX_VFS_STATS_OP_READ].bytes, 500, int, "%d");
+	BC_ASSERT_EQUAL((int)snapshot.ops[BCTBX_VFS_STATS_OP_SYNC].count, 1, int, "%d");
+	BC_ASSERT_TRUE(snapshot.ops[BCTBX_VFS_STATS_OP_SYNC].p50_us <= snapshot.ops[BCTBX_VFS_STATS_OP_SYNC].max_us);
+	BC_ASSERT_TRUE(snapshot.ops[BCTBX_VFS_STATS_OP_WRITE].p99_us <= snapshot.ops[BCTBX_VFS_STATS_OP_WRITE].max_us);
+	BC_ASSERT_EQUAL(bctbx_file_stats_get_snapshot(fp2, &snapshot), BCTBX_VFS_OK, int, "%d");
+	BC_ASSERT_EQUAL((int)snapshot.ops[BCTBX_VFS_STATS_OP_WRITE].count, 1, int, "%d");
+	BC_ASSERT_EQUAL((int)snapshot.ops[BCTBX_VFS_STATS_OP_SIZE].count, 1, int, "%d");
+	BC_ASSERT_EQUAL((int)snapshot.ops[BCTBX_VFS_STATS_OP_TRUNCATE].count, 1, int, "%d");
+
+	/* the vfs cumulates all files */
+	bctbx_vfs_stats_get_snapshot(statsVfs, &snapshot);
+	BC_ASSERT_EQUAL((int)snapshot.ops[BCTBX_VFS_STATS_OP_OPEN].count, 2, int, "%d");
+	BC_ASSERT_EQUAL((int)snapshot.ops[BCTBX_VFS_STATS_OP_WRITE].count, 3, int, "%d");
+	BC_ASSERT_EQUAL((int)snapshot.ops[BCTBX_VFS_STATS_OP_WRITE].bytes, 1510, int, "%d");
+	BC_ASSERT_EQUAL((int)snapshot.ops[BCTBX_VFS_STATS_OP_WRITE].errors, 0, int, "%d");
+	bctbx_vfs_stats_log(statsVfs, BCTBX_LOG_MESSAGE);
+
+	/* nothing is recorded while disabled */
+	bctbx_vfs_stats_set_enabled(statsVfs, FALSE);
+	BC_ASSERT_FALSE(bctbx_vfs_stats_is_enabled(statsVfs));
+	BC_ASSERT_EQUAL((int)bctbx_file_write(fp2, buf, 10, 0), 10, int, "%d");
+	bctbx_vfs_stats_get_snapshot(statsVfs, &snapshot);
+	BC_ASSERT_EQUAL((int)snapshot.ops[BCTBX_VFS_STATS_OP_WRITE].count, 3, int, "%d");
+	bctbx_vfs_stats_set_enabled(statsVfs, TRUE);
+
+	/* reset clears the vfs and the opened files */
+	bctbx_vfs_stats_reset(statsVfs);
+	bctbx_vfs_stats_get_snapshot(statsVfs, &snapshot);
+	BC_ASSERT_EQUAL((int)snapshot.ops[BCTBX_VFS_STATS_OP_WRITE].count, 0, int, "%d");
+	BC_ASSERT_EQUAL((int)snapshot.ops[BCTBX_VFS_STATS_OP_WRITE].max_us, 0, int, "%d");
+	bctbx_file_stats_get_snapshot(fp, &snapshot);
+	BC_ASSERT_EQUAL((int)snapshot.ops[BCTBX_VFS_STATS_OP_READ].count, 0, int, "%d");
+
+	/* files not opened through a stats vfs have no statistics */
+	bctbx_vfs_file_t *stdFp = bctbx_file_open2(&bcStandardVfs, path, O_RDONLY);
+	BC_ASSERT_EQUAL(bctbx_file_stats_get_snapshot(stdFp, &snapshot), BCTBX_VFS_ERROR, int, "%d");
+	bctbx_file_close(stdFp);
+
+	/* cleaning */
+	BC_ASSERT_NOT_EQUAL(bctbx_file_close(fp), BCTBX_VFS_ERROR, int, "%d");
+	BC_ASSERT_NOT_EQUAL(bctbx_file_close(fp2), BCTBX_VFS_ERROR, int, "%d");
+	bctbx_vfs_stats_destroy(statsVfs);
+	remove(path);
+	remove(path2);
+	bctbx_free(path);
+	bctbx_free(path2);
+}
+
+void file_emulation_vfs_test() {
+	uint8_t in_buf[10000];
+	uint8_t out_buf[10000];
+	bctbx_vfs_emulation_config_t config;
+	size_t i;
+	for (i = 0; i < sizeof(in_buf); i++) {
+		in_buf[i] = (uint8_t)(i * 13 + 1);
+	}
+	memset(out_buf, 0, sizeof(out_buf));
+
+	/* short reads and writes: loop until everything is transferred */
+	memset(&config, 0, sizeof(config));
+	config.short_read_percent = 100;
+	config.short_write_percent = 100;
+	config.seed = 42;
+	bctbx_vfs_t *emulationVfs = bctbx_vfs_emulation_create(&bcStandardVfs, &config);
+	BC_ASSERT_PTR_NOT_NULL(emulationVfs);
+	char *path = bc_tester_file("vfs_emulation.bin");
+	remove(path);
+	bctbx_vfs_file_t *fp = bctbx_file_open2(emulationVfs, path, O_RDWR | O_CREAT);
+	BC_ASSERT_PTR_NOT_NULL(fp);
+	ssize_t ret = bctbx_file_write(fp, in_buf, sizeof(in_buf), 0);
+	BC_ASSERT_TRUE(ret > 0 && ret < (ssize_t)sizeof(in_buf));
+	size_t done = 0;
+	while (done < sizeof(in_buf) && ret > 0) {
+		done += (size_t)ret;
+		ret = bctbx_file_write(fp, in_buf + done, sizeof(in_buf) - done, (off_t)done);
+	}
+	BC_ASSERT_EQUAL((int)bctbx_file_size(fp), (int)sizeof(in_buf), int, "%d");
+	ret = bctbx_file_read(fp, out_buf, sizeof(out_buf), 0);
+	BC_ASSERT_TRUE(ret > 0 && ret < (ssize_t)sizeof(out_buf));
+	done = 0;
+	while (done < sizeof(out_buf) && ret > 0) {
+		done += (size_t)ret;
+		ret = bctbx_file_read(fp, out_buf + done, sizeof(out_buf) - done, (off_t)done);
+	}
+	BC_ASSERT_TRUE(memcmp(in_buf, out_buf, sizeof(in_buf)) == 0);
+
+	/* latency and bandwidth: 10000 bytes at 200kB/s take 50ms */
+	memset(&config, 0, sizeof(config));
+	config.write_latency_us = 20000;
+	config.write_bandwidth = 200000;
+	bctbx_vfs_emulation_set_config(emulationVfs, &config);
+	bctbx_vfs_emulation_get_config(emulationVfs, &config);
+	BC_ASSERT_EQUAL((int)config.short_read_percent, 0, int, "%d");
+	uint64_t start = bctbx_get_cur_time_ms();
+	BC_ASSERT_EQUAL((int)bctbx_file_write(fp, in_buf, sizeof(in_buf), 0), (int)sizeof(in_buf), int, "%d");
+	BC_ASSERT_TRUE(bctbx_get_cur_time_ms() - start >= 70);
+	BC_ASSERT_EQUAL((int)bctbx_file_read(fp, out_buf, sizeof(out_buf), 0), (int)sizeof(out_buf), int, "%d");
+
+	/* one sync out of two stalls */
+	memset(&config, 0, sizeof(config));
+	config.sync_stall_us = 50000;
+	config.sync_stall_interval = 2;
+	bctbx_vfs_emulation_set_config(emulationVfs, &config);
+	start = bctbx_get_cur_time_ms();
+	BC_ASSERT_EQUAL(bctbx_file_sync(fp), BCTBX_VFS_OK, int, "%d");
+	BC_ASSERT_EQUAL(bctbx_file_sync(fp), BCTBX_VFS_OK, int, "%d");
+	BC_ASSERT_TRUE(bctbx_get_cur_time_ms() - start >= 50);
+
+	/* cleaning */
+	BC_ASSERT_NOT_EQUAL(bctbx_file_close(fp), BCTBX_VFS_ERROR, int, "%d");
+	bctbx_vfs_emulation_destroy(emulationVfs);
+	remove(path);
+	bctbx_free(path);
+}
+
+void file_direct_io_test() {
+	uint8_t in_buf[3 * BCTBX_VFS_DIRECT_IO_ALIGNMENT + 100];
+	uint8_t out_buf[sizeof(in_buf)];
+	size_t i;
+	for (i = 0; i < sizeof(in_buf); i++) {
+		in_buf[i] = (uint8_t)(i * 11 + 5);
+	}
+	memset(out_buf, 0, sizeof(out_buf));
+
+	char *path = bc_tester_file("vfs_direct_io.bin");
+	remove(path);
+	bctbx_vfs_file_t *fp = bctbx_file_open2(&bcStandardDirectVfs, path, O_RDWR | O_CREAT);
+	BC_ASSERT_PTR_NOT_NULL(fp);
+
+	/* unaligned writes: partially written blocks are preserved and the size is exact */
+	BC_ASSERT_EQUAL((int)bctbx_file_write(fp, in_buf + 10, 5000, 10), 5000, int, "%d");
+	BC_ASSERT_EQUAL((int)bctbx_file_size(fp), 5010, int, "%d");
+	BC_ASSERT_EQUAL((int)bctbx_file_write(fp, in_buf, 10, 0), 10, int, "%d");
+	BC_ASSERT_EQUAL((int)bctbx_file_write(fp, in_buf + 5010, sizeof(in_buf) - 5010, 5010),
+	                (int)(sizeof(in_buf) - 5010), int, "%d");
+	BC_ASSERT_EQUAL((int)bctbx_file_size(fp), (int)sizeof(in_buf), int, "%d");
+
+	/* unaligned reads, including one going beyond the end of file */
+	BC_ASSERT_EQUAL((int)bctbx_file_read(fp, out_buf, 3, 4095), 3, int, "%d");
+	BC_ASSERT_TRUE(memcmp(out_buf, in_buf + 4095, 3) == 0);
+	BC_ASSERT_EQUAL((int)bctbx_file_read(fp, out_buf, sizeof(out_buf), 0), (int)sizeof(in_buf), int, "%d");
+	BC_ASSERT_TRUE(memcmp(out_buf, in_buf, sizeof(in_buf)) == 0);
+	BC_ASSERT_EQUAL((int)bctbx_file_read(fp, out_buf, 1000, sizeof(in_buf) - 50), 50, int, "%d");
+	BC_ASSERT_EQUAL((int)bctbx_file_read(fp, out_buf, 1000, sizeof(in_buf) + 50), 0, int, "%d");
+
+	/* read it back without direct I/O */
+	BC_ASSERT_NOT_EQUAL(bctbx_file_close(fp), BCTBX_VFS_ERROR, int, "%d");
+	fp = bctbx_file_open2(&bcStandardVfs, path, O_RDONLY);
+	memset(out_buf, 0, sizeof(out_buf));
+	BC_ASSERT_EQUAL((int)bctbx_file_read(fp, out_buf, sizeof(out_buf), 0), (int)sizeof(in_buf), int, "%d");
+	BC_ASSERT_TRUE(memcmp(out_buf, in_buf, sizeof(in_buf)) == 0);
+	bctbx_file_close(fp);
+
+	/* a write only file still reads back the blocks partially overwritten */
+	fp = bctbx_file_open2(&bcStandardDirectVfs, path, O_WRONLY | O_TRUNC);
+	BC_ASSERT_PTR_NOT_NULL(fp);
+	BC_ASSERT_EQUAL((int)bctbx_file_write(fp, in_buf, 100, 0), 100, int, "%d");
+	BC_ASSERT_EQUAL((int)bctbx_file_write(fp, in_buf + 100, 100, 100), 100, int, "%d");
+	BC_ASSERT_NOT_EQUAL(bctbx_file_close(fp), BCTBX_VFS_ERROR, int, "%d");
+	fp = bctbx_file_open2(&bcStandardVfs, path, O_RDONLY);
+	memset(out_buf, 0, sizeof(out_buf));
+	BC_ASSERT_EQUAL((int)bctbx_file_read(fp, out_buf, sizeof(out_buf), 0), 200, int, "%d");
+	BC_ASSERT_TRUE(memcmp(out_buf, in_buf, 200) == 0);
+	bctbx_file_close(fp);
+
+	/* aligned buffer and offset with a partial last block: the whole blocks are done directly */
+	uint8_t *raw = bctbx_malloc(2 * sizeof(in_buf) + 65536);
+	uint8_t *aligned = raw + (65536 - (uintptr_t)raw % 65536) % 65536;
+	memcpy(aligned, in_buf, sizeof(in_buf));
+	fp = bctbx_file_open2(&bcStandardDirectVfs, path, O_RDWR | O_TRUNC);
+	BC_ASSERT_PTR_NOT_NULL(fp);
+	BC_ASSERT_EQUAL((int)bctbx_file_write(fp, aligned, sizeof(in_buf), 0), (int)sizeof(in_buf), int, "%d");
+	BC_ASSERT_EQUAL((int)bctbx_file_size(fp), (int)sizeof(in_buf), int, "%d");
+	memset(aligned, 0, sizeof(in_buf));
+	BC_ASSERT_EQUAL((int)bctbx_file_read(fp, aligned, sizeof(in_buf) + 1000, 0), (int)sizeof(in_buf), int, "%d");
+	BC_ASSERT_TRUE(memcmp(aligned, in_buf, sizeof(in_buf)) == 0);
+	bctbx_file_close(fp);
+	bctbx_free(raw);
+
+	remove(path);
+	bctbx_free(path);
+}
+
 static test_t vfs_tests[] = {TEST_NO_TAG("File fprint - simple", file_fprint_simple_test),
                              TEST_NO_TAG("File fprint and file_write mixed", file_fprint_and_write_test),
-                             TEST_NO_TAG("File get next line", file_get_nxtline_test)};
+                             TEST_NO_TAG("File fprint - page size", file_fprint_page_size_test),
+                             TEST_NO_TAG("File get next line", file_get_nxtline_test),
+                             TEST_NO_TAG("File line iterator", file_line_iterator_test),
+                             TEST_NO_TAG("File allocate and advise", file_allocate_test),
+                             TEST_NO_TAG("File sync batch", file_sync_batch_test),
+                             TEST_NO_TAG("File sync concurrency", file_sync_concurrency_test),
+                             TEST_NO_TAG("File copy", file_copy_test),
+                             TEST_NO_TAG("Cache vfs", file_cache_vfs_test),
+                             TEST_NO_TAG("Stats vfs", file_stats_vfs_test),
+                             TEST_NO_TAG("Emulation vfs", file_emulation_vfs_test),
+                             TEST_NO_TAG("File direct io", file_direct_io_test)};
 
 
 test_suite_t vfs_test_suite = {"vfs", NULL, NULL, NULL, NULL, sizeof(vfs_tests) / sizeof(vfs_tests[0]), vfs_tests, 0};
\ No newline at end of file
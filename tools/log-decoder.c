@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2025 Belledonne Communications SARL.
+ *
+ * This file is part of bctoolbox.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Format the binary logs written by bctbx_create_binary_log_handler() */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "bctoolbox/logging.h"
+
+static void usage(const char *name) {
+	fprintf(stderr, "Usage: %s [--threads] [binary log file]\n", name);
+	fprintf(stderr, "Writes the messages of a binary log to the standard output, reading the standard input if no file "
+	                "is given.\n");
+	fprintf(stderr, "  --threads  prefix each message with the thread that logged it\n");
+}
+
+int main(int argc, char *argv[]) {
+	const char *path = NULL;
+	int flags = 0;
+	FILE *in = stdin;
+	int count;
+	int i;
+
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--threads") == 0) {
+			flags |= BCTBX_BINARY_LOG_DECODE_THREADS;
+		} else if (strcmp(argv[i], "--help") == 0 || path != NULL) {
+			usage(argv[0]);
+			return strcmp(argv[i], "--help") == 0 ? 0 : 1;
+		} else {
+			path = argv[i];
+		}
+	}
+
+	if (path) {
+		in = fopen(path, "rb");
+		if (in == NULL) {
+			fprintf(stderr, "Cannot open %s\n", path);
+			return 1;
+		}
+	}
+	count = bctbx_decode_binary_log(in, stdout, flags);
+	if (path) fclose(in);
+	if (count < 0) {
+		fprintf(stderr, "%s is not a binary log\n", path ? path : "The input");
+		return 1;
+	}
+	return 0;
+}